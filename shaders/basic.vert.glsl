@@ -1,11 +1,11 @@
 #version 450
 
-layout (location = 1)
+layout (std140, binding = 1)
 uniform Matrices {
     mat4 projection;
     mat4 model_view;
 };
 
 void main() {
-
+    gl_Position = projection * model_view * vec4(0.0, 0.0, 0.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef SHAGGY_CAMERA_H
+#define SHAGGY_CAMERA_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+
+#include "linmath.h"
+#include "frustum.h"
+#include "math_dispatch.h"
+
+/*****************************************************************
+ * Camera
+ * Holds the projection and view matrices and only rebuilds them
+ * when something they depend on changes. Setters just mark what
+ * is stale, shaggy_camera_update does the math once per change.
+ * version lets users of the matrices skip their own derived work
+ * on frames where nothing moved. The world space frustum is kept
+ * alongside view_projection for culling.
+ *****************************************************************/
+
+struct shaggy_camera {
+	vec3 eye;
+	vec3 center;
+	vec3 up;
+
+	float y_fov; /* Radians */
+	float z_near;
+	float z_far;
+
+	int width;   /* Viewport, in pixels */
+	int height;
+
+	mat4x4 projection;
+	mat4x4 view;
+	mat4x4 view_projection;
+	struct shaggy_frustum frustum;
+
+	bool projection_dirty;
+	bool view_dirty;
+	unsigned version; /* Bumped every time the matrices change */
+};
+
+static inline
+void shaggy_camera_init(struct shaggy_camera *camera, float y_fov, float z_near, float z_far, int width, int height) {
+	camera->eye[0] = camera->eye[1] = camera->eye[2] = 0.0f;
+	camera->center[0] = camera->center[1] = 0.0f;
+	camera->center[2] = -1.0f;
+	camera->up[0] = camera->up[2] = 0.0f;
+	camera->up[1] = 1.0f;
+
+	camera->y_fov = y_fov;
+	camera->z_near = z_near;
+	camera->z_far = z_far;
+	camera->width = width;
+	camera->height = height;
+
+	camera->projection_dirty = true;
+	camera->view_dirty = true;
+	camera->version = 0;
+}
+
+static inline
+void shaggy_camera_look_at(struct shaggy_camera *camera, vec3 const eye, vec3 const center, vec3 const up) {
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		camera->eye[i] = eye[i];
+		camera->center[i] = center[i];
+		camera->up[i] = up[i];
+	}
+
+	camera->view_dirty = true;
+}
+
+static inline
+void shaggy_camera_set_lens(struct shaggy_camera *camera, float y_fov, float z_near, float z_far) {
+	camera->y_fov = y_fov;
+	camera->z_near = z_near;
+	camera->z_far = z_far;
+	camera->projection_dirty = true;
+}
+
+/*****************************************************************
+ * New drawable size, e.g. from SDL_WINDOWEVENT_SIZE_CHANGED.
+ * A zero sized (minimised) window keeps the last aspect ratio.
+ * @return true if the size actually changed.
+ *****************************************************************/
+static inline
+bool shaggy_camera_set_viewport(struct shaggy_camera *camera, int width, int height) {
+	if (width <= 0 || height <= 0 || (width == camera->width && height == camera->height)) {
+		return false;
+	}
+
+	camera->width = width;
+	camera->height = height;
+	camera->projection_dirty = true;
+	return true;
+}
+
+static inline
+float shaggy_camera_aspect(const struct shaggy_camera *camera) {
+	return camera->height > 0 ? (float) camera->width / (float) camera->height : 1.0f;
+}
+
+/*****************************************************************
+ * Rebuild whatever is stale.
+ * @return true if any matrix changed since the last call.
+ *****************************************************************/
+static inline
+bool shaggy_camera_update(struct shaggy_camera *camera) {
+	if (!camera->projection_dirty && !camera->view_dirty) {
+		return false;
+	}
+
+	if (camera->projection_dirty) {
+		mat4x4_perspective(camera->projection, camera->y_fov, shaggy_camera_aspect(camera), camera->z_near, camera->z_far);
+		logm(FINE, "Camera projection rebuilt for %dx%d", camera->width, camera->height);
+	}
+
+	if (camera->view_dirty) {
+		mat4x4_look_at(camera->view, camera->eye, camera->center, camera->up);
+	}
+
+	shaggy_math.mat4x4_mul(camera->view_projection, camera->projection, camera->view);
+	shaggy_frustum_from_matrix(&camera->frustum, camera->view_projection);
+
+	camera->projection_dirty = false;
+	camera->view_dirty = false;
+	++camera->version;
+	return true;
+}
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef SHAGGY_COMMAND_BUFFER_H
+#define SHAGGY_COMMAND_BUFFER_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+/*****************************************************************
+ * Command Buffer
+ * Rendering code records draws as small packets instead of making
+ * GL calls, each with a 64 bit sort key. Once the frame is
+ * recorded the keys are radix sorted and one pass replays the
+ * packets, only binding what differs from the previous draw. With
+ * the key ordered program, material, depth, draws that share state
+ * end up next to each other and most binds disappear.
+ *
+ * The key only decides the order. Binds are skipped by comparing
+ * the packets' real state, so two programs or materials sharing
+ * key bits can cost a bind but never skip one that is needed.
+ *
+ * Packets live in one linear buffer that is reused every frame and
+ * only grows, so steady state recording doesn't allocate.
+ *****************************************************************/
+
+#define SHAGGY_DRAW_TEXTURES 4  /* Texture units 0 up */
+#define SHAGGY_DRAW_BLOCKS 2    /* Uniform block ranges, e.g. material and object */
+#define SHAGGY_DRAW_BINDINGS 16 /* Uniform binding points whose ranges are tracked */
+
+/* Bits of the sort key, from the top */
+#define SHAGGY_SORT_PROGRAM_BITS 16
+#define SHAGGY_SORT_MATERIAL_BITS 24
+#define SHAGGY_SORT_DEPTH_BITS 24
+
+struct shaggy_draw_block {
+	GLuint buffer;   /* 0 for none */
+	GLuint binding;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+struct shaggy_draw {
+	uint64_t key;
+
+	GLuint program;
+	GLuint vertex_array;
+	GLuint textures[SHAGGY_DRAW_TEXTURES]; /* 0 leaves the unit as it is */
+	struct shaggy_draw_block blocks[SHAGGY_DRAW_BLOCKS];
+
+	GLenum mode;
+	GLenum index_type; /* 0 for non-indexed */
+	GLint first;       /* First vertex, or first index */
+	GLsizei count;
+	GLsizei instances;
+	GLint base_vertex;
+};
+
+struct shaggy_sort_entry {
+	uint64_t key;
+	uint32_t draw;
+};
+
+/* What the last submit did, each count is GL calls actually made */
+struct shaggy_submit_stats {
+	size_t draws;
+	size_t programs;
+	size_t vertex_arrays;
+	size_t textures;
+	size_t blocks;
+	size_t elided; /* Binds skipped because the state was already there */
+};
+
+struct shaggy_command_buffer {
+	struct shaggy_draw *draws;
+	size_t count;
+	size_t capacity;
+
+	struct shaggy_sort_entry *order; /* Sorted draw order, capacity entries */
+	struct shaggy_sort_entry *scratch;
+	bool sorted;
+
+	struct shaggy_submit_stats stats; /* Of the last submit */
+};
+
+/*****************************************************************
+ * Build a key that sorts by program, then material, then depth.
+ * Program and material are whatever small ids the caller has, GL
+ * names work, only their low bits are kept.
+ * @param depth 0 near to 1 far, clamped, so opaque draws go front
+ *              to back. Pass 1 - depth for back to front.
+ *****************************************************************/
+static inline
+uint64_t shaggy_sort_key(uint32_t program, uint32_t material, float depth) {
+	const uint32_t depth_max = (1u << SHAGGY_SORT_DEPTH_BITS) - 1;
+	uint32_t quantized;
+
+	if (!(depth > 0.0f)) {
+		quantized = 0;
+	} else if (depth >= 1.0f) {
+		quantized = depth_max;
+	} else {
+		quantized = (uint32_t) (depth * (float) depth_max);
+	}
+
+	return (uint64_t) (program & ((1u << SHAGGY_SORT_PROGRAM_BITS) - 1)) << (SHAGGY_SORT_MATERIAL_BITS + SHAGGY_SORT_DEPTH_BITS) |
+		   (uint64_t) (material & ((1u << SHAGGY_SORT_MATERIAL_BITS) - 1)) << SHAGGY_SORT_DEPTH_BITS |
+		   quantized;
+}
+
+/* Grow every array to hold capacity draws, false if out of memory with the old arrays intact */
+static inline
+bool shaggy_command_buffer_reserve(struct shaggy_command_buffer *buffer, size_t capacity) {
+	struct shaggy_draw *draws;
+	struct shaggy_sort_entry *order, *scratch;
+
+	if (capacity <= buffer->capacity) {
+		return true;
+	}
+
+	draws = realloc(buffer->draws, capacity * sizeof(*draws));
+	if (!draws) {
+		goto fail;
+	}
+	buffer->draws = draws;
+
+	order = realloc(buffer->order, capacity * sizeof(*order));
+	if (!order) {
+		goto fail;
+	}
+	buffer->order = order;
+
+	scratch = realloc(buffer->scratch, capacity * sizeof(*scratch));
+	if (!scratch) {
+		goto fail;
+	}
+	buffer->scratch = scratch;
+
+	buffer->capacity = capacity;
+	logm(FINE, "Command buffer grown to %zu draws", capacity);
+	return true;
+
+fail:
+	logm(ERROR, "Out of memory for %zu draws", capacity);
+	return false;
+}
+
+/*****************************************************************
+ * @param capacity Draws to make room for up front, more grows the
+ *                 buffer when recording.
+ *****************************************************************/
+static inline
+bool shaggy_command_buffer_init(struct shaggy_command_buffer *buffer, size_t capacity) {
+	memset(buffer, 0, sizeof(*buffer));
+
+	if (!shaggy_command_buffer_reserve(buffer, capacity ? capacity : 1)) {
+		free(buffer->draws);
+		free(buffer->order);
+		free(buffer->scratch);
+		memset(buffer, 0, sizeof(*buffer));
+		return false;
+	}
+
+	return true;
+}
+
+static inline
+void shaggy_command_buffer_destroy(struct shaggy_command_buffer *buffer) {
+	free(buffer->draws);
+	free(buffer->order);
+	free(buffer->scratch);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+/* Forget last frame's draws, keeps the memory */
+static inline
+void shaggy_command_buffer_begin(struct shaggy_command_buffer *buffer) {
+	buffer->count = 0;
+	buffer->sorted = false;
+}
+
+/*****************************************************************
+ * Record a draw. Fill in the returned packet, everything but the
+ * key is zeroed and instances is 1.
+ * @return NULL if out of memory. Valid until the next record.
+ *****************************************************************/
+static inline
+struct shaggy_draw *shaggy_command_buffer_record(struct shaggy_command_buffer *buffer, uint64_t key) {
+	struct shaggy_draw *draw;
+
+	if (buffer->count == buffer->capacity && !shaggy_command_buffer_reserve(buffer, buffer->capacity * 2)) {
+		return NULL;
+	}
+
+	draw = &buffer->draws[buffer->count++];
+	memset(draw, 0, sizeof(*draw));
+	draw->key = key;
+	draw->instances = 1;
+	buffer->sorted = false;
+
+	return draw;
+}
+
+/*****************************************************************
+ * Order the draws by key, equal keys keep the order they were
+ * recorded in. Least significant byte first, 8 bits a pass, the
+ * counts for every pass come from one read of the keys and passes
+ * where all keys share the byte are skipped, which for a frame's
+ * worth of keys is often several of the upper ones.
+ *****************************************************************/
+static inline
+void shaggy_command_buffer_sort(struct shaggy_command_buffer *buffer) {
+	size_t counts[8][256];
+	struct shaggy_sort_entry *from = buffer->order, *to = buffer->scratch, *swap;
+	size_t i, sum;
+	int pass, digit;
+
+	for (i = 0; i < buffer->count; ++i) {
+		buffer->order[i].key = buffer->draws[i].key;
+		buffer->order[i].draw = (uint32_t) i;
+	}
+
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < buffer->count; ++i) {
+		uint64_t key = buffer->draws[i].key;
+
+		for (pass = 0; pass < 8; ++pass) {
+			++counts[pass][(key >> (8 * pass)) & 0xff];
+		}
+	}
+
+	for (pass = 0; pass < 8; ++pass) {
+		size_t *count = counts[pass];
+
+		if (!buffer->count || count[(buffer->draws[0].key >> (8 * pass)) & 0xff] == buffer->count) {
+			continue;
+		}
+
+		for (digit = 0, sum = 0; digit < 256; ++digit) {
+			size_t n = count[digit];
+			count[digit] = sum;
+			sum += n;
+		}
+
+		for (i = 0; i < buffer->count; ++i) {
+			to[count[(from[i].key >> (8 * pass)) & 0xff]++] = from[i];
+		}
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	/* An odd number of passes leaves the result in scratch */
+	if (from != buffer->order) {
+		buffer->scratch = buffer->order;
+		buffer->order = from;
+	}
+
+	buffer->sorted = true;
+}
+
+/* Last state bound by a submit, ~0 until known */
+struct shaggy_submit_state {
+	GLuint program;
+	GLuint vertex_array;
+	GLuint textures[SHAGGY_DRAW_TEXTURES];
+	struct shaggy_draw_block blocks[SHAGGY_DRAW_BINDINGS];
+};
+
+static inline
+GLsizei shaggy_index_size(GLenum index_type) {
+	switch (index_type) {
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_UNSIGNED_SHORT:
+			return 2;
+		default:
+			return 4;
+	}
+}
+
+static inline
+void shaggy_submit_block(struct shaggy_submit_state *state, struct shaggy_submit_stats *stats, const struct shaggy_draw_block *block) {
+	struct shaggy_draw_block *bound;
+
+	if (!block->buffer) {
+		return;
+	}
+
+	if (block->binding < SHAGGY_DRAW_BINDINGS) {
+		bound = &state->blocks[block->binding];
+
+		if (bound->buffer == block->buffer && bound->offset == block->offset && bound->size == block->size) {
+			++stats->elided;
+			return;
+		}
+
+		*bound = *block;
+	}
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, block->binding, block->buffer, block->offset, block->size);
+	++stats->blocks;
+}
+
+/*****************************************************************
+ * Replay the draws in key order, sorting first if needed. Nothing
+ * is assumed about the GL state on entry, so the first draw binds
+ * everything it uses, and the last draw's state is left bound.
+ *****************************************************************/
+static inline
+void shaggy_command_buffer_submit(struct shaggy_command_buffer *buffer) {
+	struct shaggy_submit_stats *stats = &buffer->stats;
+	struct shaggy_submit_state state;
+	size_t i;
+	int k;
+
+	if (!buffer->sorted) {
+		shaggy_command_buffer_sort(buffer);
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	memset(&state, 0xff, sizeof(state));
+
+	for (i = 0; i < buffer->count; ++i) {
+		const struct shaggy_draw *draw = &buffer->draws[buffer->order[i].draw];
+
+		if (draw->program != state.program) {
+			glUseProgram(draw->program);
+			state.program = draw->program;
+			++stats->programs;
+		} else {
+			++stats->elided;
+		}
+
+		if (draw->vertex_array != state.vertex_array) {
+			glBindVertexArray(draw->vertex_array);
+			state.vertex_array = draw->vertex_array;
+			++stats->vertex_arrays;
+		} else {
+			++stats->elided;
+		}
+
+		for (k = 0; k < SHAGGY_DRAW_TEXTURES; ++k) {
+			if (!draw->textures[k]) {
+				continue;
+			}
+
+			if (draw->textures[k] != state.textures[k]) {
+				glBindTextureUnit((GLuint) k, draw->textures[k]);
+				state.textures[k] = draw->textures[k];
+				++stats->textures;
+			} else {
+				++stats->elided;
+			}
+		}
+
+		for (k = 0; k < SHAGGY_DRAW_BLOCKS; ++k) {
+			shaggy_submit_block(&state, stats, &draw->blocks[k]);
+		}
+
+		if (!draw->index_type) {
+			glDrawArraysInstanced(draw->mode, draw->first, draw->count, draw->instances);
+		} else {
+			glDrawElementsInstancedBaseVertex(
+					draw->mode, draw->count, draw->index_type,
+					(const void *) ((uintptr_t) draw->first * shaggy_index_size(draw->index_type)),
+					draw->instances, draw->base_vertex);
+		}
+	}
+
+	stats->draws = buffer->count;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SHAGGY_CULLING_H
+#define SHAGGY_CULLING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "frustum.h"
+#include "math_dispatch.h"
+#include "workers.h"
+
+/*****************************************************************
+ * Frustum Culling
+ * The plane tests of frustum.h split across shaggy_workers. Each
+ * job runs whatever shaggy_math bound for this CPU, so an AVX2
+ * machine gets the 8 wide kernels without a native build.
+ *****************************************************************/
+
+/* Objects per job below which waking more threads costs more than it saves */
+#define SHAGGY_CULL_MIN_PER_JOB 8192
+
+/*****************************************************************
+ * Split across workers. Each job packs its own range in place,
+ * then the ranges are moved down behind each other, so the list
+ * comes out the same as from a single thread.
+ *****************************************************************/
+struct shaggy_cull_run {
+	const struct shaggy_frustum *frustum;
+	struct shaggy_spheres spheres;
+	struct shaggy_aabbs aabbs;
+	uint32_t *visible;
+	size_t begin[SHAGGY_WORKERS_MAX];
+	size_t count[SHAGGY_WORKERS_MAX];
+};
+
+static inline
+void shaggy_cull_spheres_job(void *user, int job, size_t begin, size_t end) {
+	struct shaggy_cull_run *run = user;
+
+	run->begin[job] = begin;
+	run->count[job] = shaggy_math.cull_spheres(run->frustum, run->spheres, begin, end, run->visible + begin);
+}
+
+static inline
+void shaggy_cull_aabbs_job(void *user, int job, size_t begin, size_t end) {
+	struct shaggy_cull_run *run = user;
+
+	run->begin[job] = begin;
+	run->count[job] = shaggy_math.cull_aabbs(run->frustum, run->aabbs, begin, end, run->visible + begin);
+}
+
+static inline
+size_t shaggy_cull_pack(struct shaggy_cull_run *run, int jobs) {
+	size_t count = run->count[0];
+	int job;
+
+	for (job = 1; job < jobs; ++job) {
+		memmove(run->visible + count, run->visible + run->begin[job], run->count[job] * sizeof(*run->visible));
+		count += run->count[job];
+	}
+
+	return count;
+}
+
+/*****************************************************************
+ * @param workers May be NULL to cull on this thread.
+ * @param visible Room for n indices.
+ * @return How many indices were written.
+ *****************************************************************/
+static inline
+size_t shaggy_cull_spheres_parallel(struct shaggy_workers *workers, const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t n, uint32_t *visible) {
+	struct shaggy_cull_run run;
+	int jobs;
+
+	run.frustum = frustum;
+	run.spheres = s;
+	run.visible = visible;
+	jobs = shaggy_workers_run(workers, n, SHAGGY_CULL_MIN_PER_JOB, shaggy_cull_spheres_job, &run);
+
+	return shaggy_cull_pack(&run, jobs);
+}
+
+static inline
+size_t shaggy_cull_aabbs_parallel(struct shaggy_workers *workers, const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t n, uint32_t *visible) {
+	struct shaggy_cull_run run;
+	int jobs;
+
+	run.frustum = frustum;
+	run.aabbs = b;
+	run.visible = visible;
+	jobs = shaggy_workers_run(workers, n, SHAGGY_CULL_MIN_PER_JOB, shaggy_cull_aabbs_job, &run);
+
+	return shaggy_cull_pack(&run, jobs);
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef SHAGGY_FRAME_RING_H
+#define SHAGGY_FRAME_RING_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+/*****************************************************************
+ * Frame Ring
+ * One persistently mapped, coherent buffer split into a region
+ * per frame in flight. Each frame hands out aligned pieces of its
+ * region, which are written through the mapping and bound with
+ * glBindBufferRange. A fence at the end of the frame guards the
+ * region until the GPU is done with it, so nothing is reallocated
+ * or orphaned and the driver never has to shadow a copy.
+ *****************************************************************/
+
+#define SHAGGY_FRAME_RING_FRAMES 3
+
+struct shaggy_frame_ring {
+	GLuint buffer;
+	unsigned char *mapped;
+	GLsizeiptr frame_size; /* Bytes per region, a multiple of alignment */
+	GLint alignment;       /* GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT */
+	GLsync fences[SHAGGY_FRAME_RING_FRAMES];
+	unsigned frame;        /* Region being filled */
+	GLsizeiptr head;       /* Bytes of it handed out so far */
+	unsigned stalls;       /* Frames that had to wait on the GPU */
+};
+
+/* A piece of the current frame's region */
+struct shaggy_ring_allocation {
+	void *data;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+static inline
+GLsizeiptr shaggy_frame_ring_align(GLsizeiptr size, GLint alignment) {
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+/*****************************************************************
+ * Create the buffer and map it for good.
+ * @param frame_size Most bytes a single frame will allocate.
+ * @return false without ARB_buffer_storage, or if mapping failed.
+ *****************************************************************/
+static inline
+bool shaggy_frame_ring_init(struct shaggy_frame_ring *ring, GLsizeiptr frame_size) {
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	memset(ring, 0, sizeof(*ring));
+
+	if (!GLEW_ARB_buffer_storage && !GLEW_VERSION_4_4) {
+		logm(ERROR, "Frame ring needs ARB_buffer_storage");
+		return false;
+	}
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring->alignment);
+	if (ring->alignment < 1) {
+		ring->alignment = 256;
+	}
+
+	ring->frame_size = shaggy_frame_ring_align(frame_size, ring->alignment);
+
+	glCreateBuffers(1, &ring->buffer);
+	glNamedBufferStorage(ring->buffer, ring->frame_size * SHAGGY_FRAME_RING_FRAMES, NULL, flags);
+
+	ring->mapped = glMapNamedBufferRange(ring->buffer, 0, ring->frame_size * SHAGGY_FRAME_RING_FRAMES, flags);
+	if (!ring->mapped) {
+		logm(ERROR, "Failed to map the frame ring");
+		glDeleteBuffers(1, &ring->buffer);
+		ring->buffer = 0;
+		return false;
+	}
+
+	logm(CONFIG, "Frame ring of %d x %ld bytes, %d byte alignment",
+		 SHAGGY_FRAME_RING_FRAMES, (long) ring->frame_size, ring->alignment);
+
+	return true;
+}
+
+static inline
+void shaggy_frame_ring_destroy(struct shaggy_frame_ring *ring) {
+	int i;
+
+	for (i = 0; i < SHAGGY_FRAME_RING_FRAMES; ++i) {
+		if (ring->fences[i]) {
+			glDeleteSync(ring->fences[i]);
+		}
+	}
+
+	if (ring->buffer) {
+		glUnmapNamedBuffer(ring->buffer);
+		glDeleteBuffers(1, &ring->buffer);
+	}
+
+	memset(ring, 0, sizeof(*ring));
+}
+
+/*****************************************************************
+ * Start filling the next region, blocking if the GPU is still
+ * reading what was written there SHAGGY_FRAME_RING_FRAMES ago.
+ *****************************************************************/
+static inline
+void shaggy_frame_ring_begin(struct shaggy_frame_ring *ring) {
+	GLsync fence = ring->fences[ring->frame];
+	GLenum result;
+
+	ring->head = 0;
+
+	if (!fence) {
+		return;
+	}
+
+	result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		++ring->stalls;
+
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+
+	if (result == GL_WAIT_FAILED) {
+		logm(ERROR, "Waiting on frame ring fence failed");
+	}
+
+	glDeleteSync(fence);
+	ring->fences[ring->frame] = 0;
+}
+
+/*****************************************************************
+ * Hand out size bytes of the current frame's region.
+ * @return false if the frame is out of room, allocation is left
+ *         untouched.
+ *****************************************************************/
+static inline
+bool shaggy_frame_ring_alloc(
+		struct shaggy_frame_ring *ring, GLsizeiptr size, struct shaggy_ring_allocation *allocation) {
+	GLsizeiptr start = shaggy_frame_ring_align(ring->head, ring->alignment);
+
+	if (start + size > ring->frame_size) {
+		logm(WARNING, "Frame ring is out of room, %ld of %ld bytes used", (long) ring->head, (long) ring->frame_size);
+		return false;
+	}
+
+	ring->head = start + size;
+
+	allocation->offset = ring->frame * ring->frame_size + start;
+	allocation->data = ring->mapped + allocation->offset;
+	allocation->size = size;
+
+	return true;
+}
+
+static inline
+void shaggy_frame_ring_bind(
+		const struct shaggy_frame_ring *ring, GLuint binding, const struct shaggy_ring_allocation *allocation) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer, allocation->offset, allocation->size);
+}
+
+/* Fence everything submitted since begin and move to the next region */
+static inline
+void shaggy_frame_ring_end(struct shaggy_frame_ring *ring) {
+	ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring->frame = (ring->frame + 1) % SHAGGY_FRAME_RING_FRAMES;
+}
+
+#endif
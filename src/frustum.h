@@ -0,0 +1,291 @@
+#ifndef SHAGGY_FRUSTUM_H
+#define SHAGGY_FRUSTUM_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linmath.h"
+#include "linmath_batch.h"
+
+/*****************************************************************
+ * Frustum Tests
+ * Bounds live in structure of arrays streams like linmath_batch.h,
+ * so every plane test covers 4 (SSE2) or 8 (AVX) objects with a
+ * few broadcast plane terms times loads. Each cull writes the
+ * indices that may be visible, in order and packed, so what comes
+ * out is the draw list. Stores are unconditional and only the
+ * count depends on the test, so there are no per object branches.
+ *
+ * Every cull takes a [begin, end) range and needs room for
+ * end - begin indices, so ranges can be handed to different
+ * threads, see culling.h. Like linmath.h this only needs the C
+ * library, the variants are also in the shaggy_math table.
+ *****************************************************************/
+
+enum shaggy_frustum_plane {
+	SHAGGY_FRUSTUM_LEFT,
+	SHAGGY_FRUSTUM_RIGHT,
+	SHAGGY_FRUSTUM_BOTTOM,
+	SHAGGY_FRUSTUM_TOP,
+	SHAGGY_FRUSTUM_NEAR,
+	SHAGGY_FRUSTUM_FAR,
+	SHAGGY_FRUSTUM_PLANES
+};
+
+/* Planes as a x + b y + c z + d, positive inside, with unit normals so d is a distance */
+struct shaggy_frustum {
+	vec4 planes[SHAGGY_FRUSTUM_PLANES];
+};
+
+struct shaggy_spheres {
+	vec3_soa center;
+	float *radius;
+};
+
+/* Center and half size, the form a plane test needs */
+struct shaggy_aabbs {
+	vec3_soa center;
+	vec3_soa extent;
+};
+
+/*****************************************************************
+ * Planes of the volume M maps to the GL clip cube, -w <= x, y, z
+ * <= w. For Projection x View they are in world space, for
+ * Projection x View x Model in that model's space.
+ *****************************************************************/
+static inline
+void shaggy_frustum_from_matrix(struct shaggy_frustum *frustum, mat4x4 M) {
+	int p, i;
+
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+		/* Row 3 plus or minus row p / 2 of M, which is column major */
+		float sign = p & 1 ? -1.0f : 1.0f;
+		float length;
+
+		for (i = 0; i < 4; ++i) {
+			frustum->planes[p][i] = M[i][3] + sign * M[i][p / 2];
+		}
+
+		length = sqrtf(frustum->planes[p][0] * frustum->planes[p][0] +
+					   frustum->planes[p][1] * frustum->planes[p][1] +
+					   frustum->planes[p][2] * frustum->planes[p][2]);
+		if (length > 0.0f) {
+			vec4_scale(frustum->planes[p], frustum->planes[p], 1.0f / length);
+		}
+	}
+}
+
+/*****************************************************************
+ * The _scalar forms also finish the tail of the SIMD forms.
+ * @param visible Gets the index of every object that isn't fully
+ *                outside a plane, room for end - begin.
+ * @return How many indices were written.
+ *****************************************************************/
+static inline
+size_t shaggy_cull_spheres_scalar(const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t begin, size_t end, uint32_t *visible) {
+	size_t count = 0, i;
+	int p;
+
+	for (i = begin; i < end; ++i) {
+		float x = s.center.x[i], y = s.center.y[i], z = s.center.z[i], r = -s.radius[i];
+		int inside = 1;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			const float *plane = frustum->planes[p];
+			inside &= !(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < r);
+		}
+
+		visible[count] = (uint32_t) i;
+		count += inside;
+	}
+
+	return count;
+}
+
+/* A box is outside when its center is further out than its extent projects onto the normal */
+static inline
+size_t shaggy_cull_aabbs_scalar(const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t begin, size_t end, uint32_t *visible) {
+	size_t count = 0, i;
+	int p;
+
+	for (i = begin; i < end; ++i) {
+		float x = b.center.x[i], y = b.center.y[i], z = b.center.z[i];
+		float ex = b.extent.x[i], ey = b.extent.y[i], ez = b.extent.z[i];
+		int inside = 1;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			const float *plane = frustum->planes[p];
+			float r = -(fabsf(plane[0]) * ex + fabsf(plane[1]) * ey + fabsf(plane[2]) * ez);
+			inside &= !(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < r);
+		}
+
+		visible[count] = (uint32_t) i;
+		count += inside;
+	}
+
+	return count;
+}
+
+/* Append base + k for every set bit k of mask, lowest first */
+#define SHAGGY_CULL_EMIT(visible, count, base, mask, width) \
+	do { \
+		int k_; \
+		for (k_ = 0; k_ < (width); ++k_) { \
+			(visible)[count] = (uint32_t) ((base) + k_); \
+			(count) += ((mask) >> k_) & 1; \
+		} \
+	} while (0)
+
+#ifdef LINMATH_SSE2
+#define SHAGGY_CULL_PLANE_SSE2(pl, p, x, y, z) \
+	_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(pl[p][0], x), _mm_mul_ps(pl[p][1], y)), _mm_mul_ps(pl[p][2], z)), pl[p][3])
+
+static inline
+size_t shaggy_cull_spheres_sse2(const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t begin, size_t end, uint32_t *visible) {
+	__m128 pl[SHAGGY_FRUSTUM_PLANES][4];
+	size_t count = 0, i;
+	int p, k;
+
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 4; ++k)
+			pl[p][k] = _mm_set1_ps(frustum->planes[p][k]);
+
+	for (i = begin; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(s.center.x + i), y = _mm_loadu_ps(s.center.y + i), z = _mm_loadu_ps(s.center.z + i);
+		__m128 r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(s.radius + i));
+		__m128 out = _mm_setzero_ps();
+		int mask;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			out = _mm_or_ps(out, _mm_cmplt_ps(SHAGGY_CULL_PLANE_SSE2(pl, p, x, y, z), r));
+		}
+
+		mask = ~_mm_movemask_ps(out);
+		SHAGGY_CULL_EMIT(visible, count, i, mask, 4);
+	}
+
+	return count + shaggy_cull_spheres_scalar(frustum, s, i, end, visible + count);
+}
+
+static inline
+size_t shaggy_cull_aabbs_sse2(const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t begin, size_t end, uint32_t *visible) {
+	__m128 pl[SHAGGY_FRUSTUM_PLANES][4];
+	__m128 abs_pl[SHAGGY_FRUSTUM_PLANES][3];
+	size_t count = 0, i;
+	int p, k;
+
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 4; ++k)
+			pl[p][k] = _mm_set1_ps(frustum->planes[p][k]);
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 3; ++k)
+			abs_pl[p][k] = _mm_set1_ps(fabsf(frustum->planes[p][k]));
+
+	for (i = begin; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(b.center.x + i), y = _mm_loadu_ps(b.center.y + i), z = _mm_loadu_ps(b.center.z + i);
+		__m128 ex = _mm_loadu_ps(b.extent.x + i), ey = _mm_loadu_ps(b.extent.y + i), ez = _mm_loadu_ps(b.extent.z + i);
+		__m128 out = _mm_setzero_ps();
+		int mask;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_pl[p][0], ex), _mm_mul_ps(abs_pl[p][1], ey)), _mm_mul_ps(abs_pl[p][2], ez));
+			r = _mm_sub_ps(_mm_setzero_ps(), r);
+			out = _mm_or_ps(out, _mm_cmplt_ps(SHAGGY_CULL_PLANE_SSE2(pl, p, x, y, z), r));
+		}
+
+		mask = ~_mm_movemask_ps(out);
+		SHAGGY_CULL_EMIT(visible, count, i, mask, 4);
+	}
+
+	return count + shaggy_cull_aabbs_scalar(frustum, b, i, end, visible + count);
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+#define SHAGGY_CULL_PLANE_AVX_FMA(pl, p, x, y, z) \
+	_mm256_fmadd_ps(pl[p][2], z, _mm256_fmadd_ps(pl[p][1], y, _mm256_fmadd_ps(pl[p][0], x, pl[p][3])))
+
+static inline
+size_t shaggy_cull_spheres_avx_fma(const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t begin, size_t end, uint32_t *visible) {
+	__m256 pl[SHAGGY_FRUSTUM_PLANES][4];
+	size_t count = 0, i;
+	int p, k;
+
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 4; ++k)
+			pl[p][k] = _mm256_set1_ps(frustum->planes[p][k]);
+
+	for (i = begin; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(s.center.x + i), y = _mm256_loadu_ps(s.center.y + i), z = _mm256_loadu_ps(s.center.z + i);
+		__m256 r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(s.radius + i));
+		__m256 out = _mm256_setzero_ps();
+		int mask;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			out = _mm256_or_ps(out, _mm256_cmp_ps(SHAGGY_CULL_PLANE_AVX_FMA(pl, p, x, y, z), r, _CMP_LT_OQ));
+		}
+
+		mask = ~_mm256_movemask_ps(out);
+		SHAGGY_CULL_EMIT(visible, count, i, mask, 8);
+	}
+
+	return count + shaggy_cull_spheres_sse2(frustum, s, i, end, visible + count);
+}
+
+static inline
+size_t shaggy_cull_aabbs_avx_fma(const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t begin, size_t end, uint32_t *visible) {
+	__m256 pl[SHAGGY_FRUSTUM_PLANES][4];
+	__m256 abs_pl[SHAGGY_FRUSTUM_PLANES][3];
+	size_t count = 0, i;
+	int p, k;
+
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 4; ++k)
+			pl[p][k] = _mm256_set1_ps(frustum->planes[p][k]);
+	for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p)
+		for (k = 0; k < 3; ++k)
+			abs_pl[p][k] = _mm256_set1_ps(fabsf(frustum->planes[p][k]));
+
+	for (i = begin; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(b.center.x + i), y = _mm256_loadu_ps(b.center.y + i), z = _mm256_loadu_ps(b.center.z + i);
+		__m256 ex = _mm256_loadu_ps(b.extent.x + i), ey = _mm256_loadu_ps(b.extent.y + i), ez = _mm256_loadu_ps(b.extent.z + i);
+		__m256 out = _mm256_setzero_ps();
+		int mask;
+
+		for (p = 0; p < SHAGGY_FRUSTUM_PLANES; ++p) {
+			__m256 r = _mm256_fmadd_ps(abs_pl[p][2], ez, _mm256_fmadd_ps(abs_pl[p][1], ey, _mm256_mul_ps(abs_pl[p][0], ex)));
+			out = _mm256_or_ps(out, _mm256_cmp_ps(SHAGGY_CULL_PLANE_AVX_FMA(pl, p, x, y, z), _mm256_sub_ps(_mm256_setzero_ps(), r), _CMP_LT_OQ));
+		}
+
+		mask = ~_mm256_movemask_ps(out);
+		SHAGGY_CULL_EMIT(visible, count, i, mask, 8);
+	}
+
+	return count + shaggy_cull_aabbs_sse2(frustum, b, i, end, visible + count);
+}
+#endif
+
+static inline
+size_t shaggy_cull_spheres(const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t begin, size_t end, uint32_t *visible) {
+#if defined(LINMATH_AVX_FMA)
+	return shaggy_cull_spheres_avx_fma(frustum, s, begin, end, visible);
+#elif defined(LINMATH_SSE2)
+	return shaggy_cull_spheres_sse2(frustum, s, begin, end, visible);
+#else
+	return shaggy_cull_spheres_scalar(frustum, s, begin, end, visible);
+#endif
+}
+
+static inline
+size_t shaggy_cull_aabbs(const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t begin, size_t end, uint32_t *visible) {
+#if defined(LINMATH_AVX_FMA)
+	return shaggy_cull_aabbs_avx_fma(frustum, b, begin, end, visible);
+#elif defined(LINMATH_SSE2)
+	return shaggy_cull_aabbs_sse2(frustum, b, begin, end, visible);
+#else
+	return shaggy_cull_aabbs_scalar(frustum, b, begin, end, visible);
+#endif
+}
+
+#endif
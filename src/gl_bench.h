@@ -0,0 +1,668 @@
+#ifndef SHAGGY_GL_BENCH_H
+#define SHAGGY_GL_BENCH_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+
+#include "shaders.h"
+#include "uniform_block.h"
+#include "frame_ring.h"
+#include "command_buffer.h"
+
+/****************************************************************
+ * Benchmarks that need a live GL context.
+ * Selected from the command line, see main(). They're meant to
+ * be run against Mesa's software rasterizer (llvmpipe) so numbers
+ * are comparable between machines, shaggy_bench_prepare_env()
+ * forces that before the context exists.
+ ****************************************************************/
+
+/*************************************************************
+ * Must run before SDL creates the GL context.
+ * LIBGL_ALWAYS_SOFTWARE selects llvmpipe, and Mesa's own
+ * shader cache is disabled so it doesn't hide cold numbers.
+ *************************************************************/
+static inline
+void shaggy_bench_prepare_env(void) {
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+	setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+	setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+#else
+	logm(WARNING, "Can't force the software rasterizer on this platform");
+#endif
+}
+
+/* mkdtemp() where we have it, template is modified in place */
+static inline
+bool shaggy_bench_make_temp_dir(char *template) {
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+	if (!mkdtemp(template)) {
+		logm(ERROR, "mkdtemp() failed: %s", strerror(errno));
+		return false;
+	}
+
+	return true;
+#else
+	logm(ERROR, "Benchmarks need mkdtemp()");
+	return false;
+#endif
+}
+
+/* Delete a directory from shaggy_bench_make_temp_dir along with the files written to it */
+static inline
+void shaggy_bench_remove_temp_dir(const char *path) {
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+	tinydir_dir dir;
+
+	if (tinydir_open(&dir, path) == -1) {
+		logm(WARNING, "Failed to open %s to clean it up", path);
+		return;
+	}
+
+	while (dir.has_next) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+
+		if (!file.is_dir && remove(file.path) != 0) {
+			logm(WARNING, "Failed to remove %s: %s", file.path, strerror(errno));
+		}
+
+		tinydir_next(&dir);
+	}
+
+	tinydir_close(&dir);
+
+	if (rmdir(path) != 0) {
+		logm(WARNING, "Failed to remove %s: %s", path, strerror(errno));
+	}
+#endif
+}
+
+static inline
+double shaggy_bench_elapsed_ms(Uint64 start) {
+	return (double) (SDL_GetPerformanceCounter() - start) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+}
+
+/*********************************************************
+ * Scan a shader directory then build one program per
+ * vertex shader that has a fragment shader of the same
+ * name, which is the convention main() follows. Lazy like
+ * main() too, so a warm cache compiles nothing at all.
+ * @return Time spent in milliseconds, including glFinish.
+ *********************************************************/
+static inline
+double shaggy_bench_startup_pass(const char *shader_dir, const char *cache_dir, int *program_count) {
+	struct shaggy_manager *manager;
+	struct shaggy_shader_key key;
+	struct shaggy_managed_shader shader;
+	const char **names;
+	size_t name_count = 0;
+	size_t i;
+	Uint64 start;
+	double elapsed;
+
+	*program_count = 0;
+	start = SDL_GetPerformanceCounter();
+
+	manager = shaggy_create_shader_manager();
+	shaggy_manage_set_program_cache(manager, cache_dir);
+	shaggy_manage_set_lazy(manager, true);
+	shaggy_manage_shader_dir(manager, shader_dir);
+
+	/* Building can add registry entries, so don't iterate while doing it */
+	names = malloc(kh_size(manager->shaders) * sizeof(*names) + 1);
+	kh_foreach(manager->shaders, key, shader, {
+		(void) shader;
+		if (key.type == SHAGGY_VERTEX_SHADER) {
+			names[name_count++] = key.name;
+		}
+	});
+
+	for (i = 0; i < name_count; ++i) {
+		shaggy_program program;
+
+		/* Fetching would compile it, only the registry is asked */
+		if (!shaggy_manage_find_shader(manager, SHAGGY_FRAGMENT_SHADER, names[i])) {
+			continue;
+		}
+
+		program = shaggy_manage_build_program(manager, (const char *[5]) { names[i], names[i] });
+		if (program) {
+			*program_count += 1;
+		}
+	}
+
+	free(names);
+
+	glFinish();
+	elapsed = shaggy_bench_elapsed_ms(start);
+
+	shaggy_destroy_shader_manager(manager);
+
+	return elapsed;
+}
+
+/*******************************************************************
+ * Compare startup with no program cache, a cold cache and a warm
+ * cache. The cache lives in a fresh temporary directory so "cold"
+ * really is cold, and is removed afterwards.
+ *******************************************************************/
+static inline
+void shaggy_bench_startup(const char *shader_dir) {
+	char cache_dir[] = "/tmp/shaggy-program-cache-XXXXXX";
+	double uncached, cold, warm;
+	int programs;
+
+	logm(INFO, "Startup benchmark on %s", (const char *) glGetString(GL_RENDERER));
+
+	if (!shaggy_bench_make_temp_dir(cache_dir)) {
+		return;
+	}
+
+	uncached = shaggy_bench_startup_pass(shader_dir, NULL, &programs);
+	cold = shaggy_bench_startup_pass(shader_dir, cache_dir, &programs);
+	warm = shaggy_bench_startup_pass(shader_dir, cache_dir, &programs);
+
+	logm(INFO, "%d programs: uncached %.3f ms, cold cache %.3f ms, warm cache %.3f ms",
+		 programs, uncached, cold, warm);
+
+	shaggy_bench_remove_temp_dir(cache_dir);
+}
+
+/*******************************************************************
+ * Monolithic programs against separable pipelines.
+ * One vertex shader is paired with SHAGGY_BENCH_PIPELINE_COUNT
+ * generated fragment shaders. Startup covers building every pair,
+ * switching binds each pair in turn around a tiny draw.
+ *******************************************************************/
+
+#define SHAGGY_BENCH_PIPELINE_COUNT 64
+#define SHAGGY_BENCH_SWITCH_ROUNDS 256
+
+static inline
+bool shaggy_bench_write_file(const char *path, const char *contents) {
+	FILE *file = fopen(path, "w");
+
+	if (!file) {
+		logm(ERROR, "Failed to open %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	fputs(contents, file);
+	fclose(file);
+	return true;
+}
+
+static inline
+bool shaggy_bench_generate_pairs(const char *dir_path) {
+	char path[4096];
+	char source[512];
+	int i;
+
+	snprintf(path, sizeof(path), "%s/bench.vert.glsl", dir_path);
+	if (!shaggy_bench_write_file(path,
+			"#version 450\n"
+			"out gl_PerVertex { vec4 gl_Position; };\n"
+			"void main() {\n"
+			"    gl_Position = vec4(float(gl_VertexID & 1), float(gl_VertexID >> 1), 0.0, 1.0);\n"
+			"}\n")) {
+		return false;
+	}
+
+	for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+		snprintf(path, sizeof(path), "%s/bench%d.frag.glsl", dir_path, i);
+		snprintf(source, sizeof(source),
+				 "#version 450\n"
+				 "layout (location = 0) out vec4 color;\n"
+				 "void main() {\n"
+				 "    color = vec4(%d.0 / %d.0, 0.0, 0.0, 1.0);\n"
+				 "}\n", i, SHAGGY_BENCH_PIPELINE_COUNT);
+
+		if (!shaggy_bench_write_file(path, source)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static inline
+void shaggy_bench_pipelines(void) {
+	char shader_dir[] = "/tmp/shaggy-pipeline-bench-XXXXXX";
+	char names[SHAGGY_BENCH_PIPELINE_COUNT][32];
+	GLuint programs[SHAGGY_BENCH_PIPELINE_COUNT];
+	GLuint pipelines[SHAGGY_BENCH_PIPELINE_COUNT];
+	struct shaggy_manager *manager;
+	GLuint vao;
+	Uint64 start;
+	double program_build, pipeline_build, program_switch, pipeline_switch;
+	int i, round;
+
+	logm(INFO, "Pipeline benchmark on %s", (const char *) glGetString(GL_RENDERER));
+
+	if (!shaggy_bench_make_temp_dir(shader_dir)) {
+		return;
+	}
+
+	if (!shaggy_bench_generate_pairs(shader_dir)) {
+		shaggy_bench_remove_temp_dir(shader_dir);
+		return;
+	}
+
+	for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+		snprintf(names[i], sizeof(names[i]), "bench%d", i);
+	}
+
+	/* Compile once up front so both paths only pay for linking */
+	manager = shaggy_create_shader_manager();
+	shaggy_manage_shader_dir(manager, shader_dir);
+	shaggy_bench_remove_temp_dir(shader_dir);
+	glFinish();
+
+	start = SDL_GetPerformanceCounter();
+	for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+		programs[i] = shaggy_manage_build_program(manager, (const char *[5]) { "bench", names[i] });
+	}
+	glFinish();
+	program_build = shaggy_bench_elapsed_ms(start);
+
+	start = SDL_GetPerformanceCounter();
+	for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+		pipelines[i] = shaggy_manage_build_pipeline(manager, (const char *[5]) { "bench", names[i] });
+	}
+	glFinish();
+	pipeline_build = shaggy_bench_elapsed_ms(start);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	start = SDL_GetPerformanceCounter();
+	for (round = 0; round < SHAGGY_BENCH_SWITCH_ROUNDS; ++round) {
+		for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+			glUseProgram(programs[i]);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glFinish();
+	program_switch = shaggy_bench_elapsed_ms(start);
+
+	glUseProgram(0);
+
+	start = SDL_GetPerformanceCounter();
+	for (round = 0; round < SHAGGY_BENCH_SWITCH_ROUNDS; ++round) {
+		for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+			glBindProgramPipeline(pipelines[i]);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glFinish();
+	pipeline_switch = shaggy_bench_elapsed_ms(start);
+
+	glBindProgramPipeline(0);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+
+	logm(INFO, "%d pairs: build monolithic %.3f ms, pipelines %.3f ms",
+		 SHAGGY_BENCH_PIPELINE_COUNT, program_build, pipeline_build);
+	logm(INFO, "%d switches: monolithic %.3f us each, pipelines %.3f us each",
+		 SHAGGY_BENCH_PIPELINE_COUNT * SHAGGY_BENCH_SWITCH_ROUNDS,
+		 program_switch * 1000.0 / (SHAGGY_BENCH_PIPELINE_COUNT * SHAGGY_BENCH_SWITCH_ROUNDS),
+		 pipeline_switch * 1000.0 / (SHAGGY_BENCH_PIPELINE_COUNT * SHAGGY_BENCH_SWITCH_ROUNDS));
+
+	shaggy_destroy_shader_manager(manager);
+}
+
+/*******************************************************************
+ * Per-object uniform uploads three ways.
+ * Every object writes its own Matrices block and draws once:
+ *  - SubData: one small buffer updated before each draw
+ *  - Orphaning: one buffer per frame, orphaned, mapped with
+ *    invalidate and bound by range per object
+ *  - Ring: shaggy_frame_ring, persistently mapped and fenced
+ *******************************************************************/
+
+#define SHAGGY_BENCH_UPLOAD_OBJECTS 1024
+#define SHAGGY_BENCH_UPLOAD_FRAMES 64
+
+enum { SHAGGY_BENCH_PROJECTION, SHAGGY_BENCH_MODEL_VIEW };
+
+static inline
+bool shaggy_bench_generate_upload_shaders(const char *dir_path) {
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/upload.vert.glsl", dir_path);
+	if (!shaggy_bench_write_file(path,
+			"#version 450\n"
+			"layout (std140, binding = 1) uniform Matrices {\n"
+			"    mat4 projection;\n"
+			"    mat4 model_view;\n"
+			"};\n"
+			"void main() {\n"
+			"    gl_Position = projection * model_view * vec4(float(gl_VertexID & 1), float(gl_VertexID >> 1), 0.0, 1.0);\n"
+			"}\n")) {
+		return false;
+	}
+
+	snprintf(path, sizeof(path), "%s/upload.frag.glsl", dir_path);
+	return shaggy_bench_write_file(path,
+			"#version 450\n"
+			"layout (location = 0) out vec4 color;\n"
+			"void main() {\n"
+			"    color = vec4(1.0);\n"
+			"}\n");
+}
+
+/* The same made up matrices for every strategy */
+static inline
+void shaggy_bench_upload_object(const struct shaggy_block_writer *writer, void *block, int object) {
+	mat4x4 projection;
+	mat4x4 model_view;
+
+	mat4x4_perspective(projection, 1.7f, 16.0f / 9.0f, 0.1f, 100.0f);
+	mat4x4_translate(model_view, (float) (object % 32), (float) (object / 32), -10.0f);
+
+	shaggy_block_write_mat4x4(block, &writer->members[SHAGGY_BENCH_PROJECTION], 0, projection);
+	shaggy_block_write_mat4x4(block, &writer->members[SHAGGY_BENCH_MODEL_VIEW], 0, model_view);
+}
+
+static inline
+double shaggy_bench_upload_subdata(const struct shaggy_block_writer *writer) {
+	unsigned char block[writer->size];
+	GLuint buffer;
+	Uint64 start;
+	int frame, object;
+
+	glCreateBuffers(1, &buffer);
+	glNamedBufferData(buffer, writer->size, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, (GLuint) writer->binding, buffer);
+	glFinish();
+
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_UPLOAD_FRAMES; ++frame) {
+		for (object = 0; object < SHAGGY_BENCH_UPLOAD_OBJECTS; ++object) {
+			shaggy_bench_upload_object(writer, block, object);
+			glNamedBufferSubData(buffer, 0, writer->size, block);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glFinish();
+
+	glDeleteBuffers(1, &buffer);
+	return shaggy_bench_elapsed_ms(start);
+}
+
+static inline
+double shaggy_bench_upload_orphan(const struct shaggy_block_writer *writer, GLint alignment) {
+	GLsizeiptr stride = shaggy_block_writer_stride(writer, alignment);
+	GLsizeiptr size = stride * SHAGGY_BENCH_UPLOAD_OBJECTS;
+	GLuint buffer;
+	Uint64 start;
+	int frame, object;
+
+	glCreateBuffers(1, &buffer);
+	glNamedBufferData(buffer, size, NULL, GL_STREAM_DRAW);
+	glFinish();
+
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_UPLOAD_FRAMES; ++frame) {
+		unsigned char *mapped;
+
+		glNamedBufferData(buffer, size, NULL, GL_STREAM_DRAW);
+		mapped = glMapNamedBufferRange(buffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!mapped) {
+			logm(ERROR, "Failed to map the orphaned buffer");
+			break;
+		}
+
+		for (object = 0; object < SHAGGY_BENCH_UPLOAD_OBJECTS; ++object) {
+			shaggy_bench_upload_object(writer, mapped + object * stride, object);
+		}
+
+		glUnmapNamedBuffer(buffer);
+
+		for (object = 0; object < SHAGGY_BENCH_UPLOAD_OBJECTS; ++object) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, (GLuint) writer->binding, buffer, object * stride, writer->size);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glFinish();
+
+	glDeleteBuffers(1, &buffer);
+	return shaggy_bench_elapsed_ms(start);
+}
+
+static inline
+double shaggy_bench_upload_ring(const struct shaggy_block_writer *writer, GLint alignment, unsigned *stalls) {
+	struct shaggy_frame_ring ring;
+	Uint64 start;
+	double elapsed;
+	int frame, object;
+
+	if (!shaggy_frame_ring_init(&ring, shaggy_block_writer_stride(writer, alignment) * SHAGGY_BENCH_UPLOAD_OBJECTS)) {
+		return -1.0;
+	}
+
+	glFinish();
+
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_UPLOAD_FRAMES; ++frame) {
+		shaggy_frame_ring_begin(&ring);
+
+		for (object = 0; object < SHAGGY_BENCH_UPLOAD_OBJECTS; ++object) {
+			struct shaggy_ring_allocation allocation;
+
+			if (!shaggy_frame_ring_alloc(&ring, writer->size, &allocation)) {
+				break;
+			}
+
+			shaggy_bench_upload_object(writer, allocation.data, object);
+			shaggy_frame_ring_bind(&ring, (GLuint) writer->binding, &allocation);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+
+		shaggy_frame_ring_end(&ring);
+	}
+	glFinish();
+	elapsed = shaggy_bench_elapsed_ms(start);
+
+	*stalls = ring.stalls;
+	shaggy_frame_ring_destroy(&ring);
+	return elapsed;
+}
+
+static inline
+void shaggy_bench_uploads(void) {
+	static const char *const members[] = { "projection", "model_view" };
+	char shader_dir[] = "/tmp/shaggy-upload-bench-XXXXXX";
+	struct shaggy_manager *manager;
+	struct shaggy_block_writer writer;
+	shaggy_program program;
+	GLint alignment = 256;
+	GLuint vao;
+	double subdata, orphan, ring;
+	unsigned stalls = 0;
+
+	logm(INFO, "Upload benchmark on %s", (const char *) glGetString(GL_RENDERER));
+
+	if (!shaggy_bench_make_temp_dir(shader_dir)) {
+		return;
+	}
+
+	if (!shaggy_bench_generate_upload_shaders(shader_dir)) {
+		shaggy_bench_remove_temp_dir(shader_dir);
+		return;
+	}
+
+	/* Not lazy, everything is compiled once the scan returns and the files can go */
+	manager = shaggy_create_shader_manager();
+	shaggy_manage_shader_dir(manager, shader_dir);
+	shaggy_bench_remove_temp_dir(shader_dir);
+
+	program = shaggy_manage_build_program(manager, (const char *[5]) { "upload", "upload" });
+	if (!program || !shaggy_block_writer_init(
+			&writer, shaggy_manage_program_reflection(manager, program), "Matrices", members, 2)) {
+		logm(ERROR, "Upload benchmark shaders didn't build");
+		shaggy_destroy_shader_manager(manager);
+		return;
+	}
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glUseProgram(program);
+
+	subdata = shaggy_bench_upload_subdata(&writer);
+	orphan = shaggy_bench_upload_orphan(&writer, alignment);
+	ring = shaggy_bench_upload_ring(&writer, alignment, &stalls);
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+
+	logm(INFO, "%d frames of %d objects: SubData %.3f ms, orphaning %.3f ms, ring %.3f ms (%u stalled frames)",
+		 SHAGGY_BENCH_UPLOAD_FRAMES, SHAGGY_BENCH_UPLOAD_OBJECTS, subdata, orphan, ring, stalls);
+
+	shaggy_destroy_shader_manager(manager);
+}
+
+/*******************************************************************
+ * Draws with scattered state, issued inline in the order they come
+ * up, against recording them into shaggy_command_buffer, sorting
+ * and submitting. Reuses the pipeline benchmark's shaders, each
+ * draw picks one of its programs and one of a set of textures.
+ *******************************************************************/
+
+#define SHAGGY_BENCH_COMMAND_DRAWS 16384
+#define SHAGGY_BENCH_COMMAND_TEXTURES 32
+#define SHAGGY_BENCH_COMMAND_FRAMES 16
+
+static inline
+void shaggy_bench_commands(void) {
+	char shader_dir[] = "/tmp/shaggy-command-bench-XXXXXX";
+	char name[32];
+	GLuint programs[SHAGGY_BENCH_PIPELINE_COUNT];
+	GLuint textures[SHAGGY_BENCH_COMMAND_TEXTURES];
+	struct shaggy_command_buffer commands;
+	struct shaggy_manager *manager;
+	struct {
+		GLuint program;
+		GLuint texture;
+		float depth;
+	} *scene;
+	uint32_t state = 1;
+	GLuint vao;
+	Uint64 start;
+	double inline_ms, recorded_ms, sort_ms = 0.0;
+	int i, frame;
+
+	logm(INFO, "Command buffer benchmark on %s", (const char *) glGetString(GL_RENDERER));
+
+	if (!shaggy_bench_make_temp_dir(shader_dir)) {
+		return;
+	}
+
+	if (!shaggy_bench_generate_pairs(shader_dir)) {
+		shaggy_bench_remove_temp_dir(shader_dir);
+		return;
+	}
+
+	scene = malloc(sizeof(*scene) * SHAGGY_BENCH_COMMAND_DRAWS);
+	if (!scene || !shaggy_command_buffer_init(&commands, SHAGGY_BENCH_COMMAND_DRAWS)) {
+		logm(ERROR, "Out of memory for the command buffer benchmark");
+		free(scene);
+		shaggy_bench_remove_temp_dir(shader_dir);
+		return;
+	}
+
+	manager = shaggy_create_shader_manager();
+	shaggy_manage_shader_dir(manager, shader_dir);
+	shaggy_bench_remove_temp_dir(shader_dir);
+
+	for (i = 0; i < SHAGGY_BENCH_PIPELINE_COUNT; ++i) {
+		snprintf(name, sizeof(name), "bench%d", i);
+		programs[i] = shaggy_manage_build_program(manager, (const char *[5]) { "bench", name });
+	}
+
+	glCreateTextures(GL_TEXTURE_2D, SHAGGY_BENCH_COMMAND_TEXTURES, textures);
+	for (i = 0; i < SHAGGY_BENCH_COMMAND_TEXTURES; ++i) {
+		glTextureStorage2D(textures[i], 1, GL_RGBA8, 1, 1);
+	}
+
+	for (i = 0; i < SHAGGY_BENCH_COMMAND_DRAWS; ++i) {
+		state = state * 1664525u + 1013904223u;
+		scene[i].program = programs[(state >> 8) % SHAGGY_BENCH_PIPELINE_COUNT];
+		scene[i].texture = textures[(state >> 16) % SHAGGY_BENCH_COMMAND_TEXTURES];
+		scene[i].depth = (float) (state >> 24) / 256.0f;
+	}
+
+	glGenVertexArrays(1, &vao);
+	glFinish();
+
+	/* What code calling GL as it goes does */
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_COMMAND_FRAMES; ++frame) {
+		glBindVertexArray(vao);
+
+		for (i = 0; i < SHAGGY_BENCH_COMMAND_DRAWS; ++i) {
+			glUseProgram(scene[i].program);
+			glBindTextureUnit(0, scene[i].texture);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glFinish();
+	inline_ms = shaggy_bench_elapsed_ms(start) / SHAGGY_BENCH_COMMAND_FRAMES;
+
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_COMMAND_FRAMES; ++frame) {
+		Uint64 sort_start;
+
+		shaggy_command_buffer_begin(&commands);
+
+		for (i = 0; i < SHAGGY_BENCH_COMMAND_DRAWS; ++i) {
+			struct shaggy_draw *draw = shaggy_command_buffer_record(
+					&commands, shaggy_sort_key(scene[i].program, scene[i].texture, scene[i].depth));
+
+			draw->program = scene[i].program;
+			draw->vertex_array = vao;
+			draw->textures[0] = scene[i].texture;
+			draw->mode = GL_TRIANGLE_STRIP;
+			draw->count = 4;
+		}
+
+		sort_start = SDL_GetPerformanceCounter();
+		shaggy_command_buffer_sort(&commands);
+		sort_ms += shaggy_bench_elapsed_ms(sort_start);
+
+		shaggy_command_buffer_submit(&commands);
+	}
+	glFinish();
+	recorded_ms = shaggy_bench_elapsed_ms(start) / SHAGGY_BENCH_COMMAND_FRAMES;
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteTextures(SHAGGY_BENCH_COMMAND_TEXTURES, textures);
+
+	logm(INFO, "%d draws over %d programs and %d textures: inline %.3f ms, recorded %.3f ms (sort %.3f ms) per frame",
+		 SHAGGY_BENCH_COMMAND_DRAWS, SHAGGY_BENCH_PIPELINE_COUNT, SHAGGY_BENCH_COMMAND_TEXTURES,
+		 inline_ms, recorded_ms, sort_ms / SHAGGY_BENCH_COMMAND_FRAMES);
+	logm(INFO, "Recorded binds per frame: %zu programs, %zu textures, %zu vertex arrays, %zu elided (inline makes %d)",
+		 commands.stats.programs, commands.stats.textures, commands.stats.vertex_arrays, commands.stats.elided,
+		 2 * SHAGGY_BENCH_COMMAND_DRAWS);
+
+	shaggy_command_buffer_destroy(&commands);
+	shaggy_destroy_shader_manager(manager);
+	free(scene);
+}
+
+#endif
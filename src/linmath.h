@@ -3,27 +3,49 @@
 
 #include <math.h>
 
-#define LINMATH_H_DEFINE_VEC(n) \
-typedef float vec##n[n]; \
-static inline void vec##n##_add(vec##n r, vec##n const a, vec##n const b) \
+/*
+ * SIMD kernels for the hot vec4, mat4x4 and quat routines, chosen at
+ * compile time. The public names pick the widest variant the build
+ * targets, the _scalar, _sse2 and _avx_fma variants stay callable for
+ * testing. SSE2 results match the scalar code bit for bit except for
+ * invert and quat_mul, FMA rounds once per multiply-add so it can
+ * differ in the last bit. quat_rotate and quat_from_mat4x4 are a sin
+ * and cos or a pivot search with no lanes to fill and stay scalar.
+ * Define LINMATH_NO_SIMD to build the scalar code only.
+ */
+#if !defined(LINMATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LINMATH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(LINMATH_SSE2) && defined(__AVX__) && defined(__FMA__)
+#define LINMATH_AVX_FMA
+#include <immintrin.h>
+#endif
+
+#define LINMATH_SHUFFLE(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+
+/* The element-wise ops, suffix picks the names so vec4 can keep these as its _scalar forms */
+#define LINMATH_H_DEFINE_VEC_OPS(n, suffix) \
+static inline void vec##n##_add##suffix(vec##n r, vec##n const a, vec##n const b) \
 { \
     int i; \
     for(i=0; i<n; ++i) \
         r[i] = a[i] + b[i]; \
 } \
-static inline void vec##n##_sub(vec##n r, vec##n const a, vec##n const b) \
+static inline void vec##n##_sub##suffix(vec##n r, vec##n const a, vec##n const b) \
 { \
     int i; \
     for(i=0; i<n; ++i) \
         r[i] = a[i] - b[i]; \
 } \
-static inline void vec##n##_scale(vec##n r, vec##n const v, float const s) \
+static inline void vec##n##_scale##suffix(vec##n r, vec##n const v, float const s) \
 { \
     int i; \
     for(i=0; i<n; ++i) \
         r[i] = v[i] * s; \
 } \
-static inline float vec##n##_mul_inner(vec##n const a, vec##n const b) \
+static inline float vec##n##_mul_inner##suffix(vec##n const a, vec##n const b) \
 { \
     float p = 0.; \
     int i; \
@@ -31,33 +53,125 @@ static inline float vec##n##_mul_inner(vec##n const a, vec##n const b) \
         p += b[i]*a[i]; \
     return p; \
 } \
-static inline float vec##n##_len(vec##n const v) \
-{ \
-    return sqrtf(vec##n##_mul_inner(v,v)); \
-} \
-static inline void vec##n##_norm(vec##n r, vec##n const v) \
-{ \
-    float k = 1.0 / vec##n##_len(v); \
-    vec##n##_scale(r, v, k); \
-} \
-static inline void vec##n##_min(vec##n r, vec##n a, vec##n b) \
+static inline void vec##n##_min##suffix(vec##n r, vec##n a, vec##n b) \
 { \
     int i; \
     for(i=0; i<n; ++i) \
         r[i] = a[i]<b[i] ? a[i] : b[i]; \
 } \
-static inline void vec##n##_max(vec##n r, vec##n a, vec##n b) \
+static inline void vec##n##_max##suffix(vec##n r, vec##n a, vec##n b) \
 { \
     int i; \
     for(i=0; i<n; ++i) \
         r[i] = a[i]>b[i] ? a[i] : b[i]; \
 }
 
+#define LINMATH_H_DEFINE_VEC_LEN(n) \
+static inline float vec##n##_len(vec##n const v) \
+{ \
+    return sqrtf(vec##n##_mul_inner(v,v)); \
+} \
+static inline void vec##n##_norm(vec##n r, vec##n const v) \
+{ \
+    float k = 1.0 / vec##n##_len(v); \
+    vec##n##_scale(r, v, k); \
+}
+
+#define LINMATH_H_DEFINE_VEC(n) \
+typedef float vec##n[n]; \
+LINMATH_H_DEFINE_VEC_OPS(n, ) \
+LINMATH_H_DEFINE_VEC_LEN(n)
+
 LINMATH_H_DEFINE_VEC(2)
 
 LINMATH_H_DEFINE_VEC(3)
 
-LINMATH_H_DEFINE_VEC(4)
+typedef float vec4[4];
+
+LINMATH_H_DEFINE_VEC_OPS(4, _scalar)
+
+#ifdef LINMATH_SSE2
+static inline void vec4_add_sse2(vec4 r, vec4 const a, vec4 const b) {
+	_mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+}
+
+static inline void vec4_sub_sse2(vec4 r, vec4 const a, vec4 const b) {
+	_mm_storeu_ps(r, _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+}
+
+static inline void vec4_scale_sse2(vec4 r, vec4 const v, float const s) {
+	_mm_storeu_ps(r, _mm_mul_ps(_mm_loadu_ps(v), _mm_set1_ps(s)));
+}
+
+/* Lanes are summed 0 to 3 like the scalar loop, a pairwise sum would round differently */
+static inline float vec4_mul_inner_sse2(vec4 const a, vec4 const b) {
+	__m128 t = _mm_mul_ps(_mm_loadu_ps(b), _mm_loadu_ps(a));
+	__m128 p = _mm_add_ss(_mm_setzero_ps(), t); /* 0 + -0 is +0 in the scalar loop too */
+	p = _mm_add_ss(p, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(1, 1, 1, 1)));
+	p = _mm_add_ss(p, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(2, 2, 2, 2)));
+	p = _mm_add_ss(p, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(3, 3, 3, 3)));
+	return _mm_cvtss_f32(p);
+}
+
+/* minps and maxps return b when the compare fails, NaNs included, same as the ternaries */
+static inline void vec4_min_sse2(vec4 r, vec4 a, vec4 b) {
+	_mm_storeu_ps(r, _mm_min_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+}
+
+static inline void vec4_max_sse2(vec4 r, vec4 a, vec4 b) {
+	_mm_storeu_ps(r, _mm_max_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+}
+#endif
+
+static inline void vec4_add(vec4 r, vec4 const a, vec4 const b) {
+#ifdef LINMATH_SSE2
+	vec4_add_sse2(r, a, b);
+#else
+	vec4_add_scalar(r, a, b);
+#endif
+}
+
+static inline void vec4_sub(vec4 r, vec4 const a, vec4 const b) {
+#ifdef LINMATH_SSE2
+	vec4_sub_sse2(r, a, b);
+#else
+	vec4_sub_scalar(r, a, b);
+#endif
+}
+
+static inline void vec4_scale(vec4 r, vec4 const v, float const s) {
+#ifdef LINMATH_SSE2
+	vec4_scale_sse2(r, v, s);
+#else
+	vec4_scale_scalar(r, v, s);
+#endif
+}
+
+static inline float vec4_mul_inner(vec4 const a, vec4 const b) {
+#ifdef LINMATH_SSE2
+	return vec4_mul_inner_sse2(a, b);
+#else
+	return vec4_mul_inner_scalar(a, b);
+#endif
+}
+
+static inline void vec4_min(vec4 r, vec4 a, vec4 b) {
+#ifdef LINMATH_SSE2
+	vec4_min_sse2(r, a, b);
+#else
+	vec4_min_scalar(r, a, b);
+#endif
+}
+
+static inline void vec4_max(vec4 r, vec4 a, vec4 b) {
+#ifdef LINMATH_SSE2
+	vec4_max_sse2(r, a, b);
+#else
+	vec4_max_scalar(r, a, b);
+#endif
+}
+
+LINMATH_H_DEFINE_VEC_LEN(4)
 
 static inline void vec3_mul_cross(vec3 r, vec3 const a, vec3 const b) {
 	r[0] = a[1] * b[2] - a[2] * b[1];
@@ -114,29 +228,64 @@ static inline void mat4x4_col(vec4 r, mat4x4 M, int i) {
 		r[k] = M[i][k];
 }
 
-static inline void mat4x4_transpose(mat4x4 M, mat4x4 N) {
+static inline void mat4x4_transpose_scalar(mat4x4 M, mat4x4 N) {
 	int i, j;
 	for (j = 0; j < 4; ++j)
 		for (i = 0; i < 4; ++i)
 			M[i][j] = N[j][i];
 }
 
+#ifdef LINMATH_SSE2
+/* Also safe in place, unlike the scalar loop */
+static inline void mat4x4_transpose_sse2(mat4x4 M, mat4x4 N) {
+	__m128 c0 = _mm_loadu_ps(N[0]);
+	__m128 c1 = _mm_loadu_ps(N[1]);
+	__m128 c2 = _mm_loadu_ps(N[2]);
+	__m128 c3 = _mm_loadu_ps(N[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(M[0], c0);
+	_mm_storeu_ps(M[1], c1);
+	_mm_storeu_ps(M[2], c2);
+	_mm_storeu_ps(M[3], c3);
+}
+#endif
+
+static inline void mat4x4_transpose(mat4x4 M, mat4x4 N) {
+#ifdef LINMATH_SSE2
+	mat4x4_transpose_sse2(M, N);
+#else
+	mat4x4_transpose_scalar(M, N);
+#endif
+}
+
 static inline void mat4x4_add(mat4x4 M, mat4x4 a, mat4x4 b) {
 	int i;
 	for (i = 0; i < 4; ++i)
+#ifdef LINMATH_SSE2
+		_mm_storeu_ps(M[i], _mm_add_ps(_mm_loadu_ps(a[i]), _mm_loadu_ps(b[i])));
+#else
 		vec4_add(M[i], a[i], b[i]);
+#endif
 }
 
 static inline void mat4x4_sub(mat4x4 M, mat4x4 a, mat4x4 b) {
 	int i;
 	for (i = 0; i < 4; ++i)
+#ifdef LINMATH_SSE2
+		_mm_storeu_ps(M[i], _mm_sub_ps(_mm_loadu_ps(a[i]), _mm_loadu_ps(b[i])));
+#else
 		vec4_sub(M[i], a[i], b[i]);
+#endif
 }
 
 static inline void mat4x4_scale(mat4x4 M, mat4x4 a, float k) {
 	int i;
 	for (i = 0; i < 4; ++i)
+#ifdef LINMATH_SSE2
+		_mm_storeu_ps(M[i], _mm_mul_ps(_mm_loadu_ps(a[i]), _mm_set1_ps(k)));
+#else
 		vec4_scale(M[i], a[i], k);
+#endif
 }
 
 static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, float z) {
@@ -149,7 +298,7 @@ static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, floa
 	}
 }
 
-static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b) {
+static inline void mat4x4_mul_scalar(mat4x4 M, mat4x4 a, mat4x4 b) {
 	mat4x4 temp;
 	int k, r, c;
 	for (c = 0; c < 4; ++c)
@@ -161,7 +310,61 @@ static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b) {
 	mat4x4_dup(M, temp);
 }
 
-static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v) {
+#ifdef LINMATH_SSE2
+/* Column c of M is a weighted by column c of b. All of a is loaded first so M may alias a or b */
+static inline void mat4x4_mul_sse2(mat4x4 M, mat4x4 a, mat4x4 b) {
+	__m128 a0 = _mm_loadu_ps(a[0]);
+	__m128 a1 = _mm_loadu_ps(a[1]);
+	__m128 a2 = _mm_loadu_ps(a[2]);
+	__m128 a3 = _mm_loadu_ps(a[3]);
+	int c;
+	for (c = 0; c < 4; ++c) {
+		__m128 col = _mm_loadu_ps(b[c]);
+		__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(2, 2, 2, 2))));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(M[c], r);
+	}
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+/* vbroadcastf128 wants a 16 byte aligned __m128, a row is only float aligned */
+static inline __m256 linmath_broadcast_row_avx(const float *row) {
+	__m128 v = _mm_loadu_ps(row);
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(v), v, 1);
+}
+
+/* Two columns of b per 256 bit register, a is broadcast to both halves */
+static inline void mat4x4_mul_avx_fma(mat4x4 M, mat4x4 a, mat4x4 b) {
+	__m256 a0 = linmath_broadcast_row_avx(a[0]);
+	__m256 a1 = linmath_broadcast_row_avx(a[1]);
+	__m256 a2 = linmath_broadcast_row_avx(a[2]);
+	__m256 a3 = linmath_broadcast_row_avx(a[3]);
+	int c;
+	for (c = 0; c < 4; c += 2) {
+		__m256 cols = _mm256_loadu_ps(b[c]);
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(cols, LINMATH_SHUFFLE(0, 0, 0, 0)));
+		r = _mm256_fmadd_ps(a1, _mm256_permute_ps(cols, LINMATH_SHUFFLE(1, 1, 1, 1)), r);
+		r = _mm256_fmadd_ps(a2, _mm256_permute_ps(cols, LINMATH_SHUFFLE(2, 2, 2, 2)), r);
+		r = _mm256_fmadd_ps(a3, _mm256_permute_ps(cols, LINMATH_SHUFFLE(3, 3, 3, 3)), r);
+		_mm256_storeu_ps(M[c], r);
+	}
+}
+#endif
+
+static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b) {
+#if defined(LINMATH_AVX_FMA)
+	mat4x4_mul_avx_fma(M, a, b);
+#elif defined(LINMATH_SSE2)
+	mat4x4_mul_sse2(M, a, b);
+#else
+	mat4x4_mul_scalar(M, a, b);
+#endif
+}
+
+static inline void mat4x4_mul_vec4_scalar(vec4 r, mat4x4 M, vec4 v) {
 	int i, j;
 	for (j = 0; j < 4; ++j) {
 		r[j] = 0.f;
@@ -170,6 +373,38 @@ static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v) {
 	}
 }
 
+#ifdef LINMATH_SSE2
+static inline void mat4x4_mul_vec4_sse2(vec4 r, mat4x4 M, vec4 v) {
+	__m128 x = _mm_loadu_ps(v);
+	__m128 t = _mm_mul_ps(_mm_loadu_ps(M[0]), _mm_shuffle_ps(x, x, LINMATH_SHUFFLE(0, 0, 0, 0)));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(M[1]), _mm_shuffle_ps(x, x, LINMATH_SHUFFLE(1, 1, 1, 1))));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(M[2]), _mm_shuffle_ps(x, x, LINMATH_SHUFFLE(2, 2, 2, 2))));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(M[3]), _mm_shuffle_ps(x, x, LINMATH_SHUFFLE(3, 3, 3, 3))));
+	_mm_storeu_ps(r, t);
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+static inline void mat4x4_mul_vec4_avx_fma(vec4 r, mat4x4 M, vec4 v) {
+	__m128 x = _mm_loadu_ps(v);
+	__m128 t = _mm_mul_ps(_mm_loadu_ps(M[0]), _mm_permute_ps(x, LINMATH_SHUFFLE(0, 0, 0, 0)));
+	t = _mm_fmadd_ps(_mm_loadu_ps(M[1]), _mm_permute_ps(x, LINMATH_SHUFFLE(1, 1, 1, 1)), t);
+	t = _mm_fmadd_ps(_mm_loadu_ps(M[2]), _mm_permute_ps(x, LINMATH_SHUFFLE(2, 2, 2, 2)), t);
+	t = _mm_fmadd_ps(_mm_loadu_ps(M[3]), _mm_permute_ps(x, LINMATH_SHUFFLE(3, 3, 3, 3)), t);
+	_mm_storeu_ps(r, t);
+}
+#endif
+
+static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v) {
+#if defined(LINMATH_AVX_FMA)
+	mat4x4_mul_vec4_avx_fma(r, M, v);
+#elif defined(LINMATH_SSE2)
+	mat4x4_mul_vec4_sse2(r, M, v);
+#else
+	mat4x4_mul_vec4_scalar(r, M, v);
+#endif
+}
+
 static inline void mat4x4_translate(mat4x4 T, float x, float y, float z) {
 	mat4x4_identity(T);
 	T[3][0] = x;
@@ -264,7 +499,7 @@ static inline void mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle) {
 	mat4x4_mul(Q, M, R);
 }
 
-static inline void mat4x4_invert(mat4x4 T, mat4x4 M) {
+static inline void mat4x4_invert_scalar(mat4x4 T, mat4x4 M) {
 	float s[6];
 	float c[6];
 	s[0] = M[0][0] * M[1][1] - M[1][0] * M[0][1];
@@ -305,6 +540,196 @@ static inline void mat4x4_invert(mat4x4 T, mat4x4 M) {
 	T[3][3] = (M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
 }
 
+#ifdef LINMATH_SSE2
+/*
+ * Blockwise inverse over 2x2 sub-matrices, |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+ * where # is the adjugate. Works on columns as if they were rows, which
+ * gives the transpose of the inverse of the transpose, i.e. the inverse.
+ */
+static inline __m128 linmath_mat2_mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(0, 3, 0, 3))),
+					  _mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(1, 0, 3, 2)),
+								 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(2, 1, 2, 1))));
+}
+
+static inline __m128 linmath_mat2_adj_mul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(3, 3, 0, 0)), b),
+					  _mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(1, 1, 2, 2)),
+								 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(2, 3, 0, 1))));
+}
+
+static inline __m128 linmath_mat2_mul_adj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(3, 0, 3, 0))),
+					  _mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(1, 0, 3, 2)),
+								 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(2, 1, 2, 1))));
+}
+
+static inline void mat4x4_invert_sse2(mat4x4 T, mat4x4 M) {
+	__m128 m0 = _mm_loadu_ps(M[0]);
+	__m128 m1 = _mm_loadu_ps(M[1]);
+	__m128 m2 = _mm_loadu_ps(M[2]);
+	__m128 m3 = _mm_loadu_ps(M[3]);
+
+	__m128 a = _mm_movelh_ps(m0, m1);
+	__m128 b = _mm_movehl_ps(m1, m0);
+	__m128 c = _mm_movelh_ps(m2, m3);
+	__m128 d = _mm_movehl_ps(m3, m2);
+
+	/* |A| |B| |C| |D| */
+	__m128 det_sub = _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(m0, m2, LINMATH_SHUFFLE(0, 2, 0, 2)), _mm_shuffle_ps(m1, m3, LINMATH_SHUFFLE(1, 3, 1, 3))),
+			_mm_mul_ps(_mm_shuffle_ps(m0, m2, LINMATH_SHUFFLE(1, 3, 1, 3)), _mm_shuffle_ps(m1, m3, LINMATH_SHUFFLE(0, 2, 0, 2))));
+	__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, LINMATH_SHUFFLE(0, 0, 0, 0));
+	__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, LINMATH_SHUFFLE(1, 1, 1, 1));
+	__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, LINMATH_SHUFFLE(2, 2, 2, 2));
+	__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, LINMATH_SHUFFLE(3, 3, 3, 3));
+
+	__m128 d_c = linmath_mat2_adj_mul(d, c);
+	__m128 a_b = linmath_mat2_adj_mul(a, b);
+	__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), linmath_mat2_mul(b, d_c));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), linmath_mat2_mul(c, a_b));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), linmath_mat2_mul_adj(d, a_b));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), linmath_mat2_mul_adj(a, d_c));
+
+	__m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	__m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, LINMATH_SHUFFLE(0, 2, 1, 3)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, LINMATH_SHUFFLE(2, 3, 0, 1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, LINMATH_SHUFFLE(1, 0, 3, 2)));
+	det = _mm_sub_ps(det, tr);
+
+	/* Assumes it is invertible, like the scalar code */
+	__m128 idet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+	x = _mm_mul_ps(x, idet);
+	y = _mm_mul_ps(y, idet);
+	z = _mm_mul_ps(z, idet);
+	w = _mm_mul_ps(w, idet);
+
+	_mm_storeu_ps(T[0], _mm_shuffle_ps(x, y, LINMATH_SHUFFLE(3, 1, 3, 1)));
+	_mm_storeu_ps(T[1], _mm_shuffle_ps(x, y, LINMATH_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(T[2], _mm_shuffle_ps(z, w, LINMATH_SHUFFLE(3, 1, 3, 1)));
+	_mm_storeu_ps(T[3], _mm_shuffle_ps(z, w, LINMATH_SHUFFLE(2, 0, 2, 0)));
+}
+#endif
+
+static inline void mat4x4_invert(mat4x4 T, mat4x4 M) {
+#ifdef LINMATH_SSE2
+	mat4x4_invert_sse2(T, M);
+#else
+	mat4x4_invert_scalar(T, M);
+#endif
+}
+
+/*
+ * Structure aware inverses, much cheaper than the general one.
+ * Rigid: M is a rotation and a translation, e.g. mat4x4_look_at or an
+ * unscaled scene node, the inverse is the transposed rotation and the
+ * rotated, negated translation. Affine: any 3x3 plus a translation with
+ * a bottom row of 0 0 0 1, the 3x3 is inverted on its own. Neither
+ * checks the structure, pass anything else and the result is wrong.
+ */
+static inline void mat4x4_invert_rigid_scalar(mat4x4 T, mat4x4 M) {
+	float t[3] = { M[3][0], M[3][1], M[3][2] };
+	mat4x4 R;
+	int i, j;
+	for (i = 0; i < 3; ++i) {
+		for (j = 0; j < 3; ++j)
+			R[i][j] = M[j][i];
+		R[i][3] = 0.f;
+	}
+	for (i = 0; i < 3; ++i)
+		R[3][i] = -(R[0][i] * t[0] + R[1][i] * t[1] + R[2][i] * t[2]);
+	R[3][3] = 1.f;
+	mat4x4_dup(T, R);
+}
+
+static inline void mat4x4_invert_affine_scalar(mat4x4 T, mat4x4 M) {
+	float t[3] = { M[3][0], M[3][1], M[3][2] };
+	vec3 c[3];
+	float idet;
+	int i, j;
+	vec3_mul_cross(c[0], M[1], M[2]);
+	vec3_mul_cross(c[1], M[2], M[0]);
+	vec3_mul_cross(c[2], M[0], M[1]);
+	idet = 1.0f / vec3_mul_inner(M[0], c[0]);
+	/* Row i of the inverse is c[i] / det */
+	for (j = 0; j < 3; ++j) {
+		for (i = 0; i < 3; ++i)
+			T[j][i] = c[i][j] * idet;
+		T[j][3] = 0.f;
+	}
+	for (i = 0; i < 3; ++i)
+		T[3][i] = -(T[0][i] * t[0] + T[1][i] * t[1] + T[2][i] * t[2]);
+	T[3][3] = 1.f;
+}
+
+#ifdef LINMATH_SSE2
+static inline void mat4x4_invert_rigid_sse2(mat4x4 T, mat4x4 M) {
+	__m128 r0 = _mm_loadu_ps(M[0]);
+	__m128 r1 = _mm_loadu_ps(M[1]);
+	__m128 r2 = _mm_loadu_ps(M[2]);
+	__m128 t = _mm_loadu_ps(M[3]);
+	__m128 r3 = _mm_setzero_ps();
+	__m128 p;
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	p = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(0, 0, 0, 0)));
+	p = _mm_add_ps(p, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(1, 1, 1, 1))));
+	p = _mm_add_ps(p, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(2, 2, 2, 2))));
+	_mm_storeu_ps(T[0], r0);
+	_mm_storeu_ps(T[1], r1);
+	_mm_storeu_ps(T[2], r2);
+	_mm_storeu_ps(T[3], _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), p));
+}
+
+static inline __m128 linmath_cross_sse2(__m128 a, __m128 b) {
+	return _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(1, 2, 0, 3)), _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(2, 0, 1, 3))),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(2, 0, 1, 3)), _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(1, 2, 0, 3))));
+}
+
+static inline void mat4x4_invert_affine_sse2(mat4x4 T, mat4x4 M) {
+	const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 a = _mm_and_ps(_mm_loadu_ps(M[0]), xyz);
+	__m128 b = _mm_and_ps(_mm_loadu_ps(M[1]), xyz);
+	__m128 c = _mm_and_ps(_mm_loadu_ps(M[2]), xyz);
+	__m128 t = _mm_loadu_ps(M[3]);
+	__m128 r0 = linmath_cross_sse2(b, c);
+	__m128 r1 = linmath_cross_sse2(c, a);
+	__m128 r2 = linmath_cross_sse2(a, b);
+	__m128 r3 = _mm_setzero_ps();
+	__m128 det = _mm_mul_ps(a, r0), idet, p;
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, LINMATH_SHUFFLE(1, 0, 3, 2)));
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, LINMATH_SHUFFLE(2, 3, 0, 1)));
+	idet = _mm_div_ps(_mm_set1_ps(1.f), det);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	r0 = _mm_mul_ps(r0, idet);
+	r1 = _mm_mul_ps(r1, idet);
+	r2 = _mm_mul_ps(r2, idet);
+	p = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(0, 0, 0, 0)));
+	p = _mm_add_ps(p, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(1, 1, 1, 1))));
+	p = _mm_add_ps(p, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, LINMATH_SHUFFLE(2, 2, 2, 2))));
+	_mm_storeu_ps(T[0], r0);
+	_mm_storeu_ps(T[1], r1);
+	_mm_storeu_ps(T[2], r2);
+	_mm_storeu_ps(T[3], _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), p));
+}
+#endif
+
+static inline void mat4x4_invert_rigid(mat4x4 T, mat4x4 M) {
+#ifdef LINMATH_SSE2
+	mat4x4_invert_rigid_sse2(T, M);
+#else
+	mat4x4_invert_rigid_scalar(T, M);
+#endif
+}
+
+static inline void mat4x4_invert_affine(mat4x4 T, mat4x4 M) {
+#ifdef LINMATH_SSE2
+	mat4x4_invert_affine_sse2(T, M);
+#else
+	mat4x4_invert_affine_scalar(T, M);
+#endif
+}
+
 static inline void mat4x4_orthonormalize(mat4x4 R, mat4x4 M) {
 	mat4x4_dup(R, M);
 	float s = 1.;
@@ -434,19 +859,16 @@ static inline void quat_identity(quat q) {
 	q[3] = 1.f;
 }
 
+/* A quat is a vec4 to these, so they take the vec4 kernels */
 static inline void quat_add(quat r, quat a, quat b) {
-	int i;
-	for (i = 0; i < 4; ++i)
-		r[i] = a[i] + b[i];
+	vec4_add(r, a, b);
 }
 
 static inline void quat_sub(quat r, quat a, quat b) {
-	int i;
-	for (i = 0; i < 4; ++i)
-		r[i] = a[i] - b[i];
+	vec4_sub(r, a, b);
 }
 
-static inline void quat_mul(quat r, quat p, quat q) {
+static inline void quat_mul_scalar(quat r, quat p, quat q) {
 	vec3 w;
 	vec3_mul_cross(r, p, q);
 	vec3_scale(w, p, q[3]);
@@ -456,27 +878,64 @@ static inline void quat_mul(quat r, quat p, quat q) {
 	r[3] = p[3] * q[3] - vec3_mul_inner(p, q);
 }
 
+#ifdef LINMATH_SSE2
+/* Hamilton product as four broadcasts of p against sign flipped swizzles of q */
+static inline void quat_mul_sse2(quat r, quat p, quat q) {
+	const __m128 sign_x = _mm_setr_ps(1.f, -1.f, 1.f, -1.f);
+	const __m128 sign_y = _mm_setr_ps(1.f, 1.f, -1.f, -1.f);
+	const __m128 sign_z = _mm_setr_ps(-1.f, 1.f, 1.f, -1.f);
+	__m128 a = _mm_loadu_ps(p);
+	__m128 b = _mm_loadu_ps(q);
+	__m128 t = _mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(3, 3, 3, 3)), b);
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(0, 0, 0, 0)),
+											 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(3, 2, 1, 0))), sign_x));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(1, 1, 1, 1)),
+											 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(2, 3, 0, 1))), sign_y));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, LINMATH_SHUFFLE(2, 2, 2, 2)),
+											 _mm_shuffle_ps(b, b, LINMATH_SHUFFLE(1, 0, 3, 2))), sign_z));
+	_mm_storeu_ps(r, t);
+}
+#endif
+
+static inline void quat_mul(quat r, quat p, quat q) {
+#ifdef LINMATH_SSE2
+	quat_mul_sse2(r, p, q);
+#else
+	quat_mul_scalar(r, p, q);
+#endif
+}
+
 static inline void quat_scale(quat r, quat v, float s) {
-	int i;
-	for (i = 0; i < 4; ++i)
-		r[i] = v[i] * s;
+	vec4_scale(r, v, s);
 }
 
 static inline float quat_inner_product(quat a, quat b) {
-	float p = 0.f;
-	int i;
-	for (i = 0; i < 4; ++i)
-		p += b[i] * a[i];
-	return p;
+	return vec4_mul_inner(a, b);
 }
 
-static inline void quat_conj(quat r, quat q) {
+static inline void quat_conj_scalar(quat r, quat q) {
 	int i;
 	for (i = 0; i < 3; ++i)
 		r[i] = -q[i];
 	r[3] = q[3];
 }
 
+#ifdef LINMATH_SSE2
+/* Flips the sign bits of x, y and z, which is all negation does */
+static inline void quat_conj_sse2(quat r, quat q) {
+	const __m128 sign = _mm_setr_ps(-0.f, -0.f, -0.f, 0.f);
+	_mm_storeu_ps(r, _mm_xor_ps(_mm_loadu_ps(q), sign));
+}
+#endif
+
+static inline void quat_conj(quat r, quat q) {
+#ifdef LINMATH_SSE2
+	quat_conj_sse2(r, q);
+#else
+	quat_conj_scalar(r, q);
+#endif
+}
+
 static inline void quat_rotate(quat r, float angle, vec3 axis) {
 	vec3 v;
 	vec3_scale(v, axis, sinf(angle / 2));
@@ -488,7 +947,38 @@ static inline void quat_rotate(quat r, float angle, vec3 axis) {
 
 #define quat_norm vec4_norm
 
-static inline void quat_mul_vec3(vec3 r, quat q, vec3 v) {
+/* Normalized lerp along the shorter arc. Cheap, but the speed isn't constant over t */
+static inline void quat_nlerp(quat r, quat a, quat b, float t) {
+	float tb = quat_inner_product(a, b) < 0.f ? -t : t;
+	float len;
+	int i;
+	for (i = 0; i < 4; ++i)
+		r[i] = a[i] * (1.f - t) + b[i] * tb;
+	len = sqrtf(quat_inner_product(r, r));
+	for (i = 0; i < 4; ++i)
+		r[i] /= len;
+}
+
+/* Constant speed along the shorter arc, falls back to nlerp where sin(angle) gets small */
+static inline void quat_slerp(quat r, quat a, quat b, float t) {
+	float c = quat_inner_product(a, b);
+	float sign = c < 0.f ? -1.f : 1.f;
+	float angle, s, wa, wb;
+	int i;
+	c *= sign;
+	if (c > 0.9995f) {
+		quat_nlerp(r, a, b, t);
+		return;
+	}
+	angle = acosf(c);
+	s = sinf(angle);
+	wa = sinf((1.f - t) * angle) / s;
+	wb = sinf(t * angle) / s * sign;
+	for (i = 0; i < 4; ++i)
+		r[i] = a[i] * wa + b[i] * wb;
+}
+
+static inline void quat_mul_vec3_scalar(vec3 r, quat q, vec3 v) {
 /*
  * Method by Fabian 'ryg' Giessen (of Farbrausch)
 t = 2 * cross(q.xyz, v)
@@ -508,6 +998,33 @@ v' = v + q.w * t + cross(q.xyz, t)
 	vec3_add(r, r, u);
 }
 
+#ifdef LINMATH_SSE2
+/* Same steps as the scalar code a lane each, the cross products leave w at 0. vec3 is
+ * only three floats, so v is gathered and r written without touching a fourth */
+static inline void quat_mul_vec3_sse2(vec3 r, quat q, vec3 v) {
+	__m128 a = _mm_loadu_ps(q);
+	__m128 x = _mm_setr_ps(v[0], v[1], v[2], 0.f);
+	__m128 t = linmath_cross_sse2(a, x);
+	__m128 u;
+	float out[4];
+	t = _mm_mul_ps(t, _mm_set1_ps(2.f));
+	u = linmath_cross_sse2(a, t);
+	t = _mm_mul_ps(t, _mm_shuffle_ps(a, a, LINMATH_SHUFFLE(3, 3, 3, 3)));
+	_mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(x, t), u));
+	r[0] = out[0];
+	r[1] = out[1];
+	r[2] = out[2];
+}
+#endif
+
+static inline void quat_mul_vec3(vec3 r, quat q, vec3 v) {
+#ifdef LINMATH_SSE2
+	quat_mul_vec3_sse2(r, q, v);
+#else
+	quat_mul_vec3_scalar(r, q, v);
+#endif
+}
+
 static inline void mat4x4_from_quat(mat4x4 M, quat q) {
 	float a = q[3];
 	float b = q[0];
@@ -0,0 +1,1023 @@
+#ifndef LINMATH_BATCH_H
+#define LINMATH_BATCH_H
+
+#include <stddef.h>
+
+#include "linmath.h"
+
+/*
+ * Batched transforms over structure of arrays streams. Each component
+ * is its own float array, so one SIMD register holds the same component
+ * of 4 (SSE2) or 8 (AVX) elements and a whole batch is a handful of
+ * broadcast matrix entries times loads, with no shuffles. Any count
+ * works, the elements past the last full register go through the
+ * scalar code. Streams need no alignment and r may be the same
+ * streams as v.
+ *
+ * Like linmath.h the public names pick the widest variant the build
+ * targets and the _scalar, _sse2 and _avx_fma variants stay callable.
+ */
+
+typedef struct {
+	float *x;
+	float *y;
+	float *z;
+} vec3_soa;
+
+typedef struct {
+	float *x;
+	float *y;
+	float *z;
+	float *w;
+} vec4_soa;
+
+/*
+ * Points, w = 1. The affine form drops the resulting w, the vec4 form
+ * keeps it, e.g. for clip space positions.
+ */
+static inline void vec3_soa_transform_points_range(vec3_soa r, mat4x4 M, vec3_soa v, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float x = v.x[i], y = v.y[i], z = v.z[i];
+		r.x[i] = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
+		r.y[i] = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
+		r.z[i] = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
+	}
+}
+
+static inline void vec4_soa_transform_points_range(vec4_soa r, mat4x4 M, vec3_soa v, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float x = v.x[i], y = v.y[i], z = v.z[i];
+		r.x[i] = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
+		r.y[i] = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
+		r.z[i] = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
+		r.w[i] = M[0][3] * x + M[1][3] * y + M[2][3] * z + M[3][3];
+	}
+}
+
+/* Directions, w = 0, so only the upper 3x3 applies. The _range forms do [begin, n) */
+static inline void vec3_soa_transform_dirs_range(vec3_soa r, mat4x4 M, vec3_soa v, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float x = v.x[i], y = v.y[i], z = v.z[i];
+		r.x[i] = M[0][0] * x + M[1][0] * y + M[2][0] * z;
+		r.y[i] = M[0][1] * x + M[1][1] * y + M[2][1] * z;
+		r.z[i] = M[0][2] * x + M[1][2] * y + M[2][2] * z;
+	}
+}
+
+static inline void vec3_soa_transform_points_scalar(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	vec3_soa_transform_points_range(r, M, v, 0, n);
+}
+
+static inline void vec4_soa_transform_points_scalar(vec4_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	vec4_soa_transform_points_range(r, M, v, 0, n);
+}
+
+static inline void vec3_soa_transform_dirs_scalar(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	vec3_soa_transform_dirs_range(r, M, v, 0, n);
+}
+
+#ifdef LINMATH_SSE2
+#define LINMATH_SOA_ROW_SSE2(m, j, x, y, z) \
+	_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][j], x), _mm_mul_ps(m[1][j], y)), _mm_mul_ps(m[2][j], z)), m[3][j])
+
+static inline void vec3_soa_transform_points_sse2(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m128 m[4][4];
+	size_t i, j, k;
+	for (j = 0; j < 4; ++j)
+		for (k = 0; k < 4; ++k)
+			m[j][k] = _mm_set1_ps(M[j][k]);
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(v.x + i), y = _mm_loadu_ps(v.y + i), z = _mm_loadu_ps(v.z + i);
+		_mm_storeu_ps(r.x + i, LINMATH_SOA_ROW_SSE2(m, 0, x, y, z));
+		_mm_storeu_ps(r.y + i, LINMATH_SOA_ROW_SSE2(m, 1, x, y, z));
+		_mm_storeu_ps(r.z + i, LINMATH_SOA_ROW_SSE2(m, 2, x, y, z));
+	}
+	vec3_soa_transform_points_range(r, M, v, i, n);
+}
+
+static inline void vec4_soa_transform_points_sse2(vec4_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m128 m[4][4];
+	size_t i, j, k;
+	for (j = 0; j < 4; ++j)
+		for (k = 0; k < 4; ++k)
+			m[j][k] = _mm_set1_ps(M[j][k]);
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(v.x + i), y = _mm_loadu_ps(v.y + i), z = _mm_loadu_ps(v.z + i);
+		_mm_storeu_ps(r.x + i, LINMATH_SOA_ROW_SSE2(m, 0, x, y, z));
+		_mm_storeu_ps(r.y + i, LINMATH_SOA_ROW_SSE2(m, 1, x, y, z));
+		_mm_storeu_ps(r.z + i, LINMATH_SOA_ROW_SSE2(m, 2, x, y, z));
+		_mm_storeu_ps(r.w + i, LINMATH_SOA_ROW_SSE2(m, 3, x, y, z));
+	}
+	vec4_soa_transform_points_range(r, M, v, n & ~(size_t) 3, n);
+}
+
+static inline void vec3_soa_transform_dirs_sse2(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m128 m[3][3];
+	size_t i, j, k;
+	for (j = 0; j < 3; ++j)
+		for (k = 0; k < 3; ++k)
+			m[j][k] = _mm_set1_ps(M[j][k]);
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(v.x + i), y = _mm_loadu_ps(v.y + i), z = _mm_loadu_ps(v.z + i);
+		_mm_storeu_ps(r.x + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], x), _mm_mul_ps(m[1][0], y)), _mm_mul_ps(m[2][0], z)));
+		_mm_storeu_ps(r.y + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][1], x), _mm_mul_ps(m[1][1], y)), _mm_mul_ps(m[2][1], z)));
+		_mm_storeu_ps(r.z + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][2], x), _mm_mul_ps(m[1][2], y)), _mm_mul_ps(m[2][2], z)));
+	}
+	vec3_soa_transform_dirs_range(r, M, v, i, n);
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+#define LINMATH_SOA_ROW_AVX_FMA(m, j, x, y, z) \
+	_mm256_fmadd_ps(m[2][j], z, _mm256_fmadd_ps(m[1][j], y, _mm256_fmadd_ps(m[0][j], x, m[3][j])))
+
+static inline void vec3_soa_transform_points_avx_fma(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m256 m[4][4];
+	size_t i, j, k;
+	for (j = 0; j < 4; ++j)
+		for (k = 0; k < 4; ++k)
+			m[j][k] = _mm256_set1_ps(M[j][k]);
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v.x + i), y = _mm256_loadu_ps(v.y + i), z = _mm256_loadu_ps(v.z + i);
+		_mm256_storeu_ps(r.x + i, LINMATH_SOA_ROW_AVX_FMA(m, 0, x, y, z));
+		_mm256_storeu_ps(r.y + i, LINMATH_SOA_ROW_AVX_FMA(m, 1, x, y, z));
+		_mm256_storeu_ps(r.z + i, LINMATH_SOA_ROW_AVX_FMA(m, 2, x, y, z));
+	}
+	vec3_soa_transform_points_range(r, M, v, i, n);
+}
+
+static inline void vec4_soa_transform_points_avx_fma(vec4_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m256 m[4][4];
+	size_t i, j, k;
+	for (j = 0; j < 4; ++j)
+		for (k = 0; k < 4; ++k)
+			m[j][k] = _mm256_set1_ps(M[j][k]);
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v.x + i), y = _mm256_loadu_ps(v.y + i), z = _mm256_loadu_ps(v.z + i);
+		_mm256_storeu_ps(r.x + i, LINMATH_SOA_ROW_AVX_FMA(m, 0, x, y, z));
+		_mm256_storeu_ps(r.y + i, LINMATH_SOA_ROW_AVX_FMA(m, 1, x, y, z));
+		_mm256_storeu_ps(r.z + i, LINMATH_SOA_ROW_AVX_FMA(m, 2, x, y, z));
+		_mm256_storeu_ps(r.w + i, LINMATH_SOA_ROW_AVX_FMA(m, 3, x, y, z));
+	}
+	vec4_soa_transform_points_range(r, M, v, n & ~(size_t) 7, n);
+}
+
+static inline void vec3_soa_transform_dirs_avx_fma(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+	__m256 m[3][3];
+	size_t i, j, k;
+	for (j = 0; j < 3; ++j)
+		for (k = 0; k < 3; ++k)
+			m[j][k] = _mm256_set1_ps(M[j][k]);
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v.x + i), y = _mm256_loadu_ps(v.y + i), z = _mm256_loadu_ps(v.z + i);
+		_mm256_storeu_ps(r.x + i, _mm256_fmadd_ps(m[2][0], z, _mm256_fmadd_ps(m[1][0], y, _mm256_mul_ps(m[0][0], x))));
+		_mm256_storeu_ps(r.y + i, _mm256_fmadd_ps(m[2][1], z, _mm256_fmadd_ps(m[1][1], y, _mm256_mul_ps(m[0][1], x))));
+		_mm256_storeu_ps(r.z + i, _mm256_fmadd_ps(m[2][2], z, _mm256_fmadd_ps(m[1][2], y, _mm256_mul_ps(m[0][2], x))));
+	}
+	vec3_soa_transform_dirs_range(r, M, v, i, n);
+}
+#endif
+
+static inline void vec3_soa_transform_points(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	vec3_soa_transform_points_avx_fma(r, M, v, n);
+#elif defined(LINMATH_SSE2)
+	vec3_soa_transform_points_sse2(r, M, v, n);
+#else
+	vec3_soa_transform_points_scalar(r, M, v, n);
+#endif
+}
+
+static inline void vec4_soa_transform_points(vec4_soa r, mat4x4 M, vec3_soa v, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	vec4_soa_transform_points_avx_fma(r, M, v, n);
+#elif defined(LINMATH_SSE2)
+	vec4_soa_transform_points_sse2(r, M, v, n);
+#else
+	vec4_soa_transform_points_scalar(r, M, v, n);
+#endif
+}
+
+static inline void vec3_soa_transform_dirs(vec3_soa r, mat4x4 M, vec3_soa v, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	vec3_soa_transform_dirs_avx_fma(r, M, v, n);
+#elif defined(LINMATH_SSE2)
+	vec3_soa_transform_dirs_sse2(r, M, v, n);
+#else
+	vec3_soa_transform_dirs_scalar(r, M, v, n);
+#endif
+}
+
+static inline void mat4x4_mul_batch_scalar(mat4x4 *R, mat4x4 a, mat4x4 *b, size_t n) {
+	size_t i;
+	for (i = 0; i < n; ++i)
+		mat4x4_mul_scalar(R[i], a, b[i]);
+}
+
+#ifdef LINMATH_SSE2
+static inline void mat4x4_mul_batch_sse2(mat4x4 *R, mat4x4 a, mat4x4 *b, size_t n) {
+	__m128 a0 = _mm_loadu_ps(a[0]);
+	__m128 a1 = _mm_loadu_ps(a[1]);
+	__m128 a2 = _mm_loadu_ps(a[2]);
+	__m128 a3 = _mm_loadu_ps(a[3]);
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		int c;
+		for (c = 0; c < 4; ++c) {
+			__m128 col = _mm_loadu_ps(b[i][c]);
+			__m128 t = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(0, 0, 0, 0)));
+			t = _mm_add_ps(t, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(1, 1, 1, 1))));
+			t = _mm_add_ps(t, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(2, 2, 2, 2))));
+			t = _mm_add_ps(t, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, LINMATH_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(R[i][c], t);
+		}
+	}
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+static inline void mat4x4_mul_batch_avx_fma(mat4x4 *R, mat4x4 a, mat4x4 *b, size_t n) {
+	__m256 a0 = linmath_broadcast_row_avx(a[0]);
+	__m256 a1 = linmath_broadcast_row_avx(a[1]);
+	__m256 a2 = linmath_broadcast_row_avx(a[2]);
+	__m256 a3 = linmath_broadcast_row_avx(a[3]);
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		int c;
+		for (c = 0; c < 4; c += 2) {
+			__m256 cols = _mm256_loadu_ps(b[i][c]);
+			__m256 t = _mm256_mul_ps(a0, _mm256_permute_ps(cols, LINMATH_SHUFFLE(0, 0, 0, 0)));
+			t = _mm256_fmadd_ps(a1, _mm256_permute_ps(cols, LINMATH_SHUFFLE(1, 1, 1, 1)), t);
+			t = _mm256_fmadd_ps(a2, _mm256_permute_ps(cols, LINMATH_SHUFFLE(2, 2, 2, 2)), t);
+			t = _mm256_fmadd_ps(a3, _mm256_permute_ps(cols, LINMATH_SHUFFLE(3, 3, 3, 3)), t);
+			_mm256_storeu_ps(R[i][c], t);
+		}
+	}
+}
+#endif
+
+/*
+ * R[i] = a * b[i], e.g. n model matrices against one view projection.
+ * a is read once, so R may alias b but not a.
+ */
+static inline void mat4x4_mul_batch(mat4x4 *R, mat4x4 a, mat4x4 *b, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	mat4x4_mul_batch_avx_fma(R, a, b, n);
+#elif defined(LINMATH_SSE2)
+	mat4x4_mul_batch_sse2(R, a, b, n);
+#else
+	mat4x4_mul_batch_scalar(R, a, b, n);
+#endif
+}
+
+/* T[i] = inverse of rigid M[i], see mat4x4_invert_rigid. T may alias M */
+static inline void mat4x4_invert_rigid_batch(mat4x4 *T, mat4x4 *M, size_t n) {
+	size_t i;
+	for (i = 0; i < n; ++i)
+		mat4x4_invert_rigid(T[i], M[i]);
+}
+
+static inline void mat4x4_invert_affine_batch_scalar(mat4x4 *T, mat4x4 *M, size_t n) {
+	size_t i;
+	for (i = 0; i < n; ++i)
+		mat4x4_invert_affine_scalar(T[i], M[i]);
+}
+
+#ifdef LINMATH_SSE2
+/*
+ * Four matrices at a time, transposed so that each register holds one
+ * element of all four. The 3x3 cofactors are then plain lane-wise
+ * math with no shuffles, and one divide covers four determinants.
+ */
+static inline void mat4x4_invert_affine_batch_sse2(mat4x4 *T, mat4x4 *M, size_t n) {
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 e[4][4], c[3][3], idet, r3;
+		int j, k;
+		for (j = 0; j < 4; ++j) {
+			e[j][0] = _mm_loadu_ps(M[i][j]);
+			e[j][1] = _mm_loadu_ps(M[i + 1][j]);
+			e[j][2] = _mm_loadu_ps(M[i + 2][j]);
+			e[j][3] = _mm_loadu_ps(M[i + 3][j]);
+			_MM_TRANSPOSE4_PS(e[j][0], e[j][1], e[j][2], e[j][3]);
+		}
+		/* c[k] = cross of the other two columns, row k of the inverse times det */
+		for (k = 0; k < 3; ++k) {
+			int a = (k + 1) % 3, b = (k + 2) % 3;
+			c[k][0] = _mm_sub_ps(_mm_mul_ps(e[a][1], e[b][2]), _mm_mul_ps(e[a][2], e[b][1]));
+			c[k][1] = _mm_sub_ps(_mm_mul_ps(e[a][2], e[b][0]), _mm_mul_ps(e[a][0], e[b][2]));
+			c[k][2] = _mm_sub_ps(_mm_mul_ps(e[a][0], e[b][1]), _mm_mul_ps(e[a][1], e[b][0]));
+		}
+		idet = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0][0], c[0][0]), _mm_mul_ps(e[0][1], c[0][1])),
+						  _mm_mul_ps(e[0][2], c[0][2]));
+		idet = _mm_div_ps(_mm_set1_ps(1.f), idet);
+		for (j = 0; j < 3; ++j) {
+			__m128 t0 = _mm_mul_ps(c[0][j], idet);
+			__m128 t1 = _mm_mul_ps(c[1][j], idet);
+			__m128 t2 = _mm_mul_ps(c[2][j], idet);
+			r3 = _mm_setzero_ps();
+			/* Column j of the inverse is (c[0][j], c[1][j], c[2][j]), back to one matrix per register */
+			c[0][j] = t0;
+			c[1][j] = t1;
+			c[2][j] = t2;
+			_MM_TRANSPOSE4_PS(t0, t1, t2, r3);
+			_mm_storeu_ps(T[i][j], t0);
+			_mm_storeu_ps(T[i + 1][j], t1);
+			_mm_storeu_ps(T[i + 2][j], t2);
+			_mm_storeu_ps(T[i + 3][j], r3);
+		}
+		{
+			__m128 t[4];
+			for (k = 0; k < 3; ++k)
+				t[k] = _mm_sub_ps(_mm_setzero_ps(),
+								  _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[k][0], e[3][0]), _mm_mul_ps(c[k][1], e[3][1])),
+											 _mm_mul_ps(c[k][2], e[3][2])));
+			t[3] = _mm_set1_ps(1.f);
+			_MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+			_mm_storeu_ps(T[i][3], t[0]);
+			_mm_storeu_ps(T[i + 1][3], t[1]);
+			_mm_storeu_ps(T[i + 2][3], t[2]);
+			_mm_storeu_ps(T[i + 3][3], t[3]);
+		}
+	}
+	for (; i < n; ++i)
+		mat4x4_invert_affine_sse2(T[i], M[i]);
+}
+#endif
+
+/* T[i] = inverse of affine M[i], see mat4x4_invert_affine. T may alias M */
+static inline void mat4x4_invert_affine_batch(mat4x4 *T, mat4x4 *M, size_t n) {
+#ifdef LINMATH_SSE2
+	mat4x4_invert_affine_batch_sse2(T, M, n);
+#else
+	mat4x4_invert_affine_batch_scalar(T, M, n);
+#endif
+}
+
+/*
+ * Joint rotations as quaternion streams, x y z w like quat, and poses
+ * as a rotation plus a translation per joint. Rotations are expected
+ * to be unit length.
+ */
+typedef vec4_soa quat_soa;
+
+typedef struct {
+	quat_soa rotation;
+	vec3_soa translation;
+} pose_soa;
+
+/*
+ * Rigid transforms as dual quaternions, the real part the rotation and
+ * the dual part half the translation times it. Blending them linearly
+ * and renormalising keeps the result rigid, so skinning with blended
+ * joints doesn't collapse volume the way blended matrices do ("Skinning
+ * with Dual Quaternions", Kavan et al.).
+ */
+typedef struct {
+	quat_soa real;
+	quat_soa dual;
+} dualquat_soa;
+
+/*
+ * Correction from "Approximating slerp" (Arseny Kapoulkine). Feeding
+ * nlerp this t instead of the real one tracks slerp's constant speed
+ * to within 1e-3 rad for a few multiplies and no trig. d is |cos| of
+ * the angle between the two rotations.
+ */
+static inline float quat_slerp_approx_t(float t, float d) {
+	float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+	float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+	float k = A * (t - 0.5f) * (t - 0.5f) + B;
+	return t + t * (t - 0.5f) * (t - 1.f) * k;
+}
+
+/* r = normalize(a * (1 - t) + b * t) with b flipped onto a's hemisphere. The _range forms do [begin, n) */
+static inline void quat_soa_lerp_range(quat_soa r, quat_soa a, quat_soa b, float t, int approx_slerp, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float d = a.x[i] * b.x[i] + a.y[i] * b.y[i] + a.z[i] * b.z[i] + a.w[i] * b.w[i];
+		float u = approx_slerp ? quat_slerp_approx_t(t, fabsf(d)) : t;
+		float ta = 1.f - u, tb = d < 0.f ? -u : u;
+		float x = a.x[i] * ta + b.x[i] * tb;
+		float y = a.y[i] * ta + b.y[i] * tb;
+		float z = a.z[i] * ta + b.z[i] * tb;
+		float w = a.w[i] * ta + b.w[i] * tb;
+		float il = 1.f / sqrtf(x * x + y * y + z * z + w * w);
+		r.x[i] = x * il;
+		r.y[i] = y * il;
+		r.z[i] = z * il;
+		r.w[i] = w * il;
+	}
+}
+
+static inline void quat_soa_nlerp_scalar(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_range(r, a, b, t, 0, 0, n);
+}
+
+static inline void quat_soa_slerp_scalar(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_range(r, a, b, t, 1, 0, n);
+}
+
+/* Rigid joint transforms, same math as mat4x4_from_quat. Translation streams may be NULL */
+static inline void mat4x4_from_pose_soa_range(mat4x4 *M, pose_soa p, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		quat q = { p.rotation.x[i], p.rotation.y[i], p.rotation.z[i], p.rotation.w[i] };
+		mat4x4_from_quat(M[i], q);
+		if (p.translation.x) {
+			M[i][3][0] = p.translation.x[i];
+			M[i][3][1] = p.translation.y[i];
+			M[i][3][2] = p.translation.z[i];
+		}
+	}
+}
+
+static inline void mat4x4_from_pose_soa_scalar(mat4x4 *M, pose_soa p, size_t n) {
+	mat4x4_from_pose_soa_range(M, p, 0, n);
+}
+
+/* r = a + (b - a) * t, r may be the same streams as a or b */
+static inline void vec3_soa_lerp_range(vec3_soa r, vec3_soa a, vec3_soa b, float t, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		r.x[i] = a.x[i] + (b.x[i] - a.x[i]) * t;
+		r.y[i] = a.y[i] + (b.y[i] - a.y[i]) * t;
+		r.z[i] = a.z[i] + (b.z[i] - a.z[i]) * t;
+	}
+}
+
+static inline void vec3_soa_lerp_scalar(vec3_soa r, vec3_soa a, vec3_soa b, float t, size_t n) {
+	vec3_soa_lerp_range(r, a, b, t, 0, n);
+}
+
+static inline void pose_soa_blend_scalar(pose_soa r, pose_soa a, pose_soa b, float t, size_t n) {
+	quat_soa_nlerp_scalar(r.rotation, a.rotation, b.rotation, t, n);
+	vec3_soa_lerp_scalar(r.translation, a.translation, b.translation, t, n);
+}
+
+/* dual = (translation, 0) * real / 2. r.real may be the same streams as p.rotation */
+static inline void dualquat_soa_from_pose_range(dualquat_soa r, pose_soa p, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float x = p.rotation.x[i], y = p.rotation.y[i], z = p.rotation.z[i], w = p.rotation.w[i];
+		float tx = p.translation.x[i], ty = p.translation.y[i], tz = p.translation.z[i];
+		r.real.x[i] = x;
+		r.real.y[i] = y;
+		r.real.z[i] = z;
+		r.real.w[i] = w;
+		r.dual.x[i] = 0.5f * (w * tx + ty * z - tz * y);
+		r.dual.y[i] = 0.5f * (w * ty + tz * x - tx * z);
+		r.dual.z[i] = 0.5f * (w * tz + tx * y - ty * x);
+		r.dual.w[i] = -0.5f * (tx * x + ty * y + tz * z);
+	}
+}
+
+static inline void dualquat_soa_from_pose_scalar(dualquat_soa r, pose_soa p, size_t n) {
+	dualquat_soa_from_pose_range(r, p, 0, n);
+}
+
+/*
+ * Linear blend, b flipped onto a's hemisphere, then both parts divided
+ * by the length of the real part. r may be the same streams as a or b.
+ */
+static inline void dualquat_soa_blend_range(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		float d = a.real.x[i] * b.real.x[i] + a.real.y[i] * b.real.y[i] + a.real.z[i] * b.real.z[i] + a.real.w[i] * b.real.w[i];
+		float ta = 1.f - t, tb = d < 0.f ? -t : t;
+		float x = a.real.x[i] * ta + b.real.x[i] * tb;
+		float y = a.real.y[i] * ta + b.real.y[i] * tb;
+		float z = a.real.z[i] * ta + b.real.z[i] * tb;
+		float w = a.real.w[i] * ta + b.real.w[i] * tb;
+		float dx = a.dual.x[i] * ta + b.dual.x[i] * tb;
+		float dy = a.dual.y[i] * ta + b.dual.y[i] * tb;
+		float dz = a.dual.z[i] * ta + b.dual.z[i] * tb;
+		float dw = a.dual.w[i] * ta + b.dual.w[i] * tb;
+		float il = 1.f / sqrtf(x * x + y * y + z * z + w * w);
+		r.real.x[i] = x * il;
+		r.real.y[i] = y * il;
+		r.real.z[i] = z * il;
+		r.real.w[i] = w * il;
+		r.dual.x[i] = dx * il;
+		r.dual.y[i] = dy * il;
+		r.dual.z[i] = dz * il;
+		r.dual.w[i] = dw * il;
+	}
+}
+
+static inline void dualquat_soa_blend_scalar(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t n) {
+	dualquat_soa_blend_range(r, a, b, t, 0, n);
+}
+
+/* Rotation from the real part, translation 2 * dual * conj(real). Expects a unit real part, as blending leaves it */
+static inline void mat4x4_from_dualquat_soa_range(mat4x4 *M, dualquat_soa q, size_t begin, size_t n) {
+	size_t i;
+	for (i = begin; i < n; ++i) {
+		quat r = { q.real.x[i], q.real.y[i], q.real.z[i], q.real.w[i] };
+		float dx = q.dual.x[i], dy = q.dual.y[i], dz = q.dual.z[i], dw = q.dual.w[i];
+		mat4x4_from_quat(M[i], r);
+		M[i][3][0] = 2.f * (r[3] * dx - dw * r[0] + r[1] * dz - r[2] * dy);
+		M[i][3][1] = 2.f * (r[3] * dy - dw * r[1] + r[2] * dx - r[0] * dz);
+		M[i][3][2] = 2.f * (r[3] * dz - dw * r[2] + r[0] * dy - r[1] * dx);
+	}
+}
+
+static inline void mat4x4_from_dualquat_soa_scalar(mat4x4 *M, dualquat_soa q, size_t n) {
+	mat4x4_from_dualquat_soa_range(M, q, 0, n);
+}
+
+#ifdef LINMATH_SSE2
+static inline __m128 quat_slerp_approx_t_sse2(__m128 t, __m128 d) {
+	__m128 h = _mm_sub_ps(t, _mm_set1_ps(0.5f));
+	__m128 A = _mm_add_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(-1.43519f)));
+	__m128 B = _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(d, _mm_set1_ps(0.215638f)));
+	__m128 k;
+	A = _mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(d, A));
+	A = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, A));
+	B = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, B));
+	k = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(A, h), h), B);
+	return _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, h), _mm_sub_ps(t, _mm_set1_ps(1.f))), k));
+}
+
+static inline void quat_soa_lerp_sse2(quat_soa r, quat_soa a, quat_soa b, float t, int approx_slerp, size_t n) {
+	const __m128 sign_bit = _mm_set1_ps(-0.f);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128 vt = _mm_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 ax = _mm_loadu_ps(a.x + i), ay = _mm_loadu_ps(a.y + i), az = _mm_loadu_ps(a.z + i), aw = _mm_loadu_ps(a.w + i);
+		__m128 bx = _mm_loadu_ps(b.x + i), by = _mm_loadu_ps(b.y + i), bz = _mm_loadu_ps(b.z + i), bw = _mm_loadu_ps(b.w + i);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+		__m128 u = approx_slerp ? quat_slerp_approx_t_sse2(vt, _mm_andnot_ps(sign_bit, d)) : vt;
+		__m128 ta = _mm_sub_ps(one, u);
+		__m128 tb = _mm_xor_ps(u, _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()), sign_bit));
+		__m128 x = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tb));
+		__m128 y = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tb));
+		__m128 z = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tb));
+		__m128 w = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tb));
+		__m128 l = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)), _mm_mul_ps(w, w));
+		__m128 il = _mm_div_ps(one, _mm_sqrt_ps(l));
+		_mm_storeu_ps(r.x + i, _mm_mul_ps(x, il));
+		_mm_storeu_ps(r.y + i, _mm_mul_ps(y, il));
+		_mm_storeu_ps(r.z + i, _mm_mul_ps(z, il));
+		_mm_storeu_ps(r.w + i, _mm_mul_ps(w, il));
+	}
+	quat_soa_lerp_range(r, a, b, t, approx_slerp, n & ~(size_t) 3, n);
+}
+
+static inline void quat_soa_nlerp_sse2(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_sse2(r, a, b, t, 0, n);
+}
+
+static inline void quat_soa_slerp_sse2(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_sse2(r, a, b, t, 1, n);
+}
+
+/* Rotation columns of mat4x4_from_quat for four joints, col[j][k] holds element k of column j */
+static inline void linmath_quat_soa_columns_sse2(__m128 col[4][4], __m128 b, __m128 c, __m128 d, __m128 a) {
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 a2 = _mm_mul_ps(a, a), b2 = _mm_mul_ps(b, b), c2 = _mm_mul_ps(c, c), d2 = _mm_mul_ps(d, d);
+	__m128 bc = _mm_mul_ps(b, c), ad = _mm_mul_ps(a, d), bd = _mm_mul_ps(b, d);
+	__m128 ac = _mm_mul_ps(a, c), cd = _mm_mul_ps(c, d), ab = _mm_mul_ps(a, b);
+	col[0][0] = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(a2, b2), c2), d2);
+	col[0][1] = _mm_mul_ps(two, _mm_add_ps(bc, ad));
+	col[0][2] = _mm_mul_ps(two, _mm_sub_ps(bd, ac));
+	col[0][3] = zero;
+	col[1][0] = _mm_mul_ps(two, _mm_sub_ps(bc, ad));
+	col[1][1] = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(a2, b2), c2), d2);
+	col[1][2] = _mm_mul_ps(two, _mm_add_ps(cd, ab));
+	col[1][3] = zero;
+	col[2][0] = _mm_mul_ps(two, _mm_add_ps(bd, ac));
+	col[2][1] = _mm_mul_ps(two, _mm_sub_ps(cd, ab));
+	col[2][2] = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(a2, b2), c2), d2);
+	col[2][3] = zero;
+}
+
+/* Transpose four joints' columns into M[0] to M[3] */
+static inline void linmath_soa_store_mat4x4_sse2(mat4x4 *M, __m128 col[4][4]) {
+	int j;
+	for (j = 0; j < 4; ++j) {
+		_MM_TRANSPOSE4_PS(col[j][0], col[j][1], col[j][2], col[j][3]);
+		_mm_storeu_ps(M[0][j], col[j][0]);
+		_mm_storeu_ps(M[1][j], col[j][1]);
+		_mm_storeu_ps(M[2][j], col[j][2]);
+		_mm_storeu_ps(M[3][j], col[j][3]);
+	}
+}
+
+/* Four joints at a time, each register holds one matrix element of all four, transposed on the way out */
+static inline void mat4x4_from_pose_soa_sse2(mat4x4 *M, pose_soa p, size_t n) {
+	const __m128 zero = _mm_setzero_ps();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 col[4][4];
+		linmath_quat_soa_columns_sse2(col, _mm_loadu_ps(p.rotation.x + i), _mm_loadu_ps(p.rotation.y + i),
+									  _mm_loadu_ps(p.rotation.z + i), _mm_loadu_ps(p.rotation.w + i));
+		col[3][0] = p.translation.x ? _mm_loadu_ps(p.translation.x + i) : zero;
+		col[3][1] = p.translation.x ? _mm_loadu_ps(p.translation.y + i) : zero;
+		col[3][2] = p.translation.x ? _mm_loadu_ps(p.translation.z + i) : zero;
+		col[3][3] = _mm_set1_ps(1.f);
+		linmath_soa_store_mat4x4_sse2(M + i, col);
+	}
+	mat4x4_from_pose_soa_range(M, p, n & ~(size_t) 3, n);
+}
+
+static inline void vec3_soa_lerp_sse2(vec3_soa r, vec3_soa a, vec3_soa b, float t, size_t n) {
+	__m128 vt = _mm_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 ax = _mm_loadu_ps(a.x + i), ay = _mm_loadu_ps(a.y + i), az = _mm_loadu_ps(a.z + i);
+		_mm_storeu_ps(r.x + i, _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.x + i), ax), vt)));
+		_mm_storeu_ps(r.y + i, _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.y + i), ay), vt)));
+		_mm_storeu_ps(r.z + i, _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.z + i), az), vt)));
+	}
+	vec3_soa_lerp_range(r, a, b, t, n & ~(size_t) 3, n);
+}
+
+static inline void pose_soa_blend_sse2(pose_soa r, pose_soa a, pose_soa b, float t, size_t n) {
+	quat_soa_nlerp_sse2(r.rotation, a.rotation, b.rotation, t, n);
+	vec3_soa_lerp_sse2(r.translation, a.translation, b.translation, t, n);
+}
+
+static inline void dualquat_soa_from_pose_sse2(dualquat_soa r, pose_soa p, size_t n) {
+	const __m128 half = _mm_set1_ps(0.5f);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(p.rotation.x + i), y = _mm_loadu_ps(p.rotation.y + i);
+		__m128 z = _mm_loadu_ps(p.rotation.z + i), w = _mm_loadu_ps(p.rotation.w + i);
+		__m128 tx = _mm_loadu_ps(p.translation.x + i), ty = _mm_loadu_ps(p.translation.y + i), tz = _mm_loadu_ps(p.translation.z + i);
+		__m128 dx = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, tx), _mm_mul_ps(ty, z)), _mm_mul_ps(tz, y));
+		__m128 dy = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, ty), _mm_mul_ps(tz, x)), _mm_mul_ps(tx, z));
+		__m128 dz = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, tz), _mm_mul_ps(tx, y)), _mm_mul_ps(ty, x));
+		__m128 dw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, x), _mm_mul_ps(ty, y)), _mm_mul_ps(tz, z));
+		_mm_storeu_ps(r.real.x + i, x);
+		_mm_storeu_ps(r.real.y + i, y);
+		_mm_storeu_ps(r.real.z + i, z);
+		_mm_storeu_ps(r.real.w + i, w);
+		_mm_storeu_ps(r.dual.x + i, _mm_mul_ps(half, dx));
+		_mm_storeu_ps(r.dual.y + i, _mm_mul_ps(half, dy));
+		_mm_storeu_ps(r.dual.z + i, _mm_mul_ps(half, dz));
+		_mm_storeu_ps(r.dual.w + i, _mm_mul_ps(_mm_set1_ps(-0.5f), dw));
+	}
+	dualquat_soa_from_pose_range(r, p, n & ~(size_t) 3, n);
+}
+
+static inline void dualquat_soa_blend_sse2(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t n) {
+	const __m128 sign_bit = _mm_set1_ps(-0.f);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128 ta = _mm_set1_ps(1.f - t), vt = _mm_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 ax = _mm_loadu_ps(a.real.x + i), ay = _mm_loadu_ps(a.real.y + i), az = _mm_loadu_ps(a.real.z + i), aw = _mm_loadu_ps(a.real.w + i);
+		__m128 bx = _mm_loadu_ps(b.real.x + i), by = _mm_loadu_ps(b.real.y + i), bz = _mm_loadu_ps(b.real.z + i), bw = _mm_loadu_ps(b.real.w + i);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+		__m128 tb = _mm_xor_ps(vt, _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()), sign_bit));
+		__m128 x = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tb));
+		__m128 y = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tb));
+		__m128 z = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tb));
+		__m128 w = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tb));
+		__m128 l = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)), _mm_mul_ps(w, w));
+		__m128 il = _mm_div_ps(one, _mm_sqrt_ps(l));
+		__m128 dx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.dual.x + i), ta), _mm_mul_ps(_mm_loadu_ps(b.dual.x + i), tb));
+		__m128 dy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.dual.y + i), ta), _mm_mul_ps(_mm_loadu_ps(b.dual.y + i), tb));
+		__m128 dz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.dual.z + i), ta), _mm_mul_ps(_mm_loadu_ps(b.dual.z + i), tb));
+		__m128 dw = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.dual.w + i), ta), _mm_mul_ps(_mm_loadu_ps(b.dual.w + i), tb));
+		_mm_storeu_ps(r.real.x + i, _mm_mul_ps(x, il));
+		_mm_storeu_ps(r.real.y + i, _mm_mul_ps(y, il));
+		_mm_storeu_ps(r.real.z + i, _mm_mul_ps(z, il));
+		_mm_storeu_ps(r.real.w + i, _mm_mul_ps(w, il));
+		_mm_storeu_ps(r.dual.x + i, _mm_mul_ps(dx, il));
+		_mm_storeu_ps(r.dual.y + i, _mm_mul_ps(dy, il));
+		_mm_storeu_ps(r.dual.z + i, _mm_mul_ps(dz, il));
+		_mm_storeu_ps(r.dual.w + i, _mm_mul_ps(dw, il));
+	}
+	dualquat_soa_blend_range(r, a, b, t, n & ~(size_t) 3, n);
+}
+
+static inline void mat4x4_from_dualquat_soa_sse2(mat4x4 *M, dualquat_soa q, size_t n) {
+	const __m128 two = _mm_set1_ps(2.f);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(q.real.x + i), y = _mm_loadu_ps(q.real.y + i);
+		__m128 z = _mm_loadu_ps(q.real.z + i), w = _mm_loadu_ps(q.real.w + i);
+		__m128 dx = _mm_loadu_ps(q.dual.x + i), dy = _mm_loadu_ps(q.dual.y + i);
+		__m128 dz = _mm_loadu_ps(q.dual.z + i), dw = _mm_loadu_ps(q.dual.w + i);
+		__m128 col[4][4];
+		linmath_quat_soa_columns_sse2(col, x, y, z, w);
+		col[3][0] = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(w, dx), _mm_mul_ps(dw, x)), _mm_mul_ps(y, dz)), _mm_mul_ps(z, dy)));
+		col[3][1] = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(w, dy), _mm_mul_ps(dw, y)), _mm_mul_ps(z, dx)), _mm_mul_ps(x, dz)));
+		col[3][2] = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(w, dz), _mm_mul_ps(dw, z)), _mm_mul_ps(x, dy)), _mm_mul_ps(y, dx)));
+		col[3][3] = _mm_set1_ps(1.f);
+		linmath_soa_store_mat4x4_sse2(M + i, col);
+	}
+	mat4x4_from_dualquat_soa_range(M, q, n & ~(size_t) 3, n);
+}
+#endif
+
+#ifdef LINMATH_AVX_FMA
+static inline __m256 quat_slerp_approx_t_avx_fma(__m256 t, __m256 d) {
+	__m256 h = _mm256_sub_ps(t, _mm256_set1_ps(0.5f));
+	__m256 A = _mm256_fmadd_ps(d, _mm256_set1_ps(-1.43519f), _mm256_set1_ps(3.55645f));
+	__m256 B = _mm256_fmadd_ps(d, _mm256_set1_ps(0.215638f), _mm256_set1_ps(-1.06021f));
+	__m256 k;
+	A = _mm256_fmadd_ps(d, A, _mm256_set1_ps(-3.2452f));
+	A = _mm256_fmadd_ps(d, A, _mm256_set1_ps(1.0904f));
+	B = _mm256_fmadd_ps(d, B, _mm256_set1_ps(0.848013f));
+	k = _mm256_fmadd_ps(_mm256_mul_ps(A, h), h, B);
+	return _mm256_fmadd_ps(_mm256_mul_ps(_mm256_mul_ps(t, h), _mm256_sub_ps(t, _mm256_set1_ps(1.f))), k, t);
+}
+
+#define LINMATH_DOT4_AVX_FMA(ax, ay, az, aw, bx, by, bz, bw) \
+	_mm256_fmadd_ps(aw, bw, _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx))))
+
+static inline void quat_soa_lerp_avx_fma(quat_soa r, quat_soa a, quat_soa b, float t, int approx_slerp, size_t n) {
+	const __m256 sign_bit = _mm256_set1_ps(-0.f);
+	const __m256 one = _mm256_set1_ps(1.f);
+	__m256 vt = _mm256_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 ax = _mm256_loadu_ps(a.x + i), ay = _mm256_loadu_ps(a.y + i), az = _mm256_loadu_ps(a.z + i), aw = _mm256_loadu_ps(a.w + i);
+		__m256 bx = _mm256_loadu_ps(b.x + i), by = _mm256_loadu_ps(b.y + i), bz = _mm256_loadu_ps(b.z + i), bw = _mm256_loadu_ps(b.w + i);
+		__m256 d = LINMATH_DOT4_AVX_FMA(ax, ay, az, aw, bx, by, bz, bw);
+		__m256 u = approx_slerp ? quat_slerp_approx_t_avx_fma(vt, _mm256_andnot_ps(sign_bit, d)) : vt;
+		__m256 ta = _mm256_sub_ps(one, u);
+		__m256 tb = _mm256_xor_ps(u, _mm256_and_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ), sign_bit));
+		__m256 x = _mm256_fmadd_ps(bx, tb, _mm256_mul_ps(ax, ta));
+		__m256 y = _mm256_fmadd_ps(by, tb, _mm256_mul_ps(ay, ta));
+		__m256 z = _mm256_fmadd_ps(bz, tb, _mm256_mul_ps(az, ta));
+		__m256 w = _mm256_fmadd_ps(bw, tb, _mm256_mul_ps(aw, ta));
+		__m256 il = _mm256_div_ps(one, _mm256_sqrt_ps(LINMATH_DOT4_AVX_FMA(x, y, z, w, x, y, z, w)));
+		_mm256_storeu_ps(r.x + i, _mm256_mul_ps(x, il));
+		_mm256_storeu_ps(r.y + i, _mm256_mul_ps(y, il));
+		_mm256_storeu_ps(r.z + i, _mm256_mul_ps(z, il));
+		_mm256_storeu_ps(r.w + i, _mm256_mul_ps(w, il));
+	}
+	quat_soa_lerp_range(r, a, b, t, approx_slerp, n & ~(size_t) 7, n);
+}
+
+static inline void quat_soa_nlerp_avx_fma(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_avx_fma(r, a, b, t, 0, n);
+}
+
+static inline void quat_soa_slerp_avx_fma(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+	quat_soa_lerp_avx_fma(r, a, b, t, 1, n);
+}
+
+/* Same as linmath_quat_soa_columns_sse2, eight joints */
+static inline void linmath_quat_soa_columns_avx_fma(__m256 col[4][4], __m256 b, __m256 c, __m256 d, __m256 a) {
+	const __m256 two = _mm256_set1_ps(2.f);
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 a2 = _mm256_mul_ps(a, a), b2 = _mm256_mul_ps(b, b), c2 = _mm256_mul_ps(c, c), d2 = _mm256_mul_ps(d, d);
+	__m256 bc = _mm256_mul_ps(b, c), ad = _mm256_mul_ps(a, d), bd = _mm256_mul_ps(b, d);
+	__m256 ac = _mm256_mul_ps(a, c), cd = _mm256_mul_ps(c, d), ab = _mm256_mul_ps(a, b);
+	col[0][0] = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(a2, b2), c2), d2);
+	col[0][1] = _mm256_mul_ps(two, _mm256_add_ps(bc, ad));
+	col[0][2] = _mm256_mul_ps(two, _mm256_sub_ps(bd, ac));
+	col[0][3] = zero;
+	col[1][0] = _mm256_mul_ps(two, _mm256_sub_ps(bc, ad));
+	col[1][1] = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(a2, b2), c2), d2);
+	col[1][2] = _mm256_mul_ps(two, _mm256_add_ps(cd, ab));
+	col[1][3] = zero;
+	col[2][0] = _mm256_mul_ps(two, _mm256_add_ps(bd, ac));
+	col[2][1] = _mm256_mul_ps(two, _mm256_sub_ps(cd, ab));
+	col[2][2] = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(a2, b2), c2), d2);
+	col[2][3] = zero;
+}
+
+/* 4x4 transposes within each 128 bit lane, so the low lane fills M[0] to M[3] and the high lane M[4] to M[7] */
+static inline void linmath_soa_store_mat4x4_avx(mat4x4 *M, __m256 col[4][4]) {
+	int j, k;
+	for (j = 0; j < 4; ++j) {
+		__m256 t0 = _mm256_unpacklo_ps(col[j][0], col[j][1]), t1 = _mm256_unpackhi_ps(col[j][0], col[j][1]);
+		__m256 t2 = _mm256_unpacklo_ps(col[j][2], col[j][3]), t3 = _mm256_unpackhi_ps(col[j][2], col[j][3]);
+		__m256 rows[4];
+		rows[0] = _mm256_shuffle_ps(t0, t2, LINMATH_SHUFFLE(0, 1, 0, 1));
+		rows[1] = _mm256_shuffle_ps(t0, t2, LINMATH_SHUFFLE(2, 3, 2, 3));
+		rows[2] = _mm256_shuffle_ps(t1, t3, LINMATH_SHUFFLE(0, 1, 0, 1));
+		rows[3] = _mm256_shuffle_ps(t1, t3, LINMATH_SHUFFLE(2, 3, 2, 3));
+		for (k = 0; k < 4; ++k) {
+			_mm_storeu_ps(M[k][j], _mm256_castps256_ps128(rows[k]));
+			_mm_storeu_ps(M[k + 4][j], _mm256_extractf128_ps(rows[k], 1));
+		}
+	}
+}
+
+static inline void mat4x4_from_pose_soa_avx_fma(mat4x4 *M, pose_soa p, size_t n) {
+	const __m256 zero = _mm256_setzero_ps();
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 col[4][4];
+		linmath_quat_soa_columns_avx_fma(col, _mm256_loadu_ps(p.rotation.x + i), _mm256_loadu_ps(p.rotation.y + i),
+										 _mm256_loadu_ps(p.rotation.z + i), _mm256_loadu_ps(p.rotation.w + i));
+		col[3][0] = p.translation.x ? _mm256_loadu_ps(p.translation.x + i) : zero;
+		col[3][1] = p.translation.x ? _mm256_loadu_ps(p.translation.y + i) : zero;
+		col[3][2] = p.translation.x ? _mm256_loadu_ps(p.translation.z + i) : zero;
+		col[3][3] = _mm256_set1_ps(1.f);
+		linmath_soa_store_mat4x4_avx(M + i, col);
+	}
+	mat4x4_from_pose_soa_range(M, p, n & ~(size_t) 7, n);
+}
+
+static inline void vec3_soa_lerp_avx_fma(vec3_soa r, vec3_soa a, vec3_soa b, float t, size_t n) {
+	__m256 vt = _mm256_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 ax = _mm256_loadu_ps(a.x + i), ay = _mm256_loadu_ps(a.y + i), az = _mm256_loadu_ps(a.z + i);
+		_mm256_storeu_ps(r.x + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(b.x + i), ax), vt, ax));
+		_mm256_storeu_ps(r.y + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(b.y + i), ay), vt, ay));
+		_mm256_storeu_ps(r.z + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(b.z + i), az), vt, az));
+	}
+	vec3_soa_lerp_range(r, a, b, t, n & ~(size_t) 7, n);
+}
+
+static inline void pose_soa_blend_avx_fma(pose_soa r, pose_soa a, pose_soa b, float t, size_t n) {
+	quat_soa_nlerp_avx_fma(r.rotation, a.rotation, b.rotation, t, n);
+	vec3_soa_lerp_avx_fma(r.translation, a.translation, b.translation, t, n);
+}
+
+static inline void dualquat_soa_from_pose_avx_fma(dualquat_soa r, pose_soa p, size_t n) {
+	const __m256 half = _mm256_set1_ps(0.5f);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(p.rotation.x + i), y = _mm256_loadu_ps(p.rotation.y + i);
+		__m256 z = _mm256_loadu_ps(p.rotation.z + i), w = _mm256_loadu_ps(p.rotation.w + i);
+		__m256 tx = _mm256_loadu_ps(p.translation.x + i), ty = _mm256_loadu_ps(p.translation.y + i), tz = _mm256_loadu_ps(p.translation.z + i);
+		__m256 dx = _mm256_fmsub_ps(w, tx, _mm256_fmsub_ps(tz, y, _mm256_mul_ps(ty, z)));
+		__m256 dy = _mm256_fmsub_ps(w, ty, _mm256_fmsub_ps(tx, z, _mm256_mul_ps(tz, x)));
+		__m256 dz = _mm256_fmsub_ps(w, tz, _mm256_fmsub_ps(ty, x, _mm256_mul_ps(tx, y)));
+		__m256 dw = _mm256_fmadd_ps(tz, z, _mm256_fmadd_ps(ty, y, _mm256_mul_ps(tx, x)));
+		_mm256_storeu_ps(r.real.x + i, x);
+		_mm256_storeu_ps(r.real.y + i, y);
+		_mm256_storeu_ps(r.real.z + i, z);
+		_mm256_storeu_ps(r.real.w + i, w);
+		_mm256_storeu_ps(r.dual.x + i, _mm256_mul_ps(half, dx));
+		_mm256_storeu_ps(r.dual.y + i, _mm256_mul_ps(half, dy));
+		_mm256_storeu_ps(r.dual.z + i, _mm256_mul_ps(half, dz));
+		_mm256_storeu_ps(r.dual.w + i, _mm256_mul_ps(_mm256_set1_ps(-0.5f), dw));
+	}
+	dualquat_soa_from_pose_range(r, p, n & ~(size_t) 7, n);
+}
+
+static inline void dualquat_soa_blend_avx_fma(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t n) {
+	const __m256 sign_bit = _mm256_set1_ps(-0.f);
+	const __m256 one = _mm256_set1_ps(1.f);
+	__m256 ta = _mm256_set1_ps(1.f - t), vt = _mm256_set1_ps(t);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 ax = _mm256_loadu_ps(a.real.x + i), ay = _mm256_loadu_ps(a.real.y + i), az = _mm256_loadu_ps(a.real.z + i), aw = _mm256_loadu_ps(a.real.w + i);
+		__m256 bx = _mm256_loadu_ps(b.real.x + i), by = _mm256_loadu_ps(b.real.y + i), bz = _mm256_loadu_ps(b.real.z + i), bw = _mm256_loadu_ps(b.real.w + i);
+		__m256 d = LINMATH_DOT4_AVX_FMA(ax, ay, az, aw, bx, by, bz, bw);
+		__m256 tb = _mm256_xor_ps(vt, _mm256_and_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ), sign_bit));
+		__m256 x = _mm256_fmadd_ps(bx, tb, _mm256_mul_ps(ax, ta));
+		__m256 y = _mm256_fmadd_ps(by, tb, _mm256_mul_ps(ay, ta));
+		__m256 z = _mm256_fmadd_ps(bz, tb, _mm256_mul_ps(az, ta));
+		__m256 w = _mm256_fmadd_ps(bw, tb, _mm256_mul_ps(aw, ta));
+		__m256 il = _mm256_div_ps(one, _mm256_sqrt_ps(LINMATH_DOT4_AVX_FMA(x, y, z, w, x, y, z, w)));
+		__m256 dx = _mm256_fmadd_ps(_mm256_loadu_ps(b.dual.x + i), tb, _mm256_mul_ps(_mm256_loadu_ps(a.dual.x + i), ta));
+		__m256 dy = _mm256_fmadd_ps(_mm256_loadu_ps(b.dual.y + i), tb, _mm256_mul_ps(_mm256_loadu_ps(a.dual.y + i), ta));
+		__m256 dz = _mm256_fmadd_ps(_mm256_loadu_ps(b.dual.z + i), tb, _mm256_mul_ps(_mm256_loadu_ps(a.dual.z + i), ta));
+		__m256 dw = _mm256_fmadd_ps(_mm256_loadu_ps(b.dual.w + i), tb, _mm256_mul_ps(_mm256_loadu_ps(a.dual.w + i), ta));
+		_mm256_storeu_ps(r.real.x + i, _mm256_mul_ps(x, il));
+		_mm256_storeu_ps(r.real.y + i, _mm256_mul_ps(y, il));
+		_mm256_storeu_ps(r.real.z + i, _mm256_mul_ps(z, il));
+		_mm256_storeu_ps(r.real.w + i, _mm256_mul_ps(w, il));
+		_mm256_storeu_ps(r.dual.x + i, _mm256_mul_ps(dx, il));
+		_mm256_storeu_ps(r.dual.y + i, _mm256_mul_ps(dy, il));
+		_mm256_storeu_ps(r.dual.z + i, _mm256_mul_ps(dz, il));
+		_mm256_storeu_ps(r.dual.w + i, _mm256_mul_ps(dw, il));
+	}
+	dualquat_soa_blend_range(r, a, b, t, n & ~(size_t) 7, n);
+}
+
+static inline void mat4x4_from_dualquat_soa_avx_fma(mat4x4 *M, dualquat_soa q, size_t n) {
+	const __m256 two = _mm256_set1_ps(2.f);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(q.real.x + i), y = _mm256_loadu_ps(q.real.y + i);
+		__m256 z = _mm256_loadu_ps(q.real.z + i), w = _mm256_loadu_ps(q.real.w + i);
+		__m256 dx = _mm256_loadu_ps(q.dual.x + i), dy = _mm256_loadu_ps(q.dual.y + i);
+		__m256 dz = _mm256_loadu_ps(q.dual.z + i), dw = _mm256_loadu_ps(q.dual.w + i);
+		__m256 col[4][4];
+		linmath_quat_soa_columns_avx_fma(col, x, y, z, w);
+		col[3][0] = _mm256_mul_ps(two, _mm256_fmsub_ps(w, dx, _mm256_fmadd_ps(dw, x, _mm256_fmsub_ps(z, dy, _mm256_mul_ps(y, dz)))));
+		col[3][1] = _mm256_mul_ps(two, _mm256_fmsub_ps(w, dy, _mm256_fmadd_ps(dw, y, _mm256_fmsub_ps(x, dz, _mm256_mul_ps(z, dx)))));
+		col[3][2] = _mm256_mul_ps(two, _mm256_fmsub_ps(w, dz, _mm256_fmadd_ps(dw, z, _mm256_fmsub_ps(y, dx, _mm256_mul_ps(x, dy)))));
+		col[3][3] = _mm256_set1_ps(1.f);
+		linmath_soa_store_mat4x4_avx(M + i, col);
+	}
+	mat4x4_from_dualquat_soa_range(M, q, n & ~(size_t) 7, n);
+}
+#endif
+
+static inline void quat_soa_nlerp(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	quat_soa_nlerp_avx_fma(r, a, b, t, n);
+#elif defined(LINMATH_SSE2)
+	quat_soa_nlerp_sse2(r, a, b, t, n);
+#else
+	quat_soa_nlerp_scalar(r, a, b, t, n);
+#endif
+}
+
+/* Approximate slerp, see quat_slerp_approx_t. Use quat_slerp where exact matters */
+static inline void quat_soa_slerp(quat_soa r, quat_soa a, quat_soa b, float t, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	quat_soa_slerp_avx_fma(r, a, b, t, n);
+#elif defined(LINMATH_SSE2)
+	quat_soa_slerp_sse2(r, a, b, t, n);
+#else
+	quat_soa_slerp_scalar(r, a, b, t, n);
+#endif
+}
+
+static inline void mat4x4_from_pose_soa(mat4x4 *M, pose_soa p, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	mat4x4_from_pose_soa_avx_fma(M, p, n);
+#elif defined(LINMATH_SSE2)
+	mat4x4_from_pose_soa_sse2(M, p, n);
+#else
+	mat4x4_from_pose_soa_scalar(M, p, n);
+#endif
+}
+
+static inline void vec3_soa_lerp(vec3_soa r, vec3_soa a, vec3_soa b, float t, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	vec3_soa_lerp_avx_fma(r, a, b, t, n);
+#elif defined(LINMATH_SSE2)
+	vec3_soa_lerp_sse2(r, a, b, t, n);
+#else
+	vec3_soa_lerp_scalar(r, a, b, t, n);
+#endif
+}
+
+/*
+ * Blend two poses of the same skeleton, rotations along the shorter
+ * arc and translations linearly. r may be the same streams as a or b.
+ */
+static inline void pose_soa_blend(pose_soa r, pose_soa a, pose_soa b, float t, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	pose_soa_blend_avx_fma(r, a, b, t, n);
+#elif defined(LINMATH_SSE2)
+	pose_soa_blend_sse2(r, a, b, t, n);
+#else
+	pose_soa_blend_scalar(r, a, b, t, n);
+#endif
+}
+
+static inline void dualquat_soa_from_pose(dualquat_soa r, pose_soa p, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	dualquat_soa_from_pose_avx_fma(r, p, n);
+#elif defined(LINMATH_SSE2)
+	dualquat_soa_from_pose_sse2(r, p, n);
+#else
+	dualquat_soa_from_pose_scalar(r, p, n);
+#endif
+}
+
+static inline void dualquat_soa_blend(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	dualquat_soa_blend_avx_fma(r, a, b, t, n);
+#elif defined(LINMATH_SSE2)
+	dualquat_soa_blend_sse2(r, a, b, t, n);
+#else
+	dualquat_soa_blend_scalar(r, a, b, t, n);
+#endif
+}
+
+static inline void mat4x4_from_dualquat_soa(mat4x4 *M, dualquat_soa q, size_t n) {
+#if defined(LINMATH_AVX_FMA)
+	mat4x4_from_dualquat_soa_avx_fma(M, q, n);
+#elif defined(LINMATH_SSE2)
+	mat4x4_from_dualquat_soa_sse2(M, q, n);
+#else
+	mat4x4_from_dualquat_soa_scalar(M, q, n);
+#endif
+}
+
+/*
+ * Transpose between packed xyz (AoS) and SoA streams, for vertex data
+ * that has to come from or go back to a GL buffer.
+ */
+static inline void vec3_soa_from_aos(vec3_soa r, const float *aos, size_t stride, size_t n) {
+	size_t i;
+	for (i = 0; i < n; ++i, aos += stride) {
+		r.x[i] = aos[0];
+		r.y[i] = aos[1];
+		r.z[i] = aos[2];
+	}
+}
+
+static inline void vec3_soa_to_aos(float *aos, size_t stride, vec3_soa v, size_t n) {
+	size_t i;
+	for (i = 0; i < n; ++i, aos += stride) {
+		aos[0] = v.x[i];
+		aos[1] = v.y[i];
+		aos[2] = v.z[i];
+	}
+}
+
+#endif
@@ -8,13 +8,32 @@
 
 #include "linmath.h"
 #include "shaders.h"
+#include "uniform_block.h"
+#include "frame_ring.h"
+#include "camera.h"
+#include "command_buffer.h"
+#include "math_dispatch.h"
+#include "gl_bench.h"
+#include "math_bench.h"
 
 typedef struct shaggy_ctx {
 	SDL_Window *window;
 	SDL_GLContext gl_ctx;
+	struct shaggy_camera camera;
 	bool running;
 } shaggy_ctx;
 
+/* Match the viewport and projection to the drawable, which can differ from the window size on HiDPI */
+void handle_resize(shaggy_ctx *ctx) {
+	int width, height;
+
+	SDL_GL_GetDrawableSize(ctx->window, &width, &height);
+
+	if (shaggy_camera_set_viewport(&ctx->camera, width, height)) {
+		glViewport(0, 0, width, height);
+	}
+}
+
 void handle_window_event(shaggy_ctx *ctx, SDL_Event *event) {
 	switch (event->window.event) {
 		case SDL_WINDOWEVENT_SHOWN:
@@ -26,8 +45,8 @@ void handle_window_event(shaggy_ctx *ctx, SDL_Event *event) {
 		case SDL_WINDOWEVENT_MOVED:
 			break;
 		case SDL_WINDOWEVENT_RESIZED:
-			break;
 		case SDL_WINDOWEVENT_SIZE_CHANGED:
+			handle_resize(ctx);
 			break;
 		case SDL_WINDOWEVENT_MINIMIZED:
 			break;
@@ -63,11 +82,66 @@ int main(int argc, char *argv[]) {
 	shaggy_ctx ctx = {};
 	SDL_Event event;
 	struct shaggy_manager *shader_manager;
+	bool bench_startup = false;
+	bool bench_pipelines = false;
+	bool bench_uploads = false;
+	bool bench_commands = false;
+	bool bench_animation = false;
+	bool bench_culling = false;
+	bool bench_occlusion = false;
+	const char *shader_dir = NULL;
 
 	sclog4c_level = INFO;
 
+	shaggy_math_dispatch_init();
+
 	ctx.running = true;
 
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--bench-startup") == 0) {
+			bench_startup = true;
+		} else if (strcmp(argv[i], "--bench-pipelines") == 0) {
+			bench_pipelines = true;
+		} else if (strcmp(argv[i], "--bench-uploads") == 0) {
+			bench_uploads = true;
+		} else if (strcmp(argv[i], "--bench-commands") == 0) {
+			bench_commands = true;
+		} else if (strcmp(argv[i], "--bench-animation") == 0) {
+			bench_animation = true;
+		} else if (strcmp(argv[i], "--bench-culling") == 0) {
+			bench_culling = true;
+		} else if (strcmp(argv[i], "--bench-occlusion") == 0) {
+			bench_occlusion = true;
+		} else if (strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc) {
+			shader_dir = argv[++i];
+		} else {
+			logm(WARNING, "Unknown argument %s", argv[i]);
+		}
+	}
+
+	/* CPU only, runs before any window exists */
+	if (bench_animation || bench_culling || bench_occlusion) {
+		if (bench_animation) {
+			shaggy_bench_animation();
+		}
+
+		if (bench_culling) {
+			shaggy_bench_culling();
+		}
+
+		if (bench_occlusion) {
+			shaggy_bench_occlusion();
+		}
+
+		if (!bench_startup && !bench_pipelines && !bench_uploads && !bench_commands) {
+			return 0;
+		}
+	}
+
+	if (bench_startup || bench_pipelines || bench_uploads || bench_commands) {
+		shaggy_bench_prepare_env();
+	}
+
 	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
 	/*************************************
@@ -87,7 +161,7 @@ int main(int argc, char *argv[]) {
 			SDL_WINDOWPOS_CENTERED,
 			SDL_WINDOWPOS_CENTERED,
 			800, 600,
-			SDL_WINDOW_OPENGL
+			SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
 	);
 
 	if (ctx.window == NULL) {
@@ -119,6 +193,28 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	if (bench_startup || bench_pipelines || bench_uploads || bench_commands) {
+		if (bench_startup) {
+			shaggy_bench_startup("../shaders");
+		}
+
+		if (bench_pipelines) {
+			shaggy_bench_pipelines();
+		}
+
+		if (bench_uploads) {
+			shaggy_bench_uploads();
+		}
+
+		if (bench_commands) {
+			shaggy_bench_commands();
+		}
+
+		SDL_DestroyWindow(ctx.window);
+		SDL_Quit();
+		return 0;
+	}
+
 	/*************************
 	 * Create Shader Programs
 	 *************************/
@@ -132,7 +228,7 @@ int main(int argc, char *argv[]) {
 		shaggy_vertex_shader vert = shaggy_create_vertex_shader();
 		shaggy_fragment_shader frag = shaggy_create_fragment_shader();
 
-		shaggy_source_shader_from_file(vert, "../shaders/basic.vertex.glsl");
+		shaggy_source_shader_from_file(vert, "../shaders/basic.vertex.glsl", NULL);
 		shaggy_compile_shader(vert);
 		if (!shaggy_check_shader_compile_status(vert)) {
 			GLint log_length = shaggy_get_shader_info_log_length(vert);
@@ -142,7 +238,7 @@ int main(int argc, char *argv[]) {
 				shaggy_get_shader_info_log(vert, log_length, buf));
 		}
 
-		shaggy_source_shader_from_file(frag, "../shaders/basic.frag.glsl");
+		shaggy_source_shader_from_file(frag, "../shaders/basic.frag.glsl", NULL);
 		shaggy_compile_shader(frag);
 		if (!shaggy_check_shader_compile_status(frag)) {
 			GLint log_length = shaggy_get_shader_info_log_length(frag);
@@ -167,9 +263,35 @@ int main(int argc, char *argv[]) {
 	}
 #else
 	shader_manager = shaggy_create_shader_manager();
-	shaggy_manage_shader_dir(shader_manager, "../shaders");
-	shaggy_fragment_shader temp_shader = shaggy_manage_fetch_fragment_shader(shader_manager, "basic");
-	shaggy_fragment_shader temp_shader2 = shaggy_manage_fetch_fragment_shader(shader_manager, "basic2");
+
+	{
+		char *pref_path = SDL_GetPrefPath("Shaggy", "program-cache");
+		if (pref_path) {
+			shaggy_manage_set_program_cache(shader_manager, pref_path);
+			SDL_free(pref_path);
+		}
+	}
+
+	/* Only compile what gets fetched, a warm program cache compiles nothing */
+	shaggy_manage_set_lazy(shader_manager, true);
+
+	/**********************************************
+	 * Shaders are packed into the executable, a
+	 * loose directory overrides them and is the
+	 * only thing hot reload watches
+	 **********************************************/
+#ifdef SHAGGY_EMBED_SHADERS
+	shaggy_manage_shader_bundle(shader_manager, &shaggy_shader_bundle);
+#else
+	if (!shader_dir) {
+		shader_dir = "../shaders";
+	}
+#endif
+
+	if (shader_dir) {
+		shaggy_manage_shader_dir(shader_manager, shader_dir);
+		shaggy_manage_watch_dir(shader_manager, shader_dir);
+	}
 
 	shaggy_program program = shaggy_manage_build_program(
 			shader_manager,
@@ -179,48 +301,63 @@ int main(int argc, char *argv[]) {
 	);
 #endif
 
+	/****************************************
+	 * Matrices layout comes from the linked
+	 * program, members are written in place
+	 ****************************************/
+	enum { MATRICES_PROJECTION, MATRICES_MODEL_VIEW };
+	static const char *const matrices_members[] = { "projection", "model_view" };
+	struct shaggy_block_writer matrices;
+	struct shaggy_frame_ring uniform_ring;
+
+	shaggy_block_writer_init(
+			&matrices,
+			shaggy_manage_program_reflection(shader_manager, program),
+			"Matrices",
+			matrices_members, 2
+	);
+
+	/* Per-frame uniform data, written in place and never reallocated */
+	if (!shaggy_frame_ring_init(&uniform_ring, 64 * 1024)) {
+		logm(FATAL, "Failed to create the uniform ring buffer\n");
+		return 0;
+	}
+
+	/*********************************************
+	 * Draws are recorded, sorted by state and
+	 * submitted in one pass just before the swap
+	 *********************************************/
+	struct shaggy_command_buffer commands;
+
+	if (!shaggy_command_buffer_init(&commands, 4096)) {
+		logm(FATAL, "Failed to create the command buffer\n");
+		return 0;
+	}
+
+	/**********************************
+	 * Camera Only Rebuilds On Change
+	 * Window resizes feed the viewport
+	 **********************************/
+	mat4x4 Model;
+	mat4x4 ModelView;
+	unsigned camera_version = 0;
+
+	shaggy_camera_init(&ctx.camera, 1.7f, 0.1f, 100.0f, 0, 0);
+	shaggy_camera_look_at(
+			&ctx.camera,
+			(vec3) {1.0f, 0.0f, 0.0f},
+			(vec3) {0.0f, 0.0f, 0.0f},
+			(vec3) {0.0f, 0.0f, 1.0f}
+	);
+	handle_resize(&ctx);
+
+	mat4x4_identity(Model);
+
 	/**************************
 	 * Main Logic Loop
 	 **************************/
 	while (ctx.running) {
-		mat4x4 Projection = {};
-		mat4x4 View = {};
-		mat4x4 Model = {};
-		mat4x4 ModelView = {};
-
-		GLuint uniform_Matrices;
-
-		/***********************
-		 * Build World Matrices
-		 ***********************/
-		mat4x4_perspective(
-				Projection,
-				1.7f,
-				16 / 9,
-				0.1f,
-				100.0f
-		);
-
-		mat4x4_look_at(
-				View,
-				(vec3) {1.0f, 0.0f, 0.0f},
-				(vec3) {0.0f, 0.0f, 0.0f},
-				(vec3) {0.0f, 0.0f, 1.0f}
-		);
-
-		mat4x4_identity(Model);
-
-		mat4x4_mul(ModelView, View, Model);
-
-		/*******************************
-		 * Build Uniform Buffer Objects
-		 * Pass Matrices In Said Objects
-		 ********************************/
-		glGenBuffers(1, &uniform_Matrices);
-		glBindBuffer(GL_UNIFORM_BUFFER, uniform_Matrices);
-		glNamedBufferData(uniform_Matrices, sizeof(mat4x4) * 2, NULL, GL_DYNAMIC_DRAW);
-		glNamedBufferSubData(uniform_Matrices, 0, sizeof(mat4x4), Projection);
-		glNamedBufferSubData(uniform_Matrices, sizeof(mat4x4), sizeof(mat4x4), ModelView);
+		struct shaggy_ring_allocation uniform_Matrices;
 
 		/***********************
 		 * Input Handling Logic
@@ -235,15 +372,53 @@ int main(int argc, char *argv[]) {
 			}
 		}
 
+		/***********************
+		 * Build World Matrices
+		 ***********************/
+		shaggy_camera_update(&ctx.camera);
+
+		if (camera_version != ctx.camera.version) {
+			camera_version = ctx.camera.version;
+			shaggy_math.mat4x4_mul(ModelView, ctx.camera.view, Model);
+		}
+
+		/*********************************
+		 * Pass Matrices Through The Ring
+		 * Waits if the GPU is 3 frames in
+		 *********************************/
+		shaggy_frame_ring_begin(&uniform_ring);
+		shaggy_command_buffer_begin(&commands);
+		shaggy_block_writer_refresh(&matrices);
+
+		if (matrices.size && shaggy_frame_ring_alloc(&uniform_ring, matrices.size, &uniform_Matrices)) {
+			shaggy_block_write_mat4x4(uniform_Matrices.data, &matrices.members[MATRICES_PROJECTION], 0, ctx.camera.projection);
+			shaggy_block_write_mat4x4(uniform_Matrices.data, &matrices.members[MATRICES_MODEL_VIEW], 0, ModelView);
+			shaggy_frame_ring_bind(&uniform_ring, (GLuint) matrices.binding, &uniform_Matrices);
+		}
+
+		/*************************
+		 * Submit Recorded Draws
+		 *************************/
+		shaggy_command_buffer_submit(&commands);
+
 		/********************
 		 * Swap Framebuffers
 		 ********************/
 		SDL_GL_SwapWindow(ctx.window);
+		shaggy_frame_ring_end(&uniform_ring);
+
+		/**********************************
+		 * Pick Up Edited Shaders
+		 * Between frames, never mid-frame
+		 **********************************/
+		shaggy_manage_poll_reload(shader_manager);
 	}
 
 	/**********
 	 * Cleanup
 	 **********/
+	shaggy_command_buffer_destroy(&commands);
+	shaggy_frame_ring_destroy(&uniform_ring);
 	SDL_DestroyWindow(ctx.window);
 	SDL_Quit();
 
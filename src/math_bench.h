@@ -0,0 +1,401 @@
+#ifndef SHAGGY_MATH_BENCH_H
+#define SHAGGY_MATH_BENCH_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "math_dispatch.h"
+#include "camera.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "workers.h"
+
+/****************************************************************
+ * CPU side math benchmarks, no GL context needed.
+ * Each kernel is run once per variant this CPU can bind, see
+ * math_dispatch.h, so the numbers show what each tier buys.
+ ****************************************************************/
+
+#define SHAGGY_BENCH_JOINTS 4096
+#define SHAGGY_BENCH_ANIMATION_FRAMES 256
+#define SHAGGY_BENCH_CULL_OBJECTS (1 << 20)
+#define SHAGGY_BENCH_CULL_FRAMES 32
+#define SHAGGY_BENCH_OCCLUDERS 48
+
+/* Deterministic, so runs are comparable */
+static inline
+float shaggy_bench_random(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return (float) (*state >> 8) / (float) (1u << 23) - 1.0f;
+}
+
+static inline
+void shaggy_bench_random_rotations(quat_soa q, size_t n, uint32_t *state) {
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		quat r = {
+				shaggy_bench_random(state), shaggy_bench_random(state),
+				shaggy_bench_random(state), shaggy_bench_random(state)
+		};
+
+		quat_norm(r, r);
+		q.x[i] = r[0];
+		q.y[i] = r[1];
+		q.z[i] = r[2];
+		q.w[i] = r[3];
+	}
+}
+
+static inline
+double shaggy_bench_ns_per(Uint64 start, size_t count) {
+	return (double) (SDL_GetPerformanceCounter() - start) * 1e9 / (double) SDL_GetPerformanceFrequency() / (double) count;
+}
+
+/*****************************************************************
+ * Blend two poses and build joint matrices, the per-frame work of
+ * an animated skeleton, SHAGGY_BENCH_JOINTS joints at a time. The
+ * same again with the poses as dual quaternions.
+ *****************************************************************/
+static inline
+void shaggy_bench_animation(void) {
+	const size_t n = SHAGGY_BENCH_JOINTS;
+	const size_t count = n * SHAGGY_BENCH_ANIMATION_FRAMES;
+	float *streams = malloc(sizeof(float) * n * 45);
+	mat4x4 *matrices = malloc(sizeof(mat4x4) * n);
+	uint32_t state = 1;
+	volatile float sink = 0.0f;
+	pose_soa a, b, r;
+	dualquat_soa da, db, dr;
+	Uint64 start;
+	size_t i, frame;
+	int isa;
+
+	if (!streams || !matrices) {
+		logm(ERROR, "Out of memory for the animation benchmark");
+		goto cleanup;
+	}
+
+	a.rotation = (quat_soa) { streams, streams + n, streams + 2 * n, streams + 3 * n };
+	a.translation = (vec3_soa) { streams + 4 * n, streams + 5 * n, streams + 6 * n };
+	b.rotation = (quat_soa) { streams + 7 * n, streams + 8 * n, streams + 9 * n, streams + 10 * n };
+	b.translation = (vec3_soa) { streams + 11 * n, streams + 12 * n, streams + 13 * n };
+	r.rotation = (quat_soa) { streams + 14 * n, streams + 15 * n, streams + 16 * n, streams + 17 * n };
+	r.translation = (vec3_soa) { streams + 18 * n, streams + 19 * n, streams + 20 * n };
+	da.real = (quat_soa) { streams + 21 * n, streams + 22 * n, streams + 23 * n, streams + 24 * n };
+	da.dual = (quat_soa) { streams + 25 * n, streams + 26 * n, streams + 27 * n, streams + 28 * n };
+	db.real = (quat_soa) { streams + 29 * n, streams + 30 * n, streams + 31 * n, streams + 32 * n };
+	db.dual = (quat_soa) { streams + 33 * n, streams + 34 * n, streams + 35 * n, streams + 36 * n };
+	dr.real = (quat_soa) { streams + 37 * n, streams + 38 * n, streams + 39 * n, streams + 40 * n };
+	dr.dual = (quat_soa) { streams + 41 * n, streams + 42 * n, streams + 43 * n, streams + 44 * n };
+
+	shaggy_bench_random_rotations(a.rotation, n, &state);
+	shaggy_bench_random_rotations(b.rotation, n, &state);
+	/* x, y and z are laid out back to back */
+	for (i = 0; i < 3 * n; ++i) {
+		a.translation.x[i] = shaggy_bench_random(&state);
+		b.translation.x[i] = shaggy_bench_random(&state);
+	}
+	dualquat_soa_from_pose(da, a, n);
+	dualquat_soa_from_pose(db, b, n);
+
+	logm(INFO, "Animation benchmark, %zu joints x %d frames", n, SHAGGY_BENCH_ANIMATION_FRAMES);
+
+	/* What a plain loop over linmath.h costs, for reference */
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+		float t = (float) frame / SHAGGY_BENCH_ANIMATION_FRAMES;
+
+		for (i = 0; i < n; ++i) {
+			quat p = { a.rotation.x[i], a.rotation.y[i], a.rotation.z[i], a.rotation.w[i] };
+			quat q = { b.rotation.x[i], b.rotation.y[i], b.rotation.z[i], b.rotation.w[i] };
+			quat s;
+
+			quat_slerp(s, p, q, t);
+			sink += s[3];
+		}
+	}
+	logm(INFO, "quat_slerp, one at a time: %.2f ns per joint", shaggy_bench_ns_per(start, count));
+
+	for (isa = 0; isa < SHAGGY_MATH_ISA_COUNT; ++isa) {
+		struct shaggy_math_kernels kernels;
+		double nlerp, slerp, matrices_ns, blend, dq_blend, dq_matrices;
+
+		if (!shaggy_math_bind(&kernels, (enum shaggy_math_isa) isa)) {
+			continue;
+		}
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.quat_soa_nlerp(r.rotation, a.rotation, b.rotation, (float) frame / SHAGGY_BENCH_ANIMATION_FRAMES, n);
+			sink += r.rotation.w[frame];
+		}
+		nlerp = shaggy_bench_ns_per(start, count);
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.quat_soa_slerp(r.rotation, a.rotation, b.rotation, (float) frame / SHAGGY_BENCH_ANIMATION_FRAMES, n);
+			sink += r.rotation.w[frame];
+		}
+		slerp = shaggy_bench_ns_per(start, count);
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.mat4x4_from_pose_soa(matrices, r, n);
+			sink += matrices[frame][3][3];
+		}
+		matrices_ns = shaggy_bench_ns_per(start, count);
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.pose_soa_blend(r, a, b, (float) frame / SHAGGY_BENCH_ANIMATION_FRAMES, n);
+			sink += r.translation.x[frame];
+		}
+		blend = shaggy_bench_ns_per(start, count);
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.dualquat_soa_blend(dr, da, db, (float) frame / SHAGGY_BENCH_ANIMATION_FRAMES, n);
+			sink += dr.dual.w[frame];
+		}
+		dq_blend = shaggy_bench_ns_per(start, count);
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_ANIMATION_FRAMES; ++frame) {
+			kernels.mat4x4_from_dualquat_soa(matrices, dr, n);
+			sink += matrices[frame][3][0];
+		}
+		dq_matrices = shaggy_bench_ns_per(start, count);
+
+		logm(INFO, "%s: nlerp %.2f ns, approximate slerp %.2f ns, pose to matrix %.2f ns per joint",
+			 shaggy_math_isa_name(kernels.isa), nlerp, slerp, matrices_ns);
+		logm(INFO, "%s: pose blend %.2f ns, dual quaternion blend %.2f ns, dual quaternion to matrix %.2f ns per joint",
+			 shaggy_math_isa_name(kernels.isa), blend, dq_blend, dq_matrices);
+	}
+
+	(void) sink;
+
+cleanup:
+	free(streams);
+	free(matrices);
+}
+
+/*****************************************************************
+ * Frustum cull a scattered scene of spheres and boxes with each
+ * variant, then across worker threads. Every variant has to agree
+ * with the scalar list or the numbers mean nothing.
+ *****************************************************************/
+static inline
+size_t shaggy_bench_cull(const struct shaggy_math_kernels *kernels, int kind, const struct shaggy_frustum *frustum,
+						 struct shaggy_spheres spheres, struct shaggy_aabbs aabbs, size_t n, uint32_t *visible) {
+	return kind ? kernels->cull_aabbs(frustum, aabbs, 0, n, visible)
+				: kernels->cull_spheres(frustum, spheres, 0, n, visible);
+}
+
+static inline
+void shaggy_bench_culling(void) {
+	const size_t n = SHAGGY_BENCH_CULL_OBJECTS;
+	float *streams = malloc(sizeof(float) * n * 7);
+	uint32_t *expected = malloc(sizeof(uint32_t) * n);
+	uint32_t *visible = malloc(sizeof(uint32_t) * n);
+	struct shaggy_spheres spheres;
+	struct shaggy_aabbs aabbs;
+	struct shaggy_camera camera;
+	struct shaggy_workers workers;
+	uint32_t state = 1;
+	size_t i, count;
+	int kind, isa;
+
+	if (!streams || !expected || !visible) {
+		logm(ERROR, "Out of memory for the culling benchmark");
+		goto cleanup;
+	}
+
+	/* Spheres and boxes share centers, the radius doubles as the x extent */
+	spheres.center = aabbs.center = (vec3_soa) { streams, streams + n, streams + 2 * n };
+	spheres.radius = streams + 3 * n;
+	aabbs.extent = (vec3_soa) { streams + 3 * n, streams + 4 * n, streams + 5 * n };
+
+	for (i = 0; i < 3 * n; ++i) {
+		streams[i] = 100.0f * shaggy_bench_random(&state);
+	}
+	for (i = 3 * n; i < 6 * n; ++i) {
+		streams[i] = 1.0f + shaggy_bench_random(&state) * 0.5f;
+	}
+
+	shaggy_camera_init(&camera, 1.7f, 0.1f, 100.0f, 1920, 1080);
+	shaggy_camera_update(&camera);
+
+	if (!shaggy_workers_init(&workers, -1)) {
+		goto cleanup;
+	}
+
+	logm(INFO, "Culling benchmark, %zu objects x %d frames", n, SHAGGY_BENCH_CULL_FRAMES);
+
+	for (kind = 0; kind < 2; ++kind) {
+		const char *what = kind ? "aabbs" : "spheres";
+		Uint64 start;
+		int frame;
+
+		count = kind ? shaggy_cull_aabbs_scalar(&camera.frustum, aabbs, 0, n, expected)
+					 : shaggy_cull_spheres_scalar(&camera.frustum, spheres, 0, n, expected);
+
+		for (isa = 0; isa < SHAGGY_MATH_ISA_COUNT; ++isa) {
+			struct shaggy_math_kernels kernels;
+
+			if (!shaggy_math_bind(&kernels, (enum shaggy_math_isa) isa)) {
+				continue;
+			}
+
+			start = SDL_GetPerformanceCounter();
+			for (frame = 0; frame < SHAGGY_BENCH_CULL_FRAMES; ++frame) {
+				i = shaggy_bench_cull(&kernels, kind, &camera.frustum, spheres, aabbs, n, visible);
+			}
+			logm(INFO, "%s, %s: %.2f ns per object, %zu of %zu visible%s", what, shaggy_math_isa_name(kernels.isa),
+				 shaggy_bench_ns_per(start, n * SHAGGY_BENCH_CULL_FRAMES), i, n,
+				 i == count && memcmp(visible, expected, count * sizeof(*visible)) == 0 ? "" : ", differs from scalar");
+		}
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_CULL_FRAMES; ++frame) {
+			i = kind ? shaggy_cull_aabbs_parallel(&workers, &camera.frustum, aabbs, n, visible)
+					 : shaggy_cull_spheres_parallel(&workers, &camera.frustum, spheres, n, visible);
+		}
+		logm(INFO, "%s, %s, %d threads: %.2f ns per object, %zu of %zu visible%s", what,
+			 shaggy_math_isa_name(shaggy_math.isa), workers.count + 1, shaggy_bench_ns_per(start, n * SHAGGY_BENCH_CULL_FRAMES), i, n,
+			 i == count && memcmp(visible, expected, count * sizeof(*visible)) == 0 ? "" : ", differs from scalar");
+	}
+
+	shaggy_workers_destroy(&workers);
+
+cleanup:
+	free(streams);
+	free(expected);
+	free(visible);
+}
+
+/*****************************************************************
+ * A street of box shaped walls in front of a field of small boxes.
+ * Times drawing the occluders and building the pyramid, then the
+ * box queries per variant and across worker threads, which must
+ * all agree with the scalar mask.
+ *****************************************************************/
+static inline
+void shaggy_bench_occlusion(void) {
+	/* Unit cube, vertex i has x, y, z from its bits, faces wound outwards */
+	static const uint32_t cube_indices[36] = {
+			1, 3, 7, 1, 7, 5, 0, 6, 2, 0, 4, 6,
+			2, 6, 7, 2, 7, 3, 0, 1, 5, 0, 5, 4,
+			4, 5, 7, 4, 7, 6, 0, 2, 3, 0, 3, 1
+	};
+	const size_t n = SHAGGY_BENCH_CULL_OBJECTS;
+	float cube[3][8];
+	float *streams = malloc(sizeof(float) * n * 6);
+	uint8_t *expected = malloc(n);
+	uint8_t *visible = malloc(n);
+	struct shaggy_occlusion occlusion;
+	struct shaggy_workers workers;
+	struct shaggy_camera camera;
+	struct shaggy_aabbs boxes;
+	mat4x4 walls[SHAGGY_BENCH_OCCLUDERS];
+	uint32_t state = 1;
+	Uint64 start;
+	size_t i, hidden = 0;
+	int frame, wall, variant;
+	bool ready = false;
+
+	if (!streams || !expected || !visible) {
+		logm(ERROR, "Out of memory for the occlusion benchmark");
+		goto cleanup;
+	}
+
+	if (!shaggy_occlusion_init(&occlusion, 256, 128)) {
+		goto cleanup;
+	}
+	if (!shaggy_workers_init(&workers, -1)) {
+		shaggy_occlusion_destroy(&occlusion);
+		goto cleanup;
+	}
+	ready = true;
+
+	for (i = 0; i < 8; ++i) {
+		cube[0][i] = i & 1 ? 1.0f : -1.0f;
+		cube[1][i] = i & 2 ? 1.0f : -1.0f;
+		cube[2][i] = i & 4 ? 1.0f : -1.0f;
+	}
+
+	shaggy_camera_init(&camera, 1.2f, 0.1f, 100.0f, occlusion.width, occlusion.height);
+	shaggy_camera_update(&camera);
+
+	for (wall = 0; wall < SHAGGY_BENCH_OCCLUDERS; ++wall) {
+		mat4x4 model;
+
+		mat4x4_translate(model, 8.0f * shaggy_bench_random(&state), 4.0f * shaggy_bench_random(&state),
+						 -14.0f + 6.0f * shaggy_bench_random(&state));
+		mat4x4_scale_aniso(model, model, 3.0f + shaggy_bench_random(&state), 2.0f + shaggy_bench_random(&state), 0.3f);
+		mat4x4_mul(walls[wall], camera.view_projection, model);
+	}
+
+	boxes.center = (vec3_soa) { streams, streams + n, streams + 2 * n };
+	boxes.extent = (vec3_soa) { streams + 3 * n, streams + 4 * n, streams + 5 * n };
+	for (i = 0; i < n; ++i) {
+		boxes.center.x[i] = 40.0f * shaggy_bench_random(&state);
+		boxes.center.y[i] = 20.0f * shaggy_bench_random(&state);
+		boxes.center.z[i] = -57.0f + 32.0f * shaggy_bench_random(&state);
+	}
+	for (i = 3 * n; i < 6 * n; ++i) {
+		streams[i] = 0.35f + 0.15f * shaggy_bench_random(&state);
+	}
+
+	logm(INFO, "Occlusion benchmark, %d walls in front of %zu boxes, %dx%d depth", SHAGGY_BENCH_OCCLUDERS, n,
+		 occlusion.width, occlusion.height);
+
+	start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < SHAGGY_BENCH_CULL_FRAMES; ++frame) {
+		shaggy_occlusion_begin(&occlusion);
+		for (wall = 0; wall < SHAGGY_BENCH_OCCLUDERS; ++wall) {
+			shaggy_occlusion_add_occluder(&occlusion, walls[wall], (vec3_soa) { cube[0], cube[1], cube[2] }, 8, cube_indices, 12);
+		}
+		shaggy_occlusion_finish(&occlusion, &workers);
+	}
+	logm(INFO, "Occluders, %d threads: %.2f us per frame, %zu triangles drawn", workers.count + 1,
+		 shaggy_bench_ns_per(start, SHAGGY_BENCH_CULL_FRAMES) / 1000.0, occlusion.triangle_count);
+
+	shaggy_occlusion_test_aabbs_scalar(&occlusion, camera.view_projection, boxes, 0, n, expected);
+	for (i = 0; i < n; ++i) {
+		hidden += !expected[i];
+	}
+
+	for (variant = 0; variant < 3; ++variant) {
+		static const char *const names[] = { "scalar", "widest variant", "threads" };
+
+		start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < SHAGGY_BENCH_CULL_FRAMES; ++frame) {
+			if (variant == 0) {
+				shaggy_occlusion_test_aabbs_scalar(&occlusion, camera.view_projection, boxes, 0, n, visible);
+			} else if (variant == 1) {
+				shaggy_occlusion_test_aabbs(&occlusion, camera.view_projection, boxes, 0, n, visible);
+			} else {
+				shaggy_occlusion_test_aabbs_parallel(&workers, &occlusion, camera.view_projection, boxes, n, visible);
+			}
+		}
+		logm(INFO, "Box queries, %s: %.2f ns per box, %zu of %zu hidden%s", names[variant],
+			 shaggy_bench_ns_per(start, n * SHAGGY_BENCH_CULL_FRAMES), hidden, n,
+			 memcmp(visible, expected, n) == 0 ? "" : ", differs from scalar");
+	}
+
+cleanup:
+	if (ready) {
+		shaggy_workers_destroy(&workers);
+		shaggy_occlusion_destroy(&occlusion);
+	}
+	free(streams);
+	free(expected);
+	free(visible);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "sclog4c/sclog4c.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "math_dispatch.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SHAGGY_MATH_CPUID
+#endif
+
+/* Whatever linmath.h picked for this translation unit */
+struct shaggy_math_kernels shaggy_math = {
+#if defined(LINMATH_AVX_FMA)
+		SHAGGY_MATH_AVX2_FMA,
+#elif defined(LINMATH_SSE2)
+		SHAGGY_MATH_SSE2,
+#else
+		SHAGGY_MATH_SCALAR,
+#endif
+		mat4x4_mul,
+		mat4x4_mul_vec4,
+		mat4x4_invert,
+		quat_mul,
+		vec3_soa_transform_points,
+		vec4_soa_transform_points,
+		vec3_soa_transform_dirs,
+		mat4x4_mul_batch,
+		mat4x4_invert_affine_batch,
+		quat_soa_nlerp,
+		quat_soa_slerp,
+		mat4x4_from_pose_soa,
+		pose_soa_blend,
+		dualquat_soa_from_pose,
+		dualquat_soa_blend,
+		mat4x4_from_dualquat_soa,
+		shaggy_cull_spheres,
+		shaggy_cull_aabbs
+};
+
+static const char *const shaggy_math_isa_names[SHAGGY_MATH_ISA_COUNT] = {
+		"scalar", "sse2", "avx2"
+};
+
+const char *shaggy_math_isa_name(enum shaggy_math_isa isa) {
+	return isa < SHAGGY_MATH_ISA_COUNT ? shaggy_math_isa_names[isa] : "unknown";
+}
+
+/* Can the CPU (and OS, for the AVX state) run this variant */
+static bool shaggy_math_cpu_supports(enum shaggy_math_isa isa) {
+#if defined(SHAGGY_MATH_CPUID)
+	__builtin_cpu_init();
+#endif
+
+	switch (isa) {
+		case SHAGGY_MATH_SCALAR:
+			return true;
+		case SHAGGY_MATH_SSE2:
+#if defined(SHAGGY_MATH_CPUID)
+			return __builtin_cpu_supports("sse2");
+#else
+			/* Only compiled in when the target guarantees it */
+			return true;
+#endif
+		case SHAGGY_MATH_AVX2_FMA:
+#if defined(SHAGGY_MATH_CPUID)
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+			return false;
+#endif
+		default:
+			return false;
+	}
+}
+
+bool shaggy_math_bind(struct shaggy_math_kernels *kernels, enum shaggy_math_isa isa) {
+	if (!shaggy_math_cpu_supports(isa)) {
+		return false;
+	}
+
+	switch (isa) {
+		case SHAGGY_MATH_SCALAR:
+			kernels->isa = SHAGGY_MATH_SCALAR;
+			kernels->mat4x4_mul = mat4x4_mul_scalar;
+			kernels->mat4x4_mul_vec4 = mat4x4_mul_vec4_scalar;
+			kernels->mat4x4_invert = mat4x4_invert_scalar;
+			kernels->quat_mul = quat_mul_scalar;
+			kernels->vec3_soa_transform_points = vec3_soa_transform_points_scalar;
+			kernels->vec4_soa_transform_points = vec4_soa_transform_points_scalar;
+			kernels->vec3_soa_transform_dirs = vec3_soa_transform_dirs_scalar;
+			kernels->mat4x4_mul_batch = mat4x4_mul_batch_scalar;
+			kernels->mat4x4_invert_affine_batch = mat4x4_invert_affine_batch_scalar;
+			kernels->quat_soa_nlerp = quat_soa_nlerp_scalar;
+			kernels->quat_soa_slerp = quat_soa_slerp_scalar;
+			kernels->mat4x4_from_pose_soa = mat4x4_from_pose_soa_scalar;
+			kernels->pose_soa_blend = pose_soa_blend_scalar;
+			kernels->dualquat_soa_from_pose = dualquat_soa_from_pose_scalar;
+			kernels->dualquat_soa_blend = dualquat_soa_blend_scalar;
+			kernels->mat4x4_from_dualquat_soa = mat4x4_from_dualquat_soa_scalar;
+			kernels->cull_spheres = shaggy_cull_spheres_scalar;
+			kernels->cull_aabbs = shaggy_cull_aabbs_scalar;
+			break;
+#if defined(LINMATH_SSE2)
+		case SHAGGY_MATH_SSE2:
+			kernels->isa = SHAGGY_MATH_SSE2;
+			kernels->mat4x4_mul = mat4x4_mul_sse2;
+			kernels->mat4x4_mul_vec4 = mat4x4_mul_vec4_sse2;
+			kernels->mat4x4_invert = mat4x4_invert_sse2;
+			kernels->quat_mul = quat_mul_sse2;
+			kernels->vec3_soa_transform_points = vec3_soa_transform_points_sse2;
+			kernels->vec4_soa_transform_points = vec4_soa_transform_points_sse2;
+			kernels->vec3_soa_transform_dirs = vec3_soa_transform_dirs_sse2;
+			kernels->mat4x4_mul_batch = mat4x4_mul_batch_sse2;
+			kernels->mat4x4_invert_affine_batch = mat4x4_invert_affine_batch_sse2;
+			kernels->quat_soa_nlerp = quat_soa_nlerp_sse2;
+			kernels->quat_soa_slerp = quat_soa_slerp_sse2;
+			kernels->mat4x4_from_pose_soa = mat4x4_from_pose_soa_sse2;
+			kernels->pose_soa_blend = pose_soa_blend_sse2;
+			kernels->dualquat_soa_from_pose = dualquat_soa_from_pose_sse2;
+			kernels->dualquat_soa_blend = dualquat_soa_blend_sse2;
+			kernels->mat4x4_from_dualquat_soa = mat4x4_from_dualquat_soa_sse2;
+			kernels->cull_spheres = shaggy_cull_spheres_sse2;
+			kernels->cull_aabbs = shaggy_cull_aabbs_sse2;
+			break;
+#endif
+#if defined(SHAGGY_MATH_DISPATCH_AVX2)
+		case SHAGGY_MATH_AVX2_FMA:
+			shaggy_math_bind_avx2(kernels);
+			break;
+#endif
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+void shaggy_math_dispatch_init(void) {
+	enum shaggy_math_isa cap = SHAGGY_MATH_ISA_COUNT - 1;
+	const char *requested = getenv("SHAGGY_MATH");
+	int isa;
+
+#if defined(SHAGGY_MATH_CPUID)
+	__builtin_cpu_init();
+	logm(CONFIG, "CPU features:%s%s%s%s%s",
+		 __builtin_cpu_supports("sse2") ? " sse2" : "",
+		 __builtin_cpu_supports("sse4.1") ? " sse4.1" : "",
+		 __builtin_cpu_supports("avx2") ? " avx2" : "",
+		 __builtin_cpu_supports("fma") ? " fma" : "",
+		 __builtin_cpu_supports("avx512f") ? " avx512f" : "");
+#endif
+
+	if (requested) {
+		for (isa = 0; isa < SHAGGY_MATH_ISA_COUNT; ++isa) {
+			if (strcmp(requested, shaggy_math_isa_names[isa]) == 0) {
+				cap = (enum shaggy_math_isa) isa;
+				break;
+			}
+		}
+
+		if (isa == SHAGGY_MATH_ISA_COUNT) {
+			logm(WARNING, "Unknown SHAGGY_MATH=%s, expected scalar, sse2 or avx2", requested);
+		}
+	}
+
+	for (isa = cap; isa >= 0; --isa) {
+		struct shaggy_math_kernels kernels;
+
+		if (shaggy_math_bind(&kernels, (enum shaggy_math_isa) isa)) {
+			shaggy_math = kernels;
+			break;
+		}
+	}
+
+	logm(CONFIG, "Math kernels: %s", shaggy_math_isa_name(shaggy_math.isa));
+}
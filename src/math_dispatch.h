@@ -0,0 +1,78 @@
+#ifndef SHAGGY_MATH_DISPATCH_H
+#define SHAGGY_MATH_DISPATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "linmath.h"
+#include "linmath_batch.h"
+#include "frustum.h"
+
+/*****************************************************************
+ * Math Dispatch
+ * linmath.h picks its kernels when it is compiled, which for a
+ * binary that ships to many machines means the oldest CPU it has
+ * to run on. The hot routines are also reachable through
+ * shaggy_math, bound once at startup to the widest variant this
+ * CPU can run. The AVX2/FMA variants live in their own translation
+ * unit (math_dispatch_avx2.c) built with those instructions
+ * enabled, so nothing else in the binary depends on them.
+ *
+ * Until shaggy_math_dispatch_init runs the table holds whatever
+ * linmath.h picked at compile time, so it is always safe to call.
+ *****************************************************************/
+
+enum shaggy_math_isa {
+	SHAGGY_MATH_SCALAR,
+	SHAGGY_MATH_SSE2,
+	SHAGGY_MATH_AVX2_FMA,
+	SHAGGY_MATH_ISA_COUNT
+};
+
+struct shaggy_math_kernels {
+	enum shaggy_math_isa isa;
+
+	void (*mat4x4_mul)(mat4x4 M, mat4x4 a, mat4x4 b);
+	void (*mat4x4_mul_vec4)(vec4 r, mat4x4 M, vec4 v);
+	void (*mat4x4_invert)(mat4x4 T, mat4x4 M);
+	void (*quat_mul)(quat r, quat p, quat q);
+
+	void (*vec3_soa_transform_points)(vec3_soa r, mat4x4 M, vec3_soa v, size_t n);
+	void (*vec4_soa_transform_points)(vec4_soa r, mat4x4 M, vec3_soa v, size_t n);
+	void (*vec3_soa_transform_dirs)(vec3_soa r, mat4x4 M, vec3_soa v, size_t n);
+	void (*mat4x4_mul_batch)(mat4x4 *R, mat4x4 a, mat4x4 *b, size_t n);
+	void (*mat4x4_invert_affine_batch)(mat4x4 *T, mat4x4 *M, size_t n);
+	void (*quat_soa_nlerp)(quat_soa r, quat_soa a, quat_soa b, float t, size_t n);
+	void (*quat_soa_slerp)(quat_soa r, quat_soa a, quat_soa b, float t, size_t n);
+	void (*mat4x4_from_pose_soa)(mat4x4 *M, pose_soa p, size_t n);
+	void (*pose_soa_blend)(pose_soa r, pose_soa a, pose_soa b, float t, size_t n);
+	void (*dualquat_soa_from_pose)(dualquat_soa r, pose_soa p, size_t n);
+	void (*dualquat_soa_blend)(dualquat_soa r, dualquat_soa a, dualquat_soa b, float t, size_t n);
+	void (*mat4x4_from_dualquat_soa)(mat4x4 *M, dualquat_soa q, size_t n);
+
+	size_t (*cull_spheres)(const struct shaggy_frustum *frustum, struct shaggy_spheres s, size_t begin, size_t end, uint32_t *visible);
+	size_t (*cull_aabbs)(const struct shaggy_frustum *frustum, struct shaggy_aabbs b, size_t begin, size_t end, uint32_t *visible);
+};
+
+extern struct shaggy_math_kernels shaggy_math;
+
+/*****************************************************************
+ * Detect what the CPU supports and bind shaggy_math, logs the
+ * result at CONFIG. SHAGGY_MATH=scalar|sse2|avx2 in the
+ * environment caps the choice, e.g. to compare variants.
+ *****************************************************************/
+void shaggy_math_dispatch_init(void);
+
+/*****************************************************************
+ * Fill kernels with one variant without touching shaggy_math.
+ * @return false if that variant isn't in this build or the CPU
+ *         can't run it.
+ *****************************************************************/
+bool shaggy_math_bind(struct shaggy_math_kernels *kernels, enum shaggy_math_isa isa);
+
+const char *shaggy_math_isa_name(enum shaggy_math_isa isa);
+
+/* Defined by math_dispatch_avx2.c when the build has SHAGGY_MATH_DISPATCH_AVX2 */
+void shaggy_math_bind_avx2(struct shaggy_math_kernels *kernels);
+
+#endif
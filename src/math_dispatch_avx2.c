@@ -0,0 +1,37 @@
+#include "math_dispatch.h"
+
+/*****************************************************************
+ * Built with -mavx2 -mfma (see CMakeLists.txt), only ever called
+ * after shaggy_math_dispatch_init has checked the CPU for both.
+ * The static inline kernels get their own AVX copies in here.
+ *****************************************************************/
+
+#ifndef LINMATH_AVX_FMA
+#error "math_dispatch_avx2.c must be compiled with AVX2 and FMA enabled"
+#endif
+
+void shaggy_math_bind_avx2(struct shaggy_math_kernels *kernels) {
+	kernels->isa = SHAGGY_MATH_AVX2_FMA;
+
+	kernels->mat4x4_mul = mat4x4_mul_avx_fma;
+	kernels->mat4x4_mul_vec4 = mat4x4_mul_vec4_avx_fma;
+	kernels->mat4x4_invert = mat4x4_invert_sse2;
+	kernels->quat_mul = quat_mul_sse2;
+
+	kernels->vec3_soa_transform_points = vec3_soa_transform_points_avx_fma;
+	kernels->vec4_soa_transform_points = vec4_soa_transform_points_avx_fma;
+	kernels->vec3_soa_transform_dirs = vec3_soa_transform_dirs_avx_fma;
+	kernels->mat4x4_mul_batch = mat4x4_mul_batch_avx_fma;
+	kernels->mat4x4_invert_affine_batch = mat4x4_invert_affine_batch_sse2;
+
+	kernels->quat_soa_nlerp = quat_soa_nlerp_avx_fma;
+	kernels->quat_soa_slerp = quat_soa_slerp_avx_fma;
+	kernels->mat4x4_from_pose_soa = mat4x4_from_pose_soa_avx_fma;
+	kernels->pose_soa_blend = pose_soa_blend_avx_fma;
+	kernels->dualquat_soa_from_pose = dualquat_soa_from_pose_avx_fma;
+	kernels->dualquat_soa_blend = dualquat_soa_blend_avx_fma;
+	kernels->mat4x4_from_dualquat_soa = mat4x4_from_dualquat_soa_avx_fma;
+
+	kernels->cull_spheres = shaggy_cull_spheres_avx_fma;
+	kernels->cull_aabbs = shaggy_cull_aabbs_avx_fma;
+}
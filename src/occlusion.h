@@ -0,0 +1,735 @@
+#ifndef SHAGGY_OCCLUSION_H
+#define SHAGGY_OCCLUSION_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linmath.h"
+#include "linmath_batch.h"
+#include "culling.h"
+#include "math_dispatch.h"
+#include "workers.h"
+
+/*****************************************************************
+ * Occlusion Culling
+ * A small depth buffer filled on the CPU from a few big occluder
+ * meshes, walls and floors, then reduced to a max depth pyramid.
+ * A box is hidden if its nearest point is further away than the
+ * furthest occluder depth over every pixel its screen rectangle
+ * touches. The pyramid level is picked so that is at most 2x2
+ * texels, so each query is a fixed handful of loads.
+ *
+ * Each frame:
+ *   shaggy_occlusion_begin
+ *   shaggy_occlusion_add_occluder, for every occluder mesh
+ *   shaggy_occlusion_finish, rasterizes and builds the pyramid
+ *   shaggy_occlusion_test_aabbs, as often as needed
+ *
+ * Triangles are binned into screen tiles and each tile is its own
+ * job, so tiles rasterize on different threads without sharing
+ * a pixel. Everything that can go wrong only ever keeps more
+ * objects: occluders are sampled at pixel centers, only the parts
+ * of them in front of the near plane are drawn, and boxes that
+ * reach the near plane are always visible.
+ *
+ * Depth is GL NDC z, -1 near to 1 far, y goes up.
+ *****************************************************************/
+
+#define SHAGGY_OCCLUSION_TILE_WIDTH 32  /* Pixels, a multiple of 4 */
+#define SHAGGY_OCCLUSION_TILE_HEIGHT 16
+#define SHAGGY_OCCLUSION_LEVELS_MAX 16
+
+struct shaggy_occlusion_triangle {
+	float edge[3][3]; /* a x + b y + c >= 0 inside, for each edge */
+	float depth[3];   /* NDC z = a x + b y + c */
+	int min_x, min_y; /* Pixels it may cover, inclusive */
+	int max_x, max_y;
+};
+
+struct shaggy_occlusion {
+	int width;  /* Powers of two, multiples of the tile size */
+	int height;
+	int tiles_x;
+	int tiles_y;
+
+	float *levels[SHAGGY_OCCLUSION_LEVELS_MAX]; /* levels[0] is the depth buffer */
+	int level_count;
+
+	struct shaggy_occlusion_triangle *triangles;
+	size_t triangle_count;
+	size_t triangle_capacity;
+
+	vec4_soa clip; /* Scratch for transformed occluder vertices */
+	size_t clip_capacity;
+
+	uint32_t *bins;        /* Triangle indices, grouped by tile */
+	size_t bin_capacity;
+	uint32_t *bin_offsets; /* Per tile, plus one past the last */
+};
+
+/* Room for at least needed entries, NULL if out of memory and data is left as it was */
+static inline
+void *shaggy_occlusion_grow(void *data, size_t *capacity, size_t needed, size_t size) {
+	size_t grown = *capacity ? *capacity : 256;
+
+	if (needed <= *capacity) {
+		return data;
+	}
+
+	while (grown < needed) {
+		grown *= 2;
+	}
+
+	data = realloc(data, grown * size);
+	if (!data) {
+		logm(ERROR, "Out of memory for %zu occlusion entries", grown);
+		return NULL;
+	}
+
+	*capacity = grown;
+	return data;
+}
+
+/*****************************************************************
+ * @param width  Depth buffer size, e.g. 256 x 128. Powers of two
+ *               and multiples of the tile size.
+ * @return false if the size is unusable or allocation failed.
+ *****************************************************************/
+static inline
+bool shaggy_occlusion_init(struct shaggy_occlusion *occlusion, int width, int height) {
+	size_t total = 0;
+	int level, w, h;
+
+	memset(occlusion, 0, sizeof(*occlusion));
+
+	if (width < SHAGGY_OCCLUSION_TILE_WIDTH || height < SHAGGY_OCCLUSION_TILE_HEIGHT ||
+		(width & (width - 1)) || (height & (height - 1))) {
+		logm(ERROR, "Occlusion buffer %dx%d isn't a power of two of at least one tile", width, height);
+		return false;
+	}
+
+	occlusion->width = width;
+	occlusion->height = height;
+	occlusion->tiles_x = width / SHAGGY_OCCLUSION_TILE_WIDTH;
+	occlusion->tiles_y = height / SHAGGY_OCCLUSION_TILE_HEIGHT;
+
+	for (w = width, h = height; occlusion->level_count < SHAGGY_OCCLUSION_LEVELS_MAX; w /= 2, h /= 2) {
+		total += (size_t) (w ? w : 1) * (h ? h : 1);
+		++occlusion->level_count;
+
+		if (w <= 1 && h <= 1) {
+			break;
+		}
+	}
+
+	/* All levels in one block, level 0 first */
+	occlusion->levels[0] = malloc(sizeof(float) * total);
+	occlusion->bin_offsets = malloc(sizeof(uint32_t) * (occlusion->tiles_x * occlusion->tiles_y + 1));
+	if (!occlusion->levels[0] || !occlusion->bin_offsets) {
+		logm(ERROR, "Out of memory for a %dx%d occlusion buffer", width, height);
+		free(occlusion->levels[0]);
+		free(occlusion->bin_offsets);
+		memset(occlusion, 0, sizeof(*occlusion));
+		return false;
+	}
+
+	for (level = 1; level < occlusion->level_count; ++level) {
+		w = width >> (level - 1);
+		h = height >> (level - 1);
+		occlusion->levels[level] = occlusion->levels[level - 1] + (size_t) (w ? w : 1) * (h ? h : 1);
+	}
+
+	for (total = 0; total < (size_t) width * height; ++total) {
+		occlusion->levels[0][total] = 1.0f;
+	}
+
+	return true;
+}
+
+static inline
+void shaggy_occlusion_destroy(struct shaggy_occlusion *occlusion) {
+	free(occlusion->levels[0]);
+	free(occlusion->triangles);
+	free(occlusion->clip.x);
+	free(occlusion->bins);
+	free(occlusion->bin_offsets);
+	memset(occlusion, 0, sizeof(*occlusion));
+}
+
+static inline
+int shaggy_occlusion_level_width(const struct shaggy_occlusion *occlusion, int level) {
+	return occlusion->width >> level ? occlusion->width >> level : 1;
+}
+
+static inline
+int shaggy_occlusion_level_height(const struct shaggy_occlusion *occlusion, int level) {
+	return occlusion->height >> level ? occlusion->height >> level : 1;
+}
+
+/* Drop last frame's occluders */
+static inline
+void shaggy_occlusion_begin(struct shaggy_occlusion *occlusion) {
+	occlusion->triangle_count = 0;
+}
+
+/*****************************************************************
+ * Screen space setup of one clip space triangle that is in front
+ * of the near plane. Back facing, degenerate and off screen ones
+ * are dropped.
+ *****************************************************************/
+static inline
+bool shaggy_occlusion_setup_triangle(struct shaggy_occlusion *occlusion, const vec4 clip[3]) {
+	struct shaggy_occlusion_triangle *t, *triangles;
+	float x[3], y[3], z[3], area, min_x, min_y, max_x, max_y;
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		float inv_w = 1.0f / clip[i][3];
+		x[i] = (clip[i][0] * inv_w * 0.5f + 0.5f) * (float) occlusion->width;
+		y[i] = (clip[i][1] * inv_w * 0.5f + 0.5f) * (float) occlusion->height;
+		z[i] = clip[i][2] * inv_w;
+	}
+
+	/* Counter clockwise is front facing, as in GL */
+	area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0.0f)) {
+		return true;
+	}
+
+	min_x = fminf(x[0], fminf(x[1], x[2]));
+	max_x = fmaxf(x[0], fmaxf(x[1], x[2]));
+	min_y = fminf(y[0], fminf(y[1], y[2]));
+	max_y = fmaxf(y[0], fmaxf(y[1], y[2]));
+	if (max_x < 0.0f || max_y < 0.0f || min_x >= (float) occlusion->width || min_y >= (float) occlusion->height) {
+		return true;
+	}
+
+	triangles = shaggy_occlusion_grow(occlusion->triangles, &occlusion->triangle_capacity,
+									  occlusion->triangle_count + 1, sizeof(*triangles));
+	if (!triangles) {
+		return false;
+	}
+
+	occlusion->triangles = triangles;
+	t = &triangles[occlusion->triangle_count++];
+
+	for (i = 0; i < 3; ++i) {
+		int j = (i + 1) % 3;
+
+		/* Positive on the left of i -> j */
+		t->edge[i][0] = y[i] - y[j];
+		t->edge[i][1] = x[j] - x[i];
+		t->edge[i][2] = -(t->edge[i][0] * x[i] + t->edge[i][1] * y[i]);
+	}
+
+	/* Edge 1 (1 -> 2) is the weight of vertex 0, edge 2 of vertex 1, edge 0 of vertex 2 */
+	for (i = 0; i < 3; ++i) {
+		t->depth[i] = (z[0] * t->edge[1][i] + z[1] * t->edge[2][i] + z[2] * t->edge[0][i]) / area;
+	}
+
+	t->min_x = min_x < 0.0f ? 0 : (int) min_x;
+	t->min_y = min_y < 0.0f ? 0 : (int) min_y;
+	t->max_x = max_x >= (float) occlusion->width ? occlusion->width - 1 : (int) max_x;
+	t->max_y = max_y >= (float) occlusion->height ? occlusion->height - 1 : (int) max_y;
+	return true;
+}
+
+/* Cut the part behind the near plane (z < -w) off, leaves 0, 1 or 2 triangles */
+static inline
+bool shaggy_occlusion_clip_triangle(struct shaggy_occlusion *occlusion, const vec4 clip[3]) {
+	vec4 poly[4];
+	float d[3];
+	int count = 0, i, k;
+
+	for (i = 0; i < 3; ++i) {
+		d[i] = clip[i][2] + clip[i][3];
+	}
+
+	if (d[0] >= 0.0f && d[1] >= 0.0f && d[2] >= 0.0f) {
+		return shaggy_occlusion_setup_triangle(occlusion, clip);
+	}
+
+	for (i = 0; i < 3; ++i) {
+		int j = (i + 1) % 3;
+
+		if (d[i] >= 0.0f) {
+			memcpy(poly[count++], clip[i], sizeof(vec4));
+		}
+
+		if ((d[i] >= 0.0f) != (d[j] >= 0.0f)) {
+			float s = d[i] / (d[i] - d[j]);
+			for (k = 0; k < 4; ++k) {
+				poly[count][k] = clip[i][k] + (clip[j][k] - clip[i][k]) * s;
+			}
+			++count;
+		}
+	}
+
+	/* A fan over what is left */
+	if (count >= 3 && !shaggy_occlusion_setup_triangle(occlusion, (const vec4 *) poly)) {
+		return false;
+	}
+
+	if (count == 4) {
+		memcpy(poly[1], poly[0], sizeof(vec4));
+		return shaggy_occlusion_setup_triangle(occlusion, (const vec4 *) poly + 1);
+	}
+
+	return true;
+}
+
+/*****************************************************************
+ * Add an indexed triangle mesh as an occluder. It should be solid
+ * where it is drawn, with counter clockwise front faces, and have
+ * far fewer triangles than what it hides.
+ * @param mvp       Projection x View x Model for the mesh.
+ * @param positions Model space vertices.
+ * @param indices   3 per triangle.
+ * @return false if out of memory, the occluder is then partial.
+ *****************************************************************/
+static inline
+bool shaggy_occlusion_add_occluder(struct shaggy_occlusion *occlusion, mat4x4 mvp, vec3_soa positions, size_t vertex_count,
+								   const uint32_t *indices, size_t triangle_count) {
+	size_t capacity = occlusion->clip_capacity, i;
+	int k;
+
+	if (vertex_count > capacity) {
+		/* The streams are one block, nothing in it needs keeping */
+		float *streams = shaggy_occlusion_grow(occlusion->clip.x, &capacity, vertex_count, 4 * sizeof(float));
+
+		if (!streams) {
+			return false;
+		}
+
+		occlusion->clip = (vec4_soa) { streams, streams + capacity, streams + 2 * capacity, streams + 3 * capacity };
+		occlusion->clip_capacity = capacity;
+	}
+
+	shaggy_math.vec4_soa_transform_points(occlusion->clip, mvp, positions, vertex_count);
+
+	for (i = 0; i < triangle_count; ++i) {
+		vec4 clip[3];
+
+		for (k = 0; k < 3; ++k) {
+			uint32_t v = indices[3 * i + k];
+			clip[k][0] = occlusion->clip.x[v];
+			clip[k][1] = occlusion->clip.y[v];
+			clip[k][2] = occlusion->clip.z[v];
+			clip[k][3] = occlusion->clip.w[v];
+		}
+
+		if (!shaggy_occlusion_clip_triangle(occlusion, (const vec4 *) clip)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Sort triangle indices by the tiles their bounds touch, a counting pass then a fill pass */
+static inline
+bool shaggy_occlusion_bin(struct shaggy_occlusion *occlusion) {
+	const int tiles = occlusion->tiles_x * occlusion->tiles_y;
+	uint32_t *offsets = occlusion->bin_offsets, *bins;
+	size_t i, total = 0;
+	int tile, tx, ty;
+
+	memset(offsets, 0, sizeof(*offsets) * (tiles + 1));
+
+	for (i = 0; i < occlusion->triangle_count; ++i) {
+		const struct shaggy_occlusion_triangle *t = &occlusion->triangles[i];
+
+		for (ty = t->min_y / SHAGGY_OCCLUSION_TILE_HEIGHT; ty <= t->max_y / SHAGGY_OCCLUSION_TILE_HEIGHT; ++ty)
+			for (tx = t->min_x / SHAGGY_OCCLUSION_TILE_WIDTH; tx <= t->max_x / SHAGGY_OCCLUSION_TILE_WIDTH; ++tx)
+				++offsets[ty * occlusion->tiles_x + tx + 1];
+	}
+
+	for (tile = 0; tile < tiles; ++tile) {
+		total += offsets[tile + 1];
+		offsets[tile + 1] = (uint32_t) total;
+	}
+
+	bins = shaggy_occlusion_grow(occlusion->bins, &occlusion->bin_capacity, total, sizeof(*bins));
+	if (!bins) {
+		return false;
+	}
+	occlusion->bins = bins;
+
+	/* Fill by bumping each tile's start, then shift the starts back */
+	for (i = 0; i < occlusion->triangle_count; ++i) {
+		const struct shaggy_occlusion_triangle *t = &occlusion->triangles[i];
+
+		for (ty = t->min_y / SHAGGY_OCCLUSION_TILE_HEIGHT; ty <= t->max_y / SHAGGY_OCCLUSION_TILE_HEIGHT; ++ty)
+			for (tx = t->min_x / SHAGGY_OCCLUSION_TILE_WIDTH; tx <= t->max_x / SHAGGY_OCCLUSION_TILE_WIDTH; ++tx)
+				bins[offsets[ty * occlusion->tiles_x + tx]++] = (uint32_t) i;
+	}
+
+	for (tile = tiles; tile > 0; --tile) {
+		offsets[tile] = offsets[tile - 1];
+	}
+	offsets[0] = 0;
+
+	return true;
+}
+
+/*****************************************************************
+ * Clear one tile to the far plane and draw its triangles, keeping
+ * the nearest depth. Pixels are sampled at their centers.
+ *****************************************************************/
+static inline
+void shaggy_occlusion_raster_tile_scalar(struct shaggy_occlusion *occlusion, int tile) {
+	const int x0 = tile % occlusion->tiles_x * SHAGGY_OCCLUSION_TILE_WIDTH;
+	const int y0 = tile / occlusion->tiles_x * SHAGGY_OCCLUSION_TILE_HEIGHT;
+	float *depth = occlusion->levels[0];
+	uint32_t b;
+	int x, y;
+
+	for (y = y0; y < y0 + SHAGGY_OCCLUSION_TILE_HEIGHT; ++y)
+		for (x = x0; x < x0 + SHAGGY_OCCLUSION_TILE_WIDTH; ++x)
+			depth[y * occlusion->width + x] = 1.0f;
+
+	for (b = occlusion->bin_offsets[tile]; b < occlusion->bin_offsets[tile + 1]; ++b) {
+		const struct shaggy_occlusion_triangle *t = &occlusion->triangles[occlusion->bins[b]];
+		int min_x = t->min_x > x0 ? t->min_x : x0;
+		int min_y = t->min_y > y0 ? t->min_y : y0;
+		int max_x = t->max_x < x0 + SHAGGY_OCCLUSION_TILE_WIDTH - 1 ? t->max_x : x0 + SHAGGY_OCCLUSION_TILE_WIDTH - 1;
+		int max_y = t->max_y < y0 + SHAGGY_OCCLUSION_TILE_HEIGHT - 1 ? t->max_y : y0 + SHAGGY_OCCLUSION_TILE_HEIGHT - 1;
+
+		for (y = min_y; y <= max_y; ++y) {
+			float py = (float) y + 0.5f;
+			float e0 = t->edge[0][1] * py + t->edge[0][2];
+			float e1 = t->edge[1][1] * py + t->edge[1][2];
+			float e2 = t->edge[2][1] * py + t->edge[2][2];
+			float z = t->depth[1] * py + t->depth[2];
+			float *row = depth + y * occlusion->width;
+
+			for (x = min_x; x <= max_x; ++x) {
+				float px = (float) x + 0.5f;
+
+				if (t->edge[0][0] * px + e0 >= 0.0f && t->edge[1][0] * px + e1 >= 0.0f && t->edge[2][0] * px + e2 >= 0.0f) {
+					row[x] = fminf(row[x], t->depth[0] * px + z);
+				}
+			}
+		}
+	}
+}
+
+#ifdef LINMATH_SSE2
+/* Same as the scalar form 4 pixels at a time, spans start on a multiple of 4 so they never leave the tile */
+static inline
+void shaggy_occlusion_raster_tile_sse2(struct shaggy_occlusion *occlusion, int tile) {
+	const int x0 = tile % occlusion->tiles_x * SHAGGY_OCCLUSION_TILE_WIDTH;
+	const int y0 = tile / occlusion->tiles_x * SHAGGY_OCCLUSION_TILE_HEIGHT;
+	const __m128 centers = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	float *depth = occlusion->levels[0];
+	uint32_t b;
+	int x, y;
+
+	for (y = y0; y < y0 + SHAGGY_OCCLUSION_TILE_HEIGHT; ++y)
+		for (x = x0; x < x0 + SHAGGY_OCCLUSION_TILE_WIDTH; x += 4)
+			_mm_storeu_ps(depth + y * occlusion->width + x, _mm_set1_ps(1.0f));
+
+	for (b = occlusion->bin_offsets[tile]; b < occlusion->bin_offsets[tile + 1]; ++b) {
+		const struct shaggy_occlusion_triangle *t = &occlusion->triangles[occlusion->bins[b]];
+		int min_x = (t->min_x > x0 ? t->min_x : x0) & ~3;
+		int min_y = t->min_y > y0 ? t->min_y : y0;
+		int max_x = t->max_x < x0 + SHAGGY_OCCLUSION_TILE_WIDTH - 1 ? t->max_x : x0 + SHAGGY_OCCLUSION_TILE_WIDTH - 1;
+		int max_y = t->max_y < y0 + SHAGGY_OCCLUSION_TILE_HEIGHT - 1 ? t->max_y : y0 + SHAGGY_OCCLUSION_TILE_HEIGHT - 1;
+		__m128 a0 = _mm_set1_ps(t->edge[0][0]), a1 = _mm_set1_ps(t->edge[1][0]), a2 = _mm_set1_ps(t->edge[2][0]);
+		__m128 za = _mm_set1_ps(t->depth[0]);
+
+		for (y = min_y; y <= max_y; ++y) {
+			float py = (float) y + 0.5f;
+			__m128 e0 = _mm_set1_ps(t->edge[0][1] * py + t->edge[0][2]);
+			__m128 e1 = _mm_set1_ps(t->edge[1][1] * py + t->edge[1][2]);
+			__m128 e2 = _mm_set1_ps(t->edge[2][1] * py + t->edge[2][2]);
+			__m128 z = _mm_set1_ps(t->depth[1] * py + t->depth[2]);
+			float *row = depth + y * occlusion->width;
+
+			for (x = min_x; x <= max_x; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps((float) x), centers);
+				__m128 inside = _mm_and_ps(_mm_and_ps(
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero)),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero));
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(za, px), z));
+
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+		}
+	}
+}
+#endif
+
+static inline
+void shaggy_occlusion_raster_tile(struct shaggy_occlusion *occlusion, int tile) {
+#ifdef LINMATH_SSE2
+	shaggy_occlusion_raster_tile_sse2(occlusion, tile);
+#else
+	shaggy_occlusion_raster_tile_scalar(occlusion, tile);
+#endif
+}
+
+static inline
+void shaggy_occlusion_raster_job(void *user, int job, size_t begin, size_t end) {
+	size_t tile;
+
+	(void) job;
+	for (tile = begin; tile < end; ++tile) {
+		shaggy_occlusion_raster_tile(user, (int) tile);
+	}
+}
+
+/* Each texel of a level is the furthest of the 2x2 below it, an odd last row or column folds into its neighbour */
+static inline
+void shaggy_occlusion_build_level(struct shaggy_occlusion *occlusion, int level) {
+	const int src_w = shaggy_occlusion_level_width(occlusion, level - 1);
+	const int src_h = shaggy_occlusion_level_height(occlusion, level - 1);
+	const int w = shaggy_occlusion_level_width(occlusion, level);
+	const int h = shaggy_occlusion_level_height(occlusion, level);
+	const float *src = occlusion->levels[level - 1];
+	float *dst = occlusion->levels[level];
+	int x, y;
+
+	for (y = 0; y < h; ++y) {
+		const float *r0 = src + (2 * y < src_h ? 2 * y : src_h - 1) * src_w;
+		const float *r1 = src + (2 * y + 1 < src_h ? 2 * y + 1 : src_h - 1) * src_w;
+
+		x = 0;
+#ifdef LINMATH_SSE2
+		for (; 2 * x + 8 <= src_w; x += 4) {
+			__m128 a = _mm_max_ps(_mm_loadu_ps(r0 + 2 * x), _mm_loadu_ps(r1 + 2 * x));
+			__m128 b = _mm_max_ps(_mm_loadu_ps(r0 + 2 * x + 4), _mm_loadu_ps(r1 + 2 * x + 4));
+
+			_mm_storeu_ps(dst + y * w + x, _mm_max_ps(
+					_mm_shuffle_ps(a, b, LINMATH_SHUFFLE(0, 2, 0, 2)),
+					_mm_shuffle_ps(a, b, LINMATH_SHUFFLE(1, 3, 1, 3))));
+		}
+#endif
+		for (; x < w; ++x) {
+			int x1 = 2 * x + 1 < src_w ? 2 * x + 1 : src_w - 1;
+			dst[y * w + x] = fmaxf(fmaxf(r0[2 * x], r0[x1]), fmaxf(r1[2 * x], r1[x1]));
+		}
+	}
+}
+
+/*****************************************************************
+ * Rasterize everything added since shaggy_occlusion_begin, one
+ * job per tile, then build the pyramid.
+ * @param workers May be NULL to do it all on this thread.
+ * @return false if binning ran out of memory, everything is then
+ *         left visible.
+ *****************************************************************/
+static inline
+bool shaggy_occlusion_finish(struct shaggy_occlusion *occlusion, struct shaggy_workers *workers) {
+	const int tiles = occlusion->tiles_x * occlusion->tiles_y;
+	bool binned = shaggy_occlusion_bin(occlusion);
+	int level;
+
+	/* Empty bins still clear every tile to the far plane */
+	if (!binned) {
+		occlusion->triangle_count = 0;
+		memset(occlusion->bin_offsets, 0, sizeof(*occlusion->bin_offsets) * (tiles + 1));
+	}
+
+	shaggy_workers_run(workers, (size_t) tiles, 1, shaggy_occlusion_raster_job, occlusion);
+
+	for (level = 1; level < occlusion->level_count; ++level) {
+		shaggy_occlusion_build_level(occlusion, level);
+	}
+
+	return binned;
+}
+
+/*****************************************************************
+ * Is a screen rectangle, in pixels, with the given nearest depth
+ * in front of the furthest occluder depth anywhere under it.
+ *****************************************************************/
+static inline
+bool shaggy_occlusion_rect_visible(const struct shaggy_occlusion *occlusion, float min_x, float min_y, float max_x, float max_y, float min_z) {
+	const float *texels;
+	float size, furthest = -INFINITY;
+	int level = 0, x0, y0, x1, y1, x, y, w;
+
+	/* What is off screen is the frustum's business */
+	min_x = fmaxf(min_x, 0.0f);
+	min_y = fmaxf(min_y, 0.0f);
+	max_x = fminf(max_x, (float) occlusion->width - 1.0f);
+	max_y = fminf(max_y, (float) occlusion->height - 1.0f);
+	if (!(min_x <= max_x && min_y <= max_y)) {
+		return true;
+	}
+
+	size = fmaxf(max_x - min_x, max_y - min_y);
+	while (level + 1 < occlusion->level_count && (float) (1 << level) < size) {
+		++level;
+	}
+
+	w = shaggy_occlusion_level_width(occlusion, level);
+	texels = occlusion->levels[level];
+	x0 = (int) min_x >> level;
+	y0 = (int) min_y >> level;
+	x1 = (int) max_x >> level;
+	y1 = (int) max_y >> level;
+
+	for (y = y0; y <= y1; ++y)
+		for (x = x0; x <= x1; ++x)
+			furthest = fmaxf(furthest, texels[y * w + x]);
+
+	return !(min_z > furthest);
+}
+
+/*****************************************************************
+ * The _scalar form also finishes the tail of the SIMD form.
+ * @param view_projection The one the occluders were drawn with,
+ *                        before their model matrices.
+ * @param visible         Set to 1 for boxes that may be seen and
+ *                        0 for hidden ones, room for end - begin.
+ *****************************************************************/
+static inline
+void shaggy_occlusion_test_aabbs_scalar(const struct shaggy_occlusion *occlusion, mat4x4 view_projection,
+										struct shaggy_aabbs b, size_t begin, size_t end, uint8_t *visible) {
+	size_t i;
+	int corner, k;
+
+	for (i = begin; i < end; ++i) {
+		float min_x = INFINITY, min_y = INFINITY, min_z = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+		bool near_plane = false;
+
+		for (corner = 0; corner < 8; ++corner) {
+			vec4 p = {
+					b.center.x[i] + (corner & 1 ? b.extent.x[i] : -b.extent.x[i]),
+					b.center.y[i] + (corner & 2 ? b.extent.y[i] : -b.extent.y[i]),
+					b.center.z[i] + (corner & 4 ? b.extent.z[i] : -b.extent.z[i]),
+					1.0f
+			}, clip;
+			float inv_w;
+
+			for (k = 0; k < 4; ++k) {
+				clip[k] = view_projection[0][k] * p[0] + view_projection[1][k] * p[1] + view_projection[2][k] * p[2] + view_projection[3][k];
+			}
+
+			near_plane |= !(clip[2] + clip[3] > 0.0f);
+			inv_w = 1.0f / clip[3];
+			min_x = fminf(min_x, clip[0] * inv_w);
+			max_x = fmaxf(max_x, clip[0] * inv_w);
+			min_y = fminf(min_y, clip[1] * inv_w);
+			max_y = fmaxf(max_y, clip[1] * inv_w);
+			min_z = fminf(min_z, clip[2] * inv_w);
+		}
+
+		visible[i - begin] = near_plane || shaggy_occlusion_rect_visible(occlusion,
+				(min_x * 0.5f + 0.5f) * (float) occlusion->width, (min_y * 0.5f + 0.5f) * (float) occlusion->height,
+				(max_x * 0.5f + 0.5f) * (float) occlusion->width, (max_y * 0.5f + 0.5f) * (float) occlusion->height, min_z);
+	}
+}
+
+#ifdef LINMATH_SSE2
+/* Projects 4 boxes at once, the pyramid lookups stay scalar */
+static inline
+void shaggy_occlusion_test_aabbs_sse2(const struct shaggy_occlusion *occlusion, mat4x4 view_projection,
+									  struct shaggy_aabbs b, size_t begin, size_t end, uint8_t *visible) {
+	const __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+	const __m128 width = _mm_set1_ps((float) occlusion->width), height = _mm_set1_ps((float) occlusion->height);
+	__m128 m[4][4];
+	size_t i;
+	int j, k, corner;
+
+	for (j = 0; j < 4; ++j)
+		for (k = 0; k < 4; ++k)
+			m[j][k] = _mm_set1_ps(view_projection[j][k]);
+
+	for (i = begin; i + 4 <= end; i += 4) {
+		__m128 cx = _mm_loadu_ps(b.center.x + i), cy = _mm_loadu_ps(b.center.y + i), cz = _mm_loadu_ps(b.center.z + i);
+		__m128 ex = _mm_loadu_ps(b.extent.x + i), ey = _mm_loadu_ps(b.extent.y + i), ez = _mm_loadu_ps(b.extent.z + i);
+		__m128 min_x = _mm_set1_ps(INFINITY), min_y = min_x, min_z = min_x;
+		__m128 max_x = _mm_set1_ps(-INFINITY), max_y = max_x;
+		__m128 near_plane = zero;
+		float rect[5][4];
+		int near_mask;
+
+		for (corner = 0; corner < 8; ++corner) {
+			__m128 x = corner & 1 ? _mm_add_ps(cx, ex) : _mm_sub_ps(cx, ex);
+			__m128 y = corner & 2 ? _mm_add_ps(cy, ey) : _mm_sub_ps(cy, ey);
+			__m128 z = corner & 4 ? _mm_add_ps(cz, ez) : _mm_sub_ps(cz, ez);
+			__m128 clip_x = LINMATH_SOA_ROW_SSE2(m, 0, x, y, z);
+			__m128 clip_y = LINMATH_SOA_ROW_SSE2(m, 1, x, y, z);
+			__m128 clip_z = LINMATH_SOA_ROW_SSE2(m, 2, x, y, z);
+			__m128 clip_w = LINMATH_SOA_ROW_SSE2(m, 3, x, y, z);
+			__m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), clip_w);
+
+			near_plane = _mm_or_ps(near_plane, _mm_cmpngt_ps(_mm_add_ps(clip_z, clip_w), zero));
+			min_x = _mm_min_ps(min_x, _mm_mul_ps(clip_x, inv_w));
+			max_x = _mm_max_ps(max_x, _mm_mul_ps(clip_x, inv_w));
+			min_y = _mm_min_ps(min_y, _mm_mul_ps(clip_y, inv_w));
+			max_y = _mm_max_ps(max_y, _mm_mul_ps(clip_y, inv_w));
+			min_z = _mm_min_ps(min_z, _mm_mul_ps(clip_z, inv_w));
+		}
+
+		_mm_storeu_ps(rect[0], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(min_x, half), half), width));
+		_mm_storeu_ps(rect[1], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(min_y, half), half), height));
+		_mm_storeu_ps(rect[2], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(max_x, half), half), width));
+		_mm_storeu_ps(rect[3], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(max_y, half), half), height));
+		_mm_storeu_ps(rect[4], min_z);
+		near_mask = _mm_movemask_ps(near_plane);
+
+		for (k = 0; k < 4; ++k) {
+			visible[i - begin + k] = (near_mask >> k & 1) ||
+					shaggy_occlusion_rect_visible(occlusion, rect[0][k], rect[1][k], rect[2][k], rect[3][k], rect[4][k]);
+		}
+	}
+
+	shaggy_occlusion_test_aabbs_scalar(occlusion, view_projection, b, i, end, visible + (i - begin));
+}
+#endif
+
+static inline
+void shaggy_occlusion_test_aabbs(const struct shaggy_occlusion *occlusion, mat4x4 view_projection,
+								 struct shaggy_aabbs b, size_t begin, size_t end, uint8_t *visible) {
+#ifdef LINMATH_SSE2
+	shaggy_occlusion_test_aabbs_sse2(occlusion, view_projection, b, begin, end, visible);
+#else
+	shaggy_occlusion_test_aabbs_scalar(occlusion, view_projection, b, begin, end, visible);
+#endif
+}
+
+struct shaggy_occlusion_run {
+	const struct shaggy_occlusion *occlusion;
+	float (*view_projection)[4];
+	struct shaggy_aabbs aabbs;
+	uint8_t *visible;
+};
+
+static inline
+void shaggy_occlusion_test_job(void *user, int job, size_t begin, size_t end) {
+	struct shaggy_occlusion_run *run = user;
+
+	(void) job;
+	shaggy_occlusion_test_aabbs(run->occlusion, run->view_projection, run->aabbs, begin, end, run->visible + begin);
+}
+
+/*****************************************************************
+ * Test n boxes across workers.
+ * @param workers May be NULL to test on this thread.
+ * @param visible One entry per box.
+ *****************************************************************/
+static inline
+void shaggy_occlusion_test_aabbs_parallel(struct shaggy_workers *workers, const struct shaggy_occlusion *occlusion,
+										  mat4x4 view_projection, struct shaggy_aabbs b, size_t n, uint8_t *visible) {
+	struct shaggy_occlusion_run run;
+
+	run.occlusion = occlusion;
+	run.view_projection = view_projection;
+	run.aabbs = b;
+	run.visible = visible;
+	shaggy_workers_run(workers, n, SHAGGY_CULL_MIN_PER_JOB, shaggy_occlusion_test_job, &run);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SHAGGY_SHADER_BUNDLE_H
+#define SHAGGY_SHADER_BUNDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************
+ * Shader Bundle
+ * The shaders/ directory packed into the executable at build time
+ * by tools/shaggy_pack.c, see CMakeLists.txt. Names, stages and
+ * content hashes are worked out by the packer, so registering a
+ * bundle touches neither the file system nor the regex matcher.
+ *****************************************************************/
+
+/* Paths of bundled files as the shader manager sees them */
+#define SHAGGY_BUNDLE_PREFIX "bundle:/"
+
+/*****************************************************************
+ * slre pattern for shader file names, <name>.<stage>.glsl or .spv,
+ * matched case insensitively against the whole file name. The
+ * runtime and the packer both name shaders with it, so a bundled
+ * file and the loose file it stands in for always agree.
+ *****************************************************************/
+#define SHAGGY_SHADER_FILE_EXP "(^[a-zA-Z0-9\\.]*)\\.(vert|tesc|tese|geom|frag|comp)\\.(glsl|spv)"
+
+struct shaggy_bundle_file {
+	const char *path;  /* Relative to the packed directory, '/' separated */
+	const char *name;  /* Shader name, NULL for files that are only #included */
+	const char *stage; /* File suffix such as "vert", NULL like name */
+	const char *data;
+	size_t length;
+	uint64_t hash;     /* shaggy_hash64(data, length, 0) */
+};
+
+/* files is sorted by path */
+struct shaggy_shader_bundle {
+	const struct shaggy_bundle_file *files;
+	size_t count;
+};
+
+/* Generated into shader_bundle.c, only linked in with SHAGGY_EMBED_SHADERS */
+extern const struct shaggy_shader_bundle shaggy_shader_bundle;
+
+static inline
+int shaggy_bundle_compare(const void *key, const void *file) {
+	return strcmp((const char *) key, ((const struct shaggy_bundle_file *) file)->path);
+}
+
+/* Binary search by path, NULL if the bundle doesn't have it */
+static inline
+const struct shaggy_bundle_file *shaggy_bundle_find(const struct shaggy_shader_bundle *bundle, const char *path) {
+	return bsearch(path, bundle->files, bundle->count, sizeof(*bundle->files), shaggy_bundle_compare);
+}
+
+/*****************************************************************
+ * Fold "." and ".." out of a bundle path in place.
+ * @return false if ".." climbs out of the bundle.
+ *****************************************************************/
+static inline
+bool shaggy_bundle_normalize(char *path) {
+	char *read = path;
+	char *write = path;
+
+	while (*read) {
+		char *end = strchr(read, '/');
+		size_t length = end ? (size_t) (end - read) : strlen(read);
+
+		if (length == 0 || (length == 1 && read[0] == '.')) {
+			/* Nothing to keep */
+		} else if (length == 2 && read[0] == '.' && read[1] == '.') {
+			if (write == path) {
+				return false;
+			}
+
+			/* Drop the last segment written, and the slash after it */
+			do {
+				--write;
+			} while (write > path && write[-1] != '/');
+		} else {
+			memmove(write, read, length);
+			write += length;
+
+			if (end) {
+				*write++ = '/';
+			}
+		}
+
+		read += length + (end ? 1 : 0);
+	}
+
+	*write = '\0';
+	return true;
+}
+
+#endif
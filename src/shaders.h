@@ -1,16 +1,27 @@
+#ifndef SHAGGY_SHADERS_H
+#define SHAGGY_SHADERS_H
+
 #include "sclog4c/sclog4c.h"
 #include "khash.h"
 #include "tinydir.h"
 #include "slre.h"
+#include "shaggy_hash.h"
+#include "shader_bundle.h"
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
 
 /**********
  * Utility
  **********/
 
 /*******************
- * Eventually, this will also support
- * offline compilation using the same API.
+ * Offline compiled shaders go through the
+ * same API, <name>.<stage>.spv files are
+ * loaded as SPIR-V with ARB_gl_spirv.
  *******************/
 /***************************
  * Type Definitions
@@ -21,7 +32,27 @@ enum shaggy_shader_type {
 	SHAGGY_FRAGMENT_SHADER,
 	SHAGGY_TESS_CONTROL_SHADER,
 	SHAGGY_TESS_EVALUATION_SHADER,
-	SHAGGY_GEOMETRY_SHADER
+	SHAGGY_GEOMETRY_SHADER,
+	SHAGGY_COMPUTE_SHADER,
+	SHAGGY_SHADER_TYPE_COUNT
+};
+
+static const GLenum shaggy_gl_shader_types[SHAGGY_SHADER_TYPE_COUNT] = {
+	[SHAGGY_VERTEX_SHADER] = GL_VERTEX_SHADER,
+	[SHAGGY_FRAGMENT_SHADER] = GL_FRAGMENT_SHADER,
+	[SHAGGY_TESS_CONTROL_SHADER] = GL_TESS_CONTROL_SHADER,
+	[SHAGGY_TESS_EVALUATION_SHADER] = GL_TESS_EVALUATION_SHADER,
+	[SHAGGY_GEOMETRY_SHADER] = GL_GEOMETRY_SHADER,
+	[SHAGGY_COMPUTE_SHADER] = GL_COMPUTE_SHADER
+};
+
+static const char *const shaggy_shader_type_names[SHAGGY_SHADER_TYPE_COUNT] = {
+	[SHAGGY_VERTEX_SHADER] = "vertex",
+	[SHAGGY_FRAGMENT_SHADER] = "fragment",
+	[SHAGGY_TESS_CONTROL_SHADER] = "tess_control",
+	[SHAGGY_TESS_EVALUATION_SHADER] = "tess_evaluation",
+	[SHAGGY_GEOMETRY_SHADER] = "geometry",
+	[SHAGGY_COMPUTE_SHADER] = "compute"
 };
 
 #define \
@@ -35,6 +66,7 @@ shader_type(tess_control);
 shader_type(tess_evaluation);
 shader_type(geometry);
 shader_type(fragment);
+shader_type(compute);
 
 /****************************
  * Shader Creation Functions
@@ -57,6 +89,8 @@ shader_create(geometry, GL_GEOMETRY_SHADER);
 
 shader_create(fragment, GL_FRAGMENT_SHADER);
 
+shader_create(compute, GL_COMPUTE_SHADER);
+
 /*************************
  * Platform-specific Code
  *************************/
@@ -69,18 +103,27 @@ shader_create(fragment, GL_FRAGMENT_SHADER);
 #include <sys/mman.h>
 #include <fcntl.h>
 
+/**********************************************************
+ * A read-only view of a file's contents.
+ * On POSIX this is an mmap, the descriptor is closed as
+ * soon as the mapping exists.
+ **********************************************************/
+struct shaggy_source_map {
+	const char *data;
+	size_t length;
+};
+
 /***********************************************************************************
- * Load shader source into the shader via a file.
- * @param shader OpenGL Shader you wish to assign source.
- * @param file File to obtain source for said shader.
+ * Map a shader file into memory.
+ * @param map Receives the view of the file. Release with shaggy_unmap_source_file.
+ * @param file File to map.
  * @todo Only works with POSIX for now since we virtually map the file using mmap.
  ***********************************************************************************/
-bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
+bool shaggy_map_source_file(struct shaggy_source_map *map, const char *file) {
 	struct stat source_stat;
 	int source_fd;
 	int error;
-	size_t length;
-	char *source;
+	void *source;
 	bool result = false;
 
 	source_fd = open(file, O_RDONLY);
@@ -92,7 +135,7 @@ bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
 	error = fstat(source_fd, &source_stat);
 	if (error == -1) {
 		logm(ERROR, "fstat() failed: %s", strerror(errno));
-		return result;
+		goto fail;
 	}
 
 	if (!S_ISREG(source_stat.st_mode)) {
@@ -111,10 +154,8 @@ bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
 		goto fail;
 	}
 
-	glShaderSource(shader, 1, (const GLchar *const *) &source, (const GLint *) &source_stat.st_size);
-
-	munmap(source, source_stat.st_size);
-
+	map->data = source;
+	map->length = source_stat.st_size;
 	result = true;
 
 fail:
@@ -122,6 +163,24 @@ fail:
 	return result;
 }
 
+void shaggy_unmap_source_file(struct shaggy_source_map *map) {
+	munmap((void *) map->data, map->length);
+	map->data = NULL;
+	map->length = 0;
+}
+
+/* Absolute path with links and ".." resolved, caller frees. NULL if it doesn't exist. */
+static inline
+char *shaggy_canonical_path(const char *path) {
+	char *canonical = realpath(path, NULL);
+
+	if (!canonical) {
+		logm(ERROR, "Failed to resolve %s: %s", path, strerror(errno));
+	}
+
+	return canonical;
+}
+
 #elif _WIN32
 
 /* Man I hate Windows... this is insane. */
@@ -148,12 +207,18 @@ void _print_windows_error() {
 	LocalFree(lpMsgBuf);
 }
 
-bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
+struct shaggy_source_map {
+	const char *data;
+	size_t length;
+	HANDLE file;
+	HANDLE mapping;
+};
+
+bool shaggy_map_source_file(struct shaggy_source_map *map, const char *file) {
 	HANDLE source;
 	DWORD source_size = 0;
 	HANDLE source_map;
 	LPVOID source_map_view;
-	bool result = false;
 
 	source = CreateFile(file,
 						GENERIC_READ,
@@ -165,7 +230,7 @@ bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
 
 	if (source == INVALID_HANDLE_VALUE) {
 		_print_windows_error();
-		return result;
+		return false;
 	}
 
 	source_size = GetFileSize(source, 0);
@@ -192,22 +257,558 @@ bool shaggy_source_shader_from_file(GLuint shader, const char *file) {
 		goto fail_map_view;
 	}
 
-	logm(WARNING, "%s", source_map_view);
-	glShaderSource(shader, 1, (const GLchar *const *) &source_map_view, (const GLint *) &source_size);
-	result = true;
-
-	UnmapViewOfFile(source_map_view);
+	map->data = source_map_view;
+	map->length = source_size;
+	map->file = source;
+	map->mapping = source_map;
+	return true;
 
 	fail_map_view:
 	CloseHandle(source_map);
 
 	fail_map:
 	CloseHandle(source);
-	return result;
+	return false;
+}
+
+void shaggy_unmap_source_file(struct shaggy_source_map *map) {
+	UnmapViewOfFile(map->data);
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+	map->data = NULL;
+	map->length = 0;
+}
+
+static inline
+char *shaggy_canonical_path(const char *path) {
+	char *canonical = _fullpath(NULL, path, 0);
+
+	if (!canonical) {
+		logm(ERROR, "Failed to resolve %s", path);
+	}
+
+	return canonical;
+}
+
+#endif
+
+static inline
+void shaggy_source_shader_from_map(GLuint shader, const struct shaggy_source_map *map) {
+	GLint length = (GLint) map->length;
+
+	glShaderSource(shader, 1, (const GLchar *const *) &map->data, &length);
+}
+
+/***********************************************************************************
+ * Load shader source into the shader via a file.
+ * @param shader OpenGL Shader you wish to assign source.
+ * @param file File to obtain source for said shader.
+ * @param hash If not NULL, receives shaggy_hash64 of the source.
+ ***********************************************************************************/
+bool shaggy_source_shader_from_file(GLuint shader, const char *file, uint64_t *hash) {
+	struct shaggy_source_map map;
+
+	if (!shaggy_map_source_file(&map, file)) {
+		return false;
+	}
+
+	shaggy_source_shader_from_map(shader, &map);
+
+	if (hash) {
+		*hash = shaggy_hash64(map.data, map.length, 0);
+	}
+
+	shaggy_unmap_source_file(&map);
+	return true;
+}
+
+/*****************************************************************
+ * Include Resolution
+ * #include "file" is expanded by handing glShaderSource a list of
+ * chunks pointing straight into each file's mapping, nothing is
+ * concatenated. Paths are relative to the including file and a
+ * file is only pulled in once per shader. The #line directives
+ * put in after each include use the file's index in files as the
+ * source string number, so errors read <index>:<line>.
+ *****************************************************************/
+
+#define SHAGGY_MAX_INCLUDE_DEPTH 32
+
+struct shaggy_source {
+	const GLchar **strings;
+	GLint *lengths;
+	size_t count;
+	size_t capacity;
+
+	/* files[i] is the canonical path of maps[i], files[0] is the shader itself */
+	struct shaggy_source_map *maps;
+	char **files;
+	size_t file_count;
+
+	/* Text we made up ourselves, #defines and #line directives */
+	char **owned;
+	size_t owned_count;
+
+	/* Resolves SHAGGY_BUNDLE_PREFIX paths, may be NULL */
+	const struct shaggy_shader_bundle *bundle;
+
+	/* Packed hash of the shader file when it came from a bundle */
+	uint64_t root_hash;
+
+	/* A push ran out of memory and was dropped, the source is incomplete */
+	bool out_of_memory;
+};
+
+static inline
+void shaggy_source_push(struct shaggy_source *source, const char *data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+
+	if (source->count == source->capacity) {
+		size_t capacity = source->capacity ? source->capacity * 2 : 16;
+		const GLchar **strings = realloc(source->strings, capacity * sizeof(*source->strings));
+		GLint *lengths;
+
+		if (strings) {
+			source->strings = strings;
+		}
+
+		lengths = strings ? realloc(source->lengths, capacity * sizeof(*source->lengths)) : NULL;
+		if (!lengths) {
+			source->out_of_memory = true;
+			return;
+		}
+
+		source->lengths = lengths;
+		source->capacity = capacity;
+	}
+
+	source->strings[source->count] = data;
+	source->lengths[source->count] = (GLint) length;
+	++source->count;
+}
+
+/* Push a string the source should free, takes ownership of text */
+static inline
+void shaggy_source_push_owned(struct shaggy_source *source, char *text) {
+	char **owned = realloc(source->owned, (source->owned_count + 1) * sizeof(*source->owned));
+
+	if (!owned) {
+		source->out_of_memory = true;
+		free(text);
+		return;
+	}
+
+	source->owned = owned;
+	source->owned[source->owned_count++] = text;
+	shaggy_source_push(source, text, strlen(text));
+}
+
+static inline
+void shaggy_source_push_line(struct shaggy_source *source, int line, size_t file_index) {
+	char *directive = malloc(48);
+
+	if (!directive) {
+		source->out_of_memory = true;
+		return;
+	}
+
+	snprintf(directive, 48, "#line %d %zu\n", line, file_index);
+	shaggy_source_push_owned(source, directive);
+}
+
+/* Index just past the end of the line starting at i */
+static inline
+size_t shaggy_source_line_end(const char *data, size_t length, size_t i) {
+	const char *newline = memchr(data + i, '\n', length - i);
+
+	return newline ? (size_t) (newline - data) + 1 : length;
+}
+
+/* If line is "#<name> ...", return what follows the name, else NULL */
+static inline
+const char *shaggy_source_directive(const char *line, const char *end, const char *name) {
+	size_t name_length = strlen(name);
+
+	while (line < end && (*line == ' ' || *line == '\t')) {
+		++line;
+	}
+
+	if (line == end || *line++ != '#') {
+		return NULL;
+	}
+
+	while (line < end && (*line == ' ' || *line == '\t')) {
+		++line;
+	}
+
+	if ((size_t) (end - line) < name_length || memcmp(line, name, name_length) != 0) {
+		return NULL;
+	}
+
+	line += name_length;
+	if (line < end && *line != ' ' && *line != '\t' && *line != '"' && *line != '\r' && *line != '\n') {
+		return NULL;
+	}
+
+	return line;
+}
+
+/* Track block comments across lines so commented out directives are left alone */
+static inline
+bool shaggy_source_in_comment(const char *line, const char *end, bool in_comment) {
+	for (; line + 1 < end; ++line) {
+		if (in_comment) {
+			if (line[0] == '*' && line[1] == '/') {
+				in_comment = false;
+				++line;
+			}
+		} else if (line[0] == '/' && line[1] == '/') {
+			break;
+		} else if (line[0] == '/' && line[1] == '*') {
+			in_comment = true;
+			++line;
+		}
+	}
+
+	return in_comment;
+}
+
+static inline
+bool shaggy_source_has_file(struct shaggy_source *source, const char *path) {
+	size_t i;
+
+	for (i = 0; i < source->file_count; ++i) {
+		if (strcmp(source->files[i], path) == 0) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
+/* Path of an include relative to the file including it, caller frees */
+static inline
+char *shaggy_source_resolve(const char *includer, const char *path, size_t path_length) {
+	const char *slash = strrchr(includer, '/');
+	size_t dir_length;
+	char *resolved;
+
+#if defined (_WIN32)
+	const char *backslash = strrchr(includer, '\\');
+
+	if (backslash && (!slash || backslash > slash)) {
+		slash = backslash;
+	}
 #endif
 
+	if (path[0] == '/' || !slash) {
+		return strndup(path, path_length);
+	}
+
+	dir_length = (size_t) (slash - includer) + 1;
+	resolved = malloc(dir_length + path_length + 1);
+	memcpy(resolved, includer, dir_length);
+	memcpy(resolved + dir_length, path, path_length);
+	resolved[dir_length + path_length] = '\0';
+
+	return resolved;
+}
+
+static inline
+bool shaggy_source_append_file(struct shaggy_source *source, const char *path, const char *defines, int depth);
+
+/* <name>.<stage>.spv, compiled offline. Case insensitive like shaggy_classify_shader_file */
+static inline
+bool shaggy_is_spirv_path(const char *path) {
+	const char *suffix = ".spv";
+	size_t length = strlen(path);
+	size_t i;
+
+	if (length <= 4) {
+		return false;
+	}
+
+	for (i = 0; i < 4; ++i) {
+		if (tolower((unsigned char) path[length - 4 + i]) != suffix[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static inline
+bool shaggy_source_is_bundled(const char *path) {
+	return strncmp(path, SHAGGY_BUNDLE_PREFIX, strlen(SHAGGY_BUNDLE_PREFIX)) == 0;
+}
+
+/* Bundle counterpart of shaggy_canonical_path + shaggy_map_source_file, no file I/O */
+static inline
+char *shaggy_source_map_bundled(
+		struct shaggy_source *source, const char *path, struct shaggy_source_map *map) {
+	const struct shaggy_bundle_file *file = NULL;
+	char *canonical = strdup(path);
+	char *relative = canonical + strlen(SHAGGY_BUNDLE_PREFIX);
+
+	if (source->bundle && shaggy_bundle_normalize(relative)) {
+		file = shaggy_bundle_find(source->bundle, relative);
+	}
+
+	if (!file) {
+		logm(ERROR, "%s isn't in the shader bundle", path);
+		free(canonical);
+		return NULL;
+	}
+
+	memset(map, 0, sizeof(*map));
+	map->data = file->data;
+	map->length = file->length;
+
+	if (source->file_count == 0) {
+		source->root_hash = file->hash;
+	}
+
+	return canonical;
+}
+
+/* Splice the include on this line in, false if it couldn't be loaded */
+static inline
+bool shaggy_source_include(
+		struct shaggy_source *source, size_t file_index, const char *rest, const char *end, int depth) {
+	const char *close;
+	char *resolved;
+	bool result;
+
+	while (rest < end && (*rest == ' ' || *rest == '\t')) {
+		++rest;
+	}
+
+	close = rest < end && *rest == '"' ? memchr(rest + 1, '"', end - rest - 1) : NULL;
+	if (!close) {
+		logm(ERROR, "Malformed #include in %s", source->files[file_index]);
+		return false;
+	}
+
+	resolved = shaggy_source_resolve(source->files[file_index], rest + 1, close - rest - 1);
+	result = shaggy_source_append_file(source, resolved, NULL, depth + 1);
+	free(resolved);
+
+	return result;
+}
+
+static inline
+bool shaggy_source_append_file(struct shaggy_source *source, const char *path, const char *defines, int depth) {
+	struct shaggy_source_map map;
+	struct shaggy_source_map *maps;
+	char **files;
+	const char *data;
+	char *canonical;
+	size_t file_index;
+	size_t start = 0;
+	size_t i;
+	int line = 1;
+	bool in_comment = false;
+	bool version_seen = false;
+
+	if (depth > SHAGGY_MAX_INCLUDE_DEPTH) {
+		logm(ERROR, "Includes nested deeper than %d at %s", SHAGGY_MAX_INCLUDE_DEPTH, path);
+		return false;
+	}
+
+	if (shaggy_source_is_bundled(path)) {
+		canonical = shaggy_source_map_bundled(source, path, &map);
+		if (!canonical) {
+			return false;
+		}
+
+		if (shaggy_source_has_file(source, canonical)) {
+			free(canonical);
+			return true;
+		}
+	} else {
+		canonical = shaggy_canonical_path(path);
+		if (!canonical) {
+			return false;
+		}
+
+		if (shaggy_source_has_file(source, canonical)) {
+			free(canonical);
+			return true;
+		}
+
+		if (!shaggy_map_source_file(&map, canonical)) {
+			free(canonical);
+			return false;
+		}
+	}
+
+	/* Grown one at a time, a failure leaves the arrays as they were for shaggy_source_free */
+	maps = realloc(source->maps, (source->file_count + 1) * sizeof(*source->maps));
+	if (maps) {
+		source->maps = maps;
+	}
+
+	files = maps ? realloc(source->files, (source->file_count + 1) * sizeof(*source->files)) : NULL;
+	if (!files) {
+		logm(ERROR, "Out of memory loading %s", canonical);
+
+		if (!shaggy_source_is_bundled(canonical)) {
+			shaggy_unmap_source_file(&map);
+		}
+
+		free(canonical);
+		return false;
+	}
+
+	source->files = files;
+	file_index = source->file_count++;
+	source->maps[file_index] = map;
+	source->files[file_index] = canonical;
+	data = map.data;
+
+	/* SPIR-V is a word stream, there's nothing to expand */
+	if (shaggy_is_spirv_path(path)) {
+		shaggy_source_push(source, data, map.length);
+		return true;
+	}
+
+	if (file_index > 0) {
+		shaggy_source_push_line(source, 1, file_index);
+	}
+
+	/* Defines have to follow #version, or come first if there isn't one. Comments are skipped like below */
+	if (defines) {
+		for (i = 0; i < map.length && !version_seen; i = shaggy_source_line_end(data, map.length, i)) {
+			const char *end = data + shaggy_source_line_end(data, map.length, i);
+
+			if (!in_comment) {
+				version_seen = shaggy_source_directive(data + i, end, "version") != NULL;
+			}
+
+			in_comment = shaggy_source_in_comment(data + i, end, in_comment);
+		}
+
+		in_comment = false;
+
+		if (!version_seen) {
+			shaggy_source_push(source, defines, strlen(defines));
+			shaggy_source_push_line(source, 1, file_index);
+		}
+	}
+
+	for (i = 0; i < map.length; i = shaggy_source_line_end(data, map.length, i), ++line) {
+		const char *end = data + shaggy_source_line_end(data, map.length, i);
+		const char *rest;
+
+		if (in_comment) {
+			in_comment = shaggy_source_in_comment(data + i, end, in_comment);
+			continue;
+		}
+
+		if (defines && version_seen && shaggy_source_directive(data + i, end, "version")) {
+			shaggy_source_push(source, data + start, end - data - start);
+			shaggy_source_push(source, defines, strlen(defines));
+			shaggy_source_push_line(source, line + 1, file_index);
+			start = end - data;
+			defines = NULL;
+		} else if ((rest = shaggy_source_directive(data + i, end, "include"))) {
+			shaggy_source_push(source, data + start, i - start);
+
+			if (!shaggy_source_include(source, file_index, rest, end, depth)) {
+				return false;
+			}
+
+			shaggy_source_push_line(source, line + 1, file_index);
+			start = end - data;
+		}
+
+		in_comment = shaggy_source_in_comment(data + i, end, in_comment);
+	}
+
+	shaggy_source_push(source, data + start, map.length - start);
+	return true;
+}
+
+static inline
+void shaggy_source_free(struct shaggy_source *source) {
+	size_t i;
+
+	for (i = 0; i < source->file_count; ++i) {
+		if (!shaggy_source_is_bundled(source->files[i])) {
+			shaggy_unmap_source_file(&source->maps[i]);
+		}
+
+		free(source->files[i]);
+	}
+
+	for (i = 0; i < source->owned_count; ++i) {
+		free(source->owned[i]);
+	}
+
+	free(source->strings);
+	free(source->lengths);
+	free(source->maps);
+	free(source->files);
+	free(source->owned);
+	memset(source, 0, sizeof(*source));
+}
+
+/*****************************************************************
+ * Map a shader file and everything it includes.
+ * Release with shaggy_source_free whether or not it succeeds.
+ * @param bundle Where SHAGGY_BUNDLE_PREFIX paths live, may be NULL.
+ * @param defines Injected after #version, NULL for none. The
+ *                source takes ownership of it.
+ *****************************************************************/
+static inline
+bool shaggy_source_load(
+		struct shaggy_source *source, const struct shaggy_shader_bundle *bundle, const char *path, char *defines) {
+	memset(source, 0, sizeof(*source));
+	source->bundle = bundle;
+
+	if (defines) {
+		source->owned = malloc(sizeof(*source->owned));
+		if (!source->owned) {
+			logm(ERROR, "Out of memory loading %s", path);
+			free(defines);
+			return false;
+		}
+
+		source->owned[source->owned_count++] = defines;
+	}
+
+	if (!shaggy_source_append_file(source, path, defines, 0)) {
+		return false;
+	}
+
+	if (source->out_of_memory) {
+		logm(ERROR, "Out of memory loading %s", path);
+		return false;
+	}
+
+	return true;
+}
+
+/* Hash of exactly what glShaderSource will see */
+static inline
+uint64_t shaggy_source_hash(const struct shaggy_source *source) {
+	uint64_t hash = 0;
+	size_t i;
+
+	/* A bundled file on its own was hashed when it was packed */
+	if (source->count == 1 && source->root_hash) {
+		return source->root_hash;
+	}
+
+	for (i = 0; i < source->count; ++i) {
+		hash = shaggy_hash64(source->strings[i], source->lengths[i], hash);
+	}
+
+	return hash;
+}
+
 static inline
 void shaggy_compile_shader(GLuint shader) {
 	glCompileShader(shader);
@@ -298,192 +899,2695 @@ void shaggy_delete_program(shaggy_program program) {
 /**************************************************************************
  * Managed functions that handle shader loading, compiling, and cleanup
  * You give a shader, it will immediately try to load and compile the file.
+ * In lazy mode the file is only registered and is compiled the first time
+ * it's fetched.
  * It will stay in memory until you explicitly remove the shader or kill the managed object.
  * Programs must still be explicitly defined. Perhaps a spec input later.
  **************************************************************************/
 
-KHASH_MAP_INIT_STR(shader_map, GLint)
+enum shaggy_shader_state {
+	SHAGGY_SHADER_UNLOADED, /* Registered, nothing sent to the driver yet */
+	SHAGGY_SHADER_PENDING,  /* Submitted, compile may still be running */
+	SHAGGY_SHADER_LOADED    /* Compiled, or failed to and won't be retried */
+};
 
-struct shaggy_manager {
-	khash_t(shader_map) *vertex_shader_map;
-	khash_t(shader_map) *fragment_shader_map;
+/*****************************************************************
+ * What glSpecializeShaderARB gets for a SPIR-V shader. Constants
+ * left out keep the defaults baked into the module.
+ *****************************************************************/
+struct shaggy_specialization {
+	char *entry_point;
+	GLuint count;
+	GLuint *indices;
+	GLuint *values;
 };
 
-static inline
-struct shaggy_manager *shaggy_create_shader_manager(void) {
-	struct shaggy_manager *manager = malloc(sizeof(struct shaggy_manager));
+struct shaggy_managed_shader {
+	GLuint shader;
+	enum shaggy_shader_state state;
+	char *path;
+	uint64_t source_hash; /* 0 when unknown, covers includes and defines */
+	struct shaggy_specialization *specialization; /* SPIR-V only, NULL for "main" and no constants */
+};
 
-	manager->vertex_shader_map = kh_init(shader_map);
-	manager->fragment_shader_map = kh_init(shader_map);
+static inline
+void shaggy_free_specialization(struct shaggy_specialization *specialization) {
+	if (!specialization) {
+		return;
+	}
 
-	return manager;
+	free(specialization->entry_point);
+	free(specialization->indices);
+	free(specialization->values);
+	free(specialization);
 }
 
+/* Constants change the compiled shader, so they're part of its source hash */
 static inline
-void shaggy_destroy_shader_manager(struct shaggy_manager *manager) {
-	kh_destroy(shader_map, manager->vertex_shader_map);
-	kh_destroy(shader_map, manager->fragment_shader_map);
-	free(manager);
+uint64_t shaggy_specialization_hash(const struct shaggy_specialization *specialization, uint64_t hash) {
+	if (!specialization) {
+		return hash;
+	}
+
+	hash = shaggy_hash64(specialization->entry_point, strlen(specialization->entry_point), hash);
+	hash = shaggy_hash64(specialization->indices, specialization->count * sizeof(GLuint), hash);
+	return shaggy_hash64(specialization->values, specialization->count * sizeof(GLuint), hash);
 }
 
-#define shaggy_manage_add_shader(manager, name, shader) _Generic((shader),         \
-        shaggy_vertex_shader: shaggy_manage_add_vertex_shader,                     \
-        shaggy_fragment_shader: shaggy_manage_add_fragment_shader                  \
-    ) (manager, name, shader)
+/*****************************************************************
+ * Registry key. The name is interned, so every stage of "basic"
+ * shares one string. variant is a bitmask of flags from
+ * shaggy_manage_variant_flag, 0 is the file compiled as is.
+ *****************************************************************/
+struct shaggy_shader_key {
+	const char *name;
+	enum shaggy_shader_type type;
+	uint64_t variant;
+};
 
+static inline
+khint_t shaggy_shader_key_hash(struct shaggy_shader_key key) {
+	return kh_str_hash_func(key.name) ^ ((khint_t) key.type * 0x9e3779b9u) ^
+		   (khint_t) shaggy_hash_mix(key.variant);
+}
 
-#define shader_hash_impl(T)                                                                             \
-static inline                                                                                           \
+static inline
+bool shaggy_shader_key_equal(struct shaggy_shader_key a, struct shaggy_shader_key b) {
+	return a.type == b.type && a.variant == b.variant && (a.name == b.name || strcmp(a.name, b.name) == 0);
+}
+
+/* (name, stage, variant) -> shader, one probe resolves any lookup */
+KHASH_INIT(shader_registry, struct shaggy_shader_key, struct shaggy_managed_shader, 1,
+		   shaggy_shader_key_hash, shaggy_shader_key_equal)
+
+/* Owns every name string the manager hands around */
+KHASH_SET_INIT_STR(intern_set)
+
+/* Object key, see shaggy_shader_object_key -> compiled shader shared by every name with that source */
+KHASH_MAP_INIT_INT64(shader_object_map, GLuint)
+
+/* A compiled shader and how many registry entries and pending compiles hold it */
+struct shaggy_shader_object {
+	uint64_t key;
+	unsigned refs;
+};
+
+KHASH_MAP_INIT_INT(shader_ref_map, struct shaggy_shader_object)
+
+/* Every shader compiled from a file that includes a given path */
+struct shaggy_dependents {
+	struct shaggy_shader_key *keys;
+	size_t count;
+	size_t capacity;
+};
+
+/* Interned canonical include path -> dependents */
+KHASH_MAP_INIT_STR(include_graph, struct shaggy_dependents)
+
+/* The stages a program or pipeline is built from, interned names (NULL for unused slots) and the variant */
+struct shaggy_program_key {
+	const char *shaders[SHAGGY_SHADER_TYPE_COUNT];
+	uint64_t variant;
+};
+
+static inline
+khint_t shaggy_program_key_hash(struct shaggy_program_key key) {
+	return (khint_t) shaggy_hash64(key.shaders, sizeof(key.shaders), key.variant);
+}
+
+static inline
+bool shaggy_program_key_equal(struct shaggy_program_key a, struct shaggy_program_key b) {
+	return a.variant == b.variant && memcmp(a.shaders, b.shaders, sizeof(a.shaders)) == 0;
+}
+
+/*****************************************************************
+ * Link cache, stage names -> program. Keyed by name rather than
+ * by GL shader because names with the same source share a shader
+ * object, yet each is reloaded and relinked on its own.
+ *****************************************************************/
+KHASH_INIT(program_cache, struct shaggy_program_key, shaggy_program, 1, shaggy_program_key_hash, shaggy_program_key_equal)
+
+/*****************************************************************
+ * Program Reflection
+ * Every uniform and uniform block of a linked program, read once
+ * with the program interface query so drawing code never has to
+ * ask GL by name. Lookups go by shaggy_uniform_hash of the name,
+ * which callers work out once and keep.
+ *****************************************************************/
+
+struct shaggy_uniform {
+	const char *name;   /* Interned, arrays lose their "[0]" */
+	uint64_t hash;      /* shaggy_uniform_hash(name) */
+	GLenum type;
+	GLint location;     /* -1 for block members */
+	GLint array_size;
+	GLint block;        /* Index into blocks, -1 for the default block */
+	GLint offset;       /* Block layout, -1 outside blocks */
+	GLint array_stride;
+	GLint matrix_stride;
+	bool row_major;
+};
+
+struct shaggy_uniform_block {
+	const char *name;   /* Interned, like shaggy_uniform */
+	uint64_t hash;
+	GLuint index;       /* For glUniformBlockBinding */
+	GLint binding;
+	GLint data_size;
+	size_t first_member; /* Members are uniforms[first_member, first_member + member_count) by offset */
+	size_t member_count;
+};
+
+/* Name hash -> index into uniforms or blocks */
+KHASH_MAP_INIT_INT64(reflection_index, uint32_t)
+
+struct shaggy_program_reflection {
+	struct shaggy_uniform *uniforms; /* Default block first, then each block's members */
+	size_t uniform_count;
+	struct shaggy_uniform_block *blocks; /* Indexed by GL block index */
+	size_t block_count;
+	khash_t(reflection_index) *uniform_index;
+	khash_t(reflection_index) *block_index;
+	unsigned generation; /* Bumped each time the program is reflected, i.e. relinked */
+};
+
+static inline
+void shaggy_reflection_clear(struct shaggy_program_reflection *reflection) {
+	free(reflection->uniforms);
+	free(reflection->blocks);
+	kh_clear(reflection_index, reflection->uniform_index);
+	kh_clear(reflection_index, reflection->block_index);
+
+	reflection->uniforms = NULL;
+	reflection->uniform_count = 0;
+	reflection->blocks = NULL;
+	reflection->block_count = 0;
+}
+
+static inline
+void shaggy_reflection_free(struct shaggy_program_reflection *reflection) {
+	if (!reflection) {
+		return;
+	}
+
+	shaggy_reflection_clear(reflection);
+	kh_destroy(reflection_index, reflection->uniform_index);
+	kh_destroy(reflection_index, reflection->block_index);
+	free(reflection);
+}
+
+/***************************************************************
+ * A program built by the manager. Kept alive while references
+ * remain and relinked when one of its stages is reloaded.
+ ***************************************************************/
+struct shaggy_managed_program {
+	struct shaggy_program_key key; /* Stage names and variant, also its link cache key */
+	struct shaggy_program_reflection *reflection; /* Refreshed in place on relink */
+	unsigned refs;
+	bool dirty;
+};
+
+KHASH_MAP_INIT_INT(program_map, struct shaggy_managed_program)
+
+/* (name, stage, variant) -> separable program holding just that stage */
+KHASH_INIT(separable_map, struct shaggy_shader_key, shaggy_program, 1, shaggy_shader_key_hash, shaggy_shader_key_equal)
+
+/* Stage names -> program pipeline object */
+KHASH_INIT(pipeline_cache, struct shaggy_program_key, GLuint, 1, shaggy_program_key_hash, shaggy_program_key_equal)
+
+/* inotify watch descriptor -> watched directory */
+KHASH_MAP_INIT_INT(watch_map, char *)
+
+/* A shader that has been submitted to the driver but not checked yet */
+struct shaggy_pending_shader {
+	GLuint shader;
+	enum shaggy_shader_type type;
+	const char *name; /* Interned */
+	uint64_t variant;
+	char *path;
+	uint64_t source_hash;
+};
+
+/* Variant bits are a uint64_t, one per registered flag */
+#define SHAGGY_MAX_VARIANT_FLAGS 64
+
+struct shaggy_manager {
+	khash_t(shader_registry) *shaders;
+	khash_t(intern_set) *names;
+
+	/* Identical sources share one GL shader, see shaggy_manage_release_object */
+	khash_t(shader_object_map) *objects;
+	khash_t(shader_ref_map) *object_refs;
+
+	/* Set by shaggy_manage_shader_bundle, resolves SHAGGY_BUNDLE_PREFIX paths */
+	const struct shaggy_shader_bundle *bundle;
+
+	/* Reverse #include edges, so editing a header recompiles only its users */
+	khash_t(include_graph) *dependents;
+
+	/* Variant bit i injects "#define <variant_flags[i]>", interned */
+	const char *variant_flags[SHAGGY_MAX_VARIANT_FLAGS];
+	int variant_flag_count;
+
+	struct shaggy_pending_shader *pending;
+	size_t pending_count;
+	size_t pending_capacity;
+
+	/* KHR/ARB_parallel_shader_compile is available */
+	bool parallel_compile;
+
+	/* ARB_gl_spirv is available, .spv files win over .glsl ones when it is */
+	bool spirv;
+
+	/* ARB_program_interface_query is available, programs are reflected after linking */
+	bool reflection;
+
+	/* Directory scans register files instead of compiling them */
+	bool lazy;
+
+	khash_t(program_map) *programs;
+	khash_t(program_cache) *program_cache;
+	bool programs_dirty;
+
+	/* ARB_separate_shader_objects path, see shaggy_manage_build_pipeline */
+	khash_t(separable_map) *separable_programs;
+	khash_t(pipeline_cache) *pipelines;
+
+	/* Hot reload, watch_fd is -1 until a directory is watched */
+	int watch_fd;
+	khash_t(watch_map) *watches;
+
+	/* On-disk program binary cache, disabled when NULL */
+	char *program_cache_dir;
+	uint64_t driver_hash;
+};
+
+static inline
+struct shaggy_manager *shaggy_create_shader_manager(void) {
+	struct shaggy_manager *manager = malloc(sizeof(struct shaggy_manager));
+
+	manager->shaders = kh_init(shader_registry);
+	manager->names = kh_init(intern_set);
+	manager->objects = kh_init(shader_object_map);
+	manager->object_refs = kh_init(shader_ref_map);
+	manager->dependents = kh_init(include_graph);
+	manager->bundle = NULL;
+	manager->variant_flag_count = 0;
+	manager->lazy = false;
+	manager->programs = kh_init(program_map);
+	manager->program_cache = kh_init(program_cache);
+	manager->programs_dirty = false;
+	manager->separable_programs = kh_init(separable_map);
+	manager->pipelines = kh_init(pipeline_cache);
+	manager->watch_fd = -1;
+	manager->watches = kh_init(watch_map);
+	manager->program_cache_dir = NULL;
+	manager->driver_hash = 0;
+
+	manager->pending = NULL;
+	manager->pending_count = 0;
+	manager->pending_capacity = 0;
+
+	/* Let the driver pick how many compiler threads it wants */
+	manager->parallel_compile = false;
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		manager->parallel_compile = true;
+	} else if (GLEW_ARB_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		manager->parallel_compile = true;
+	}
+
+	logm(CONFIG, "Parallel shader compile %s", manager->parallel_compile ? "enabled" : "unavailable");
+
+	manager->spirv = GLEW_ARB_gl_spirv || GLEW_VERSION_4_6;
+	logm(CONFIG, "SPIR-V shaders %s", manager->spirv ? "enabled" : "unavailable");
+
+	manager->reflection = GLEW_ARB_program_interface_query || GLEW_VERSION_4_3;
+	logm(CONFIG, "Program reflection %s", manager->reflection ? "enabled" : "unavailable");
+
+	return manager;
+}
+
+/*****************************************************************
+ * Shader Objects
+ * Every shader the manager compiles is keyed by its stage and a
+ * hash of the exact text sent to the driver, so duplicate files
+ * and variants that expand to the same source share one object.
+ * Registry entries and pending compiles each hold a reference.
+ *****************************************************************/
+
+static inline
+uint64_t shaggy_shader_object_key(enum shaggy_shader_type type, uint64_t source_hash) {
+	uint64_t stage = (uint64_t) type;
+
+	return shaggy_hash64(&stage, sizeof(stage), source_hash);
+}
+
+/* Compiled (or compiling) shader with this source, 0 if there isn't one */
+static inline
+GLuint shaggy_manage_find_object(struct shaggy_manager *manager, uint64_t key) {
+	khiter_t iter = kh_get(shader_object_map, manager->objects, key);
+
+	return iter == kh_end(manager->objects) ? 0 : kh_val(manager->objects, iter);
+}
+
+static inline
+void shaggy_manage_retain_object(struct shaggy_manager *manager, GLuint shader) {
+	khiter_t iter = kh_get(shader_ref_map, manager->object_refs, shader);
+
+	if (iter != kh_end(manager->object_refs)) {
+		kh_val(manager->object_refs, iter).refs += 1;
+	}
+}
+
+/* Start sharing a freshly created shader, the caller holds the first reference */
+static inline
+void shaggy_manage_add_object(struct shaggy_manager *manager, GLuint shader, uint64_t key) {
+	khiter_t iter;
+	int ret;
+
+	iter = kh_put(shader_object_map, manager->objects, key, &ret);
+	if (ret == -1) {
+		return;
+	}
+
+	kh_val(manager->objects, iter) = shader;
+
+	iter = kh_put(shader_ref_map, manager->object_refs, shader, &ret);
+	if (ret == -1) {
+		kh_del(shader_object_map, manager->objects, kh_get(shader_object_map, manager->objects, key));
+		return;
+	}
+
+	kh_val(manager->object_refs, iter).key = key;
+	kh_val(manager->object_refs, iter).refs = 1;
+}
+
+/*****************************************************************
+ * Drop a reference to a shader, deleting it with the last one.
+ * Shaders the manager didn't compile, e.g. from
+ * shaggy_manage_add_shader, are owned outright and deleted.
+ *****************************************************************/
+static inline
+void shaggy_manage_release_object(struct shaggy_manager *manager, GLuint shader) {
+	khiter_t iter;
+	khiter_t object_iter;
+	struct shaggy_shader_object *object;
+
+	if (!shader) {
+		return;
+	}
+
+	iter = kh_get(shader_ref_map, manager->object_refs, shader);
+	if (iter == kh_end(manager->object_refs)) {
+		shaggy_delete_shader(shader);
+		return;
+	}
+
+	object = &kh_val(manager->object_refs, iter);
+	if (--object->refs > 0) {
+		return;
+	}
+
+	object_iter = kh_get(shader_object_map, manager->objects, object->key);
+	if (object_iter != kh_end(manager->objects) && kh_val(manager->objects, object_iter) == shader) {
+		kh_del(shader_object_map, manager->objects, object_iter);
+	}
+
+	kh_del(shader_ref_map, manager->object_refs, iter);
+	shaggy_delete_shader(shader);
+}
+
+static inline
+void shaggy_destroy_shader_registry(struct shaggy_manager *manager) {
+	struct shaggy_shader_key key;
+	struct shaggy_managed_shader entry;
+	struct shaggy_dependents dependents;
+	const char *name;
+	khiter_t iter;
+
+	kh_foreach(manager->dependents, name, dependents, {
+		(void) name;
+		free(dependents.keys);
+	});
+
+	kh_destroy(include_graph, manager->dependents);
+
+	kh_foreach(manager->shaders, key, entry, {
+		(void) key;
+		shaggy_manage_release_object(manager, entry.shader);
+		shaggy_free_specialization(entry.specialization);
+		free(entry.path);
+	});
+
+	kh_destroy(shader_registry, manager->shaders);
+	kh_destroy(shader_object_map, manager->objects);
+	kh_destroy(shader_ref_map, manager->object_refs);
+
+	for (iter = kh_begin(manager->names); iter != kh_end(manager->names); ++iter) {
+		if (kh_exist(manager->names, iter)) {
+			name = kh_key(manager->names, iter);
+			free((char *) name);
+		}
+	}
+
+	kh_destroy(intern_set, manager->names);
+}
+
+static inline
+void shaggy_destroy_shader_manager(struct shaggy_manager *manager) {
+	size_t i;
+
+	for (i = 0; i < manager->pending_count; ++i) {
+		shaggy_manage_release_object(manager, manager->pending[i].shader);
+		free(manager->pending[i].path);
+	}
+
+	free(manager->pending);
+
+	/* Any references still out there go stale along with the manager */
+	{
+		shaggy_program program;
+		struct shaggy_managed_program record;
+
+		kh_foreach(manager->programs, program, record, {
+			shaggy_reflection_free(record.reflection);
+			shaggy_delete_program(program);
+		});
+
+		kh_destroy(program_map, manager->programs);
+		kh_destroy(program_cache, manager->program_cache);
+	}
+
+	{
+		shaggy_program program;
+		GLuint pipeline;
+
+		kh_foreach_value(manager->separable_programs, program, shaggy_delete_program(program));
+		kh_foreach_value(manager->pipelines, pipeline, glDeleteProgramPipelines(1, &pipeline));
+
+		kh_destroy(separable_map, manager->separable_programs);
+		kh_destroy(pipeline_cache, manager->pipelines);
+	}
+
+	{
+		char *dir_path;
+
+		kh_foreach_value(manager->watches, dir_path, free(dir_path));
+		kh_destroy(watch_map, manager->watches);
+	}
+
+#if defined (__linux__)
+	if (manager->watch_fd != -1) {
+		close(manager->watch_fd);
+	}
+#endif
+
+	shaggy_destroy_shader_registry(manager);
+	free(manager->program_cache_dir);
+	free(manager);
+}
+
+/*****************************************************************
+ * Return the manager's copy of name, adding it if it's new.
+ * Interned names live as long as the manager and can be compared
+ * by pointer.
+ * @param name Name to intern, doesn't need to be NUL terminated.
+ * @param length Number of characters in name.
+ *****************************************************************/
+static inline
+const char *shaggy_manage_intern_n(struct shaggy_manager *manager, const char *name, size_t length) {
+	int ret;
+	khiter_t iter;
+	char *copy = strndup(name, length);
+
+	iter = kh_put(intern_set, manager->names, copy, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to intern %s", copy);
+		free(copy);
+		return NULL;
+	}
+
+	if (ret == 0) {
+		free(copy);
+	}
+
+	return kh_key(manager->names, iter);
+}
+
+static inline
+const char *shaggy_manage_intern(struct shaggy_manager *manager, const char *name) {
+	return name ? shaggy_manage_intern_n(manager, name, strlen(name)) : NULL;
+}
+
+/*****************************************************************
+ * Shader Variants
+ * A variant is the same file compiled with a set of #defines
+ * injected after its #version line. Each flag gets a bit the first
+ * time it's seen, OR them together to name a variant. Variants
+ * are compiled the first time they're fetched and cached like any
+ * other shader.
+ *****************************************************************/
+
+/*****************************************************************
+ * Get the variant bit for a define, assigning one if it's new.
+ * @param define What follows "#define ", e.g. "SKINNED" or
+ *               "MAX_LIGHTS 8".
+ * @return The bit, or 0 if all SHAGGY_MAX_VARIANT_FLAGS are taken.
+ *****************************************************************/
+static inline
+uint64_t shaggy_manage_variant_flag(struct shaggy_manager *manager, const char *define) {
+	const char *interned = shaggy_manage_intern(manager, define);
+	int i;
+
+	if (!interned) {
+		return 0;
+	}
+
+	for (i = 0; i < manager->variant_flag_count; ++i) {
+		if (manager->variant_flags[i] == interned) {
+			return UINT64_C(1) << i;
+		}
+	}
+
+	if (manager->variant_flag_count == SHAGGY_MAX_VARIANT_FLAGS) {
+		logm(ERROR, "Out of variant flags, can't add %s", define);
+		return 0;
+	}
+
+	manager->variant_flags[manager->variant_flag_count] = interned;
+	return UINT64_C(1) << manager->variant_flag_count++;
+}
+
+/* Whether every bit of variant has been handed out by shaggy_manage_variant_flag */
+static inline
+bool shaggy_manage_known_variant(struct shaggy_manager *manager, uint64_t variant) {
+	uint64_t known = manager->variant_flag_count == SHAGGY_MAX_VARIANT_FLAGS
+			? ~UINT64_C(0) : (UINT64_C(1) << manager->variant_flag_count) - 1;
+
+	return (variant & ~known) == 0;
+}
+
+/*****************************************************************
+ * Build the #define block for a variant.
+ * @param defines Receives the block, NULL for variant 0. Caller frees.
+ * @return false if variant has bits no flag was assigned, or on
+ *         allocation failure.
+ *****************************************************************/
+static inline
+bool shaggy_manage_variant_defines(struct shaggy_manager *manager, uint64_t variant, char **defines) {
+	size_t length = 0;
+	size_t offset = 0;
+	int i;
+
+	*defines = NULL;
+
+	if (!variant) {
+		return true;
+	}
+
+	if (!shaggy_manage_known_variant(manager, variant)) {
+		logm(ERROR, "Variant %#llx has bits no variant flag was assigned", (unsigned long long) variant);
+		return false;
+	}
+
+	for (i = 0; i < manager->variant_flag_count; ++i) {
+		if (variant & (UINT64_C(1) << i)) {
+			length += strlen("#define \n") + strlen(manager->variant_flags[i]);
+		}
+	}
+
+	*defines = malloc(length + 1);
+	if (!*defines) {
+		logm(ERROR, "Out of memory building the defines of variant %#llx", (unsigned long long) variant);
+		return false;
+	}
+
+	(*defines)[0] = '\0';
+
+	for (i = 0; i < manager->variant_flag_count; ++i) {
+		if (variant & (UINT64_C(1) << i)) {
+			offset += sprintf(*defines + offset, "#define %s\n", manager->variant_flags[i]);
+		}
+	}
+
+	return true;
+}
+
+/* Record that the shader under key includes path */
+static inline
+void shaggy_manage_add_dependent(struct shaggy_manager *manager, const char *path, struct shaggy_shader_key key) {
+	struct shaggy_dependents *dependents;
+	khiter_t iter;
+	size_t i;
+	int ret;
+
+	path = shaggy_manage_intern(manager, path);
+	if (!path) {
+		return;
+	}
+
+	iter = kh_put(include_graph, manager->dependents, path, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to record dependency on %s", path);
+		return;
+	}
+
+	dependents = &kh_val(manager->dependents, iter);
+	if (ret > 0) {
+		memset(dependents, 0, sizeof(*dependents));
+	}
+
+	for (i = 0; i < dependents->count; ++i) {
+		if (shaggy_shader_key_equal(dependents->keys[i], key)) {
+			return;
+		}
+	}
+
+	if (dependents->count == dependents->capacity) {
+		dependents->capacity = dependents->capacity ? dependents->capacity * 2 : 4;
+		dependents->keys = realloc(dependents->keys, dependents->capacity * sizeof(*dependents->keys));
+	}
+
+	dependents->keys[dependents->count++] = key;
+}
+
+/*****************************************************************
+ * Load the full source of a registry entry, includes resolved and
+ * the variant's defines injected, and note what it includes.
+ * Free with shaggy_source_free whatever the result.
+ *****************************************************************/
+static inline
+bool shaggy_manage_load_source(
+		struct shaggy_manager *manager, struct shaggy_shader_key key, const char *path, struct shaggy_source *source) {
+	char *defines;
+	size_t i;
+
+	if (key.variant && shaggy_is_spirv_path(path)) {
+		memset(source, 0, sizeof(*source));
+		logm(ERROR, "%s is SPIR-V, it can't take #define variants, use specialization constants", path);
+		return false;
+	}
+
+	if (!shaggy_manage_variant_defines(manager, key.variant, &defines)) {
+		memset(source, 0, sizeof(*source));
+		return false;
+	}
+
+	if (!shaggy_source_load(source, manager->bundle, path, defines)) {
+		return false;
+	}
+
+	for (i = 1; i < source->file_count; ++i) {
+		shaggy_manage_add_dependent(manager, source->files[i], key);
+	}
+
+	return true;
+}
+
+/* File name suffix for each stage, <name>.<suffix>.glsl or <name>.<suffix>.spv */
+static const char *const shaggy_shader_file_suffixes[SHAGGY_SHADER_TYPE_COUNT] = {
+	[SHAGGY_VERTEX_SHADER] = "vert",
+	[SHAGGY_FRAGMENT_SHADER] = "frag",
+	[SHAGGY_TESS_CONTROL_SHADER] = "tesc",
+	[SHAGGY_TESS_EVALUATION_SHADER] = "tese",
+	[SHAGGY_GEOMETRY_SHADER] = "geom",
+	[SHAGGY_COMPUTE_SHADER] = "comp"
+};
+
+/*************************************************************
+ * Work out which stage a file holds from its name.
+ * Shader files are named <name>.<vert|tesc|tese|geom|frag|comp>.glsl,
+ * or .spv for SPIR-V compiled offline.
+ * @param filename File name, without any directory.
+ * @param name Receives the shader name, points into filename.
+ * @param name_length Receives the length of name.
+ * @param type Receives the shader stage.
+ * @return false if the name isn't a valid shaggy shader file.
+ *************************************************************/
+static inline
+bool shaggy_classify_shader_file(
+		const char *filename, const char **name, int *name_length, enum shaggy_shader_type *type) {
+	int bytes_scanned;
+	int filename_length = strlen(filename);
+	struct slre_cap caps[3];
+	int i;
+
+	bytes_scanned = slre_match(SHAGGY_SHADER_FILE_EXP, filename, filename_length, caps, 3, SLRE_IGNORE_CASE);
+
+	if (bytes_scanned < 0 || bytes_scanned != filename_length) {
+		return false;
+	}
+
+	*name = caps[0].ptr;
+	*name_length = caps[0].len;
+
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		bytes_scanned = slre_match(shaggy_shader_file_suffixes[i], caps[1].ptr, caps[1].len, 0, 0, SLRE_IGNORE_CASE);
+		if (bytes_scanned == caps[1].len) {
+			*type = (enum shaggy_shader_type) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Same checks every entry point does before trusting a path */
+static inline
+bool shaggy_open_shader_file(
+		tinydir_file *file, const char *pathname, const char **name, int *name_length, enum shaggy_shader_type *type) {
+	int error = tinydir_file_open(file, pathname);
+	if (error < 0) {
+		logm(WARNING, "Failed to create tinydir object for %s", pathname);
+		return false;
+	}
+
+	if (!file->is_reg) {
+		logm(WARNING, "%s is not a regular file!", pathname);
+		return false;
+	}
+
+	if (!shaggy_classify_shader_file(file->name, name, name_length, type)) {
+		/* Plain .glsl files are there to be #included */
+		if (strlen(file->name) > 5 && strcmp(file->name + strlen(file->name) - 5, ".glsl") == 0) {
+			logm(FINE, "%s has no stage, only usable through #include", file->name);
+		} else {
+			logm(WARNING, "File %s didn't match a valid shaggy shader file name.", file->name);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+/* Specialization set on a registry entry, NULL if there's no entry or none was set */
+static inline
+struct shaggy_specialization *shaggy_manage_specialization(struct shaggy_manager *manager, struct shaggy_shader_key key) {
+	khiter_t iter = kh_get(shader_registry, manager->shaders, key);
+
+	if (iter == kh_end(manager->shaders)) {
+		return NULL;
+	}
+
+	return kh_val(manager->shaders, iter).specialization;
+}
+
+/* SPIR-V starts with 0x07230203 in either byte order */
+static inline
+bool shaggy_check_spirv(const struct shaggy_source *source, const char *path) {
+	uint32_t magic;
+
+	if (source->count != 1 || source->lengths[0] < 20 || source->lengths[0] % 4 != 0) {
+		logm(ERROR, "%s is too short or not a whole number of words, not SPIR-V", path);
+		return false;
+	}
+
+	memcpy(&magic, source->strings[0], sizeof(magic));
+	if (magic != 0x07230203u && magic != 0x03022307u) {
+		logm(ERROR, "%s doesn't start with the SPIR-V magic number", path);
+		return false;
+	}
+
+	return true;
+}
+
+/*****************************************************************
+ * SPIR-V counterpart of glShaderSource + glCompileShader.
+ * The module goes to the driver straight out of the file mapping
+ * or the bundle. Specializing is what sets GL_COMPILE_STATUS, so
+ * the usual polling picks the result up.
+ *****************************************************************/
+static inline
+void shaggy_specialize_spirv(
+		GLuint shader, const struct shaggy_source *source, const struct shaggy_specialization *specialization) {
+	glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, source->strings[0], source->lengths[0]);
+
+	if (specialization) {
+		glSpecializeShaderARB(shader, specialization->entry_point, specialization->count,
+							  specialization->indices, specialization->values);
+	} else {
+		glSpecializeShaderARB(shader, "main", 0, NULL, NULL);
+	}
+}
+
+/* Create, source and start compiling pending->type from pending->path */
+static inline
+bool shaggy_start_shader_compile(struct shaggy_manager *manager, struct shaggy_pending_shader *pending) {
+	struct shaggy_source source;
+	struct shaggy_shader_key key;
+	struct shaggy_specialization *specialization = NULL;
+	bool spirv = shaggy_is_spirv_path(pending->path);
+	uint64_t object_key;
+	bool result = false;
+
+	key.name = pending->name;
+	key.type = pending->type;
+	key.variant = pending->variant;
+
+	if (spirv && !manager->spirv) {
+		memset(&source, 0, sizeof(source));
+		logm(ERROR, "Can't load %s, ARB_gl_spirv is unavailable", pending->path);
+		goto fail;
+	}
+
+	if (!shaggy_manage_load_source(manager, key, pending->path, &source)) {
+		goto fail;
+	}
+
+	if (spirv) {
+		if (!shaggy_check_spirv(&source, pending->path)) {
+			goto fail;
+		}
+
+		specialization = shaggy_manage_specialization(manager, key);
+	}
+
+	pending->source_hash = shaggy_specialization_hash(specialization, shaggy_source_hash(&source));
+	result = true;
+
+	/* Same text already went to the driver under another name */
+	object_key = shaggy_shader_object_key(pending->type, pending->source_hash);
+	pending->shader = shaggy_manage_find_object(manager, object_key);
+	if (pending->shader) {
+		logm(FINE, "%s has the same source as shader %u, sharing it", pending->path, pending->shader);
+		shaggy_manage_retain_object(manager, pending->shader);
+		goto fail;
+	}
+
+	pending->shader = glCreateShader(shaggy_gl_shader_types[pending->type]);
+	if (spirv) {
+		shaggy_specialize_spirv(pending->shader, &source, specialization);
+	} else {
+		glShaderSource(pending->shader, (GLsizei) source.count, source.strings, source.lengths);
+		shaggy_compile_shader(pending->shader);
+	}
+
+	shaggy_manage_add_object(manager, pending->shader, object_key);
+
+fail:
+	shaggy_source_free(&source);
+	return result;
+}
+
+static inline
+void shaggy_manage_push_pending(struct shaggy_manager *manager, struct shaggy_pending_shader pending) {
+	if (manager->pending_count == manager->pending_capacity) {
+		manager->pending_capacity = manager->pending_capacity ? manager->pending_capacity * 2 : 16;
+		manager->pending = realloc(manager->pending, manager->pending_capacity * sizeof(*manager->pending));
+	}
+
+	manager->pending[manager->pending_count++] = pending;
+}
+
+/*****************************************************************
+ * Insert or update (name, type, variant) in the registry.
+ * Takes ownership of path, an existing path is replaced by it.
+ * @param key If not NULL, receives the interned name.
+ *****************************************************************/
+static inline
+struct shaggy_managed_shader *shaggy_manage_put_shader_key(
+		struct shaggy_manager *manager, enum shaggy_shader_type type,
+		const char *name, uint64_t variant, char *path, const char **key) {
+	int ret;
+	khiter_t iter;
+	struct shaggy_shader_key shader_key;
+	struct shaggy_managed_shader *entry;
+
+	shader_key.name = shaggy_manage_intern(manager, name);
+	shader_key.type = type;
+	shader_key.variant = variant;
+
+	if (!shader_key.name) {
+		free(path);
+		return NULL;
+	}
+
+	iter = kh_put(shader_registry, manager->shaders, shader_key, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to create key %s in shader hash table!", name);
+		free(path);
+		return NULL;
+	}
+
+	entry = &kh_val(manager->shaders, iter);
+
+	if (key) {
+		*key = shader_key.name;
+	}
+
+	if (ret == 0) {
+		if (path && entry->path != path) {
+			free(entry->path);
+			entry->path = path;
+		}
+	} else {
+		entry->shader = 0;
+		entry->state = SHAGGY_SHADER_UNLOADED;
+		entry->path = path;
+		entry->source_hash = 0;
+		entry->specialization = NULL;
+	}
+
+	return entry;
+}
+
+static inline
+struct shaggy_managed_shader *shaggy_manage_put_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, char *path) {
+	return shaggy_manage_put_shader_key(manager, type, name, 0, path, NULL);
+}
+
+/* Mark every program using the given stage so it's relinked at the next reload poll */
+static inline
+void shaggy_manage_invalidate_programs(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, uint64_t variant) {
+	khiter_t iter;
+
+	for (iter = kh_begin(manager->programs); iter != kh_end(manager->programs); ++iter) {
+		struct shaggy_managed_program *record;
+
+		if (!kh_exist(manager->programs, iter)) {
+			continue;
+		}
+
+		record = &kh_val(manager->programs, iter);
+		if (record->key.shaders[type] == name && record->key.variant == variant) {
+			record->dirty = true;
+			manager->programs_dirty = true;
+		}
+	}
+}
+
+/*******************************************************************
+ * Separable Programs
+ * With ARB_separate_shader_objects each stage is linked once on its
+ * own and combinations are just pipeline objects pointing at those
+ * programs, so link work grows with the number of shaders instead of
+ * the number of combinations.
+ *******************************************************************/
+
+static const GLbitfield shaggy_stage_bits[SHAGGY_SHADER_TYPE_COUNT] = {
+	[SHAGGY_VERTEX_SHADER] = GL_VERTEX_SHADER_BIT,
+	[SHAGGY_FRAGMENT_SHADER] = GL_FRAGMENT_SHADER_BIT,
+	[SHAGGY_TESS_CONTROL_SHADER] = GL_TESS_CONTROL_SHADER_BIT,
+	[SHAGGY_TESS_EVALUATION_SHADER] = GL_TESS_EVALUATION_SHADER_BIT,
+	[SHAGGY_GEOMETRY_SHADER] = GL_GEOMETRY_SHADER_BIT,
+	[SHAGGY_COMPUTE_SHADER] = GL_COMPUTE_SHADER_BIT
+};
+
+/* Link a single compiled stage as a separable program, 0 on failure */
+static inline
+shaggy_program shaggy_link_separable_program(GLuint shader) {
+	shaggy_program program = shaggy_create_program();
+
+	glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	shaggy_attach_shader(program, shader);
+	shaggy_link_program(program);
+	shaggy_detach_shader(program, shader);
+
+	if (shaggy_check_program_link_status(program) == GL_FALSE) {
+		GLsizei buf_size = shaggy_get_program_info_log_length(program);
+		GLchar buf[buf_size];
+
+		shaggy_get_program_info_log(program, buf_size, buf);
+		logm(WARNING, "Failed to link separable program for shader %u: %.*s", shader, buf_size, buf);
+		shaggy_delete_program(program);
+		return 0;
+	}
+
+	return program;
+}
+
+/* Separable program for a stage, linked from shader the first time it's asked for */
+static inline
+shaggy_program shaggy_manage_separable_program(
+		struct shaggy_manager *manager, struct shaggy_shader_key key, GLuint shader) {
+	khiter_t iter;
+	int ret;
+	shaggy_program program;
+
+	iter = kh_get(separable_map, manager->separable_programs, key);
+	if (iter != kh_end(manager->separable_programs)) {
+		return kh_val(manager->separable_programs, iter);
+	}
+
+	program = shaggy_link_separable_program(shader);
+	if (!program) {
+		return 0;
+	}
+
+	iter = kh_put(separable_map, manager->separable_programs, key, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to record separable program for shader %s", key.name);
+		shaggy_delete_program(program);
+		return 0;
+	}
+
+	kh_val(manager->separable_programs, iter) = program;
+	return program;
+}
+
+/*****************************************************************
+ * A reload gave (name, type, variant) new_shader. Relink its
+ * separable program and repoint every pipeline built from that
+ * name. Pipelines keep the old stage if the new one doesn't link.
+ *****************************************************************/
+static inline
+void shaggy_manage_swap_separable(
+		struct shaggy_manager *manager, enum shaggy_shader_type type,
+		const char *name, uint64_t variant, GLuint new_shader) {
+	struct shaggy_shader_key key;
+	khiter_t iter;
+	shaggy_program old_program;
+	shaggy_program new_program;
+
+	key.name = name;
+	key.type = type;
+	key.variant = variant;
+
+	iter = kh_get(separable_map, manager->separable_programs, key);
+	if (iter == kh_end(manager->separable_programs)) {
+		return;
+	}
+
+	new_program = shaggy_link_separable_program(new_shader);
+	if (!new_program) {
+		return;
+	}
+
+	old_program = kh_val(manager->separable_programs, iter);
+	kh_val(manager->separable_programs, iter) = new_program;
+
+	for (iter = kh_begin(manager->pipelines); iter != kh_end(manager->pipelines); ++iter) {
+		if (kh_exist(manager->pipelines, iter) && kh_key(manager->pipelines, iter).shaders[type] == name &&
+			kh_key(manager->pipelines, iter).variant == variant) {
+			glUseProgramStages(kh_val(manager->pipelines, iter), shaggy_stage_bits[type], new_program);
+		}
+	}
+
+	shaggy_delete_program(old_program);
+}
+
+/*****************************************************************
+ * Whether a file should back the plain (name, type) entry. With
+ * ARB_gl_spirv a .spv file wins over GLSL of the same name, so a
+ * project can ship both and fall back on drivers without it.
+ * Without the extension .spv files are skipped.
+ *****************************************************************/
+static inline
+bool shaggy_manage_accept_path(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, const char *path) {
+	struct shaggy_shader_key key;
+	khiter_t iter;
+
+	if (shaggy_is_spirv_path(path)) {
+		if (!manager->spirv) {
+			logm(FINE, "Skipping %s, ARB_gl_spirv is unavailable", path);
+			return false;
+		}
+
+		return true;
+	}
+
+	key.name = name;
+	key.type = type;
+	key.variant = 0;
+
+	iter = kh_get(shader_registry, manager->shaders, key);
+	if (manager->spirv && iter != kh_end(manager->shaders) && kh_val(manager->shaders, iter).path &&
+		shaggy_is_spirv_path(kh_val(manager->shaders, iter).path)) {
+		logm(FINE, "Skipping %s, %s is used instead", path, kh_val(manager->shaders, iter).path);
+		return false;
+	}
+
+	return true;
+}
+
+static inline
+void shaggy_manage_mark_pending(struct shaggy_manager *manager, struct shaggy_pending_shader *pending) {
+	struct shaggy_managed_shader *entry;
+
+	entry = shaggy_manage_put_shader_key(
+			manager, pending->type, pending->name, pending->variant, strdup(pending->path), NULL);
+	if (entry && entry->state == SHAGGY_SHADER_UNLOADED) {
+		entry->state = SHAGGY_SHADER_PENDING;
+	}
+}
+
+/* Second phase, the compile is known to be done (or we're willing to block on it) */
+static inline
+void shaggy_manage_finish_shader(struct shaggy_manager *manager, struct shaggy_pending_shader *pending) {
+	struct shaggy_managed_shader *entry;
+	const char *name;
+	GLint status = shaggy_check_shader_compile_status(pending->shader);
+
+	/* A .spv file took the entry over while this GLSL compile was in flight */
+	if (pending->variant == 0 && !shaggy_manage_accept_path(manager, pending->type, pending->name, pending->path)) {
+		shaggy_manage_release_object(manager, pending->shader);
+		free(pending->path);
+		return;
+	}
+
+	entry = shaggy_manage_put_shader_key(
+			manager, pending->type, pending->name, pending->variant, pending->path, &name);
+	if (!entry) {
+		shaggy_manage_release_object(manager, pending->shader);
+		return;
+	}
+
+	entry->state = SHAGGY_SHADER_LOADED;
+
+	if (status == GL_FALSE) {
+		GLsizei buf_size = shaggy_get_shader_info_log_length(pending->shader);
+		GLchar buf[buf_size];
+
+		shaggy_get_shader_info_log(pending->shader, buf_size, buf);
+		logm(WARNING, "Failed to compile %s: %.*s",
+			 entry->path, buf_size, buf);
+
+		shaggy_manage_release_object(manager, pending->shader);
+		return;
+	}
+
+	/******************************************
+	 * A reload replaces the shader in place.
+	 * The old one is only flagged for deletion
+	 * by GL while programs still have it.
+	 ******************************************/
+	if (entry->shader && entry->shader != pending->shader) {
+		logm(INFO, "Reloaded %s", entry->path);
+		shaggy_manage_invalidate_programs(manager, pending->type, name, pending->variant);
+		shaggy_manage_swap_separable(manager, pending->type, name, pending->variant, pending->shader);
+	}
+
+	/**********************************
+	 * Add shader to hashmap so we can
+	 * query by shader file name. The
+	 * pending reference moves over.
+	 **********************************/
+	shaggy_manage_release_object(manager, entry->shader);
+	entry->shader = pending->shader;
+	entry->source_hash = pending->source_hash;
+}
+
+/*****************************************************************
+ * Pick up any submitted shaders whose compile has finished.
+ * With parallel_shader_compile this never blocks, without it the
+ * first status query waits on the driver like it always did.
+ * @return Number of shaders still compiling.
+ *****************************************************************/
+static inline
+size_t shaggy_manage_poll_shaders(struct shaggy_manager *manager) {
+	size_t i;
+	size_t remaining = 0;
+
+	for (i = 0; i < manager->pending_count; ++i) {
+		struct shaggy_pending_shader *pending = &manager->pending[i];
+
+		if (manager->parallel_compile) {
+			GLint completed = GL_FALSE;
+
+			glGetShaderiv(pending->shader, GL_COMPLETION_STATUS_KHR, &completed);
+			if (completed == GL_FALSE) {
+				manager->pending[remaining++] = *pending;
+				continue;
+			}
+		}
+
+		shaggy_manage_finish_shader(manager, pending);
+	}
+
+	manager->pending_count = remaining;
+	return remaining;
+}
+
+/* Block until every submitted shader has been compiled and added */
+static inline
+void shaggy_manage_wait_shaders(struct shaggy_manager *manager) {
+	size_t i;
+
+	for (i = 0; i < manager->pending_count; ++i) {
+		shaggy_manage_finish_shader(manager, &manager->pending[i]);
+	}
+
+	manager->pending_count = 0;
+}
+
+/*****************************************************************
+ * Block on the submitted compiles of one shader variant only, the
+ * rest stay queued for shaggy_manage_poll_shaders. A reload can
+ * queue a second compile of the same shader, they're finished in
+ * submission order so the newest one ends up in the registry.
+ * @param name Interned shader name.
+ *****************************************************************/
+static inline
+void shaggy_manage_wait_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, uint64_t variant) {
+	size_t i;
+	size_t remaining = 0;
+
+	for (i = 0; i < manager->pending_count; ++i) {
+		struct shaggy_pending_shader *pending = &manager->pending[i];
+
+		if (pending->type != type || pending->name != name || pending->variant != variant) {
+			manager->pending[remaining++] = *pending;
+			continue;
+		}
+
+		shaggy_manage_finish_shader(manager, pending);
+	}
+
+	manager->pending_count = remaining;
+}
+
+/* Submit a known name/stage/variant/path. Takes ownership of path. */
+static inline
+void shaggy_manage_submit_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type,
+		const char *name, uint64_t variant, char *path) {
+	struct shaggy_pending_shader pending;
+
+	pending.type = type;
+	pending.name = shaggy_manage_intern(manager, name);
+	pending.variant = variant;
+	pending.path = path;
+
+	if (!pending.name || !shaggy_start_shader_compile(manager, &pending)) {
+		free(path);
+		return;
+	}
+
+	shaggy_manage_mark_pending(manager, &pending);
+	shaggy_manage_push_pending(manager, pending);
+}
+
+static inline
+void shaggy_manage_submit_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, char *path) {
+	shaggy_manage_submit_variant(manager, type, name, 0, path);
+}
+
+/*****************************************************************
+ * First phase of loading a shader file.
+ * Creates the shader, sources it and kicks off glCompileShader but
+ * doesn't wait on the result. The shader can't be fetched until
+ * shaggy_manage_poll_shaders or shaggy_manage_wait_shaders has
+ * picked it up, fetching it early blocks.
+ * @param manager Manager the shader will be added to.
+ * @param pathname Path of a <name>.<stage>.glsl or .spv file.
+ *****************************************************************/
+static inline
+void shaggy_manage_submit_shader_file(struct shaggy_manager *manager, const char *pathname) {
+	tinydir_file file;
+	const char *name;
+	int name_length;
+	enum shaggy_shader_type type;
+
+	if (!shaggy_open_shader_file(&file, pathname, &name, &name_length, &type)) {
+		return;
+	}
+
+	name = shaggy_manage_intern_n(manager, name, name_length);
+	if (name && shaggy_manage_accept_path(manager, type, name, file.path)) {
+		shaggy_manage_submit_shader(manager, type, name, strdup(file.path));
+	}
+}
+
+/*****************************************************************
+ * Lazy counterpart of shaggy_manage_submit_shader_file.
+ * Only records the name and path, nothing touches the driver or
+ * even reads the file until the shader is fetched or prefetched.
+ *****************************************************************/
+static inline
+void shaggy_manage_register_shader_file(struct shaggy_manager *manager, const char *pathname) {
+	tinydir_file file;
+	const char *name;
+	int name_length;
+	enum shaggy_shader_type type;
+
+	if (!shaggy_open_shader_file(&file, pathname, &name, &name_length, &type)) {
+		return;
+	}
+
+	name = shaggy_manage_intern_n(manager, name, name_length);
+	if (name && shaggy_manage_accept_path(manager, type, name, file.path) &&
+		shaggy_manage_put_shader(manager, type, name, strdup(file.path))) {
+		logm(FINE, "Registered %s", file.path);
+	}
+}
+
+/* Single registry probe, shader_name doesn't have to be interned */
+static inline
+struct shaggy_managed_shader *shaggy_manage_find_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name, uint64_t variant) {
+	khiter_t iter;
+	struct shaggy_shader_key key;
+
+	if (!shader_name || type >= SHAGGY_SHADER_TYPE_COUNT) {
+		return NULL;
+	}
+
+	key.name = shader_name;
+	key.type = type;
+	key.variant = variant;
+
+	iter = kh_get(shader_registry, manager->shaders, key);
+	if (iter == kh_end(manager->shaders)) {
+		return NULL;
+	}
+
+	return &kh_val(manager->shaders, iter);
+}
+
+static inline
+struct shaggy_managed_shader *shaggy_manage_find_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name) {
+	return shaggy_manage_find_variant(manager, type, shader_name, 0);
+}
+
+/*****************************************************************
+ * Find a variant, registering it against the plain shader's file
+ * if this is the first time it's been asked for. Doesn't compile.
+ * @return The entry, or NULL if the shader or a variant bit is
+ *         unknown. Any entry pointer held before this call may be
+ *         stale afterwards.
+ *****************************************************************/
+static inline
+struct shaggy_managed_shader *shaggy_manage_register_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name, uint64_t variant) {
+	struct shaggy_managed_shader *entry = shaggy_manage_find_variant(manager, type, shader_name, variant);
+	struct shaggy_managed_shader *base;
+
+	if (entry || !variant) {
+		return entry;
+	}
+
+	/* Unassigned bits would compile the same as variant 0 under another key */
+	if (!shaggy_manage_known_variant(manager, variant)) {
+		logm(ERROR, "Variant %#llx of %s has bits no variant flag was assigned",
+			 (unsigned long long) variant, shader_name);
+		return NULL;
+	}
+
+	base = shaggy_manage_find_shader(manager, type, shader_name);
+	if (!base || !base->path) {
+		return NULL;
+	}
+
+	return shaggy_manage_put_shader_key(manager, type, shader_name, variant, strdup(base->path), NULL);
+}
+
+/*****************************************************************
+ * Make sure a shader variant has been submitted.
+ * @return The entry, or NULL if the shader is unknown. Any entry
+ *         pointer held before this call may be stale afterwards.
+ *****************************************************************/
+static inline
+struct shaggy_managed_shader *shaggy_manage_request_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name, uint64_t variant) {
+	struct shaggy_managed_shader *entry = shaggy_manage_register_variant(manager, type, shader_name, variant);
+
+	if (!entry || entry->state != SHAGGY_SHADER_UNLOADED || !entry->path) {
+		return entry;
+	}
+
+	shaggy_manage_submit_variant(manager, type, shader_name, variant, strdup(entry->path));
+
+	/* Submitting can grow the table */
+	entry = shaggy_manage_find_variant(manager, type, shader_name, variant);
+
+	/* Couldn't even read the file, don't retry on every fetch */
+	if (entry->state == SHAGGY_SHADER_UNLOADED) {
+		entry->state = SHAGGY_SHADER_LOADED;
+	}
+
+	return entry;
+}
+
+static inline
+struct shaggy_managed_shader *shaggy_manage_request_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name) {
+	return shaggy_manage_request_variant(manager, type, shader_name, 0);
+}
+
+/*****************************************************************
+ * Look up a shader variant, compiling it first if it hasn't been
+ * yet. Blocks if the shader is still compiling, but not on any
+ * other compile in flight.
+ * @param variant OR of shaggy_manage_variant_flag bits, 0 for the
+ *                file as it is.
+ * @return The shader, or 0 if it's unknown or failed to compile.
+ *****************************************************************/
+static inline
+GLuint shaggy_manage_fetch_variant(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name, uint64_t variant) {
+	struct shaggy_managed_shader *entry = shaggy_manage_request_variant(manager, type, shader_name, variant);
+
+	if (!entry) {
+		logm(WARNING, "Failed to find key %s in shader hash table!", shader_name);
+		return 0;
+	}
+
+	if (entry->state == SHAGGY_SHADER_PENDING) {
+		shaggy_manage_wait_variant(manager, type, shaggy_manage_intern(manager, shader_name), variant);
+		entry = shaggy_manage_find_variant(manager, type, shader_name, variant);
+	}
+
+	return entry->shader;
+}
+
+/*****************************************************************
+ * Look up a shader by name, compiling it first if it has only
+ * been registered. Blocks if the shader is still compiling.
+ * @return The shader, or 0 if it's unknown or failed to compile.
+ *****************************************************************/
+static inline
+GLuint shaggy_manage_fetch_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *shader_name) {
+	return shaggy_manage_fetch_variant(manager, type, shader_name, 0);
+}
+
+#define shaggy_manage_add_shader(manager, name, shader) _Generic((shader),         \
+        shaggy_vertex_shader: shaggy_manage_add_vertex_shader,                     \
+        shaggy_tess_control_shader: shaggy_manage_add_tess_control_shader,         \
+        shaggy_tess_evaluation_shader: shaggy_manage_add_tess_evaluation_shader,   \
+        shaggy_geometry_shader: shaggy_manage_add_geometry_shader,                 \
+        shaggy_fragment_shader: shaggy_manage_add_fragment_shader,                 \
+        shaggy_compute_shader: shaggy_manage_add_compute_shader                    \
+    ) (manager, name, shader)
+
+
+#define shader_hash_impl(T, Enum)                                                                       \
+static inline                                                                                           \
 void shaggy_manage_add_##T##_shader(                                                                    \
 struct shaggy_manager *manager, const char *name, shaggy_##T##_shader shader) {                         \
-    int ret;                                                                                            \
-    khiter_t iter;                                                                                      \
-    khash_t(shader_map) *map = manager->T##_shader_map;                                                 \
+    struct shaggy_managed_shader *entry;                                                                \
                                                                                                         \
-    iter = kh_put(shader_map, map, name, &ret);                                                         \
-    if (ret == -1) {                                                                                    \
-        logm(ERROR, "Failed to create key %s in shader hash table!", name);                             \
+    entry = shaggy_manage_put_shader(manager, Enum, name, NULL);                                        \
+    if (!entry) {                                                                                       \
+        return;                                                                                         \
     }                                                                                                   \
                                                                                                         \
     logm(INFO, "Added %s to the " #T " shader hash table!", name);                                      \
-    kh_val(map, iter) = shader.shader;                                                                  \
-                                                                                                        \
+    if (entry->shader != shader.shader) {                                                               \
+        shaggy_manage_release_object(manager, entry->shader);                                           \
+    }                                                                                                   \
+    entry->shader = shader.shader;                                                                      \
+    entry->state = SHAGGY_SHADER_LOADED;                                                                \
 }                                                                                                       \
                                                                                                         \
 static inline                                                                                           \
 shaggy_##T##_shader                                                                                     \
 shaggy_manage_fetch_##T##_shader(struct shaggy_manager *manager, const char *shader_name) {             \
-    khiter_t iter;                                                                                      \
-    khash_t(shader_map) *map = manager->T##_shader_map;                                                 \
-                                                                                                        \
-    iter = kh_get(shader_map, map, shader_name);                                                        \
-    if (iter == kh_end(map)) {                                                                          \
-        logm(WARNING, "Failed to find key %s in shader hash table!", shader_name);                      \
-        return (shaggy_##T##_shader) { 0 };                                                             \
-    }                                                                                                   \
-                                                                                                        \
-    return (shaggy_##T##_shader) { kh_value(map, iter) };                                               \
+    return (shaggy_##T##_shader) { shaggy_manage_fetch_shader(manager, Enum, shader_name) };            \
+}
+
+shader_hash_impl(vertex, SHAGGY_VERTEX_SHADER)
+
+shader_hash_impl(tess_control, SHAGGY_TESS_CONTROL_SHADER)
+
+shader_hash_impl(tess_evaluation, SHAGGY_TESS_EVALUATION_SHADER)
+
+shader_hash_impl(geometry, SHAGGY_GEOMETRY_SHADER)
+
+shader_hash_impl(fragment, SHAGGY_FRAGMENT_SHADER)
+
+shader_hash_impl(compute, SHAGGY_COMPUTE_SHADER)
+
+/*****************************************************************
+ * Set the entry point and specialization constants of a SPIR-V
+ * shader. Takes copies of everything. A shader that was already
+ * compiled is resubmitted and its programs relinked at the next
+ * reload poll, same as if the file had changed.
+ * @param entry_point NULL for "main".
+ * @param count Number of constants in indices and values.
+ * @param indices Constant IDs, the SpecId in the source.
+ * @param values Raw 32 bit values, floats have to be bit cast.
+ * @return false if the shader is unknown or isn't SPIR-V.
+ *****************************************************************/
+static inline
+bool shaggy_manage_specialize_shader(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name,
+		const char *entry_point, GLuint count, const GLuint *indices, const GLuint *values) {
+	struct shaggy_managed_shader *entry = shaggy_manage_find_shader(manager, type, name);
+	struct shaggy_specialization *specialization;
+
+	if (!entry || !entry->path) {
+		logm(WARNING, "Can't specialize unknown %s shader %s", shaggy_shader_type_names[type], name);
+		return false;
+	}
+
+	if (!shaggy_is_spirv_path(entry->path)) {
+		logm(WARNING, "Can't specialize %s, only SPIR-V shaders take specialization constants", entry->path);
+		return false;
+	}
+
+	specialization = malloc(sizeof(*specialization));
+	specialization->entry_point = strdup(entry_point ? entry_point : "main");
+	specialization->count = count;
+	specialization->indices = malloc(count * sizeof(GLuint) + 1);
+	specialization->values = malloc(count * sizeof(GLuint) + 1);
+	if (count) {
+		memcpy(specialization->indices, indices, count * sizeof(GLuint));
+		memcpy(specialization->values, values, count * sizeof(GLuint));
+	}
+
+	shaggy_free_specialization(entry->specialization);
+	entry->specialization = specialization;
+
+	if (entry->state == SHAGGY_SHADER_UNLOADED) {
+		entry->source_hash = 0;
+	} else {
+		shaggy_manage_submit_shader(manager, type, shaggy_manage_intern(manager, name), strdup(entry->path));
+	}
+
+	return true;
+}
+
+/* Directory scans only register files from now on, see shaggy_manage_register_shader_file */
+static inline
+void shaggy_manage_set_lazy(struct shaggy_manager *manager, bool lazy) {
+	manager->lazy = lazy;
+}
+
+static inline
+void shaggy_manage_submit_shader_dir(struct shaggy_manager *manager, const char *dir_path) {
+	tinydir_dir dir;
+
+	if (tinydir_open(&dir, dir_path) == -1) {
+		logm(WARNING, "Failed to open shader directory %s", dir_path);
+		return;
+	}
+
+	while (dir.has_next) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+
+		if (manager->lazy) {
+			shaggy_manage_register_shader_file(manager, file.path);
+		} else {
+			shaggy_manage_submit_shader_file(manager, file.path);
+		}
+
+		tinydir_next(&dir);
+	}
+
+	tinydir_close(&dir);
+}
+
+/*****************************************************************
+ * Register or submit every shader in a bundle, following the lazy
+ * setting like a directory scan. Stages and names come from the
+ * packer, nothing is read from disk. Scanning a directory
+ * afterwards overrides bundled shaders with loose files of the
+ * same name, which is how development builds pick up edits.
+ * @param bundle Must outlive the manager, normally &shaggy_shader_bundle.
+ *****************************************************************/
+static inline
+void shaggy_manage_shader_bundle(struct shaggy_manager *manager, const struct shaggy_shader_bundle *bundle) {
+	size_t i;
+	int j;
+
+	manager->bundle = bundle;
+
+	for (i = 0; i < bundle->count; ++i) {
+		const struct shaggy_bundle_file *file = &bundle->files[i];
+		char *path;
+
+		if (!file->stage) {
+			continue;
+		}
+
+		for (j = 0; j < SHAGGY_SHADER_TYPE_COUNT; ++j) {
+			if (strcmp(file->stage, shaggy_shader_file_suffixes[j]) == 0) {
+				break;
+			}
+		}
+
+		if (j == SHAGGY_SHADER_TYPE_COUNT) {
+			logm(WARNING, "Bundled %s has unknown stage %s", file->path, file->stage);
+			continue;
+		}
+
+		path = malloc(strlen(SHAGGY_BUNDLE_PREFIX) + strlen(file->path) + 1);
+		sprintf(path, "%s%s", SHAGGY_BUNDLE_PREFIX, file->path);
+
+		if (!shaggy_manage_accept_path(manager, (enum shaggy_shader_type) j, file->name, path)) {
+			free(path);
+		} else if (manager->lazy) {
+			shaggy_manage_put_shader(manager, (enum shaggy_shader_type) j, file->name, path);
+		} else {
+			shaggy_manage_submit_shader(manager, (enum shaggy_shader_type) j, file->name, path);
+		}
+	}
+
+	logm(CONFIG, "Registered %zu bundled shader files", bundle->count);
+}
+
+static inline
+void shaggy_manage_shader_file(struct shaggy_manager *manager, const char *pathname) {
+	shaggy_manage_submit_shader_file(manager, pathname);
+	shaggy_manage_wait_shaders(manager);
+}
+
+/* Every file is submitted before any status is queried so the driver can overlap them */
+static inline
+void shaggy_manage_shader_dir(struct shaggy_manager *manager, const char *dir_path) {
+	shaggy_manage_submit_shader_dir(manager, dir_path);
+	shaggy_manage_wait_shaders(manager);
+}
+
+/*******************************************************************
+ * Warm the shaders a set of programs will need.
+ * Every stage named in programs is submitted without waiting, so in
+ * lazy mode the compiles overlap instead of happening one at a time
+ * on first fetch. Call shaggy_manage_wait_shaders to block on them.
+ * @param programs Program specs, same layout shaggy_manage_build_program takes.
+ * @param count Number of specs in programs.
+ *******************************************************************/
+static inline
+void shaggy_manage_prefetch(struct shaggy_manager *manager, const char *programs[][5], size_t count) {
+	size_t i;
+	int j;
+
+	for (i = 0; i < count; ++i) {
+		for (j = 0; j < 5; ++j) {
+			const char *name = programs[i][j];
+
+			if (name && !shaggy_manage_request_shader(manager, (enum shaggy_shader_type) j, name)) {
+				logm(WARNING, "Can't prefetch unknown shader %s", name);
+			}
+		}
+	}
+}
+
+/*******************************************************************
+ * Hot Reload
+ * Watched directories are monitored with inotify. A changed file is
+ * recompiled on its own and swapped into its existing table entry,
+ * then every program built from it is relinked. Nothing happens
+ * until shaggy_manage_poll_reload is called, which is meant to be
+ * done once per frame between frames.
+ * @todo Only Linux has a watcher for now.
+ *******************************************************************/
+
+/* Latest submitted compile of (name, type, variant), NULL if there is none. name must be interned. */
+static inline
+struct shaggy_pending_shader *shaggy_manage_find_pending(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, uint64_t variant) {
+	size_t i;
+
+	for (i = manager->pending_count; i > 0; --i) {
+		struct shaggy_pending_shader *pending = &manager->pending[i - 1];
+
+		if (pending->type == type && pending->name == name && pending->variant == variant) {
+			return pending;
+		}
+	}
+
+	return NULL;
+}
+
+static inline
+bool shaggy_manage_is_pending(
+		struct shaggy_manager *manager, enum shaggy_shader_type type, const char *name, uint64_t variant) {
+	return shaggy_manage_find_pending(manager, type, name, variant) != NULL;
+}
+
+/* Recompile everything that includes pathname */
+static inline
+void shaggy_manage_reload_dependents(struct shaggy_manager *manager, const char *pathname) {
+	struct shaggy_shader_key *keys;
+	struct shaggy_managed_shader *entry;
+	size_t count;
+	size_t i;
+	khiter_t iter;
+	char *canonical = shaggy_canonical_path(pathname);
+
+	if (!canonical) {
+		return;
+	}
+
+	iter = kh_get(include_graph, manager->dependents, canonical);
+	free(canonical);
+
+	if (iter == kh_end(manager->dependents)) {
+		return;
+	}
+
+	/* Submitting records dependencies again, which can move the list */
+	count = kh_val(manager->dependents, iter).count;
+	keys = malloc(count * sizeof(*keys) + 1);
+	memcpy(keys, kh_val(manager->dependents, iter).keys, count * sizeof(*keys));
+
+	logm(INFO, "%s changed, %zu shaders include it", pathname, count);
+
+	for (i = 0; i < count; ++i) {
+		entry = shaggy_manage_find_variant(manager, keys[i].type, keys[i].name, keys[i].variant);
+
+		if (!entry || !entry->path) {
+			continue;
+		}
+
+		/* Programs restored from the binary cache use it without it ever being compiled */
+		if (entry->state == SHAGGY_SHADER_UNLOADED) {
+			entry->source_hash = 0;
+			shaggy_manage_invalidate_programs(manager, keys[i].type, keys[i].name, keys[i].variant);
+			continue;
+		}
+
+		if (!shaggy_manage_is_pending(manager, keys[i].type, keys[i].name, keys[i].variant)) {
+			shaggy_manage_submit_variant(manager, keys[i].type, keys[i].name, keys[i].variant, strdup(entry->path));
+		}
+	}
+
+	free(keys);
+}
+
+/* A file under a watched directory changed, pick up the new contents */
+static inline
+void shaggy_manage_reload_shader_file(struct shaggy_manager *manager, const char *pathname) {
+	tinydir_file file;
+	const char *name;
+	int name_length;
+	enum shaggy_shader_type type;
+	struct shaggy_managed_shader *entry;
+	struct shaggy_managed_shader value;
+	struct shaggy_shader_key key;
+	const char *shader_name;
+	uint64_t *variants = NULL;
+	size_t variant_count = 0;
+	size_t i;
+
+	shaggy_manage_reload_dependents(manager, pathname);
+
+	if (!shaggy_open_shader_file(&file, pathname, &name, &name_length, &type)) {
+		return;
+	}
+
+	shader_name = shaggy_manage_intern_n(manager, name, name_length);
+	if (!shader_name || !shaggy_manage_accept_path(manager, type, shader_name, file.path)) {
+		return;
+	}
+
+	entry = shaggy_manage_find_shader(manager, type, shader_name);
+
+	if (!entry) {
+		/* Brand new file, treat it like the directory scan would have */
+		if (manager->lazy) {
+			shaggy_manage_register_shader_file(manager, file.path);
+		} else {
+			shaggy_manage_submit_shader_file(manager, file.path);
+		}
+
+		return;
+	}
+
+	/* Every variant comes from this file, collect them first since submitting can grow the table */
+	kh_foreach(manager->shaders, key, value, {
+		(void) value;
+		if (key.name == shader_name && key.type == type) {
+			variants = realloc(variants, (variant_count + 1) * sizeof(*variants));
+			variants[variant_count++] = key.variant;
+		}
+	});
+
+	for (i = 0; i < variant_count; ++i) {
+		entry = shaggy_manage_find_variant(manager, type, shader_name, variants[i]);
+
+		if (entry->state == SHAGGY_SHADER_UNLOADED) {
+			/* Never compiled, forget the hash we may have taken and relink anything restored from binaries */
+			entry->source_hash = 0;
+			shaggy_manage_invalidate_programs(manager, type, shader_name, variants[i]);
+			continue;
+		}
+
+		/* Editors tend to produce several events per save */
+		if (shaggy_manage_is_pending(manager, type, shader_name, variants[i])) {
+			continue;
+		}
+
+		shaggy_manage_submit_variant(manager, type, shader_name, variants[i], strdup(file.path));
+	}
+
+	free(variants);
+}
+
+static inline
+void shaggy_detach_all_shaders(shaggy_program program, GLuint shaders[SHAGGY_SHADER_TYPE_COUNT], GLsizei *count) {
+	GLsizei i;
+
+	glGetAttachedShaders(program, SHAGGY_SHADER_TYPE_COUNT, count, shaders);
+	for (i = 0; i < *count; ++i) {
+		shaggy_detach_shader(program, shaders[i]);
+	}
+}
+
+/*****************************************************************
+ * Hash a uniform or block name for the reflection lookups.
+ * Meant to be done once, e.g. into a static, not per draw.
+ *****************************************************************/
+static inline
+uint64_t shaggy_uniform_hash(const char *name) {
+	return shaggy_hash64(name, strlen(name), 0);
+}
+
+/* Intern a resource name, "light[0]" is stored as "light" so arrays are found by their GLSL name */
+static inline
+const char *shaggy_reflection_name(struct shaggy_manager *manager, const GLchar *name, GLsizei length) {
+	if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+		length -= 3;
+	}
+
+	return shaggy_manage_intern_n(manager, name, (size_t) length);
+}
+
+static inline
+void shaggy_reflection_index(
+		khash_t(reflection_index) *index, uint64_t hash, uint32_t value, const char *name, GLuint program) {
+	int ret;
+	khiter_t iter = kh_put(reflection_index, index, hash, &ret);
+
+	if (ret == 0) {
+		logm(WARNING, "Program %u: %s collides with another name's hash, only the first is reachable", program, name);
+		return;
+	}
+
+	kh_val(index, iter) = value;
 }
 
-shader_hash_impl(fragment)
+/* Default block first, then block by block in offset order */
+static inline
+int shaggy_uniform_compare(const void *a, const void *b) {
+	const struct shaggy_uniform *x = a;
+	const struct shaggy_uniform *y = b;
+
+	if (x->block != y->block) {
+		return x->block < y->block ? -1 : 1;
+	}
+
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/*****************************************************************
+ * Read every active uniform and uniform block of a linked program
+ * into reflection, replacing what was there. Two queries per
+ * resource, paid once per link instead of once per draw.
+ *****************************************************************/
+static inline
+void shaggy_reflect_program(
+		struct shaggy_manager *manager, shaggy_program program, struct shaggy_program_reflection *reflection) {
+	static const GLenum uniform_props[] = {
+		GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX,
+		GL_OFFSET, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE, GL_IS_ROW_MAJOR
+	};
+	static const GLenum block_props[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+	GLint uniform_count = 0;
+	GLint block_count = 0;
+	GLint uniform_name_length = 0;
+	GLint block_name_length = 0;
+	GLint i;
+
+	shaggy_reflection_clear(reflection);
+	++reflection->generation;
+
+	if (!manager->reflection) {
+		return;
+	}
+
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniform_count);
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &uniform_name_length);
+	glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &block_count);
+	glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_MAX_NAME_LENGTH, &block_name_length);
+
+	reflection->uniforms = malloc(uniform_count * sizeof(*reflection->uniforms) + 1);
+	reflection->blocks = malloc(block_count * sizeof(*reflection->blocks) + 1);
+
+	{
+		GLchar name[uniform_name_length + 1];
+
+		for (i = 0; i < uniform_count; ++i) {
+			struct shaggy_uniform *uniform = &reflection->uniforms[reflection->uniform_count];
+			GLint values[sizeof(uniform_props) / sizeof(uniform_props[0])];
+			GLsizei length = 0;
+
+			glGetProgramResourceiv(program, GL_UNIFORM, (GLuint) i, sizeof(uniform_props) / sizeof(uniform_props[0]),
+								   uniform_props, sizeof(values) / sizeof(values[0]), NULL, values);
+			glGetProgramResourceName(program, GL_UNIFORM, (GLuint) i, uniform_name_length + 1, &length, name);
+
+			uniform->name = shaggy_reflection_name(manager, name, length);
+			if (!uniform->name) {
+				continue;
+			}
+
+			uniform->hash = shaggy_uniform_hash(uniform->name);
+			uniform->type = (GLenum) values[0];
+			uniform->location = values[1];
+			uniform->array_size = values[2];
+			uniform->block = values[3];
+			uniform->offset = values[4];
+			uniform->array_stride = values[5];
+			uniform->matrix_stride = values[6];
+			uniform->row_major = values[7] != 0;
+			++reflection->uniform_count;
+		}
+	}
+
+	qsort(reflection->uniforms, reflection->uniform_count, sizeof(*reflection->uniforms), shaggy_uniform_compare);
+
+	{
+		GLchar name[block_name_length + 1];
+
+		for (i = 0; i < block_count; ++i) {
+			struct shaggy_uniform_block *block = &reflection->blocks[i];
+			GLint values[sizeof(block_props) / sizeof(block_props[0])];
+			GLsizei length = 0;
+
+			glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, (GLuint) i, sizeof(block_props) / sizeof(block_props[0]),
+								   block_props, sizeof(values) / sizeof(values[0]), NULL, values);
+			glGetProgramResourceName(program, GL_UNIFORM_BLOCK, (GLuint) i, block_name_length + 1, &length, name);
+
+			block->name = shaggy_reflection_name(manager, name, length);
+			block->hash = block->name ? shaggy_uniform_hash(block->name) : 0;
+			block->index = (GLuint) i;
+			block->binding = values[0];
+			block->data_size = values[1];
+			block->first_member = 0;
+			block->member_count = 0;
+		}
+
+		reflection->block_count = (size_t) block_count;
+	}
+
+	for (i = 0; i < (GLint) reflection->uniform_count; ++i) {
+		struct shaggy_uniform *uniform = &reflection->uniforms[i];
+
+		shaggy_reflection_index(reflection->uniform_index, uniform->hash, (uint32_t) i, uniform->name, program);
+
+		if (uniform->block >= 0 && uniform->block < block_count) {
+			struct shaggy_uniform_block *block = &reflection->blocks[uniform->block];
+
+			if (block->member_count++ == 0) {
+				block->first_member = (size_t) i;
+			}
+		}
+	}
+
+	for (i = 0; i < block_count; ++i) {
+		if (reflection->blocks[i].name) {
+			shaggy_reflection_index(reflection->block_index, reflection->blocks[i].hash, (uint32_t) i,
+									reflection->blocks[i].name, program);
+		}
+	}
+
+	logm(FINE, "Program %u has %zu uniforms in %zu blocks", program, reflection->uniform_count, reflection->block_count);
+}
+
+static inline
+struct shaggy_program_reflection *shaggy_manage_reflect_program(struct shaggy_manager *manager, shaggy_program program) {
+	struct shaggy_program_reflection *reflection = calloc(1, sizeof(*reflection));
+
+	reflection->uniform_index = kh_init(reflection_index);
+	reflection->block_index = kh_init(reflection_index);
+	shaggy_reflect_program(manager, program, reflection);
+
+	return reflection;
+}
+
+/*****************************************************************
+ * Reflection of a program built by the manager. Stays valid, and
+ * is kept up to date across hot reloads, until the program's last
+ * reference is released.
+ * @return NULL for programs the manager didn't build.
+ *****************************************************************/
+static inline
+const struct shaggy_program_reflection *shaggy_manage_program_reflection(
+		struct shaggy_manager *manager, shaggy_program program) {
+	khiter_t iter = kh_get(program_map, manager->programs, program);
+
+	return iter == kh_end(manager->programs) ? NULL : kh_val(manager->programs, iter).reflection;
+}
+
+/* @return The uniform, or NULL if the program doesn't use it */
+static inline
+const struct shaggy_uniform *shaggy_reflection_uniform(
+		const struct shaggy_program_reflection *reflection, uint64_t hash) {
+	khiter_t iter = kh_get(reflection_index, reflection->uniform_index, hash);
+
+	return iter == kh_end(reflection->uniform_index) ? NULL : &reflection->uniforms[kh_val(reflection->uniform_index, iter)];
+}
+
+/* glGetUniformLocation without the string compare, -1 if absent or inside a block */
+static inline
+GLint shaggy_reflection_location(const struct shaggy_program_reflection *reflection, uint64_t hash) {
+	const struct shaggy_uniform *uniform = shaggy_reflection_uniform(reflection, hash);
+
+	return uniform ? uniform->location : -1;
+}
+
+/* @return The block, or NULL if the program doesn't use it */
+static inline
+const struct shaggy_uniform_block *shaggy_reflection_block(
+		const struct shaggy_program_reflection *reflection, uint64_t hash) {
+	khiter_t iter = kh_get(reflection_index, reflection->block_index, hash);
+
+	return iter == kh_end(reflection->block_index) ? NULL : &reflection->blocks[kh_val(reflection->block_index, iter)];
+}
+
+/*****************************************************************
+ * Relink a program against the current version of its stages.
+ * The new stages are test linked in a scratch program first. The
+ * old stage objects may already be gone (finish_shader released
+ * them, GL only kept them alive while attached) and a program
+ * restored from the binary cache has none, so a failed link is
+ * never allowed to touch the program the caller holds.
+ *****************************************************************/
+static inline
+void shaggy_manage_relink_program(
+		struct shaggy_manager *manager, shaggy_program program, struct shaggy_managed_program *record) {
+	GLuint previous[SHAGGY_SHADER_TYPE_COUNT];
+	GLuint stages[SHAGGY_SHADER_TYPE_COUNT] = { 0 };
+	GLsizei previous_count = 0;
+	shaggy_program scratch;
+	int j;
+
+	/* Same rule as shaggy_manage_build_stages, never link without a stage */
+	for (j = 0; j < SHAGGY_SHADER_TYPE_COUNT; ++j) {
+		enum shaggy_shader_type type = (enum shaggy_shader_type) j;
+		const char *name = record->key.shaders[type];
+
+		if (!name) {
+			continue;
+		}
+
+		stages[j] = shaggy_manage_fetch_variant(manager, type, name, record->key.variant);
+		if (!stages[j]) {
+			logm(WARNING, "Not relinking program %u, %s shader %s has failed to compile",
+				 program, shaggy_shader_type_names[j], name);
+			return;
+		}
+	}
+
+	scratch = shaggy_create_program();
+
+	for (j = 0; j < SHAGGY_SHADER_TYPE_COUNT; ++j) {
+		if (stages[j]) {
+			shaggy_attach_shader(scratch, stages[j]);
+		}
+	}
+
+	shaggy_link_program(scratch);
+	if (shaggy_check_program_link_status(scratch) == GL_FALSE) {
+		GLsizei buf_size = shaggy_get_program_info_log_length(scratch);
+		GLchar buf[buf_size];
+
+		shaggy_get_program_info_log(scratch, buf_size, buf);
+		logm(WARNING, "Not relinking program %u, its new stages don't link: %.*s",
+			 program, buf_size, buf);
+		shaggy_delete_program(scratch);
+		return;
+	}
+
+	/* Deleting the scratch program detaches the stages, the registry still holds them */
+	shaggy_delete_program(scratch);
+
+	shaggy_detach_all_shaders(program, previous, &previous_count);
+
+	for (j = 0; j < SHAGGY_SHADER_TYPE_COUNT; ++j) {
+		if (stages[j]) {
+			shaggy_attach_shader(program, stages[j]);
+		}
+	}
+
+	shaggy_link_program(program);
+	if (shaggy_check_program_link_status(program) == GL_FALSE) {
+		GLsizei buf_size = shaggy_get_program_info_log_length(program);
+		GLchar buf[buf_size];
+
+		shaggy_get_program_info_log(program, buf_size, buf);
+		logm(ERROR, "Failed to relink program %u after its stages linked on their own: %.*s",
+			 program, buf_size, buf);
+	}
 
-shader_hash_impl(vertex)
+	/* Linking resets locations, they may not come back the same */
+	shaggy_reflect_program(manager, program, record->reflection);
+}
 
+/*****************************************************************
+ * Submit whatever stages of a program haven't been compiled yet.
+ * @return false while any stage is still compiling, relinking then
+ *         would block the frame on the driver.
+ *****************************************************************/
 static inline
-void shaggy_manage_shader_file(struct shaggy_manager *manager, const char *pathname) {
-	int bytes_scanned;
-	int name_length;
-	int error;
-	struct slre_cap caps[2];
-	tinydir_file file;
-	const char *filename_exp = "(^[a-zA-Z0-9\\.]*)\\.(vert|frag)\\.glsl";
+bool shaggy_manage_stages_ready(struct shaggy_manager *manager, const struct shaggy_program_key *key) {
+	bool ready = true;
+	int i;
 
-	GLint shader = 0; /* Resulting shader */
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		enum shaggy_shader_type type = (enum shaggy_shader_type) i;
+		struct shaggy_managed_shader *entry;
 
-	error = tinydir_file_open(&file, pathname);
-	if (error < 0) {
-		logm(WARNING, "Failed to create tinydir object for %s", pathname);
-		return;
+		if (!key->shaders[i]) {
+			continue;
+		}
+
+		entry = shaggy_manage_request_variant(manager, type, key->shaders[i], key->variant);
+		if ((entry && entry->state == SHAGGY_SHADER_PENDING) ||
+			shaggy_manage_is_pending(manager, type, key->shaders[i], key->variant)) {
+			ready = false;
+		}
 	}
 
-	if (!file.is_reg) {
-		logm(WARNING, "%s is not a regular file!", pathname);
+	return ready;
+}
+
+static inline
+void shaggy_manage_relink_dirty_programs(struct shaggy_manager *manager) {
+	khiter_t iter;
+
+	if (!manager->programs_dirty) {
 		return;
 	}
 
-	name_length = strlen(file.name);
-	bytes_scanned = slre_match(filename_exp, file.name, name_length, caps, 2, SLRE_IGNORE_CASE);
+	manager->programs_dirty = false;
+
+	for (iter = kh_begin(manager->programs); iter != kh_end(manager->programs); ++iter) {
+		struct shaggy_managed_program *record;
+
+		if (!kh_exist(manager->programs, iter)) {
+			continue;
+		}
+
+		record = &kh_val(manager->programs, iter);
+		if (!record->dirty) {
+			continue;
+		}
+
+		/* Picked up again at the next poll once the compiles are in */
+		if (!shaggy_manage_stages_ready(manager, &record->key)) {
+			manager->programs_dirty = true;
+			continue;
+		}
+
+		record->dirty = false;
+		shaggy_manage_relink_program(manager, kh_key(manager->programs, iter), record);
+	}
+}
+
+#if defined (__linux__)
+
+#include <sys/inotify.h>
+
+/*****************************************************************
+ * Start watching a directory for shader changes.
+ * @param manager Manager whose shaders should be reloaded.
+ * @param dir_path Directory to watch, usually one already scanned.
+ * @return false if the watch couldn't be set up.
+ *****************************************************************/
+static inline
+bool shaggy_manage_watch_dir(struct shaggy_manager *manager, const char *dir_path) {
+	int wd;
+	int ret;
+	khiter_t iter;
+
+	if (manager->watch_fd == -1) {
+		manager->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (manager->watch_fd == -1) {
+			logm(ERROR, "inotify_init1() failed: %s", strerror(errno));
+			return false;
+		}
+	}
+
+	/* Editors either write in place or write aside and rename over */
+	wd = inotify_add_watch(manager->watch_fd, dir_path, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd == -1) {
+		logm(ERROR, "inotify_add_watch() failed for %s: %s", dir_path, strerror(errno));
+		return false;
+	}
+
+	iter = kh_put(watch_map, manager->watches, wd, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to record watch for %s", dir_path);
+		return false;
+	}
+
+	if (ret == 0) {
+		free(kh_val(manager->watches, iter));
+	}
+
+	kh_val(manager->watches, iter) = strdup(dir_path);
+	logm(CONFIG, "Watching %s for shader changes", dir_path);
+
+	return true;
+}
+
+/* Drain queued inotify events without blocking */
+static inline
+void shaggy_manage_read_watch_events(struct shaggy_manager *manager) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
 
-	if (bytes_scanned < 0 || bytes_scanned != name_length) {
-		logm(WARNING, "File %s didn't match a valid shaggy shader file name.", file.name);
+	if (manager->watch_fd == -1) {
 		return;
 	}
 
-	/*******************************
-	 * Compile the shader and stuff
-	 *******************************/
-	bytes_scanned = slre_match("frag", caps[1].ptr, caps[1].len, 0, 0, SLRE_IGNORE_CASE);
-	if (bytes_scanned == caps[1].len) {
-		shader = shaggy_create_fragment_shader().shader;
-		goto regex_done;
+	while ((length = read(manager->watch_fd, buf, sizeof(buf))) > 0) {
+		const struct inotify_event *event;
+		char *ptr;
+
+		for (ptr = buf; ptr < buf + length; ptr += sizeof(struct inotify_event) + event->len) {
+			khiter_t iter;
+			char path[4096];
+
+			event = (const struct inotify_event *) ptr;
+			if (event->len == 0 || (event->mask & IN_ISDIR)) {
+				continue;
+			}
+
+			iter = kh_get(watch_map, manager->watches, event->wd);
+			if (iter == kh_end(manager->watches)) {
+				continue;
+			}
+
+			snprintf(path, sizeof(path), "%s/%s", kh_val(manager->watches, iter), event->name);
+			shaggy_manage_reload_shader_file(manager, path);
+		}
 	}
 
-	bytes_scanned = slre_match("vert", caps[1].ptr, caps[1].len, 0, 0, SLRE_IGNORE_CASE);
-	if (bytes_scanned == caps[1].len) {
-		shader = shaggy_create_vertex_shader().shader;
-		goto regex_done;
+	if (length == -1 && errno != EAGAIN) {
+		logm(WARNING, "read() on inotify descriptor failed: %s", strerror(errno));
 	}
+}
+
+#else
+
+static inline
+bool shaggy_manage_watch_dir(struct shaggy_manager *manager, const char *dir_path) {
+	logm(WARNING, "Hot reload isn't supported on this platform, not watching %s", dir_path);
+	return false;
+}
+
+static inline
+void shaggy_manage_read_watch_events(struct shaggy_manager *manager) {
+}
+
+#endif
+
+/*****************************************************************
+ * Apply any shader changes seen since the last call.
+ * Recompiles are submitted and picked up once the driver is done
+ * with them, so a frame only ever pays for the swap and relink.
+ *****************************************************************/
+static inline
+void shaggy_manage_poll_reload(struct shaggy_manager *manager) {
+	shaggy_manage_read_watch_events(manager);
+	shaggy_manage_poll_shaders(manager);
+	shaggy_manage_relink_dirty_programs(manager);
+}
+
+/*******************************************************************
+ * Program Binary Cache
+ * Linked programs are written out with glGetProgramBinary and read
+ * back with glProgramBinary. Entries are keyed by the source hash of
+ * every attached stage plus the GL vendor/renderer/version strings,
+ * so a driver update simply misses instead of loading stale binaries.
+ * Anything the driver rejects falls back to a regular link.
+ *
+ * Stages that were only registered are hashed straight from their
+ * file, so a warm cache in lazy mode skips compiling entirely.
+ * Prefetched stages are keyed by the compile already submitted.
+ *******************************************************************/
+
+#define SHAGGY_PROGRAM_CACHE_MAGIC 0x53484743u /* "SHGC" */
+
+struct shaggy_program_cache_header {
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint64_t length;
+};
+
+/*******************************************************************
+ * Enable the on-disk program binary cache.
+ * Requires a current GL context. The directory must already exist.
+ * @param manager Manager to enable caching on.
+ * @param dir_path Directory binaries are stored in.
+ *******************************************************************/
+static inline
+void shaggy_manage_set_program_cache(struct shaggy_manager *manager, const char *dir_path) {
+	const char *strings[3];
+	GLint formats = 0;
+	uint64_t hash = 0;
+	int i;
 
-	regex_done:
+	free(manager->program_cache_dir);
+	manager->program_cache_dir = NULL;
 
-	if (!shaggy_source_shader_from_file(shader, file.path)) {
+	if (!dir_path) {
 		return;
 	}
 
-	shaggy_compile_shader(shader);
-	{
-		GLint status = shaggy_check_shader_compile_status(shader);
-		if (status == GL_FALSE) {
-			GLsizei buf_size = shaggy_get_shader_info_log_length(shader);
-			GLchar buf[buf_size];
-
-			shaggy_get_shader_info_log(shader, buf_size, buf);
-			logm(WARNING, "Failed to compile %s: %.*s",
-				 file.name, buf_size, buf);
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats == 0) {
+		logm(WARNING, "Driver exposes no program binary formats, program cache disabled");
+		return;
+	}
+
+	strings[0] = (const char *) glGetString(GL_VENDOR);
+	strings[1] = (const char *) glGetString(GL_RENDERER);
+	strings[2] = (const char *) glGetString(GL_VERSION);
+
+	for (i = 0; i < 3; ++i) {
+		if (!strings[i]) {
+			logm(WARNING, "Failed to query driver strings, program cache disabled");
 			return;
 		}
+
+		hash = shaggy_hash64(strings[i], strlen(strings[i]), hash);
 	}
-	/**********************************
-	 * Add shader to hashmap so we can
-	 * query by shader file name.
-	 **********************************/
-	bytes_scanned = slre_match("vert", caps[1].ptr, caps[1].len, 0, 0, SLRE_IGNORE_CASE);
-	if (bytes_scanned == caps[1].len) {
-		shaggy_manage_add_shader(manager, strndup(caps[0].ptr, caps[0].len), (shaggy_fragment_shader) {shader});
+
+	manager->program_cache_dir = strdup(dir_path);
+	manager->driver_hash = hash;
+
+	logm(CONFIG, "Program cache at %s for %s / %s / %s", dir_path, strings[0], strings[1], strings[2]);
+}
+
+/* Source hash of a stage, reading the files if it hasn't been compiled yet */
+static inline
+uint64_t shaggy_manage_source_hash(
+		struct shaggy_manager *manager, struct shaggy_shader_key key, struct shaggy_managed_shader *entry) {
+	struct shaggy_source source;
+
+	/* Prefetched, the hash was taken when the compile was submitted */
+	if (entry->state == SHAGGY_SHADER_PENDING) {
+		struct shaggy_pending_shader *pending = shaggy_manage_find_pending(manager, key.type, key.name, key.variant);
+
+		return pending ? pending->source_hash : entry->source_hash;
+	}
+
+	if (entry->source_hash || !entry->path || entry->state != SHAGGY_SHADER_UNLOADED) {
+		return entry->source_hash;
+	}
+
+	if (shaggy_manage_load_source(manager, key, entry->path, &source)) {
+		entry->source_hash = shaggy_specialization_hash(entry->specialization, shaggy_source_hash(&source));
+	}
+
+	shaggy_source_free(&source);
+	return entry->source_hash;
+}
+
+/* Returns 0 if any attached stage has no known source, shaders must be interned */
+static inline
+uint64_t shaggy_program_cache_key(
+		struct shaggy_manager *manager, const char *shaders[SHAGGY_SHADER_TYPE_COUNT], uint64_t variant,
+		struct shaggy_managed_shader *stages[SHAGGY_SHADER_TYPE_COUNT]) {
+	uint64_t key = manager->driver_hash;
+	int i;
+
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		struct shaggy_shader_key shader_key;
+		uint64_t stage[2];
+
+		if (!stages[i]) {
+			continue;
+		}
+
+		shader_key.name = shaders[i];
+		shader_key.type = (enum shaggy_shader_type) i;
+		shader_key.variant = variant;
+
+		stage[0] = i;
+		stage[1] = shaggy_manage_source_hash(manager, shader_key, stages[i]);
+		if (stage[1] == 0) {
+			return 0;
+		}
+
+		key = shaggy_hash64(stage, sizeof(stage), key);
+	}
+
+	return key;
+}
+
+static inline
+void shaggy_program_cache_path(struct shaggy_manager *manager, uint64_t key, char *buf, size_t buf_size) {
+	snprintf(buf, buf_size, "%s/%016llx.bin", manager->program_cache_dir, (unsigned long long) key);
+}
+
+/*****************************************************************
+ * Try to restore a program from the cache.
+ * @return true if the program is linked and ready for use.
+ *****************************************************************/
+static inline
+bool shaggy_program_cache_load(struct shaggy_manager *manager, shaggy_program program, uint64_t key) {
+	struct shaggy_program_cache_header header;
+	char path[4096];
+	void *binary;
+	FILE *file;
+	bool result = false;
+
+	shaggy_program_cache_path(manager, key, path, sizeof(path));
+
+	file = fopen(path, "rb");
+	if (!file) {
+		return result;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		header.magic != SHAGGY_PROGRAM_CACHE_MAGIC ||
+		header.key != key ||
+		header.length == 0 || header.length > INT32_MAX) {
+		logm(WARNING, "Ignoring malformed program cache entry %s", path);
+		goto fail;
+	}
+
+	binary = malloc(header.length);
+	if (fread(binary, header.length, 1, file) != 1) {
+		logm(WARNING, "Truncated program cache entry %s", path);
+		goto fail_read;
+	}
+
+	glProgramBinary(program, header.format, binary, (GLsizei) header.length);
+
+	result = shaggy_check_program_link_status(program) == GL_TRUE;
+	if (!result) {
+		logm(INFO, "Driver rejected cached program %s, relinking", path);
+	}
+
+fail_read:
+	free(binary);
+
+fail:
+	fclose(file);
+	return result;
+}
+
+static inline
+void shaggy_program_cache_store(struct shaggy_manager *manager, shaggy_program program, uint64_t key) {
+	struct shaggy_program_cache_header header;
+	char path[4096];
+	char temp_path[4096 + 4];
+	GLint length = 0;
+	GLenum format = 0;
+	void *binary;
+	FILE *file;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		logm(WARNING, "Driver returned no binary for program %u", program);
 		return;
 	}
 
-	bytes_scanned = slre_match("frag", caps[1].ptr, caps[1].len, 0, 0, SLRE_IGNORE_CASE);
-	if (bytes_scanned == caps[1].len) {
-		shaggy_manage_add_shader(manager, strndup(caps[0].ptr, caps[0].len), (shaggy_vertex_shader) {shader});
+	binary = malloc(length);
+	glGetProgramBinary(program, length, &length, &format, binary);
+
+	header.magic = SHAGGY_PROGRAM_CACHE_MAGIC;
+	header.format = format;
+	header.key = key;
+	header.length = length;
+
+	/* Write aside and rename so a crash never leaves a torn entry behind */
+	shaggy_program_cache_path(manager, key, path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+	file = fopen(temp_path, "wb");
+	if (!file) {
+		logm(WARNING, "Failed to open %s: %s", temp_path, strerror(errno));
+		goto fail;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(binary, length, 1, file) != 1) {
+		logm(WARNING, "Failed to write %s: %s", temp_path, strerror(errno));
+		fclose(file);
+		remove(temp_path);
+		goto fail;
+	}
+
+	fclose(file);
+
+	remove(path);
+	if (rename(temp_path, path) != 0) {
+		logm(WARNING, "Failed to rename %s: %s", temp_path, strerror(errno));
+		remove(temp_path);
+	}
+
+fail:
+	free(binary);
+}
+
+/* Start tracking a freshly built program with a single reference */
+static inline
+void shaggy_manage_record_program(
+		struct shaggy_manager *manager, shaggy_program program, const struct shaggy_program_key *key) {
+	struct shaggy_managed_program *record;
+	khiter_t iter;
+	int ret;
+
+	iter = kh_put(program_map, manager->programs, program, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to record program %u", program);
 		return;
 	}
+
+	record = &kh_val(manager->programs, iter);
+	record->key = *key;
+	record->refs = 1;
+	record->dirty = false;
+	record->reflection = shaggy_manage_reflect_program(manager, program);
+
+	iter = kh_put(program_cache, manager->program_cache, *key, &ret);
+	if (ret > 0) {
+		kh_val(manager->program_cache, iter) = program;
+	}
 }
 
 static inline
-void shaggy_manage_shader_dir(struct shaggy_manager *manager, const char *dir_path) {
-	tinydir_dir dir;
-	tinydir_open(&dir, dir_path);
+shaggy_program shaggy_manage_retain_program(struct shaggy_manager *manager, shaggy_program program) {
+	khiter_t iter = kh_get(program_map, manager->programs, program);
 
-	while (dir.has_next) {
-		tinydir_file file;
-		tinydir_readfile(&dir, &file);
+	if (iter != kh_end(manager->programs)) {
+		kh_val(manager->programs, iter).refs += 1;
+	}
 
-		shaggy_manage_shader_file(manager, file.path);
+	return program;
+}
 
-		tinydir_next(&dir);
+/*****************************************************************
+ * Drop a reference to a program from shaggy_manage_build_program.
+ * The program is deleted once nothing holds it any more.
+ *****************************************************************/
+static inline
+void shaggy_manage_release_program(struct shaggy_manager *manager, shaggy_program program) {
+	struct shaggy_managed_program *record;
+	khiter_t iter = kh_get(program_map, manager->programs, program);
+
+	if (iter == kh_end(manager->programs)) {
+		logm(WARNING, "Program %u isn't managed", program);
+		return;
 	}
 
-	tinydir_close(&dir);
+	record = &kh_val(manager->programs, iter);
+	if (--record->refs > 0) {
+		return;
+	}
+
+	{
+		khiter_t cache_iter = kh_get(program_cache, manager->program_cache, record->key);
+
+		if (cache_iter != kh_end(manager->program_cache) && kh_val(manager->program_cache, cache_iter) == program) {
+			kh_del(program_cache, manager->program_cache, cache_iter);
+		}
+	}
+
+	shaggy_reflection_free(record->reflection);
+	kh_del(program_map, manager->programs, iter);
+	shaggy_delete_program(program);
 }
 
+/* Shared by the graphics and compute entry points, shaders has one slot per stage */
 static inline
-shaggy_program shaggy_manage_build_program(struct shaggy_manager *manager, const char *shaders[5]) {
+shaggy_program shaggy_manage_build_stages(
+		struct shaggy_manager *manager, const char *shaders[SHAGGY_SHADER_TYPE_COUNT], uint64_t variant) {
 	GLint status;
-	shaggy_program program = shaggy_create_program();
+	struct shaggy_managed_shader *entries[SHAGGY_SHADER_TYPE_COUNT] = { NULL };
+	struct shaggy_program_key key;
+	GLuint stages[SHAGGY_SHADER_TYPE_COUNT] = { 0 };
+	uint64_t cache_key = 0;
+	shaggy_program program;
+	khiter_t iter;
+	int i;
+
+	memset(&key, 0, sizeof(key));
+	key.variant = variant;
+
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		key.shaders[i] = shaggy_manage_intern(manager, shaders[i]);
+		if (shaders[i] && !key.shaders[i]) {
+			return 0;
+		}
+	}
 
-	GLuint shader = shaggy_manage_fetch_vertex_shader(manager, shaders[SHAGGY_VERTEX_SHADER]).shader;
-	if (!shader) {
-		logm(WARNING, "Failed to fetch vertex shader %s", shaders[SHAGGY_VERTEX_SHADER]);
-	} else {
-		shaggy_attach_shader(program, shader);
+	iter = kh_get(program_cache, manager->program_cache, key);
+	if (iter != kh_end(manager->program_cache)) {
+		return shaggy_manage_retain_program(manager, kh_val(manager->program_cache, iter));
 	}
 
-	shader = shaggy_manage_fetch_fragment_shader(manager, shaders[SHAGGY_FRAGMENT_SHADER]).shader;
-	if (!shader) {
-		logm(WARNING, "Failed to fetch vertex shader %s", shaders[SHAGGY_FRAGMENT_SHADER]);
-	} else {
-		shaggy_attach_shader(program, shader);
+	/* First use of a variant, registering it lets the binary cache key cover it */
+	for (i = 0; variant && i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		shaggy_manage_register_variant(manager, (enum shaggy_shader_type) i, shaders[i], variant);
+	}
+
+	if (manager->program_cache_dir) {
+		for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+			entries[i] = shaggy_manage_find_variant(manager, (enum shaggy_shader_type) i, shaders[i], variant);
+		}
+
+		cache_key = shaggy_program_cache_key(manager, key.shaders, variant, entries);
+	}
+
+	program = shaggy_create_program();
+
+	if (cache_key) {
+		if (shaggy_program_cache_load(manager, program, cache_key)) {
+			shaggy_manage_record_program(manager, program, &key);
+			return program;
+		}
+
+		/* A rejected binary can leave the object in an odd state, start over */
+		shaggy_delete_program(program);
+		program = shaggy_create_program();
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	/* Compile anything that has only been registered before waiting on any of it */
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		if (shaders[i]) {
+			shaggy_manage_request_variant(manager, (enum shaggy_shader_type) i, shaders[i], variant);
+		}
+	}
+
+	for (i = 0; i < SHAGGY_SHADER_TYPE_COUNT; ++i) {
+		if (!shaders[i]) {
+			continue;
+		}
+
+		/**********************************************
+		 * A program missing a stage may still link but
+		 * would be memoized and cached in that state,
+		 * so nothing gets built until the stage is fixed
+		 **********************************************/
+		stages[i] = shaggy_manage_fetch_variant(manager, (enum shaggy_shader_type) i, shaders[i], variant);
+		if (!stages[i]) {
+			logm(WARNING, "Failed to fetch %s shader %s", shaggy_shader_type_names[i], shaders[i]);
+			shaggy_delete_program(program);
+			return 0;
+		}
+
+		shaggy_attach_shader(program, stages[i]);
 	}
 
 	/*********************************************
@@ -502,7 +3606,143 @@ shaggy_program shaggy_manage_build_program(struct shaggy_manager *manager, const
 		logm(WARNING, "Failed to link program: %.*s", buf_size, buf);
 		shaggy_delete_program(program);
 		program = 0;
+	} else {
+		if (cache_key) {
+			shaggy_program_cache_store(manager, program, cache_key);
+		}
+
+		shaggy_manage_record_program(manager, program, &key);
 	}
 
 	return program;
-}
\ No newline at end of file
+}
+
+/*****************************************************************
+ * Build a program out of managed shaders.
+ * Repeat requests for the same stage combination return the same
+ * program with another reference taken, each call should be paired
+ * with shaggy_manage_release_program.
+ * @param shaders Shader names, indexed by enum shaggy_shader_type.
+ * @return The program, or 0 if a stage is missing or linking failed.
+ *****************************************************************/
+static inline
+shaggy_program shaggy_manage_build_program(struct shaggy_manager *manager, const char *shaders[5]) {
+	const char *stages[SHAGGY_SHADER_TYPE_COUNT] = { NULL };
+
+	memcpy(stages, shaders, 5 * sizeof(*shaders));
+	return shaggy_manage_build_stages(manager, stages, 0);
+}
+
+/*****************************************************************
+ * shaggy_manage_build_program with the same variant of every
+ * stage, e.g. one material ubershader built with and without
+ * SKINNED. Only variants that are actually built get compiled.
+ * @param variant OR of shaggy_manage_variant_flag bits.
+ *****************************************************************/
+static inline
+shaggy_program shaggy_manage_build_program_variant(
+		struct shaggy_manager *manager, const char *shaders[5], uint64_t variant) {
+	const char *stages[SHAGGY_SHADER_TYPE_COUNT] = { NULL };
+
+	memcpy(stages, shaders, 5 * sizeof(*shaders));
+	return shaggy_manage_build_stages(manager, stages, variant);
+}
+
+/*****************************************************************
+ * Build a compute program from a single <name>.comp.glsl shader.
+ * Shares the link cache and reference counting with
+ * shaggy_manage_build_program.
+ * @return The program, or 0 if a stage is missing or linking failed.
+ *****************************************************************/
+static inline
+shaggy_program shaggy_manage_build_compute_program(struct shaggy_manager *manager, const char *name) {
+	const char *stages[SHAGGY_SHADER_TYPE_COUNT] = { [SHAGGY_COMPUTE_SHADER] = name };
+
+	return shaggy_manage_build_stages(manager, stages, 0);
+}
+
+/*****************************************************************
+ * Alternative to shaggy_manage_build_program using program
+ * pipeline objects. Each stage is linked once as a separable
+ * program and shared between every pipeline that uses it.
+ * Pipelines live as long as the manager, bind the result with
+ * glBindProgramPipeline rather than glUseProgram.
+ * @param shaders Shader names, indexed by enum shaggy_shader_type.
+ * @return The pipeline, or 0 if a stage failed to link.
+ *****************************************************************/
+static inline
+GLuint shaggy_manage_build_pipeline(struct shaggy_manager *manager, const char *shaders[5]) {
+	struct shaggy_program_key key;
+	shaggy_program stage_programs[5] = { 0 };
+	GLuint pipeline;
+	khiter_t iter;
+	int ret;
+	size_t i;
+
+	if (!GLEW_ARB_separate_shader_objects) {
+		logm(ERROR, "Program pipelines need ARB_separate_shader_objects");
+		return 0;
+	}
+
+	memset(&key, 0, sizeof(key));
+	for (i = 0; i < 5; ++i) {
+		key.shaders[i] = shaggy_manage_intern(manager, shaders[i]);
+		if (shaders[i] && !key.shaders[i]) {
+			return 0;
+		}
+	}
+
+	iter = kh_get(pipeline_cache, manager->pipelines, key);
+	if (iter != kh_end(manager->pipelines)) {
+		return kh_val(manager->pipelines, iter);
+	}
+
+	for (i = 0; i < 5; ++i) {
+		if (shaders[i]) {
+			shaggy_manage_request_shader(manager, (enum shaggy_shader_type) i, shaders[i]);
+		}
+	}
+
+	for (i = 0; i < 5; ++i) {
+		struct shaggy_shader_key stage_key;
+		GLuint shader;
+
+		if (!key.shaders[i]) {
+			continue;
+		}
+
+		shader = shaggy_manage_fetch_shader(manager, (enum shaggy_shader_type) i, shaders[i]);
+		if (!shader) {
+			logm(WARNING, "Failed to fetch %s shader %s", shaggy_shader_type_names[i], shaders[i]);
+			return 0;
+		}
+
+		stage_key.name = key.shaders[i];
+		stage_key.type = (enum shaggy_shader_type) i;
+		stage_key.variant = 0;
+
+		stage_programs[i] = shaggy_manage_separable_program(manager, stage_key, shader);
+		if (!stage_programs[i]) {
+			return 0;
+		}
+	}
+
+	glGenProgramPipelines(1, &pipeline);
+	for (i = 0; i < 5; ++i) {
+		if (stage_programs[i]) {
+			glUseProgramStages(pipeline, shaggy_stage_bits[i], stage_programs[i]);
+		}
+	}
+
+	iter = kh_put(pipeline_cache, manager->pipelines, key, &ret);
+	if (ret == -1) {
+		logm(ERROR, "Failed to record program pipeline");
+		glDeleteProgramPipelines(1, &pipeline);
+		return 0;
+	}
+
+	kh_val(manager->pipelines, iter) = pipeline;
+	return pipeline;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SHAGGY_HASH_H
+#define SHAGGY_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*****************************************************************
+ * Kept free of GL so host tools (tools/shaggy_pack.c) hash shader
+ * sources exactly like the runtime does.
+ *****************************************************************/
+
+static inline
+uint64_t shaggy_hash_mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/***********************************************************
+ * 64-bit hash over an arbitrary block of memory.
+ * Consumes 8 bytes per step so it keeps up with mmap'd
+ * shader sources. Not cryptographic, don't treat it as such.
+ * @param data Bytes to hash.
+ * @param length Number of bytes in data.
+ * @param seed Previous hash to chain from, or 0.
+ ***********************************************************/
+static inline
+uint64_t shaggy_hash64(const void *data, size_t length, uint64_t seed) {
+	const unsigned char *bytes = data;
+	uint64_t h = seed ^ (length * 0x9e3779b97f4a7c15ULL);
+	uint64_t k;
+
+	while (length >= 8) {
+		memcpy(&k, bytes, 8);
+		k *= 0x87c37b91114253d5ULL;
+		k = (k << 31) | (k >> 33);
+		k *= 0x4cf5ad432745937fULL;
+
+		h ^= k;
+		h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+
+		bytes += 8;
+		length -= 8;
+	}
+
+	k = 0;
+	memcpy(&k, bytes, length);
+	h ^= k * 0x87c37b91114253d5ULL;
+
+	return shaggy_hash_mix(h);
+}
+
+#endif
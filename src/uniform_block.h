@@ -0,0 +1,273 @@
+#ifndef SHAGGY_UNIFORM_BLOCK_H
+#define SHAGGY_UNIFORM_BLOCK_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "linmath.h"
+#include "shaders.h"
+
+/*****************************************************************
+ * Uniform Block Writer
+ * Fills a uniform block straight into mapped buffer memory at the
+ * offsets the program was linked with, std140 or otherwise. The
+ * layout is looked up once, so an update is one pass of plain
+ * stores into one mapping with no staging copy and no GL call per
+ * member. Writers for per-object blocks can lay out many copies
+ * back to back, see shaggy_block_writer_stride.
+ *****************************************************************/
+
+#define SHAGGY_BLOCK_MAX_MEMBERS 16
+
+/* Where a member lives inside the block, offset is -1 if the program doesn't have it */
+struct shaggy_block_member {
+	uint64_t hash;
+	GLint offset;
+	GLint array_size;
+	GLint array_stride;
+	GLint matrix_stride;
+	bool row_major;
+};
+
+struct shaggy_block_writer {
+	const struct shaggy_program_reflection *reflection;
+	unsigned generation;
+	uint64_t hash;
+	GLuint index;
+	GLint binding;
+	GLsizeiptr size; /* 0 if the program has no such block */
+
+	/* Same order as the names given to shaggy_block_writer_init */
+	struct shaggy_block_member members[SHAGGY_BLOCK_MAX_MEMBERS];
+	size_t member_count;
+};
+
+/* Look the block and its members up again, keeps the hashes */
+static inline
+void shaggy_block_writer_resolve(struct shaggy_block_writer *writer) {
+	const struct shaggy_uniform_block *block = NULL;
+	size_t i;
+
+	if (writer->reflection) {
+		writer->generation = writer->reflection->generation;
+		block = shaggy_reflection_block(writer->reflection, writer->hash);
+	}
+
+	writer->index = block ? block->index : GL_INVALID_INDEX;
+	writer->binding = block ? block->binding : 0;
+	writer->size = block ? block->data_size : 0;
+
+	for (i = 0; i < writer->member_count; ++i) {
+		struct shaggy_block_member *member = &writer->members[i];
+		const struct shaggy_uniform *uniform = NULL;
+
+		if (block) {
+			uniform = shaggy_reflection_uniform(writer->reflection, member->hash);
+		}
+
+		/* Same name in the default block or another block doesn't count */
+		if (!uniform || uniform->block != (GLint) block->index) {
+			member->offset = -1;
+			member->array_size = 0;
+			continue;
+		}
+
+		member->offset = uniform->offset;
+		member->array_size = uniform->array_size;
+		member->array_stride = uniform->array_stride;
+		member->matrix_stride = uniform->matrix_stride;
+		member->row_major = uniform->row_major;
+	}
+}
+
+/*****************************************************************
+ * Set up a writer for one block of a reflected program.
+ * @param reflection From shaggy_manage_program_reflection, may be NULL.
+ * @param block Block name as declared in GLSL.
+ * @param members Member names, writes refer to them by index.
+ * @param count Number of members, at most SHAGGY_BLOCK_MAX_MEMBERS.
+ * @return false if the block or any member is missing, writes to
+ *         missing members are dropped.
+ *****************************************************************/
+static inline
+bool shaggy_block_writer_init(
+		struct shaggy_block_writer *writer, const struct shaggy_program_reflection *reflection,
+		const char *block, const char *const members[], size_t count) {
+	bool result = true;
+	size_t i;
+
+	memset(writer, 0, sizeof(*writer));
+
+	if (count > SHAGGY_BLOCK_MAX_MEMBERS) {
+		logm(ERROR, "Block %s has %zu members, only %d are supported", block, count, SHAGGY_BLOCK_MAX_MEMBERS);
+		count = SHAGGY_BLOCK_MAX_MEMBERS;
+		result = false;
+	}
+
+	writer->reflection = reflection;
+	writer->hash = shaggy_uniform_hash(block);
+	writer->member_count = count;
+
+	for (i = 0; i < count; ++i) {
+		writer->members[i].hash = shaggy_uniform_hash(members[i]);
+	}
+
+	shaggy_block_writer_resolve(writer);
+
+	if (writer->size == 0) {
+		logm(WARNING, "Program has no uniform block %s", block);
+		return false;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (writer->members[i].offset < 0) {
+			logm(WARNING, "Uniform block %s has no member %s", block, members[i]);
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+/*****************************************************************
+ * Pick up a new layout if the program was relinked since the
+ * writer last looked, e.g. by hot reload. Cheap enough to call
+ * before every update.
+ * @return true if the layout changed.
+ *****************************************************************/
+static inline
+bool shaggy_block_writer_refresh(struct shaggy_block_writer *writer) {
+	if (!writer->reflection || writer->generation == writer->reflection->generation) {
+		return false;
+	}
+
+	shaggy_block_writer_resolve(writer);
+	return true;
+}
+
+/* Distance between consecutive copies of the block, for GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT */
+static inline
+GLsizeiptr shaggy_block_writer_stride(const struct shaggy_block_writer *writer, GLint alignment) {
+	if (alignment <= 1) {
+		return writer->size;
+	}
+
+	return (writer->size + alignment - 1) / alignment * alignment;
+}
+
+/* Address of one array element of a member, NULL if it isn't in the block */
+static inline
+unsigned char *shaggy_block_member_address(void *base, const struct shaggy_block_member *member, GLint element) {
+	if (member->offset < 0 || element < 0 || element >= member->array_size) {
+		return NULL;
+	}
+
+	return (unsigned char *) base + member->offset + element * member->array_stride;
+}
+
+static inline
+void shaggy_block_write_float(void *base, const struct shaggy_block_member *member, GLint element, float value) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+
+	if (dest) {
+		memcpy(dest, &value, sizeof(value));
+	}
+}
+
+static inline
+void shaggy_block_write_int(void *base, const struct shaggy_block_member *member, GLint element, GLint value) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+
+	if (dest) {
+		memcpy(dest, &value, sizeof(value));
+	}
+}
+
+static inline
+void shaggy_block_write_vec2(void *base, const struct shaggy_block_member *member, GLint element, vec2 const v) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+
+	if (dest) {
+		memcpy(dest, v, sizeof(vec2));
+	}
+}
+
+static inline
+void shaggy_block_write_vec3(void *base, const struct shaggy_block_member *member, GLint element, vec3 const v) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+
+	if (dest) {
+		memcpy(dest, v, sizeof(vec3));
+	}
+}
+
+static inline
+void shaggy_block_write_vec4(void *base, const struct shaggy_block_member *member, GLint element, vec4 const v) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+
+	if (dest) {
+		memcpy(dest, v, sizeof(vec4));
+	}
+}
+
+/*****************************************************************
+ * linmath matrices are column major. A column major mat4 with
+ * std140's 16 byte matrix stride is one 64 byte copy, anything
+ * else goes column by column (or row by row) at matrix_stride.
+ *****************************************************************/
+static inline
+void shaggy_block_write_mat4x4(void *base, const struct shaggy_block_member *member, GLint element, mat4x4 M) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+	int i, j;
+
+	if (!dest) {
+		return;
+	}
+
+	if (!member->row_major && member->matrix_stride == sizeof(vec4)) {
+		memcpy(dest, M, sizeof(mat4x4));
+		return;
+	}
+
+	for (i = 0; i < 4; ++i) {
+		if (member->row_major) {
+			vec4 row;
+
+			for (j = 0; j < 4; ++j) {
+				row[j] = M[j][i];
+			}
+
+			memcpy(dest + i * member->matrix_stride, row, sizeof(row));
+		} else {
+			memcpy(dest + i * member->matrix_stride, M[i], sizeof(vec4));
+		}
+	}
+}
+
+/* Upper left 3x3 of M into a mat3, e.g. a normal matrix. Each column is padded to matrix_stride */
+static inline
+void shaggy_block_write_mat3(void *base, const struct shaggy_block_member *member, GLint element, mat4x4 M) {
+	unsigned char *dest = shaggy_block_member_address(base, member, element);
+	int i, j;
+
+	if (!dest) {
+		return;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		vec3 vector;
+
+		for (j = 0; j < 3; ++j) {
+			vector[j] = member->row_major ? M[j][i] : M[i][j];
+		}
+
+		memcpy(dest + i * member->matrix_stride, vector, sizeof(vector));
+	}
+}
+
+#endif
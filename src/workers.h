@@ -0,0 +1,223 @@
+#ifndef SHAGGY_WORKERS_H
+#define SHAGGY_WORKERS_H
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+/*****************************************************************
+ * Workers
+ * A handful of threads that sleep until handed a range to split.
+ * shaggy_workers_run cuts [0, n) into contiguous jobs, the calling
+ * thread takes jobs too, and it returns once all of them are done,
+ * so results can be read right after. Threads are created once,
+ * not per frame, waking them costs a broadcast.
+ *
+ * Only one thread may call shaggy_workers_run at a time and job
+ * functions must not call it themselves.
+ *****************************************************************/
+
+#define SHAGGY_WORKERS_MAX 32 /* Jobs per run, including the calling thread */
+
+/*****************************************************************
+ * One job of a run.
+ * @param job   0 to jobs - 1, in the order the ranges appear, so
+ *              per job results can be kept in an array.
+ * @param begin First index of this job's range.
+ * @param end   One past the last index.
+ *****************************************************************/
+typedef void (*shaggy_job_fn)(void *user, int job, size_t begin, size_t end);
+
+struct shaggy_workers {
+	SDL_Thread *threads[SHAGGY_WORKERS_MAX - 1];
+	int count;          /* Threads started, the caller makes count + 1 */
+
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	SDL_cond *done;
+	unsigned generation; /* Bumped for every run */
+	int busy;           /* Threads not done with the current run */
+	bool quit;
+
+	/* Current run */
+	shaggy_job_fn fn;
+	void *user;
+	size_t n;
+	int jobs;
+	SDL_atomic_t next;  /* Next job to hand out */
+};
+
+/* Job ranges differ in size by at most one */
+static inline
+void shaggy_workers_job_range(size_t n, int jobs, int job, size_t *begin, size_t *end) {
+	*begin = n / jobs * job + ((size_t) job < n % jobs ? (size_t) job : n % jobs);
+	*end = *begin + n / jobs + ((size_t) job < n % jobs ? 1 : 0);
+}
+
+static inline
+void shaggy_workers_drain(struct shaggy_workers *workers) {
+	int job;
+
+	while ((job = SDL_AtomicAdd(&workers->next, 1)) < workers->jobs) {
+		size_t begin, end;
+
+		shaggy_workers_job_range(workers->n, workers->jobs, job, &begin, &end);
+		workers->fn(workers->user, job, begin, end);
+	}
+}
+
+static inline
+int shaggy_workers_main(void *data) {
+	struct shaggy_workers *workers = data;
+	unsigned seen = 0;
+
+	SDL_LockMutex(workers->lock);
+
+	for (;;) {
+		while (!workers->quit && workers->generation == seen) {
+			SDL_CondWait(workers->wake, workers->lock);
+		}
+
+		if (workers->quit) {
+			break;
+		}
+
+		seen = workers->generation;
+		SDL_UnlockMutex(workers->lock);
+
+		shaggy_workers_drain(workers);
+
+		SDL_LockMutex(workers->lock);
+		if (--workers->busy == 0) {
+			SDL_CondSignal(workers->done);
+		}
+	}
+
+	SDL_UnlockMutex(workers->lock);
+	return 0;
+}
+
+/*****************************************************************
+ * Start the threads.
+ * @param threads How many besides the caller, negative for one
+ *                less than the CPU count. 0 is valid and runs
+ *                every job on the calling thread.
+ * @return false if the mutex or conditions couldn't be made.
+ *         Threads that fail to start only cost parallelism.
+ *****************************************************************/
+static inline
+bool shaggy_workers_init(struct shaggy_workers *workers, int threads) {
+	int i;
+
+	memset(workers, 0, sizeof(*workers));
+
+	if (threads < 0) {
+		threads = SDL_GetCPUCount() - 1;
+	}
+	if (threads > SHAGGY_WORKERS_MAX - 1) {
+		threads = SHAGGY_WORKERS_MAX - 1;
+	}
+
+	workers->lock = SDL_CreateMutex();
+	workers->wake = SDL_CreateCond();
+	workers->done = SDL_CreateCond();
+	if (!workers->lock || !workers->wake || !workers->done) {
+		logm(ERROR, "Failed to create worker sync objects: %s", SDL_GetError());
+		goto fail;
+	}
+
+	for (i = 0; i < threads; ++i) {
+		workers->threads[workers->count] = SDL_CreateThread(shaggy_workers_main, "shaggy_worker", workers);
+
+		if (!workers->threads[workers->count]) {
+			logm(WARNING, "Failed to start worker thread: %s", SDL_GetError());
+			break;
+		}
+
+		++workers->count;
+	}
+
+	logm(CONFIG, "%d worker threads", workers->count);
+	return true;
+
+fail:
+	if (workers->lock) SDL_DestroyMutex(workers->lock);
+	if (workers->wake) SDL_DestroyCond(workers->wake);
+	if (workers->done) SDL_DestroyCond(workers->done);
+	memset(workers, 0, sizeof(*workers));
+	return false;
+}
+
+static inline
+void shaggy_workers_destroy(struct shaggy_workers *workers) {
+	int i;
+
+	if (!workers->lock) {
+		return;
+	}
+
+	SDL_LockMutex(workers->lock);
+	workers->quit = true;
+	SDL_CondBroadcast(workers->wake);
+	SDL_UnlockMutex(workers->lock);
+
+	for (i = 0; i < workers->count; ++i) {
+		SDL_WaitThread(workers->threads[i], NULL);
+	}
+
+	SDL_DestroyMutex(workers->lock);
+	SDL_DestroyCond(workers->wake);
+	SDL_DestroyCond(workers->done);
+	memset(workers, 0, sizeof(*workers));
+}
+
+/*****************************************************************
+ * Split [0, n) into jobs and wait for all of them.
+ * @param workers     May be NULL or have no threads, then fn runs
+ *                    once over the whole range on this thread.
+ * @param min_per_job Smallest range worth a job of its own, so
+ *                    small runs don't pay for waking threads.
+ * @return How many jobs fn was called for, at least 1 (fn is
+ *         called once even for n = 0).
+ *****************************************************************/
+static inline
+int shaggy_workers_run(struct shaggy_workers *workers, size_t n, size_t min_per_job, shaggy_job_fn fn, void *user) {
+	int jobs = workers ? workers->count + 1 : 1;
+
+	if (min_per_job && n / min_per_job < (size_t) jobs) {
+		jobs = (int) (n / min_per_job);
+	}
+
+	if (jobs <= 1) {
+		fn(user, 0, 0, n);
+		return 1;
+	}
+
+	workers->fn = fn;
+	workers->user = user;
+	workers->n = n;
+	workers->jobs = jobs;
+	SDL_AtomicSet(&workers->next, 0);
+
+	SDL_LockMutex(workers->lock);
+	workers->busy = workers->count;
+	++workers->generation;
+	SDL_CondBroadcast(workers->wake);
+	SDL_UnlockMutex(workers->lock);
+
+	shaggy_workers_drain(workers);
+
+	SDL_LockMutex(workers->lock);
+	while (workers->busy) {
+		SDL_CondWait(workers->done, workers->lock);
+	}
+	SDL_UnlockMutex(workers->lock);
+
+	return jobs;
+}
+
+#endif
@@ -0,0 +1,751 @@
+/* clock_gettime and CLOCK_MONOTONIC are POSIX, not C11 */
+#define _POSIX_C_SOURCE 199309L
+
+#include "sclog4c/sclog4c.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "linmath.h"
+#include "linmath_batch.h"
+#include "math_dispatch.h"
+
+/*****************************************************************
+ * Micro-benchmarks for linmath.h, linmath_batch.h and every
+ * variant shaggy_math can bind on this CPU.
+ * usage: shaggy_bench [--filter <text>] [--json <out.json>]
+ *                     [--compare <baseline.json>] [--threshold <%>]
+ *
+ * Each benchmark calls its routine over a small rotating working
+ * set that stays in L1, so the numbers are compute cost, not
+ * memory. The iteration count per sample is calibrated once during
+ * warm-up so a sample lasts at least BENCH_MIN_SAMPLE_NS and is
+ * then fixed for every measured sample. Reported are the median,
+ * 10th and 90th percentile of BENCH_SAMPLES samples.
+ *
+ * --compare reads a file written by --json and exits with 1 if
+ * any median got slower than the baseline by more than the
+ * threshold (10% by default).
+ *****************************************************************/
+
+#define BENCH_SET 64 /* Working set per argument, a power of two */
+#define BENCH_MASK (BENCH_SET - 1)
+#define BENCH_BATCH 1024 /* Elements per call of a batched routine */
+#define BENCH_STREAMS 42 /* Float streams of BENCH_BATCH for the batched routines */
+#define BENCH_WARMUP 5
+#define BENCH_SAMPLES 31
+#define BENCH_MIN_SAMPLE_NS 200000.0
+/* Past this a sample still under BENCH_MIN_SAMPLE_NS means the loop was optimised away */
+#define BENCH_MAX_ITERATIONS ((size_t) 1 << 30)
+
+struct bench_case {
+	char name[96];
+	void (*run)(size_t iterations);
+	size_t items; /* Elements per iteration, results are per element */
+	int isa;      /* shaggy_math variant to bind first, -1 for none */
+};
+
+struct bench_result {
+	char name[96];
+	size_t iterations;
+	size_t items;
+	double median;
+	double p10;
+	double p90;
+	double min;
+};
+
+/*****************************************************************
+ * Inputs and outputs. Outputs are globals so nothing gets thrown
+ * away as dead code.
+ *****************************************************************/
+static mat4x4 bench_m[BENCH_SET], bench_m_out[BENCH_SET];
+static vec4 bench_v4[BENCH_SET], bench_v4_out[BENCH_SET];
+static vec3 bench_v3[BENCH_SET], bench_v3_out[BENCH_SET];
+static vec2 bench_v2[BENCH_SET], bench_v2_out[BENCH_SET];
+static quat bench_q[BENCH_SET], bench_q_out[BENCH_SET];
+static float bench_f[BENCH_SET], bench_f_out[BENCH_SET];
+
+static float *bench_soa; /* BENCH_STREAMS streams of BENCH_BATCH, see bench_stream */
+static mat4x4 bench_batch_m[BENCH_BATCH], bench_batch_out[BENCH_BATCH];
+
+static struct shaggy_frustum bench_frustum;
+static uint32_t bench_visible[BENCH_BATCH];
+
+static struct shaggy_math_kernels bench_kernels;
+
+static uint32_t bench_state = 1;
+
+static float bench_random(void) {
+	bench_state = bench_state * 1664525u + 1013904223u;
+	return (float) (bench_state >> 8) / (float) (1u << 23) - 1.0f;
+}
+
+static void bench_random_quat(quat q) {
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		q[i] = bench_random();
+	}
+
+	quat_norm(q, q);
+}
+
+/* Rigid matrices, valid input for every inverse */
+static void bench_random_matrix(mat4x4 M) {
+	quat q;
+
+	bench_random_quat(q);
+	mat4x4_from_quat(M, q);
+	M[3][0] = bench_random() * 10.0f;
+	M[3][1] = bench_random() * 10.0f;
+	M[3][2] = bench_random() * 10.0f;
+}
+
+static float *bench_stream(int stream) {
+	return bench_soa + (size_t) stream * BENCH_BATCH;
+}
+
+/*
+ * Streams: a rotation 0-3, a translation 4-6, b rotation 7-10, b translation 11-13, out 14-17,
+ * then dual quaternions of a 18-25, of b 26-33 and out 34-41
+ */
+static vec3_soa bench_soa_in(void) {
+	return (vec3_soa) { bench_stream(4), bench_stream(5), bench_stream(6) };
+}
+
+static vec3_soa bench_soa_out3(void) {
+	return (vec3_soa) { bench_stream(14), bench_stream(15), bench_stream(16) };
+}
+
+static vec4_soa bench_soa_out4(void) {
+	return (vec4_soa) { bench_stream(14), bench_stream(15), bench_stream(16), bench_stream(17) };
+}
+
+/* Centers are a translation, radius and extents b translation */
+static struct shaggy_spheres bench_spheres(void) {
+	return (struct shaggy_spheres) { bench_soa_in(), bench_stream(11) };
+}
+
+static struct shaggy_aabbs bench_aabbs(void) {
+	return (struct shaggy_aabbs) { bench_soa_in(), { bench_stream(11), bench_stream(12), bench_stream(13) } };
+}
+
+static pose_soa bench_pose(int which) {
+	int base = which == 0 ? 0 : 7;
+
+	return (pose_soa) {
+			{ bench_stream(base), bench_stream(base + 1), bench_stream(base + 2), bench_stream(base + 3) },
+			{ bench_stream(base + 4), bench_stream(base + 5), bench_stream(base + 6) }
+	};
+}
+
+/* 0 and 1 are poses a and b, 2 is output */
+static dualquat_soa bench_dualquat(int which) {
+	int base = 18 + 8 * which;
+
+	return (dualquat_soa) {
+			{ bench_stream(base), bench_stream(base + 1), bench_stream(base + 2), bench_stream(base + 3) },
+			{ bench_stream(base + 4), bench_stream(base + 5), bench_stream(base + 6), bench_stream(base + 7) }
+	};
+}
+
+static pose_soa bench_pose_out(void) {
+	return (pose_soa) {
+			{ bench_stream(14), bench_stream(15), bench_stream(16), bench_stream(17) },
+			{ bench_stream(4), bench_stream(5), bench_stream(6) }
+	};
+}
+
+static bool bench_init_data(void) {
+	mat4x4 projection;
+	size_t i, j;
+
+	bench_soa = malloc(sizeof(float) * BENCH_BATCH * BENCH_STREAMS);
+	if (!bench_soa) {
+		return false;
+	}
+
+	for (i = 0; i < BENCH_SET; ++i) {
+		bench_random_matrix(bench_m[i]);
+		bench_random_quat(bench_q[i]);
+
+		for (j = 0; j < 4; ++j) {
+			bench_v4[i][j] = bench_random();
+		}
+
+		for (j = 0; j < 3; ++j) {
+			bench_v3[i][j] = bench_random();
+		}
+
+		bench_v2[i][0] = bench_random();
+		bench_v2[i][1] = bench_random();
+		bench_f[i] = bench_random();
+	}
+
+	/* Looking down -z from the origin, so roughly the z < 0 half of the streams is inside */
+	mat4x4_perspective(projection, 1.2f, 1.5f, 0.1f, 10.0f);
+	shaggy_frustum_from_matrix(&bench_frustum, projection);
+
+	for (i = 0; i < BENCH_BATCH; ++i) {
+		quat a, b;
+
+		bench_random_matrix(bench_batch_m[i]);
+		bench_random_quat(a);
+		bench_random_quat(b);
+
+		for (j = 0; j < 4; ++j) {
+			bench_stream(j)[i] = a[j];
+			bench_stream(7 + j)[i] = b[j];
+		}
+
+		for (j = 0; j < 3; ++j) {
+			bench_stream(4 + j)[i] = bench_random();
+			bench_stream(11 + j)[i] = bench_random();
+		}
+	}
+
+	dualquat_soa_from_pose_scalar(bench_dualquat(0), bench_pose(0), BENCH_BATCH);
+	dualquat_soa_from_pose_scalar(bench_dualquat(1), bench_pose(1), BENCH_BATCH);
+
+	return true;
+}
+
+/*****************************************************************
+ * Sink run after every call. Storing to the output globals alone
+ * isn't enough, the compiler can see that the working set repeats
+ * and fold a pure routine's loop down to almost nothing. The empty
+ * asm claims to read and write all memory, so every iteration's
+ * result has to be stored and every input loaded again. Without
+ * GNU asm a call through a volatile pointer does the same.
+ *****************************************************************/
+#if defined(__GNUC__)
+#define BENCH_SINK() __asm__ __volatile__("" : : : "memory")
+#else
+static void bench_sink_nothing(void) {
+}
+
+static void (*volatile bench_sink)(void) = bench_sink_nothing;
+#define BENCH_SINK() bench_sink()
+#endif
+
+/*****************************************************************
+ * One function per routine. j and k walk the working set, k
+ * offset so binary operations don't see the same input twice.
+ *****************************************************************/
+#define BENCH_OP(id, call) \
+static void bench_##id(size_t iterations) { \
+	size_t i; \
+	for (i = 0; i < iterations; ++i) { \
+		size_t j = i & BENCH_MASK, k = (i + 7) & BENCH_MASK; \
+		(void) j; (void) k; \
+		call; \
+		BENCH_SINK(); \
+	} \
+}
+
+#define BENCH_BATCH_OP(id, call) \
+static void bench_##id(size_t iterations) { \
+	size_t i; \
+	for (i = 0; i < iterations; ++i) { \
+		float t = (float) (i & 15) / 16.0f; \
+		(void) t; \
+		call; \
+		BENCH_SINK(); \
+	} \
+}
+
+#define BENCH_VEC_OPS(n) \
+BENCH_OP(vec##n##_add, vec##n##_add(bench_v##n##_out[j], bench_v##n[j], bench_v##n[k])) \
+BENCH_OP(vec##n##_sub, vec##n##_sub(bench_v##n##_out[j], bench_v##n[j], bench_v##n[k])) \
+BENCH_OP(vec##n##_scale, vec##n##_scale(bench_v##n##_out[j], bench_v##n[j], bench_f[k])) \
+BENCH_OP(vec##n##_mul_inner, bench_f_out[j] = vec##n##_mul_inner(bench_v##n[j], bench_v##n[k])) \
+BENCH_OP(vec##n##_len, bench_f_out[j] = vec##n##_len(bench_v##n[j])) \
+BENCH_OP(vec##n##_norm, vec##n##_norm(bench_v##n##_out[j], bench_v##n[j])) \
+BENCH_OP(vec##n##_min, vec##n##_min(bench_v##n##_out[j], bench_v##n[j], bench_v##n[k])) \
+BENCH_OP(vec##n##_max, vec##n##_max(bench_v##n##_out[j], bench_v##n[j], bench_v##n[k]))
+
+BENCH_VEC_OPS(2)
+BENCH_VEC_OPS(3)
+BENCH_VEC_OPS(4)
+
+BENCH_OP(vec3_mul_cross, vec3_mul_cross(bench_v3_out[j], bench_v3[j], bench_v3[k]))
+BENCH_OP(vec3_reflect, vec3_reflect(bench_v3_out[j], bench_v3[j], bench_v3[k]))
+BENCH_OP(vec4_mul_cross, vec4_mul_cross(bench_v4_out[j], bench_v4[j], bench_v4[k]))
+BENCH_OP(vec4_reflect, vec4_reflect(bench_v4_out[j], bench_v4[j], bench_v4[k]))
+
+BENCH_OP(mat4x4_identity, mat4x4_identity(bench_m_out[j]))
+BENCH_OP(mat4x4_dup, mat4x4_dup(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_row, mat4x4_row(bench_v4_out[j], bench_m[j], (int) (k & 3)))
+BENCH_OP(mat4x4_col, mat4x4_col(bench_v4_out[j], bench_m[j], (int) (k & 3)))
+BENCH_OP(mat4x4_transpose, mat4x4_transpose(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_transpose_scalar, mat4x4_transpose_scalar(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_add, mat4x4_add(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_sub, mat4x4_sub(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_scale, mat4x4_scale(bench_m_out[j], bench_m[j], bench_f[k]))
+BENCH_OP(mat4x4_scale_aniso, mat4x4_scale_aniso(bench_m_out[j], bench_m[j], bench_f[k], bench_f[j], 2.0f))
+BENCH_OP(mat4x4_mul, mat4x4_mul(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_mul_scalar, mat4x4_mul_scalar(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_mul_vec4, mat4x4_mul_vec4(bench_v4_out[j], bench_m[j], bench_v4[k]))
+BENCH_OP(mat4x4_mul_vec4_scalar, mat4x4_mul_vec4_scalar(bench_v4_out[j], bench_m[j], bench_v4[k]))
+BENCH_OP(mat4x4_translate, mat4x4_translate(bench_m_out[j], bench_f[j], bench_f[k], 1.0f))
+BENCH_OP(mat4x4_translate_in_place, mat4x4_translate_in_place(bench_m_out[j], bench_f[j], bench_f[k], 1.0f))
+BENCH_OP(mat4x4_from_vec3_mul_outer, mat4x4_from_vec3_mul_outer(bench_m_out[j], bench_v3[j], bench_v3[k]))
+BENCH_OP(mat4x4_rotate, mat4x4_rotate(bench_m_out[j], bench_m[j], bench_v3[k][0], bench_v3[k][1], bench_v3[k][2], bench_f[j]))
+BENCH_OP(mat4x4_rotate_X, mat4x4_rotate_X(bench_m_out[j], bench_m[j], bench_f[k]))
+BENCH_OP(mat4x4_rotate_Y, mat4x4_rotate_Y(bench_m_out[j], bench_m[j], bench_f[k]))
+BENCH_OP(mat4x4_rotate_Z, mat4x4_rotate_Z(bench_m_out[j], bench_m[j], bench_f[k]))
+BENCH_OP(mat4x4_invert, mat4x4_invert(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_scalar, mat4x4_invert_scalar(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_rigid, mat4x4_invert_rigid(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_rigid_scalar, mat4x4_invert_rigid_scalar(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_affine, mat4x4_invert_affine(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_affine_scalar, mat4x4_invert_affine_scalar(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_orthonormalize, mat4x4_orthonormalize(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_frustum, mat4x4_frustum(bench_m_out[j], -1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 10.0f + bench_f[k]))
+BENCH_OP(mat4x4_ortho, mat4x4_ortho(bench_m_out[j], -1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 10.0f + bench_f[k]))
+BENCH_OP(mat4x4_perspective, mat4x4_perspective(bench_m_out[j], 1.0f + bench_f[k] * 0.5f, 1.5f, 0.1f, 100.0f))
+BENCH_OP(mat4x4_look_at, mat4x4_look_at(bench_m_out[j], bench_v3[j], bench_v3[k], (vec3) { 0.0f, 0.0f, 1.0f }))
+BENCH_OP(mat4x4_from_quat, mat4x4_from_quat(bench_m_out[j], bench_q[k]))
+BENCH_OP(mat4x4o_mul_quat, mat4x4o_mul_quat(bench_m_out[j], bench_m[j], bench_q[k]))
+
+BENCH_OP(quat_identity, quat_identity(bench_q_out[j]))
+BENCH_OP(quat_add, quat_add(bench_q_out[j], bench_q[j], bench_q[k]))
+BENCH_OP(quat_sub, quat_sub(bench_q_out[j], bench_q[j], bench_q[k]))
+BENCH_OP(quat_mul, quat_mul(bench_q_out[j], bench_q[j], bench_q[k]))
+BENCH_OP(quat_mul_scalar, quat_mul_scalar(bench_q_out[j], bench_q[j], bench_q[k]))
+BENCH_OP(quat_scale, quat_scale(bench_q_out[j], bench_q[j], bench_f[k]))
+BENCH_OP(quat_inner_product, bench_f_out[j] = quat_inner_product(bench_q[j], bench_q[k]))
+BENCH_OP(quat_conj, quat_conj(bench_q_out[j], bench_q[k]))
+BENCH_OP(quat_rotate, quat_rotate(bench_q_out[j], bench_f[k], bench_v3[j]))
+BENCH_OP(quat_norm, quat_norm(bench_q_out[j], bench_q[k]))
+BENCH_OP(quat_nlerp, quat_nlerp(bench_q_out[j], bench_q[j], bench_q[k], 0.3f))
+BENCH_OP(quat_slerp, quat_slerp(bench_q_out[j], bench_q[j], bench_q[k], 0.3f))
+BENCH_OP(quat_mul_vec3, quat_mul_vec3(bench_v3_out[j], bench_q[j], bench_v3[k]))
+BENCH_OP(quat_from_mat4x4, quat_from_mat4x4(bench_q_out[j], bench_m[k]))
+
+#ifdef LINMATH_SSE2
+BENCH_OP(mat4x4_transpose_sse2, mat4x4_transpose_sse2(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_mul_sse2, mat4x4_mul_sse2(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_mul_vec4_sse2, mat4x4_mul_vec4_sse2(bench_v4_out[j], bench_m[j], bench_v4[k]))
+BENCH_OP(mat4x4_invert_sse2, mat4x4_invert_sse2(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_rigid_sse2, mat4x4_invert_rigid_sse2(bench_m_out[j], bench_m[k]))
+BENCH_OP(mat4x4_invert_affine_sse2, mat4x4_invert_affine_sse2(bench_m_out[j], bench_m[k]))
+BENCH_OP(quat_mul_sse2, quat_mul_sse2(bench_q_out[j], bench_q[j], bench_q[k]))
+#endif
+
+#ifdef LINMATH_AVX_FMA
+BENCH_OP(mat4x4_mul_avx_fma, mat4x4_mul_avx_fma(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(mat4x4_mul_vec4_avx_fma, mat4x4_mul_vec4_avx_fma(bench_v4_out[j], bench_m[j], bench_v4[k]))
+#endif
+
+BENCH_BATCH_OP(mat4x4_invert_rigid_batch, mat4x4_invert_rigid_batch(bench_batch_out, bench_batch_m, BENCH_BATCH))
+BENCH_BATCH_OP(pose_soa_blend, pose_soa_blend(bench_pose_out(), bench_pose(0), bench_pose(1), t, BENCH_BATCH))
+
+/* Batched routines through the dispatch table, run once per bindable variant */
+BENCH_BATCH_OP(table_vec3_soa_transform_points,
+			   bench_kernels.vec3_soa_transform_points(bench_soa_out3(), bench_m[i & BENCH_MASK], bench_soa_in(), BENCH_BATCH))
+BENCH_BATCH_OP(table_vec4_soa_transform_points,
+			   bench_kernels.vec4_soa_transform_points(bench_soa_out4(), bench_m[i & BENCH_MASK], bench_soa_in(), BENCH_BATCH))
+BENCH_BATCH_OP(table_vec3_soa_transform_dirs,
+			   bench_kernels.vec3_soa_transform_dirs(bench_soa_out3(), bench_m[i & BENCH_MASK], bench_soa_in(), BENCH_BATCH))
+BENCH_BATCH_OP(table_mat4x4_mul_batch,
+			   bench_kernels.mat4x4_mul_batch(bench_batch_out, bench_m[i & BENCH_MASK], bench_batch_m, BENCH_BATCH))
+BENCH_BATCH_OP(table_mat4x4_invert_affine_batch,
+			   bench_kernels.mat4x4_invert_affine_batch(bench_batch_out, bench_batch_m, BENCH_BATCH))
+BENCH_BATCH_OP(table_quat_soa_nlerp,
+			   bench_kernels.quat_soa_nlerp(bench_pose_out().rotation, bench_pose(0).rotation, bench_pose(1).rotation, t, BENCH_BATCH))
+BENCH_BATCH_OP(table_quat_soa_slerp,
+			   bench_kernels.quat_soa_slerp(bench_pose_out().rotation, bench_pose(0).rotation, bench_pose(1).rotation, t, BENCH_BATCH))
+BENCH_BATCH_OP(table_mat4x4_from_pose_soa,
+			   bench_kernels.mat4x4_from_pose_soa(bench_batch_out, bench_pose(0), BENCH_BATCH))
+BENCH_BATCH_OP(table_pose_soa_blend,
+			   bench_kernels.pose_soa_blend(bench_pose_out(), bench_pose(0), bench_pose(1), t, BENCH_BATCH))
+BENCH_BATCH_OP(table_dualquat_soa_from_pose,
+			   bench_kernels.dualquat_soa_from_pose(bench_dualquat(2), bench_pose(0), BENCH_BATCH))
+BENCH_BATCH_OP(table_dualquat_soa_blend,
+			   bench_kernels.dualquat_soa_blend(bench_dualquat(2), bench_dualquat(0), bench_dualquat(1), t, BENCH_BATCH))
+BENCH_BATCH_OP(table_mat4x4_from_dualquat_soa,
+			   bench_kernels.mat4x4_from_dualquat_soa(bench_batch_out, bench_dualquat(0), BENCH_BATCH))
+BENCH_BATCH_OP(table_cull_spheres,
+			   bench_kernels.cull_spheres(&bench_frustum, bench_spheres(), 0, BENCH_BATCH, bench_visible))
+BENCH_BATCH_OP(table_cull_aabbs,
+			   bench_kernels.cull_aabbs(&bench_frustum, bench_aabbs(), 0, BENCH_BATCH, bench_visible))
+
+/* Single element routines through the table, to show the cost of the indirect call */
+BENCH_OP(table_mat4x4_mul, bench_kernels.mat4x4_mul(bench_m_out[j], bench_m[j], bench_m[k]))
+BENCH_OP(table_mat4x4_mul_vec4, bench_kernels.mat4x4_mul_vec4(bench_v4_out[j], bench_m[j], bench_v4[k]))
+BENCH_OP(table_mat4x4_invert, bench_kernels.mat4x4_invert(bench_m_out[j], bench_m[k]))
+BENCH_OP(table_quat_mul, bench_kernels.quat_mul(bench_q_out[j], bench_q[j], bench_q[k]))
+
+#define BENCH_CASE(id) { #id, bench_##id, 1, -1 }
+#define BENCH_BATCH_CASE(id) { #id, bench_##id, BENCH_BATCH, -1 }
+#define BENCH_VEC_CASES(n) \
+	BENCH_CASE(vec##n##_add), BENCH_CASE(vec##n##_sub), BENCH_CASE(vec##n##_scale), \
+	BENCH_CASE(vec##n##_mul_inner), BENCH_CASE(vec##n##_len), BENCH_CASE(vec##n##_norm), \
+	BENCH_CASE(vec##n##_min), BENCH_CASE(vec##n##_max)
+
+static const struct bench_case bench_cases[] = {
+		BENCH_VEC_CASES(2),
+		BENCH_VEC_CASES(3),
+		BENCH_VEC_CASES(4),
+		BENCH_CASE(vec3_mul_cross),
+		BENCH_CASE(vec3_reflect),
+		BENCH_CASE(vec4_mul_cross),
+		BENCH_CASE(vec4_reflect),
+
+		BENCH_CASE(mat4x4_identity),
+		BENCH_CASE(mat4x4_dup),
+		BENCH_CASE(mat4x4_row),
+		BENCH_CASE(mat4x4_col),
+		BENCH_CASE(mat4x4_transpose),
+		BENCH_CASE(mat4x4_transpose_scalar),
+		BENCH_CASE(mat4x4_add),
+		BENCH_CASE(mat4x4_sub),
+		BENCH_CASE(mat4x4_scale),
+		BENCH_CASE(mat4x4_scale_aniso),
+		BENCH_CASE(mat4x4_mul),
+		BENCH_CASE(mat4x4_mul_scalar),
+		BENCH_CASE(mat4x4_mul_vec4),
+		BENCH_CASE(mat4x4_mul_vec4_scalar),
+		BENCH_CASE(mat4x4_translate),
+		BENCH_CASE(mat4x4_translate_in_place),
+		BENCH_CASE(mat4x4_from_vec3_mul_outer),
+		BENCH_CASE(mat4x4_rotate),
+		BENCH_CASE(mat4x4_rotate_X),
+		BENCH_CASE(mat4x4_rotate_Y),
+		BENCH_CASE(mat4x4_rotate_Z),
+		BENCH_CASE(mat4x4_invert),
+		BENCH_CASE(mat4x4_invert_scalar),
+		BENCH_CASE(mat4x4_invert_rigid),
+		BENCH_CASE(mat4x4_invert_rigid_scalar),
+		BENCH_CASE(mat4x4_invert_affine),
+		BENCH_CASE(mat4x4_invert_affine_scalar),
+		BENCH_CASE(mat4x4_orthonormalize),
+		BENCH_CASE(mat4x4_frustum),
+		BENCH_CASE(mat4x4_ortho),
+		BENCH_CASE(mat4x4_perspective),
+		BENCH_CASE(mat4x4_look_at),
+		BENCH_CASE(mat4x4_from_quat),
+		BENCH_CASE(mat4x4o_mul_quat),
+
+		BENCH_CASE(quat_identity),
+		BENCH_CASE(quat_add),
+		BENCH_CASE(quat_sub),
+		BENCH_CASE(quat_mul),
+		BENCH_CASE(quat_mul_scalar),
+		BENCH_CASE(quat_scale),
+		BENCH_CASE(quat_inner_product),
+		BENCH_CASE(quat_conj),
+		BENCH_CASE(quat_rotate),
+		BENCH_CASE(quat_norm),
+		BENCH_CASE(quat_nlerp),
+		BENCH_CASE(quat_slerp),
+		BENCH_CASE(quat_mul_vec3),
+		BENCH_CASE(quat_from_mat4x4),
+
+#ifdef LINMATH_SSE2
+		BENCH_CASE(mat4x4_transpose_sse2),
+		BENCH_CASE(mat4x4_mul_sse2),
+		BENCH_CASE(mat4x4_mul_vec4_sse2),
+		BENCH_CASE(mat4x4_invert_sse2),
+		BENCH_CASE(mat4x4_invert_rigid_sse2),
+		BENCH_CASE(mat4x4_invert_affine_sse2),
+		BENCH_CASE(quat_mul_sse2),
+#endif
+#ifdef LINMATH_AVX_FMA
+		BENCH_CASE(mat4x4_mul_avx_fma),
+		BENCH_CASE(mat4x4_mul_vec4_avx_fma),
+#endif
+
+		BENCH_BATCH_CASE(mat4x4_invert_rigid_batch),
+		BENCH_BATCH_CASE(pose_soa_blend),
+};
+
+/* Named <routine>@<variant>, e.g. quat_soa_nlerp@avx2 */
+static const struct bench_case bench_table_cases[] = {
+		{ "vec3_soa_transform_points", bench_table_vec3_soa_transform_points, BENCH_BATCH, -1 },
+		{ "vec4_soa_transform_points", bench_table_vec4_soa_transform_points, BENCH_BATCH, -1 },
+		{ "vec3_soa_transform_dirs", bench_table_vec3_soa_transform_dirs, BENCH_BATCH, -1 },
+		{ "mat4x4_mul_batch", bench_table_mat4x4_mul_batch, BENCH_BATCH, -1 },
+		{ "mat4x4_invert_affine_batch", bench_table_mat4x4_invert_affine_batch, BENCH_BATCH, -1 },
+		{ "quat_soa_nlerp", bench_table_quat_soa_nlerp, BENCH_BATCH, -1 },
+		{ "quat_soa_slerp", bench_table_quat_soa_slerp, BENCH_BATCH, -1 },
+		{ "mat4x4_from_pose_soa", bench_table_mat4x4_from_pose_soa, BENCH_BATCH, -1 },
+		{ "pose_soa_blend", bench_table_pose_soa_blend, BENCH_BATCH, -1 },
+		{ "dualquat_soa_from_pose", bench_table_dualquat_soa_from_pose, BENCH_BATCH, -1 },
+		{ "dualquat_soa_blend", bench_table_dualquat_soa_blend, BENCH_BATCH, -1 },
+		{ "mat4x4_from_dualquat_soa", bench_table_mat4x4_from_dualquat_soa, BENCH_BATCH, -1 },
+		{ "cull_spheres", bench_table_cull_spheres, BENCH_BATCH, -1 },
+		{ "cull_aabbs", bench_table_cull_aabbs, BENCH_BATCH, -1 },
+		{ "mat4x4_mul", bench_table_mat4x4_mul, 1, -1 },
+		{ "mat4x4_mul_vec4", bench_table_mat4x4_mul_vec4, 1, -1 },
+		{ "mat4x4_invert", bench_table_mat4x4_invert, 1, -1 },
+		{ "quat_mul", bench_table_quat_mul, 1, -1 },
+};
+
+static double bench_now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+static double bench_time(const struct bench_case *bench_case, size_t iterations) {
+	double start = bench_now_ns();
+
+	bench_case->run(iterations);
+	return bench_now_ns() - start;
+}
+
+static int bench_compare_doubles(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* false if the case never got slow enough to time */
+static bool bench_run(const struct bench_case *bench_case, struct bench_result *result) {
+	double samples[BENCH_SAMPLES];
+	size_t iterations = bench_case->items > 1 ? 1 : 1024;
+	double elapsed;
+	int i;
+
+	if (bench_case->isa >= 0) {
+		shaggy_math_bind(&bench_kernels, (enum shaggy_math_isa) bench_case->isa);
+	}
+
+	/* Warm up caches and clocks, growing the sample until it is long enough to time */
+	for (i = 0; i < BENCH_WARMUP; ++i) {
+		elapsed = bench_time(bench_case, iterations);
+
+		while (elapsed < BENCH_MIN_SAMPLE_NS) {
+			if (iterations >= BENCH_MAX_ITERATIONS) {
+				fprintf(stderr, "shaggy_bench: %s took %.0f ns for %zu iterations, "
+								"its loop must have been optimised away\n",
+						bench_case->name, elapsed, iterations);
+				return false;
+			}
+
+			iterations *= 2;
+			elapsed = bench_time(bench_case, iterations);
+		}
+	}
+
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		samples[i] = bench_time(bench_case, iterations) / ((double) iterations * (double) bench_case->items);
+	}
+
+	qsort(samples, BENCH_SAMPLES, sizeof(double), bench_compare_doubles);
+
+	snprintf(result->name, sizeof(result->name), "%s", bench_case->name);
+	result->iterations = iterations;
+	result->items = bench_case->items;
+	result->min = samples[0];
+	result->p10 = samples[(BENCH_SAMPLES - 1) / 10];
+	result->median = samples[(BENCH_SAMPLES - 1) / 2];
+	result->p90 = samples[(BENCH_SAMPLES - 1) * 9 / 10];
+	return true;
+}
+
+/* One benchmark per line, which is all bench_read_baseline has to parse */
+static bool bench_write_json(const char *path, const struct bench_result *results, size_t count) {
+	FILE *out = fopen(path, "w");
+	size_t i;
+
+	if (!out) {
+		fprintf(stderr, "shaggy_bench: failed to open %s for writing\n", path);
+		return false;
+	}
+
+	fprintf(out, "{\n\"isa\": \"%s\",\n\"benchmarks\": [\n", shaggy_math_isa_name(shaggy_math.isa));
+
+	for (i = 0; i < count; ++i) {
+		fprintf(out, "{\"name\": \"%s\", \"median_ns\": %.4f, \"p10_ns\": %.4f, \"p90_ns\": %.4f, "
+					 "\"min_ns\": %.4f, \"iterations\": %zu, \"items\": %zu}%s\n",
+				results[i].name, results[i].median, results[i].p10, results[i].p90,
+				results[i].min, results[i].iterations, results[i].items, i + 1 < count ? "," : "");
+	}
+
+	fprintf(out, "]\n}\n");
+	fclose(out);
+	return true;
+}
+
+static size_t bench_read_baseline(const char *path, struct bench_result **baseline) {
+	FILE *in = fopen(path, "r");
+	char line[512];
+	size_t count = 0, capacity = 0;
+
+	*baseline = NULL;
+
+	if (!in) {
+		fprintf(stderr, "shaggy_bench: failed to open baseline %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		struct bench_result result;
+
+		memset(&result, 0, sizeof(result));
+
+		if (sscanf(line, "{\"name\": \"%95[^\"]\", \"median_ns\": %lf", result.name, &result.median) != 2) {
+			continue;
+		}
+
+		if (count == capacity) {
+			struct bench_result *grown;
+
+			capacity = capacity ? capacity * 2 : 64;
+			grown = realloc(*baseline, capacity * sizeof(*grown));
+
+			if (!grown) {
+				break;
+			}
+
+			*baseline = grown;
+		}
+
+		(*baseline)[count++] = result;
+	}
+
+	fclose(in);
+	return count;
+}
+
+/* @return Number of benchmarks slower than baseline by more than threshold percent */
+static size_t bench_compare(const struct bench_result *results, size_t count,
+							const struct bench_result *baseline, size_t baseline_count, double threshold) {
+	size_t regressions = 0, matched = 0;
+	size_t i, j;
+
+	for (i = 0; i < count; ++i) {
+		for (j = 0; j < baseline_count; ++j) {
+			double change;
+
+			if (strcmp(results[i].name, baseline[j].name) != 0 || baseline[j].median <= 0.0) {
+				continue;
+			}
+
+			++matched;
+			change = (results[i].median / baseline[j].median - 1.0) * 100.0;
+
+			if (change > threshold) {
+				++regressions;
+				printf("REGRESSION %-44s %10.3f -> %10.3f ns (%+.1f%%)\n",
+					   results[i].name, baseline[j].median, results[i].median, change);
+			} else if (change < -threshold) {
+				printf("improved   %-44s %10.3f -> %10.3f ns (%+.1f%%)\n",
+					   results[i].name, baseline[j].median, results[i].median, change);
+			}
+
+			break;
+		}
+	}
+
+	printf("%zu of %zu benchmarks matched the baseline, %zu regressed by more than %.1f%%\n",
+		   matched, count, regressions, threshold);
+
+	return regressions;
+}
+
+int main(int argc, char *argv[]) {
+	const size_t table_count = sizeof(bench_table_cases) / sizeof(bench_table_cases[0]);
+	const size_t case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
+	struct bench_case *cases = NULL;
+	struct bench_result *results = NULL, *baseline = NULL;
+	const char *filter = NULL, *json_path = NULL, *compare_path = NULL;
+	double threshold = 10.0;
+	size_t count = 0, result_count = 0, baseline_count = 0;
+	size_t i;
+	int isa, status = EXIT_FAILURE;
+
+	for (i = 1; i < (size_t) argc; ++i) {
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < (size_t) argc) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < (size_t) argc) {
+			json_path = argv[++i];
+		} else if (strcmp(argv[i], "--compare") == 0 && i + 1 < (size_t) argc) {
+			compare_path = argv[++i];
+		} else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < (size_t) argc) {
+			threshold = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [--filter <text>] [--json <out.json>] "
+							"[--compare <baseline.json>] [--threshold <percent>]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	sclog4c_level = CONFIG;
+	shaggy_math_dispatch_init();
+
+	cases = malloc(sizeof(*cases) * (case_count + table_count * SHAGGY_MATH_ISA_COUNT));
+	results = malloc(sizeof(*results) * (case_count + table_count * SHAGGY_MATH_ISA_COUNT));
+
+	if (!cases || !results || !bench_init_data()) {
+		fprintf(stderr, "shaggy_bench: out of memory\n");
+		goto fail;
+	}
+
+	for (i = 0; i < case_count; ++i) {
+		cases[count++] = bench_cases[i];
+	}
+
+	for (isa = 0; isa < SHAGGY_MATH_ISA_COUNT; ++isa) {
+		if (!shaggy_math_bind(&bench_kernels, (enum shaggy_math_isa) isa)) {
+			continue;
+		}
+
+		for (i = 0; i < table_count; ++i) {
+			cases[count] = bench_table_cases[i];
+			cases[count].isa = isa;
+			snprintf(cases[count].name, sizeof(cases[count].name), "%.64s@%s",
+					 bench_table_cases[i].name, shaggy_math_isa_name((enum shaggy_math_isa) isa));
+			++count;
+		}
+	}
+
+	printf("%-48s %10s %10s %10s\n", "benchmark", "median", "p10", "p90");
+
+	for (i = 0; i < count; ++i) {
+		if (filter && !strstr(cases[i].name, filter)) {
+			continue;
+		}
+
+		if (!bench_run(&cases[i], &results[result_count])) {
+			goto fail;
+		}
+
+		printf("%-48s %10.3f %10.3f %10.3f ns%s\n", results[result_count].name, results[result_count].median,
+			   results[result_count].p10, results[result_count].p90, cases[i].items > 1 ? " per element" : "");
+		++result_count;
+	}
+
+	if (json_path && !bench_write_json(json_path, results, result_count)) {
+		goto fail;
+	}
+
+	status = EXIT_SUCCESS;
+
+	if (compare_path) {
+		baseline_count = bench_read_baseline(compare_path, &baseline);
+
+		if (baseline_count == 0) {
+			fprintf(stderr, "shaggy_bench: no benchmarks in %s\n", compare_path);
+			status = EXIT_FAILURE;
+		} else if (bench_compare(results, result_count, baseline, baseline_count, threshold) > 0) {
+			status = EXIT_FAILURE;
+		}
+	}
+
+fail:
+	free(cases);
+	free(results);
+	free(baseline);
+	free(bench_soa);
+	return status;
+}
@@ -0,0 +1,755 @@
+#include "sclog4c/sclog4c.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linmath.h"
+#include "math_dispatch.h"
+
+/*****************************************************************
+ * Checks the SIMD variants of the linmath.h kernels against the
+ * *_scalar code, run by ctest. usage: shaggy_math_test
+ *
+ * The SSE2 and AVX2/FMA variants come from shaggy_math_bind, which
+ * hands out exactly the *_sse2 and *_avx_fma functions, the latter
+ * from math_dispatch_avx2.c, the only file built to run them. A
+ * variant the build or the CPU lacks is skipped. Every kernel is
+ * also run with its output aliasing its inputs, which linmath.h
+ * allows, against a reference computed on separate copies.
+ *
+ * SSE2 mul, mul_vec4 and transpose do the scalar arithmetic in the
+ * same order and must match bit for bit. FMA rounds once per
+ * multiply-add, and invert and quat_mul sum in another order, so
+ * those only have to be close, as do the pose and dual quaternion
+ * kernels, and the batched transforms, which are held to
+ * mat4x4_mul_vec4_scalar and mat4x4_mul_scalar one element at a
+ * time. A pose turned into a dual quaternion also has to give
+ * the same matrix as the pose itself. The frustum culls in the
+ * table have to return the same index list as shaggy_cull_*_scalar.
+ *
+ * The scalar code itself is checked first, against products worked
+ * out by hand and against invert(M) * M = I. It's the reference for
+ * the rest and all a LINMATH_NO_SIMD build has.
+ *
+ * The rigid and affine inverses, single and batched, are checked
+ * against mat4x4_invert_scalar on inputs of the structure they
+ * assume, in place as well. The SSE2 vec4 ops, quat_conj and
+ * quat_mul_vec3 only exist in linmath.h, not the table, and are
+ * checked bit for bit with the SSE2 variant.
+ *****************************************************************/
+
+#define TEST_CASES 1000
+#define TEST_TOLERANCE 1e-5f         /* Relative, for products of values in [-1, 1] */
+#define TEST_INVERT_TOLERANCE 1e-4f /* Relative, inverses are only as good as the conditioning */
+#define TEST_CULL_OBJECTS 1003       /* Not a multiple of 8, so the tails run too */
+#define TEST_JOINTS 1003            /* Also the batch size, likewise for the tails */
+/* Poses a 0-6, b 7-13, want 14-20, got 21-27, dual quaternions a 28-35, b 36-43, want 44-51, got 52-59.
+ * test_batch reuses 0-10 for its own streams. */
+#define TEST_STREAMS 60
+
+struct test_variant {
+	char name[32];
+	struct shaggy_math_kernels kernels;
+	void (*mat4x4_transpose)(mat4x4 M, mat4x4 N); /* NULL if the variant has none of its own */
+	void (*mat4x4_invert_rigid)(mat4x4 T, mat4x4 M);  /* Likewise */
+	void (*mat4x4_invert_affine)(mat4x4 T, mat4x4 M);
+	bool vec4_sse2; /* The vec4, quat_conj and quat_mul_vec3 _sse2 forms are checked with this variant */
+	bool exact;
+};
+
+static uint32_t test_state = 1;
+static float test_streams[TEST_STREAMS][TEST_JOINTS];
+static mat4x4 test_want_matrices[TEST_JOINTS], test_got_matrices[TEST_JOINTS], test_in_matrices[TEST_JOINTS];
+static int test_checks;
+static int test_failures;
+
+static float test_random(void) {
+	test_state = test_state * 1664525u + 1013904223u;
+	return (float) (test_state >> 8) / (float) (1u << 23) - 1.0f;
+}
+
+static void test_random_vec4(vec4 v) {
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		v[i] = test_random();
+	}
+}
+
+static void test_random_matrix(mat4x4 M) {
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		test_random_vec4(M[i]);
+	}
+}
+
+/*****************************************************************
+ * Invertible input, alternating between a scaled rigid transform
+ * like a scene node and a diagonally dominant general matrix with
+ * a full bottom row, so the projective part is covered too.
+ *****************************************************************/
+static void test_random_invertible(mat4x4 M, int which) {
+	int i;
+
+	if (which & 1) {
+		quat q;
+
+		test_random_vec4(q);
+		quat_norm(q, q);
+		mat4x4_from_quat(M, q);
+		mat4x4_scale_aniso(M, M, 1.5f + test_random(), 1.5f + test_random(), 1.5f + test_random());
+
+		for (i = 0; i < 3; ++i) {
+			M[3][i] = test_random() * 10.0f;
+		}
+	} else {
+		test_random_matrix(M);
+
+		for (i = 0; i < 4; ++i) {
+			M[i][i] += test_random() < 0.0f ? -4.0f : 4.0f;
+		}
+	}
+}
+
+/* Rotation and translation only, what mat4x4_invert_rigid takes */
+static void test_random_rigid(mat4x4 M) {
+	quat q;
+	int i;
+
+	test_random_vec4(q);
+	quat_norm(q, q);
+	mat4x4_from_quat(M, q);
+
+	for (i = 0; i < 3; ++i) {
+		M[3][i] = test_random() * 10.0f;
+	}
+}
+
+/* Bottom row 0 0 0 1, alternating a scaled rotation and a sheared, diagonally dominant 3x3 */
+static void test_random_affine(mat4x4 M, int which) {
+	int i;
+
+	if (which & 1) {
+		test_random_invertible(M, 1);
+		return;
+	}
+
+	test_random_matrix(M);
+
+	for (i = 0; i < 3; ++i) {
+		M[i][i] += test_random() < 0.0f ? -4.0f : 4.0f;
+		M[i][3] = 0.0f;
+		M[3][i] *= 10.0f;
+	}
+
+	M[3][3] = 1.0f;
+}
+
+/* Compare n floats, logging the first mismatch, false if there was one */
+static bool test_check(const struct test_variant *variant, const char *what,
+					   const float *got, const float *want, int n, bool exact, float tolerance) {
+	int i;
+
+	++test_checks;
+
+	for (i = 0; i < n; ++i) {
+		bool same = exact ? memcmp(&got[i], &want[i], sizeof(float)) == 0
+						  : fabsf(got[i] - want[i]) <= tolerance * (1.0f + fabsf(want[i]));
+
+		if (!same) {
+			fprintf(stderr, "FAIL %s %s: element %d is %.9g, scalar gives %.9g\n",
+					variant->name, what, i, got[i], want[i]);
+			++test_failures;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define TEST_CHECK_MAT(variant, what, got, want, exact, tolerance) \
+	test_check(variant, what, &(got)[0][0], &(want)[0][0], 16, exact, tolerance)
+
+/* Small integers, so the scalar products are exact */
+static void test_scalar(const struct test_variant *variant) {
+	mat4x4 a = { { 1, 2, 3, 4 }, { 5, 6, 7, 8 }, { 9, 10, 11, 12 }, { 13, 14, 15, 16 } };
+	mat4x4 b = { { 2, 0, 1, 0 }, { 0, 1, 0, -1 }, { 3, 0, 0, 1 }, { 1, 2, 0, 0 } };
+	mat4x4 ab = { { 11, 14, 17, 20 }, { -8, -8, -8, -8 }, { 16, 20, 24, 28 }, { 11, 14, 17, 20 } };
+	mat4x4 a_t = { { 1, 5, 9, 13 }, { 2, 6, 10, 14 }, { 3, 7, 11, 15 }, { 4, 8, 12, 16 } };
+	vec4 v = { 1.0f, -1.0f, 2.0f, 0.5f };
+	vec4 av = { 20.5f, 23.0f, 25.5f, 28.0f };
+	quat i_hat = { 1, 0, 0, 0 }, j_hat = { 0, 1, 0, 0 }, k_hat = { 0, 0, 1, 0 };
+	quat p = { 1, 2, 3, 4 }, q = { 5, 6, 7, 8 }, pq = { 24, 48, 48, -6 };
+	mat4x4 M, T, identity, got;
+	vec4 got_vec;
+	quat got_quat;
+	int i;
+
+	variant->kernels.mat4x4_mul(got, a, b);
+	TEST_CHECK_MAT(variant, "mat4x4_mul known product", got, ab, true, 0.0f);
+
+	mat4x4_dup(got, a);
+	variant->kernels.mat4x4_mul(got, got, b);
+	TEST_CHECK_MAT(variant, "mat4x4_mul known product M = a", got, ab, true, 0.0f);
+
+	variant->kernels.mat4x4_mul_vec4(got_vec, a, v);
+	test_check(variant, "mat4x4_mul_vec4 known product", got_vec, av, 4, true, 0.0f);
+
+	mat4x4_transpose_scalar(got, a);
+	TEST_CHECK_MAT(variant, "mat4x4_transpose known result", got, a_t, true, 0.0f);
+
+	variant->kernels.quat_mul(got_quat, i_hat, j_hat);
+	test_check(variant, "quat_mul i j = k", got_quat, k_hat, 4, true, 0.0f);
+
+	variant->kernels.quat_mul(got_quat, p, q);
+	test_check(variant, "quat_mul known product", got_quat, pq, 4, true, 0.0f);
+
+	mat4x4_identity(identity);
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_invertible(M, i);
+
+		/* The general scalar inverse isn't safe in place, it never was */
+		variant->kernels.mat4x4_invert(T, M);
+		variant->kernels.mat4x4_mul(got, T, M);
+		TEST_CHECK_MAT(variant, "mat4x4_invert(M) * M", got, identity, false, TEST_INVERT_TOLERANCE);
+	}
+}
+
+static void test_mul(const struct test_variant *variant) {
+	bool exact = variant->exact && variant->kernels.isa == SHAGGY_MATH_SSE2;
+	mat4x4 a, b, want, got;
+	int i;
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_matrix(a);
+		test_random_matrix(b);
+		mat4x4_mul_scalar(want, a, b);
+
+		variant->kernels.mat4x4_mul(got, a, b);
+		TEST_CHECK_MAT(variant, "mat4x4_mul", got, want, exact, TEST_TOLERANCE);
+
+		mat4x4_dup(got, a);
+		variant->kernels.mat4x4_mul(got, got, b);
+		TEST_CHECK_MAT(variant, "mat4x4_mul M = a", got, want, exact, TEST_TOLERANCE);
+
+		mat4x4_dup(got, b);
+		variant->kernels.mat4x4_mul(got, a, got);
+		TEST_CHECK_MAT(variant, "mat4x4_mul M = b", got, want, exact, TEST_TOLERANCE);
+
+		mat4x4_mul_scalar(want, a, a);
+		mat4x4_dup(got, a);
+		variant->kernels.mat4x4_mul(got, got, got);
+		TEST_CHECK_MAT(variant, "mat4x4_mul M = a = b", got, want, exact, TEST_TOLERANCE);
+	}
+}
+
+static void test_mul_vec4(const struct test_variant *variant) {
+	bool exact = variant->exact && variant->kernels.isa == SHAGGY_MATH_SSE2;
+	mat4x4 M;
+	vec4 v, want, got;
+	int i;
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_matrix(M);
+		test_random_vec4(v);
+		mat4x4_mul_vec4_scalar(want, M, v);
+
+		variant->kernels.mat4x4_mul_vec4(got, M, v);
+		test_check(variant, "mat4x4_mul_vec4", got, want, 4, exact, TEST_TOLERANCE);
+
+		memcpy(got, v, sizeof(vec4));
+		variant->kernels.mat4x4_mul_vec4(got, M, got);
+		test_check(variant, "mat4x4_mul_vec4 r = v", got, want, 4, exact, TEST_TOLERANCE);
+	}
+}
+
+static void test_transpose(const struct test_variant *variant) {
+	mat4x4 N, want, got;
+	int i;
+
+	if (!variant->mat4x4_transpose) {
+		return;
+	}
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_matrix(N);
+		mat4x4_transpose_scalar(want, N);
+
+		variant->mat4x4_transpose(got, N);
+		TEST_CHECK_MAT(variant, "mat4x4_transpose", got, want, true, 0.0f);
+
+		/* The scalar loop can't run in place, the SIMD ones can */
+		mat4x4_dup(got, N);
+		variant->mat4x4_transpose(got, got);
+		TEST_CHECK_MAT(variant, "mat4x4_transpose M = N", got, want, true, 0.0f);
+	}
+}
+
+static void test_invert(const struct test_variant *variant) {
+	mat4x4 M, want, got;
+	int i;
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_invertible(M, i);
+		mat4x4_invert_scalar(want, M);
+
+		variant->kernels.mat4x4_invert(got, M);
+		TEST_CHECK_MAT(variant, "mat4x4_invert", got, want, false, TEST_INVERT_TOLERANCE);
+
+		mat4x4_dup(got, M);
+		variant->kernels.mat4x4_invert(got, got);
+		TEST_CHECK_MAT(variant, "mat4x4_invert T = M", got, want, false, TEST_INVERT_TOLERANCE);
+	}
+}
+
+/* One structured inverse against the general one, separate and in place */
+static void test_invert_structured(const struct test_variant *variant, const char *what,
+								   void (*invert)(mat4x4 T, mat4x4 M), mat4x4 M) {
+	char what_in_place[64];
+	mat4x4 want, got;
+
+	mat4x4_invert_scalar(want, M);
+
+	invert(got, M);
+	TEST_CHECK_MAT(variant, what, got, want, false, TEST_INVERT_TOLERANCE);
+
+	snprintf(what_in_place, sizeof(what_in_place), "%s T = M", what);
+	mat4x4_dup(got, M);
+	invert(got, got);
+	TEST_CHECK_MAT(variant, what_in_place, got, want, false, TEST_INVERT_TOLERANCE);
+}
+
+static void test_invert_fast(const struct test_variant *variant) {
+	mat4x4 M;
+	int i;
+
+	for (i = 0; variant->mat4x4_invert_rigid && i < TEST_CASES; ++i) {
+		test_random_rigid(M);
+		test_invert_structured(variant, "mat4x4_invert_rigid", variant->mat4x4_invert_rigid, M);
+	}
+
+	for (i = 0; variant->mat4x4_invert_affine && i < TEST_CASES; ++i) {
+		test_random_affine(M, i);
+		test_invert_structured(variant, "mat4x4_invert_affine", variant->mat4x4_invert_affine, M);
+	}
+}
+
+static void test_quat_mul(const struct test_variant *variant) {
+	quat p, q, want, got;
+	int i;
+
+	for (i = 0; i < TEST_CASES; ++i) {
+		test_random_vec4(p);
+		test_random_vec4(q);
+		quat_mul_scalar(want, p, q);
+
+		variant->kernels.quat_mul(got, p, q);
+		test_check(variant, "quat_mul", got, want, 4, false, TEST_TOLERANCE);
+
+		memcpy(got, p, sizeof(quat));
+		variant->kernels.quat_mul(got, got, q);
+		test_check(variant, "quat_mul r = p", got, want, 4, false, TEST_TOLERANCE);
+
+		memcpy(got, q, sizeof(quat));
+		variant->kernels.quat_mul(got, p, got);
+		test_check(variant, "quat_mul r = q", got, want, 4, false, TEST_TOLERANCE);
+
+		quat_mul_scalar(want, p, p);
+		memcpy(got, p, sizeof(quat));
+		variant->kernels.quat_mul(got, got, got);
+		test_check(variant, "quat_mul r = p = q", got, want, 4, false, TEST_TOLERANCE);
+	}
+}
+
+#ifdef LINMATH_SSE2
+/* Runs the _scalar and _sse2 forms of a four wide op on the same arguments */
+#define TEST_VEC4_OP(variant, op, exact, ...)                                  \
+	do {                                                                       \
+		vec4 op_want, op_got;                                                  \
+		op##_scalar(op_want, __VA_ARGS__);                                     \
+		op##_sse2(op_got, __VA_ARGS__);                                        \
+		test_check(variant, #op, op_got, op_want, 4, exact, TEST_TOLERANCE);   \
+	} while (0)
+
+static void test_vec4(const struct test_variant *variant) {
+	vec4 a, b, want, got;
+	vec3 v, want3, got3;
+	float s, want_inner, got_inner;
+	int i;
+
+	for (i = 0; variant->vec4_sse2 && i < TEST_CASES; ++i) {
+		test_random_vec4(a);
+		test_random_vec4(b);
+		s = test_random();
+
+		TEST_VEC4_OP(variant, vec4_add, variant->exact, a, b);
+		TEST_VEC4_OP(variant, vec4_sub, variant->exact, a, b);
+		TEST_VEC4_OP(variant, vec4_scale, variant->exact, a, s);
+		TEST_VEC4_OP(variant, vec4_min, variant->exact, a, b);
+		TEST_VEC4_OP(variant, vec4_max, variant->exact, a, b);
+		TEST_VEC4_OP(variant, quat_conj, variant->exact, a);
+
+		want_inner = vec4_mul_inner_scalar(a, b);
+		got_inner = vec4_mul_inner_sse2(a, b);
+		test_check(variant, "vec4_mul_inner", &got_inner, &want_inner, 1, variant->exact, TEST_TOLERANCE);
+
+		vec4_add_scalar(want, a, b);
+		memcpy(got, a, sizeof(got));
+		vec4_add_sse2(got, got, b);
+		test_check(variant, "vec4_add r = a", got, want, 4, variant->exact, TEST_TOLERANCE);
+
+		v[0] = b[0];
+		v[1] = b[1];
+		v[2] = b[2];
+		quat_norm(a, a);
+		quat_mul_vec3_scalar(want3, a, v);
+		quat_mul_vec3_sse2(got3, a, v);
+		test_check(variant, "quat_mul_vec3", got3, want3, 3, variant->exact, TEST_TOLERANCE);
+
+		quat_mul_vec3_sse2(v, a, v);
+		test_check(variant, "quat_mul_vec3 r = v", v, want3, 3, variant->exact, TEST_TOLERANCE);
+	}
+}
+#endif
+
+static pose_soa test_pose(int base) {
+	return (pose_soa) {
+			{ test_streams[base], test_streams[base + 1], test_streams[base + 2], test_streams[base + 3] },
+			{ test_streams[base + 4], test_streams[base + 5], test_streams[base + 6] }
+	};
+}
+
+static dualquat_soa test_dualquat(int base) {
+	return (dualquat_soa) {
+			{ test_streams[base], test_streams[base + 1], test_streams[base + 2], test_streams[base + 3] },
+			{ test_streams[base + 4], test_streams[base + 5], test_streams[base + 6], test_streams[base + 7] }
+	};
+}
+
+/* Compare count streams of TEST_JOINTS */
+static void test_check_streams(const struct test_variant *variant, const char *what, int got, int want, int count) {
+	int k;
+
+	for (k = 0; k < count; ++k) {
+		if (!test_check(variant, what, test_streams[got + k], test_streams[want + k], TEST_JOINTS, false, TEST_TOLERANCE)) {
+			return;
+		}
+	}
+}
+
+static void test_check_matrices(const struct test_variant *variant, const char *what) {
+	test_check(variant, what, &test_got_matrices[0][0][0], &test_want_matrices[0][0][0], 16 * TEST_JOINTS, false, TEST_TOLERANCE);
+}
+
+/* Transform v into r, then again with r holding a copy of v since the streams may alias. r shares r4's streams */
+#define TEST_SOA_TRANSFORM(kernel, r, count)                      \
+	do {                                                              \
+		kernel(r, M, v, TEST_JOINTS);                                 \
+		test_check_soa(variant, #kernel, r4, want, count);            \
+		memcpy(r.x, v.x, sizeof(test_streams[0]));                    \
+		memcpy(r.y, v.y, sizeof(test_streams[0]));                    \
+		memcpy(r.z, v.z, sizeof(test_streams[0]));                    \
+		kernel(r, M, (vec3_soa) { r.x, r.y, r.z }, TEST_JOINTS);      \
+		test_check_soa(variant, #kernel " r = v", r4, want, count);   \
+	} while (0)
+
+static void test_check_soa(const struct test_variant *variant, const char *what, vec4_soa got, float *want[4], int count) {
+	float *streams[4] = { got.x, got.y, got.z, got.w };
+	int k;
+
+	for (k = 0; k < count; ++k) {
+		if (!test_check(variant, what, streams[k], want[k], TEST_JOINTS, false, TEST_TOLERANCE)) {
+			return;
+		}
+	}
+}
+
+/* Batches against mat4x4_mul_vec4_scalar and mat4x4_mul_scalar one element at a time */
+static void test_batch(const struct test_variant *variant) {
+	vec3_soa v = { test_streams[0], test_streams[1], test_streams[2] };
+	vec4_soa r4 = { test_streams[3], test_streams[4], test_streams[5], test_streams[6] };
+	vec3_soa r3 = { r4.x, r4.y, r4.z };
+	float *want[4] = { test_streams[7], test_streams[8], test_streams[9], test_streams[10] };
+	mat4x4 M;
+	size_t i;
+	int k;
+
+	test_random_matrix(M);
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		vec4 point = { test_random(), test_random(), test_random(), 1.0f };
+		vec4 out;
+
+		v.x[i] = point[0];
+		v.y[i] = point[1];
+		v.z[i] = point[2];
+
+		mat4x4_mul_vec4_scalar(out, M, point);
+		for (k = 0; k < 4; ++k) {
+			want[k][i] = out[k];
+		}
+	}
+
+	TEST_SOA_TRANSFORM(variant->kernels.vec4_soa_transform_points, r4, 4);
+	TEST_SOA_TRANSFORM(variant->kernels.vec3_soa_transform_points, r3, 3);
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		vec4 dir = { v.x[i], v.y[i], v.z[i], 0.0f };
+		vec4 out;
+
+		mat4x4_mul_vec4_scalar(out, M, dir);
+		for (k = 0; k < 3; ++k) {
+			want[k][i] = out[k];
+		}
+	}
+
+	TEST_SOA_TRANSFORM(variant->kernels.vec3_soa_transform_dirs, r3, 3);
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		test_random_matrix(test_in_matrices[i]);
+		mat4x4_mul_scalar(test_want_matrices[i], M, test_in_matrices[i]);
+	}
+
+	variant->kernels.mat4x4_mul_batch(test_got_matrices, M, test_in_matrices, TEST_JOINTS);
+	test_check_matrices(variant, "mat4x4_mul_batch");
+
+	memcpy(test_got_matrices, test_in_matrices, sizeof(test_in_matrices));
+	variant->kernels.mat4x4_mul_batch(test_got_matrices, M, test_got_matrices, TEST_JOINTS);
+	test_check_matrices(variant, "mat4x4_mul_batch R = b");
+}
+
+/* in holds the inputs and want their general inverses, n isn't a multiple of 4 */
+static void test_invert_batch(const struct test_variant *variant, const char *what,
+							  void (*invert)(mat4x4 *T, mat4x4 *M, size_t n)) {
+	char what_in_place[64];
+
+	invert(test_got_matrices, test_in_matrices, TEST_JOINTS);
+	test_check(variant, what, &test_got_matrices[0][0][0], &test_want_matrices[0][0][0],
+			   16 * TEST_JOINTS, false, TEST_INVERT_TOLERANCE);
+
+	snprintf(what_in_place, sizeof(what_in_place), "%s T = M", what);
+	memcpy(test_got_matrices, test_in_matrices, sizeof(test_in_matrices));
+	invert(test_got_matrices, test_got_matrices, TEST_JOINTS);
+	test_check(variant, what_in_place, &test_got_matrices[0][0][0], &test_want_matrices[0][0][0],
+			   16 * TEST_JOINTS, false, TEST_INVERT_TOLERANCE);
+}
+
+static void test_invert_batches(const struct test_variant *variant) {
+	size_t i;
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		test_random_affine(test_in_matrices[i], (int) i);
+		mat4x4_invert_scalar(test_want_matrices[i], test_in_matrices[i]);
+	}
+
+	test_invert_batch(variant, "mat4x4_invert_affine_batch", variant->kernels.mat4x4_invert_affine_batch);
+
+	/* Not in the table, whatever linmath.h picked is checked once with the scalar code */
+	if (variant->kernels.isa != SHAGGY_MATH_SCALAR) {
+		return;
+	}
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		test_random_rigid(test_in_matrices[i]);
+		mat4x4_invert_scalar(test_want_matrices[i], test_in_matrices[i]);
+	}
+
+	test_invert_batch(variant, "mat4x4_invert_rigid_batch", mat4x4_invert_rigid_batch);
+}
+
+/* Unit rotations on both hemispheres, translations a few units out */
+static void test_animation(const struct test_variant *variant) {
+	const float t = 0.3f;
+	int i, k;
+
+	for (i = 0; i < TEST_JOINTS; ++i) {
+		for (k = 0; k < 14; k += 7) {
+			quat q;
+
+			test_random_vec4(q);
+			quat_norm(q, q);
+			test_streams[k][i] = q[0];
+			test_streams[k + 1][i] = q[1];
+			test_streams[k + 2][i] = q[2];
+			test_streams[k + 3][i] = q[3];
+			test_streams[k + 4][i] = 5.0f * test_random();
+			test_streams[k + 5][i] = 5.0f * test_random();
+			test_streams[k + 6][i] = 5.0f * test_random();
+		}
+	}
+
+	quat_soa_nlerp_scalar(test_pose(14).rotation, test_pose(0).rotation, test_pose(7).rotation, t, TEST_JOINTS);
+	variant->kernels.quat_soa_nlerp(test_pose(21).rotation, test_pose(0).rotation, test_pose(7).rotation, t, TEST_JOINTS);
+	test_check_streams(variant, "quat_soa_nlerp", 21, 14, 4);
+
+	quat_soa_slerp_scalar(test_pose(14).rotation, test_pose(0).rotation, test_pose(7).rotation, t, TEST_JOINTS);
+	variant->kernels.quat_soa_slerp(test_pose(21).rotation, test_pose(0).rotation, test_pose(7).rotation, t, TEST_JOINTS);
+	test_check_streams(variant, "quat_soa_slerp", 21, 14, 4);
+
+	pose_soa_blend_scalar(test_pose(14), test_pose(0), test_pose(7), t, TEST_JOINTS);
+	variant->kernels.pose_soa_blend(test_pose(21), test_pose(0), test_pose(7), t, TEST_JOINTS);
+	test_check_streams(variant, "pose_soa_blend", 21, 14, 7);
+
+	memcpy(test_streams[21], test_streams[0], 7 * sizeof(test_streams[0]));
+	variant->kernels.pose_soa_blend(test_pose(21), test_pose(21), test_pose(7), t, TEST_JOINTS);
+	test_check_streams(variant, "pose_soa_blend r = a", 21, 14, 7);
+
+	mat4x4_from_pose_soa_scalar(test_want_matrices, test_pose(0), TEST_JOINTS);
+	variant->kernels.mat4x4_from_pose_soa(test_got_matrices, test_pose(0), TEST_JOINTS);
+	test_check_matrices(variant, "mat4x4_from_pose_soa");
+
+	dualquat_soa_from_pose_scalar(test_dualquat(28), test_pose(0), TEST_JOINTS);
+	dualquat_soa_from_pose_scalar(test_dualquat(36), test_pose(7), TEST_JOINTS);
+	variant->kernels.dualquat_soa_from_pose(test_dualquat(52), test_pose(0), TEST_JOINTS);
+	test_check_streams(variant, "dualquat_soa_from_pose", 52, 28, 8);
+
+	/* The dual quaternion has to describe the same transform as the pose it came from */
+	variant->kernels.mat4x4_from_dualquat_soa(test_got_matrices, test_dualquat(52), TEST_JOINTS);
+	test_check_matrices(variant, "mat4x4_from_dualquat_soa of a pose");
+
+	dualquat_soa_blend_scalar(test_dualquat(44), test_dualquat(28), test_dualquat(36), t, TEST_JOINTS);
+	variant->kernels.dualquat_soa_blend(test_dualquat(52), test_dualquat(28), test_dualquat(36), t, TEST_JOINTS);
+	test_check_streams(variant, "dualquat_soa_blend", 52, 44, 8);
+
+	memcpy(test_streams[52], test_streams[36], 8 * sizeof(test_streams[0]));
+	variant->kernels.dualquat_soa_blend(test_dualquat(52), test_dualquat(28), test_dualquat(52), t, TEST_JOINTS);
+	test_check_streams(variant, "dualquat_soa_blend r = b", 52, 44, 8);
+
+	mat4x4_from_dualquat_soa_scalar(test_want_matrices, test_dualquat(44), TEST_JOINTS);
+	variant->kernels.mat4x4_from_dualquat_soa(test_got_matrices, test_dualquat(44), TEST_JOINTS);
+	test_check_matrices(variant, "mat4x4_from_dualquat_soa");
+}
+
+/* Objects scattered around a camera at the origin, sized so plenty straddle a plane */
+static void test_cull(const struct test_variant *variant) {
+	float streams[7][TEST_CULL_OBJECTS];
+	uint32_t want[TEST_CULL_OBJECTS], got[TEST_CULL_OBJECTS];
+	struct shaggy_spheres spheres = { { streams[0], streams[1], streams[2] }, streams[3] };
+	struct shaggy_aabbs aabbs = { { streams[0], streams[1], streams[2] }, { streams[4], streams[5], streams[6] } };
+	struct shaggy_frustum frustum;
+	mat4x4 projection, view, view_projection;
+	size_t want_count, got_count, begin;
+	int i, k;
+
+	for (k = 0; k < 7; ++k) {
+		for (i = 0; i < TEST_CULL_OBJECTS; ++i) {
+			streams[k][i] = k < 3 ? 20.0f * test_random() : 1.5f + test_random();
+		}
+	}
+
+	mat4x4_perspective(projection, 1.2f, 1.5f, 0.1f, 15.0f);
+	mat4x4_look_at(view, (vec3) { 1.0f, 2.0f, 3.0f }, (vec3) { 0.0f, 0.0f, -5.0f }, (vec3) { 0.0f, 1.0f, 0.0f });
+	mat4x4_mul_scalar(view_projection, projection, view);
+	shaggy_frustum_from_matrix(&frustum, view_projection);
+
+	/* From 0 and from an odd start, the parallel driver hands out arbitrary ranges */
+	for (begin = 0; begin < 8; begin += 5) {
+		++test_checks;
+
+		want_count = shaggy_cull_spheres_scalar(&frustum, spheres, begin, TEST_CULL_OBJECTS, want);
+		got_count = variant->kernels.cull_spheres(&frustum, spheres, begin, TEST_CULL_OBJECTS, got);
+		if (got_count != want_count || memcmp(got, want, want_count * sizeof(*want)) != 0) {
+			fprintf(stderr, "FAIL %s cull_spheres from %zu: %zu visible, scalar gives %zu\n",
+					variant->name, begin, got_count, want_count);
+			++test_failures;
+		}
+
+		++test_checks;
+
+		want_count = shaggy_cull_aabbs_scalar(&frustum, aabbs, begin, TEST_CULL_OBJECTS, want);
+		got_count = variant->kernels.cull_aabbs(&frustum, aabbs, begin, TEST_CULL_OBJECTS, got);
+		if (got_count != want_count || memcmp(got, want, want_count * sizeof(*want)) != 0) {
+			fprintf(stderr, "FAIL %s cull_aabbs from %zu: %zu visible, scalar gives %zu\n",
+					variant->name, begin, got_count, want_count);
+			++test_failures;
+		}
+	}
+}
+
+int main(void) {
+	struct test_variant variants[SHAGGY_MATH_ISA_COUNT];
+	struct test_variant scalar;
+	int count = 0;
+	int isa, i;
+
+	sclog4c_level = WARNING;
+
+	memset(&scalar, 0, sizeof(scalar));
+	snprintf(scalar.name, sizeof(scalar.name), "%s", shaggy_math_isa_name(SHAGGY_MATH_SCALAR));
+	shaggy_math_bind(&scalar.kernels, SHAGGY_MATH_SCALAR);
+	scalar.mat4x4_invert_rigid = mat4x4_invert_rigid_scalar;
+	scalar.mat4x4_invert_affine = mat4x4_invert_affine_scalar;
+
+	test_scalar(&scalar);
+	test_invert_fast(&scalar);
+	test_invert_batches(&scalar);
+	test_batch(&scalar);
+	printf("%s: %s\n", scalar.name, test_failures ? "FAILED" : "ok");
+
+	for (isa = SHAGGY_MATH_SCALAR + 1; isa < SHAGGY_MATH_ISA_COUNT; ++isa) {
+		struct test_variant *variant = &variants[count];
+
+		memset(variant, 0, sizeof(*variant));
+
+		if (!shaggy_math_bind(&variant->kernels, (enum shaggy_math_isa) isa)) {
+			printf("%s: not in this build or not supported by this CPU, skipped\n",
+				   shaggy_math_isa_name((enum shaggy_math_isa) isa));
+			continue;
+		}
+
+		snprintf(variant->name, sizeof(variant->name), "%s", shaggy_math_isa_name((enum shaggy_math_isa) isa));
+
+		/*****************************************************************
+		 * With FMA enabled for the whole build (SHAGGY_MARCH_NATIVE) the
+		 * compiler may contract the scalar reference as well, in its own
+		 * pattern, so nothing is bit for bit any more.
+		 *****************************************************************/
+#if !defined(__FMA__)
+		variant->exact = true;
+#endif
+
+#ifdef LINMATH_SSE2
+		if (isa == SHAGGY_MATH_SSE2) {
+			variant->mat4x4_transpose = mat4x4_transpose_sse2;
+			variant->mat4x4_invert_rigid = mat4x4_invert_rigid_sse2;
+			variant->mat4x4_invert_affine = mat4x4_invert_affine_sse2;
+			variant->vec4_sse2 = true;
+		}
+#endif
+
+		++count;
+	}
+
+	for (i = 0; i < count; ++i) {
+		int failures = test_failures;
+
+		test_mul(&variants[i]);
+		test_mul_vec4(&variants[i]);
+		test_transpose(&variants[i]);
+		test_invert(&variants[i]);
+		test_invert_fast(&variants[i]);
+		test_invert_batches(&variants[i]);
+		test_quat_mul(&variants[i]);
+#ifdef LINMATH_SSE2
+		test_vec4(&variants[i]);
+#endif
+		test_batch(&variants[i]);
+		test_cull(&variants[i]);
+		test_animation(&variants[i]);
+
+		printf("%s: %s\n", variants[i].name, failures == test_failures ? "ok" : "FAILED");
+	}
+
+	if (count == 0) {
+		printf("No SIMD variant to compare, only the scalar code was checked\n");
+	}
+
+	printf("%d checks, %d failed\n", test_checks, test_failures);
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+/* strndup is POSIX.1-2008, not C11 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "tinydir.h"
+#include "slre.h"
+#include "shaggy_hash.h"
+#include "shader_bundle.h"
+
+/*****************************************************************
+ * Packs a shader directory into a C source file holding one blob
+ * and a sorted index of it, see src/shader_bundle.h.
+ * Run by the build, usage: shaggy_pack <shader dir> <output.c>
+ *****************************************************************/
+
+/* Must match shaggy_shader_file_suffixes in shaders.h */
+static const char *const pack_stage_suffixes[] = { "vert", "frag", "tesc", "tese", "geom", "comp" };
+
+struct pack_file {
+	char *path;
+	char *name;
+	const char *stage;
+	unsigned char *data;
+	size_t length;
+	size_t offset;
+};
+
+struct pack_list {
+	struct pack_file *files;
+	size_t count;
+	size_t capacity;
+};
+
+static bool pack_read_file(const char *path, unsigned char **data, size_t *length) {
+	FILE *file = fopen(path, "rb");
+	long size;
+
+	if (!file) {
+		fprintf(stderr, "shaggy_pack: failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) == -1 || fseek(file, 0, SEEK_SET) != 0) {
+		fprintf(stderr, "shaggy_pack: failed to get the size of %s: %s\n", path, strerror(errno));
+		fclose(file);
+		return false;
+	}
+
+	*length = (size_t) size;
+	*data = malloc(*length + 1);
+
+	if (!*data) {
+		fprintf(stderr, "shaggy_pack: out of memory reading %s\n", path);
+		fclose(file);
+		return false;
+	}
+
+	if (*length && fread(*data, *length, 1, file) != 1) {
+		fprintf(stderr, "shaggy_pack: failed to read %s\n", path);
+		fclose(file);
+		free(*data);
+		return false;
+	}
+
+	fclose(file);
+	return true;
+}
+
+/* Length of a .glsl or .spv extension on filename, 0 for anything else */
+static size_t pack_extension_length(const char *filename) {
+	size_t length = strlen(filename);
+
+	if (length > strlen(".glsl") && strcasecmp(filename + length - strlen(".glsl"), ".glsl") == 0) {
+		return strlen(".glsl");
+	}
+
+	if (length > strlen(".spv") && strcasecmp(filename + length - strlen(".spv"), ".spv") == 0) {
+		return strlen(".spv");
+	}
+
+	return 0;
+}
+
+/*************************************************************
+ * Same rule as shaggy_classify_shader_file, the runtime's own
+ * pattern and matcher, so a file the runtime wouldn't load as a
+ * shader is packed as include-only rather than under a name
+ * nothing can look up.
+ *************************************************************/
+static void pack_classify(struct pack_file *file, const char *filename) {
+	int length = (int) strlen(filename);
+	struct slre_cap caps[3];
+	size_t i;
+
+	file->name = NULL;
+	file->stage = NULL;
+
+	if (slre_match(SHAGGY_SHADER_FILE_EXP, filename, length, caps, 3, SLRE_IGNORE_CASE) != length) {
+		return;
+	}
+
+	for (i = 0; i < sizeof(pack_stage_suffixes) / sizeof(pack_stage_suffixes[0]); ++i) {
+		if ((size_t) caps[1].len == strlen(pack_stage_suffixes[i]) &&
+			strncasecmp(caps[1].ptr, pack_stage_suffixes[i], caps[1].len) == 0) {
+			file->name = strndup(caps[0].ptr, caps[0].len);
+			file->stage = pack_stage_suffixes[i];
+			return;
+		}
+	}
+}
+
+static bool pack_scan(struct pack_list *list, const char *dir_path, const char *prefix) {
+	tinydir_dir dir;
+	bool result = true;
+
+	if (tinydir_open(&dir, dir_path) == -1) {
+		fprintf(stderr, "shaggy_pack: failed to open directory %s\n", dir_path);
+		return false;
+	}
+
+	for (; dir.has_next && result; tinydir_next(&dir)) {
+		tinydir_file file;
+		size_t name_length;
+		char *relative;
+
+		tinydir_readfile(&dir, &file);
+		name_length = strlen(file.name);
+
+		if (file.name[0] == '.') {
+			continue;
+		}
+
+		relative = malloc(strlen(prefix) + name_length + 2);
+		if (!relative) {
+			fprintf(stderr, "shaggy_pack: out of memory scanning %s\n", dir_path);
+			result = false;
+			break;
+		}
+
+		sprintf(relative, "%s%s", prefix, file.name);
+
+		if (file.is_dir) {
+			strcat(relative, "/");
+			result = pack_scan(list, file.path, relative);
+			free(relative);
+			continue;
+		}
+
+		if (!pack_extension_length(file.name)) {
+			free(relative);
+			continue;
+		}
+
+		if (list->count == list->capacity) {
+			size_t capacity = list->capacity ? list->capacity * 2 : 16;
+			struct pack_file *files = realloc(list->files, capacity * sizeof(*list->files));
+
+			/* The old array is still the list's, freed with it */
+			if (!files) {
+				fprintf(stderr, "shaggy_pack: out of memory scanning %s\n", dir_path);
+				free(relative);
+				result = false;
+				break;
+			}
+
+			list->files = files;
+			list->capacity = capacity;
+		}
+
+		list->files[list->count].path = relative;
+		pack_classify(&list->files[list->count], file.name);
+
+		if (list->files[list->count].stage && !list->files[list->count].name) {
+			fprintf(stderr, "shaggy_pack: out of memory scanning %s\n", dir_path);
+			free(relative);
+			result = false;
+			break;
+		}
+
+		/* SPIR-V can't be #included, so it's no use without a stage */
+		if (!list->files[list->count].stage && pack_extension_length(file.name) == strlen(".spv")) {
+			fprintf(stderr, "shaggy_pack: skipping %s, SPIR-V needs a <name>.<stage>.spv name\n", file.path);
+			free(relative);
+			continue;
+		}
+
+		result = pack_read_file(file.path, &list->files[list->count].data, &list->files[list->count].length);
+		if (result) {
+			++list->count;
+		} else {
+			free(list->files[list->count].name);
+			free(relative);
+		}
+	}
+
+	tinydir_close(&dir);
+	return result;
+}
+
+static int pack_compare(const void *a, const void *b) {
+	return strcmp(((const struct pack_file *) a)->path, ((const struct pack_file *) b)->path);
+}
+
+/*****************************************************************
+ * C string literal, or NULL. Quotes and backslashes are escaped,
+ * ? too so no trigraph can form, and anything unprintable goes
+ * out as a three digit octal escape, which can't run on into a
+ * following digit the way a hex escape would.
+ *****************************************************************/
+static void pack_write_string(FILE *out, const char *string) {
+	const unsigned char *c;
+
+	if (!string) {
+		fputs("NULL", out);
+		return;
+	}
+
+	fputc('"', out);
+
+	for (c = (const unsigned char *) string; *c; ++c) {
+		if (*c == '"' || *c == '\\' || *c == '?') {
+			fprintf(out, "\\%c", *c);
+		} else if (*c < 0x20 || *c >= 0x7f) {
+			fprintf(out, "\\%03o", *c);
+		} else {
+			fputc(*c, out);
+		}
+	}
+
+	fputc('"', out);
+}
+
+static bool pack_write(const struct pack_list *list, const char *dir_path, const char *out_path) {
+	FILE *out = fopen(out_path, "w");
+	size_t column = 0;
+	size_t i, j;
+
+	if (!out) {
+		fprintf(stderr, "shaggy_pack: failed to open %s: %s\n", out_path, strerror(errno));
+		return false;
+	}
+
+	fprintf(out, "/* Generated by shaggy_pack from %s, don't edit */\n\n", dir_path);
+	fputs("#include \"shader_bundle.h\"\n\n", out);
+
+	/*****************************************************************
+	 * A trailing zero keeps the array non-empty when there's nothing
+	 * to pack. Files start on 4 byte boundaries so SPIR-V modules can
+	 * be handed to the driver as words without copying them.
+	 *****************************************************************/
+	fputs("static _Alignas(4) const char shaggy_bundle_blob[] = {", out);
+	for (i = 0; i < list->count; ++i) {
+		for (; column % 4; ++column) {
+			fprintf(out, "%s0x00,", column % 16 ? " " : "\n\t");
+		}
+
+		list->files[i].offset = column;
+
+		for (j = 0; j < list->files[i].length; ++j, ++column) {
+			fprintf(out, "%s0x%02x,", column % 16 ? " " : "\n\t", list->files[i].data[j]);
+		}
+	}
+	fputs("\n\t0x00\n};\n\n", out);
+
+	fputs("static const struct shaggy_bundle_file shaggy_bundle_files[] = {\n", out);
+	for (i = 0; i < list->count; ++i) {
+		const struct pack_file *file = &list->files[i];
+
+		fputs("\t{ ", out);
+		pack_write_string(out, file->path);
+		fputs(", ", out);
+		pack_write_string(out, file->name);
+		fputs(", ", out);
+		pack_write_string(out, file->stage);
+		fprintf(out, ", shaggy_bundle_blob + %zu, %zu, UINT64_C(0x%016llx) },\n",
+				file->offset, file->length, (unsigned long long) shaggy_hash64(file->data, file->length, 0));
+	}
+	fputs("\t{ NULL, NULL, NULL, NULL, 0, 0 }\n};\n\n", out);
+
+	fprintf(out, "const struct shaggy_shader_bundle shaggy_shader_bundle = { shaggy_bundle_files, %zu };\n",
+			list->count);
+
+	if (fclose(out) != 0) {
+		fprintf(stderr, "shaggy_pack: failed to write %s: %s\n", out_path, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	struct pack_list list = { NULL, 0, 0 };
+	size_t i;
+	int status = EXIT_FAILURE;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <shader dir> <output.c>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!pack_scan(&list, argv[1], "")) {
+		goto fail;
+	}
+
+	/* The runtime looks files up with bsearch */
+	qsort(list.files, list.count, sizeof(*list.files), pack_compare);
+
+	if (pack_write(&list, argv[1], argv[2])) {
+		status = EXIT_SUCCESS;
+	}
+
+fail:
+	for (i = 0; i < list.count; ++i) {
+		free(list.files[i].path);
+		free(list.files[i].name);
+		free(list.files[i].data);
+	}
+
+	free(list.files);
+	return status;
+}